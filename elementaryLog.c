@@ -0,0 +1,261 @@
+#include <string.h>
+
+#include "elementaryLog.h"
+
+// Recording
+
+// empty log for operations on m x n matrices, with room for capacity operations allocated on frame
+//
+// elem_log log = elem_log_create(A.m, A.n, 256, &frame);
+elem_log elem_log_create(int m, int n, int capacity, pool* frame) {
+	elem_log log = { m, n, 0, 0, NULL };
+	if (m <= 0 || n <= 0 || capacity <= 0) {
+		printf("error while creating elementary op log: \n(%d x %d) matrices, capacity %d\n", m, n, capacity);
+		return log;
+	}
+
+	log.ops = (elem_op*)raw_pool_alloc(frame, capacity * sizeof(elem_op));
+	if (log.ops != NULL) { log.capacity = capacity; }
+	return log;
+}
+
+// appends an operation after checking its indices against limit (rows or columns of the log). Returns 0 if it wasn't recorded
+static int record(elem_log* log, int kind, int limit, int dest, float c1, int src, float c2) {
+	if (dest < 0 || dest >= limit || src < 0 || src >= limit) {
+		printf("elementary op log error: \nindex %d or %d out of bounds (make sure you are 0-indexed)\n", dest, src);
+		return 0;
+	}
+	if (log->count == log->capacity) {
+		printf("elementary op log error: \nlog is full (%d ops)\n", log->capacity);
+		return 0;
+	}
+
+	log->ops[log->count++] = (elem_op){ kind, dest, src, c1, c2 };
+	return 1;
+}
+
+// each of these records the fmatrix_ op of the same name and arguments. They return 1 if it was recorded
+//
+// elem_log_row_sum(&log, 0, 3, 1, 0.5) // R1 <- 3R1 + 0.5R2, once the log is applied
+int elem_log_row_scale(elem_log* log, int row, float c) {
+	return record(log, ELEM_ROW_SCALE, log->m, row, c, row, 0.0f);
+}
+
+int elem_log_row_swap(elem_log* log, int row1, int row2) {
+	return record(log, ELEM_ROW_SWAP, log->m, row1, 1.0f, row2, 0.0f);
+}
+
+int elem_log_row_sum(elem_log* log, int dest, float c1, int src, float c2) {
+	return record(log, ELEM_ROW_SUM, log->m, dest, c1, src, c2);
+}
+
+int elem_log_col_scale(elem_log* log, int col, float c) {
+	return record(log, ELEM_COL_SCALE, log->n, col, c, col, 0.0f);
+}
+
+int elem_log_col_swap(elem_log* log, int col1, int col2) {
+	return record(log, ELEM_COL_SWAP, log->n, col1, 1.0f, col2, 0.0f);
+}
+
+int elem_log_col_sum(elem_log* log, int dest, float c1, int src, float c2) {
+	return record(log, ELEM_COL_SUM, log->n, dest, c1, src, c2);
+}
+
+
+// Compiling
+
+// replays the row ops (columns = 0) or column ops (columns = 1) of log on a size x size identity, and returns how many there were
+// column ops on M are row ops on the transpose of M, so both sides are built by the row functions, on contiguous rows:
+// the result is L for rows and R^T for columns
+static int replay(elem_log log, int columns, fmatrix T) {
+	int replayed = 0;
+	for (int k = 0; k < log.count; k++) {
+		elem_op op = log.ops[k];
+		int kind = op.kind;
+		if (columns) {
+			if (kind < ELEM_COL_SCALE) { continue; }
+			kind -= ELEM_COL_SCALE;
+		}
+		else if (kind >= ELEM_COL_SCALE) { continue; }
+
+		switch (kind) {
+		case ELEM_ROW_SCALE: fmatrix_row_scale_in(T, op.dest, op.c1); break;
+		case ELEM_ROW_SWAP: fmatrix_row_swap_in(T, op.dest, op.src); break;
+		case ELEM_ROW_SUM: fmatrix_row_sum_in(T, op.dest, op.c1, op.src, op.c2); break;
+		}
+		replayed++;
+	}
+	return replayed;
+}
+
+// builds one side of the transform on frame, either dense into *dense or as CSR into *sparse (the other is left as an error matrix)
+// the replay matrix is size^2 floats of scratch, so a sparse result is compressed behind it and then moved down to where it
+// started, leaving only ptr, index and values on the pool
+static void compile_side(elem_log log, int columns, int size, fmatrix* dense, fspmatrix* sparse, pool* frame) {
+	*dense = ERROR_FMATRIX;
+	*sparse = ERROR_FSPMATRIX;
+
+	void* start = frame->ptr;
+	fmatrix T = fmatrix_create_identity(size, size, frame);
+	if (T.matrix == NULL) { return; }
+	if (replay(log, columns, T) == 0) {
+		pool_free_from(frame, start);
+		return;
+	}
+
+	int nnz = 0;
+	for (int i = 0; i < size * size; i++) {
+		if (T.matrix[i] != 0.0f) { nnz++; }
+	}
+	if (nnz * ELEMLOG_DENSE_FRACTION > size * size) {
+		*dense = T;
+		return;
+	}
+
+	int bytes = (size + 1 + nnz) * sizeof(int) + nnz * sizeof(float);
+	int* ptr = (int*)raw_pool_alloc(frame, bytes);
+	if (ptr == NULL) {
+		pool_free_from(frame, start);
+		return;
+	}
+	int* index = ptr + size + 1;
+	float* values = (float*)(index + nnz);
+
+	int p = 0;
+	for (int i = 0; i < size; i++) {
+		ptr[i] = p;
+		for (int j = 0; j < size; j++) {
+			float value = T.matrix[i * size + j];
+			if (value == 0.0f) { continue; }
+			index[p] = j;
+			values[p++] = value;
+		}
+	}
+	ptr[size] = p;
+
+	// move it down over the scratch
+	ptr = (int*)pool_compact(frame, start, ptr, bytes);
+	index = ptr + size + 1;
+	values = (float*)(index + nnz);
+
+	*sparse = (fspmatrix){ size, size, nnz, ptr, index, values, 0 };
+}
+
+// compiles log into the transform L A R it applies, allocated on frame. The log can be reused or discarded afterwards
+// a side with no operations is left empty and skipped when applying, so a log of only row ops costs a single multiply
+//
+// elem_transform T = elem_log_compile(log, &frame);
+elem_transform elem_log_compile(elem_log log, pool* frame) {
+	elem_transform T;
+	T.m = log.m;
+	T.n = log.n;
+
+	compile_side(log, 0, log.m, &T.left, &T.left_sparse, frame);
+	compile_side(log, 1, log.n, &T.right, &T.right_sparse, frame);
+
+	// R was built transposed. For the dense side that's a flag flip, and the transpose of a CSR R^T is a CSC R
+	if (T.right.matrix != NULL) { fmatrix_transpose_in(&T.right); }
+	if (T.right_sparse.ptr != NULL) { fspmatrix_transpose_in(&T.right_sparse); }
+
+	return T;
+}
+
+
+// Applying
+
+// index into a block of count m x n matrices, placed side by side (m x count*n) or stacked (count*m x n)
+static int block_index(int side_by_side, int count, int m, int n, int t, int i, int j) {
+	return side_by_side ? i * count * n + t * n + j : (t * m + i) * n + j;
+}
+
+static void pack(fmatrix* targets, int count, int side_by_side, float* block) {
+	for (int t = 0; t < count; t++) {
+		fmatrix A = targets[t];
+		for (int i = 0; i < A.m; i++) {
+			for (int j = 0; j < A.n; j++) {
+				block[block_index(side_by_side, count, A.m, A.n, t, i, j)] = MATRIX_AT(A, i, j);
+			}
+		}
+	}
+}
+
+static void unpack(const float* block, int side_by_side, fmatrix* targets, int count) {
+	for (int t = 0; t < count; t++) {
+		fmatrix A = targets[t];
+		for (int i = 0; i < A.m; i++) {
+			for (int j = 0; j < A.n; j++) {
+				A.matrix[INDEX_AT(A, i, j)] = block[block_index(side_by_side, count, A.m, A.n, t, i, j)];
+			}
+		}
+	}
+}
+
+// applies T to every matrix in targets (A <- L A R), in place. They all have to be T.m x T.n and general, and can be transposed
+// the targets go side by side into one T.m x count*T.n block for L, then get stacked into one count*T.m x T.n block for R,
+// so each side is a single multiply however many targets there are. Returns 0 on a shape mismatch or allocation failure
+//
+// fmatrix batch[3] = { A, B, C };
+// elem_transform_apply_many_in(T, batch, 3, &frame);
+int elem_transform_apply_many_in(elem_transform T, fmatrix* targets, int count, pool* frame) {
+	for (int t = 0; t < count; t++) {
+		if (targets[t].m != T.m || targets[t].n != T.n) {
+			printf("error while applying elementary ops: \ndimension mismatch: ");
+			printf("ops: (%d x %d)  target %d: (%d x %d)\n", T.m, T.n, t, targets[t].m, targets[t].n);
+			return 0;
+		}
+		if (targets[t].kind != FMATRIX_GENERAL) {
+			printf("error while applying elementary ops: \ntarget %d is packed, unpack it first (fmatrix_unpack)\n", t);
+			return 0;
+		}
+	}
+
+	int has_left = T.left.matrix != NULL || T.left_sparse.ptr != NULL;
+	int has_right = T.right.matrix != NULL || T.right_sparse.ptr != NULL;
+	if (count <= 0 || (!has_left && !has_right)) { return 1; }
+
+	void* workspace = frame->ptr;
+	int elements = count * T.m * T.n;
+	float* block = (float*)raw_pool_alloc(frame, elements * sizeof(float));
+	if (block == NULL) { return 0; }
+	pack(targets, count, has_left, block);
+
+	if (has_left) {
+		fmatrix wide = (fmatrix){ T.m, count * T.n, block, 0 };
+		fmatrix product = T.left.matrix != NULL ? fmatrix_multiply(T.left, wide, frame) : fspmatrix_multiply_dense(T.left_sparse, wide, frame);
+		if (product.matrix == NULL) {
+			pool_free_from(frame, workspace);
+			return 0;
+		}
+		if (!has_right) {
+			unpack(product.matrix, 1, targets, count);
+			pool_free_from(frame, workspace);
+			return 1;
+		}
+
+		// side by side -> stacked, reusing the packing block
+		for (int t = 0; t < count; t++) {
+			for (int i = 0; i < T.m; i++) {
+				memcpy(&block[block_index(0, count, T.m, T.n, t, i, 0)],
+					&product.matrix[block_index(1, count, T.m, T.n, t, i, 0)], T.n * sizeof(float));
+			}
+		}
+	}
+
+	fmatrix tall = (fmatrix){ count * T.m, T.n, block, 0 };
+	fmatrix product = T.right.matrix != NULL ? fmatrix_multiply(tall, T.right, frame) : fmatrix_multiply_sparse(tall, T.right_sparse, frame);
+	if (product.matrix == NULL) {
+		pool_free_from(frame, workspace);
+		return 0;
+	}
+	unpack(product.matrix, 0, targets, count);
+
+	pool_free_from(frame, workspace);
+	return 1;
+}
+
+// applies T to A in place, same as running the recorded ops on it one by one
+//
+// elem_transform_apply_in(T, A, &frame);
+int elem_transform_apply_in(elem_transform T, fmatrix A, pool* frame) {
+	return elem_transform_apply_many_in(T, &A, 1, frame);
+}
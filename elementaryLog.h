@@ -0,0 +1,76 @@
+#ifndef ELEMENTARYLOG_H
+#define ELEMENTARYLOG_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "memoryPool.h"
+#include "matrix.h"
+#include "sparseMatrix.h"
+
+// Recorded elementary operations
+// A long sequence of fmatrix_row_sum_in, fmatrix_col_scale_in, ... calls is a pass over a row (or a strided column) per call.
+// The same sequence can be recorded into an elem_log instead, and compiled once into the two matrices it amounts to:
+//   row operations multiply from the left (A <- E A), and column operations from the right (A <- A F), and the two sides
+//   commute, so any interleaving of them is  A <- L A R  with L = E_k ... E_1 (m x m) and R = F_1 ... F_k (n x n)
+// Compiling replays the operations on identity matrices (O(m) or O(n) per operation, independent of the targets), and keeps
+// each side as a sparse (CSR) matrix unless more than 1 in ELEMLOG_DENSE_FRACTION of its elements are nonzero. Applying the
+// result is then one multiply per side, and elem_transform_apply_many_in puts several targets side by side so they share it.
+//
+// elem_log log = elem_log_create(A.m, A.n, 1000, &frame);
+// elem_log_row_sum(&log, 2, 1.0f, 0, -3.0f);				// records R2 <- R2 - 3R0, A isn't touched
+// elem_log_col_swap(&log, 0, 1);
+// elem_transform T = elem_log_compile(log, &frame);
+// elem_transform_apply_in(T, A, &frame);					// same as calling the two ops on A
+
+// a side of the transform is stored dense once more than 1 in ELEMLOG_DENSE_FRACTION of its elements are nonzero
+#define ELEMLOG_DENSE_FRACTION 2
+
+typedef enum {
+	ELEM_ROW_SCALE,
+	ELEM_ROW_SWAP,
+	ELEM_ROW_SUM,
+	ELEM_COL_SCALE,
+	ELEM_COL_SWAP,
+	ELEM_COL_SUM
+}elem_op_kind;
+
+// one recorded operation, with the arguments of the fmatrix_ function it stands for (dest <- c1 * dest + c2 * src for sums,
+// dest <- c1 * dest for scales, dest <-> src for swaps)
+typedef struct {
+	int kind;
+	int dest, src;
+	float c1, c2;
+}elem_op;
+
+// sequence of operations on m x n matrices. ops is allocated on a pool with room for capacity of them
+typedef struct {
+	int m, n;
+	int count, capacity;
+	elem_op* ops;
+}elem_log;
+
+// compiled log: A <- L A R. Each side is either dense (an fmatrix) or sparse (an fspmatrix), and the unused form is an error
+// matrix. Both forms empty means the log had no operations on that side
+typedef struct {
+	int m, n;
+	fmatrix left;
+	fspmatrix left_sparse;
+	fmatrix right;
+	fspmatrix right_sparse;
+}elem_transform;
+
+elem_log elem_log_create(int m, int n, int capacity, pool* frame);
+int elem_log_row_scale(elem_log* log, int row, float c);
+int elem_log_row_swap(elem_log* log, int row1, int row2);
+int elem_log_row_sum(elem_log* log, int dest, float c1, int src, float c2);
+int elem_log_col_scale(elem_log* log, int col, float c);
+int elem_log_col_swap(elem_log* log, int col1, int col2);
+int elem_log_col_sum(elem_log* log, int dest, float c1, int src, float c2);
+
+elem_transform elem_log_compile(elem_log log, pool* frame);
+int elem_transform_apply_in(elem_transform T, fmatrix A, pool* frame);
+int elem_transform_apply_many_in(elem_transform T, fmatrix* targets, int count, pool* frame);
+
+#endif
@@ -0,0 +1,278 @@
+#include <string.h>
+
+#include "halfMatrix.h"
+
+// MSVC doesn't define __F16C__, but every /arch:AVX2 target has it
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define HALF_F16C
+#endif
+#if defined(__AVX512BF16__)
+#define HALF_AVX512BF16
+#endif
+#if defined(HALF_F16C) || defined(HALF_AVX512BF16)
+#include <immintrin.h>
+#endif
+
+// Scalar conversions
+// These define the rounding that the SIMD paths match: round to nearest even, overflow to infinity, NaN stays NaN
+
+// returns value rounded to a 16 bit format
+//
+// uint16_t h = float_to_half(1.5f, HALF_FP16);
+uint16_t float_to_half(float value, half_format format) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	if (format == HALF_BF16) {
+		if ((bits & 0x7FFFFFFF) > 0x7F800000) { return (uint16_t)((bits >> 16) | 0x40); }	// keep NaN quiet, the rounding could carry it to inf
+		bits += 0x7FFF + ((bits >> 16) & 1);
+		return (uint16_t)(bits >> 16);
+	}
+
+	uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+	uint32_t magnitude = bits & 0x7FFFFFFF;
+	if (magnitude > 0x7F800000) { return sign | 0x7E00; }			// NaN
+	if (magnitude >= 0x477FF000) { return sign | 0x7C00; }			// 65520 and up round to infinity
+	if (magnitude < 0x38800000) {									// below 2^-14: a subnormal half, counted in units of 2^-24
+		float scaled;
+		memcpy(&scaled, &magnitude, sizeof(scaled));
+		return sign | (uint16_t)nearbyintf(scaled * 16777216.0f);	// 1024 carries into the smallest normal, which is correct
+	}
+	// rebias the exponent from 127 to 15 and round away the low 13 bits of the mantissa
+	magnitude += 0xFFF + ((magnitude >> 13) & 1);
+	return sign | (uint16_t)((magnitude >> 13) - (112 << 10));
+}
+
+// returns the float a 16 bit element stands for (exact, every half fits in a float)
+//
+// float f = half_to_float(h, HALF_FP16);
+float half_to_float(uint16_t value, half_format format) {
+	uint32_t bits;
+	float result;
+	if (format == HALF_BF16) {
+		bits = (uint32_t)value << 16;
+		memcpy(&result, &bits, sizeof(result));
+		return result;
+	}
+
+	uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+	uint32_t exponent = (value >> 10) & 0x1F;
+	uint32_t mantissa = value & 0x3FF;
+	if (exponent == 0) {											// zero or subnormal
+		result = (float)mantissa * (1.0f / 16777216.0f);
+		return sign ? -result : result;
+	}
+	if (exponent == 31) { bits = sign | 0x7F800000 | (mantissa << 13); }
+	else { bits = sign | ((exponent + 112) << 23) | (mantissa << 13); }
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+// converts count floats from src to dst
+// note that the AVX512-BF16 instruction flushes float subnormals to 0, where the scalar path rounds them
+void half_encode(const float* src, uint16_t* dst, int count, half_format format) {
+	int i = 0;
+	if (format == HALF_FP16) {
+#ifdef HALF_F16C
+		for (; i + 8 <= count; i += 8) {
+			__m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(&src[i]), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+			_mm_storeu_si128((__m128i*)&dst[i], h);
+		}
+#endif
+	}
+	else {
+#ifdef HALF_AVX512BF16
+		for (; i + 16 <= count; i += 16) {
+			__m256bh h = _mm512_cvtneps_pbh(_mm512_loadu_ps(&src[i]));
+			memcpy(&dst[i], &h, sizeof(h));
+		}
+#endif
+	}
+	for (; i < count; i++) { dst[i] = float_to_half(src[i], format); }
+}
+
+// converts count 16 bit elements from src to floats in dst
+// bf16 is just a shift, which compilers vectorize without help
+void half_decode(const uint16_t* src, float* dst, int count, half_format format) {
+	int i = 0;
+	if (format == HALF_BF16) {
+		for (; i < count; i++) {
+			uint32_t bits = (uint32_t)src[i] << 16;
+			memcpy(&dst[i], &bits, sizeof(bits));
+		}
+		return;
+	}
+#ifdef HALF_F16C
+	for (; i + 8 <= count; i += 8) {
+		_mm256_storeu_ps(&dst[i], _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)&src[i])));
+	}
+#endif
+	for (; i < count; i++) { dst[i] = half_to_float(src[i], HALF_FP16); }
+}
+
+
+// Creation and conversion
+
+// creates an m x n 16 bit matrix of zeros (0 is all zero bits in both formats)
+hmatrix hmatrix_create_zero(int m, int n, half_format format, pool* frame) {
+	if (m < 0 || n < 0) {
+		printf("hmatrix must have positive row/columns\n");
+		return ERROR_HMATRIX;
+	}
+	uint16_t* matrix = raw_pool_alloc(frame, m * n * sizeof(uint16_t));
+	if (matrix == NULL) {
+		printf("pool allocation for half matrix failed, returning error matrix\n");
+		return ERROR_HMATRIX;
+	}
+	memset(matrix, 0, m * n * sizeof(uint16_t));
+	return (hmatrix) { m, n, matrix, 0, (uint8_t)format };
+}
+
+// returns mat rounded to a 16 bit format, allocated on frame. Keeps mat's layout and transpose flag, so mat has to be general
+//
+// hmatrix Ah = fmatrix_to_hmatrix(A, HALF_FP16, &frame);
+hmatrix fmatrix_to_hmatrix(fmatrix mat, half_format format, pool* frame) {
+	if (mat.kind != FMATRIX_GENERAL) {
+		printf("error while converting to half matrix: \nrequires a general matrix, unpack it first (fmatrix_unpack)\n");
+		return ERROR_HMATRIX;
+	}
+	hmatrix result = hmatrix_create_zero(mat.m, mat.n, format, frame);
+	if (result.matrix == NULL) { return result; }
+	half_encode(mat.matrix, result.matrix, mat.m * mat.n, format);
+	result.transpose = mat.transpose;
+	return result;
+}
+
+// returns mat as floats, allocated on frame. Keeps mat's layout and transpose flag
+//
+// fmatrix A = hmatrix_to_fmatrix(Ah, &frame);
+fmatrix hmatrix_to_fmatrix(hmatrix mat, pool* frame) {
+	float* matrix = raw_pool_alloc(frame, mat.m * mat.n * sizeof(float));
+	if (matrix == NULL) {
+		printf("error while converting half matrix: pool allocation failure\n");
+		return ERROR_FMATRIX;
+	}
+	half_decode(mat.matrix, matrix, mat.m * mat.n, (half_format)mat.format);
+	return (fmatrix) { mat.m, mat.n, matrix, mat.transpose };
+}
+
+// constant time, like fmatrix_transpose_in
+void hmatrix_transpose_in(hmatrix* mat) {
+	intswap(&mat->m, &mat->n);
+	mat->transpose = !mat->transpose;
+}
+
+
+// Kernels
+
+// decodes rows r0 to r1 - 1, columns c0 to c1 - 1 of mat (as it's read) into dst, row major
+// rows of a non transposed matrix are contiguous, so they go through half_decode. A transposed one is gathered element by element
+static void decode_block(hmatrix mat, int r0, int r1, int c0, int c1, float* dst) {
+	int width = c1 - c0;
+	half_format format = (half_format)mat.format;
+	for (int i = r0; i < r1; i++) {
+		float* row = &dst[(i - r0) * width];
+		if (!mat.transpose) {
+			half_decode(&mat.matrix[i * mat.n + c0], row, width, format);
+		}
+		else {
+			for (int j = c0; j < c1; j++) { row[j - c0] = HALF_AT(mat, i, j); }
+		}
+	}
+}
+
+// multiplies two 16 bit matrices, accumulating in float, and returns the float product allocated on frame
+// B is decoded HALF_BLOCK_ROWS rows at a time, and every row of A adds its share of that block to its row of the result, so the
+// inner loop is a contiguous float axpy and nothing is decoded twice
+//
+// fmatrix C = hmatrix_multiply(Ah, Bh, &frame);
+fmatrix hmatrix_multiply(hmatrix matA, hmatrix matB, pool* frame) {
+	if (matA.n != matB.m) {
+		printf("error while multiplying half matrices: \ndimension mismatch: ");
+		printf("matrix a: (%d x _%d_)  matrix b: (_%d_ x %d)\n", matA.m, matA.n, matB.m, matB.n);
+		return ERROR_FMATRIX;
+	}
+	int m = matA.m, k = matA.n, n = matB.n;
+
+	void* start = frame->ptr;
+	fmatrix result = fmatrix_create_zero(m, n, frame);
+	void* workspace = frame->ptr;
+	float* block = raw_pool_alloc(frame, HALF_BLOCK_ROWS * n * sizeof(float));
+	float* a = raw_pool_alloc(frame, HALF_BLOCK_ROWS * sizeof(float));
+	if (result.matrix == NULL || block == NULL || a == NULL) {
+		printf("error while multiplying half matrices: pool allocation failure\n");
+		pool_free_from(frame, start);
+		return ERROR_FMATRIX;
+	}
+
+	for (int p0 = 0; p0 < k; p0 += HALF_BLOCK_ROWS) {
+		int p1 = (p0 + HALF_BLOCK_ROWS < k) ? p0 + HALF_BLOCK_ROWS : k;
+		decode_block(matB, p0, p1, 0, n, block);
+		for (int i = 0; i < m; i++) {
+			decode_block(matA, i, i + 1, p0, p1, a);
+			float* c = &result.matrix[i * n];
+			for (int p = 0; p < p1 - p0; p++) {
+				float scale = a[p];
+				if (scale == 0.0f) { continue; }
+				const float* b = &block[p * n];
+				for (int j = 0; j < n; j++) { c[j] += scale * b[j]; }
+			}
+		}
+	}
+
+	pool_free_from(frame, workspace);
+	return result;
+}
+
+// fmatrix y = hmatrix_multiply_vector(Ah, x, &frame);
+fmatrix hmatrix_multiply_vector(hmatrix A, fmatrix x, pool* frame) {
+	if (A.n != x.m || x.n != 1) {
+		printf("error while multiplying half matrix and vector: \ndimension mismatch: ");
+		printf("matrix a: (%d x _%d_)  vector x: (_%d_ x %d)\n", A.m, A.n, x.m, x.n);
+		return ERROR_FMATRIX;
+	}
+	if (x.kind != FMATRIX_GENERAL) {
+		printf("error while multiplying half matrix and vector: \nx has to be a general matrix\n");
+		return ERROR_FMATRIX;
+	}
+
+	fmatrix result = fmatrix_create_zero(A.m, 1, frame);
+	if (result.matrix == NULL) { return result; }
+
+	hmatrix_multiply_vector_in(A, x.matrix, result.matrix);
+	return result;
+}
+
+// y = Ax on raw float arrays, with no checks or allocation. x has A.n elements and y has A.m
+// stored rows are decoded HALF_CHUNK elements at a time into a stack buffer. They're rows of A (dot products) normally, and
+// columns of A (axpys into y) if A is transposed
+void hmatrix_multiply_vector_in(hmatrix A, const float* x, float* y) {
+	float buffer[HALF_CHUNK];
+	half_format format = (half_format)A.format;
+
+	if (!A.transpose) {
+		for (int i = 0; i < A.m; i++) {
+			const uint16_t* row = &A.matrix[i * A.n];
+			float sum = 0.0f;
+			for (int c0 = 0; c0 < A.n; c0 += HALF_CHUNK) {
+				int count = (c0 + HALF_CHUNK < A.n) ? HALF_CHUNK : A.n - c0;
+				half_decode(&row[c0], buffer, count, format);
+				for (int c = 0; c < count; c++) { sum += buffer[c] * x[c0 + c]; }
+			}
+			y[i] = sum;
+		}
+		return;
+	}
+
+	memset(y, 0, A.m * sizeof(float));
+	for (int j = 0; j < A.n; j++) {
+		const uint16_t* col = &A.matrix[j * A.m];
+		float scale = x[j];
+		if (scale == 0.0f) { continue; }
+		for (int c0 = 0; c0 < A.m; c0 += HALF_CHUNK) {
+			int count = (c0 + HALF_CHUNK < A.m) ? HALF_CHUNK : A.m - c0;
+			half_decode(&col[c0], buffer, count, format);
+			for (int c = 0; c < count; c++) { y[c0 + c] += scale * buffer[c]; }
+		}
+	}
+}
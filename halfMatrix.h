@@ -0,0 +1,68 @@
+#ifndef HALFMATRIX_H
+#define HALFMATRIX_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "memoryPool.h"
+#include "matrix.h"
+
+// 16 bit matrices
+// Elements are stored in half the space of a float, in one of two formats:
+//   - HALF_FP16: IEEE half precision. 11 significant bits, but a range of only about 6e-8 to 65504
+//   - HALF_BF16: bfloat16, the top half of a float. Only 8 significant bits, but the same range as float
+// They're meant for storage only: every kernel decodes its operands to float and accumulates in float, so the savings are
+// memory and bandwidth, not precision. Layout and the transpose flag work exactly like fmatrix, so MATRIX_AT gives the raw
+// 16 bit element and HALF_AT gives it as a float.
+//
+// Conversions use F16C (fp16) and AVX512-BF16 (bf16 encoding) when the compiler targets them (ex. -mf16c -mavx512bf16,
+// or /arch:AVX2 for F16C on MSVC), and portable bit manipulation otherwise. Both round to nearest even.
+//
+// hmatrix Ah = fmatrix_to_hmatrix(A, HALF_BF16, &frame);
+// fmatrix C = hmatrix_multiply(Ah, Bh, &frame);	// C is float
+// hmatrix_multiply_vector_in(Ah, x, y);			// y = Ax, x and y are float
+
+// rows of B decoded at a time by hmatrix_multiply, and floats decoded at a time by the vector kernels.
+// A HALF_BLOCK_ROWS x n float block of B is reused by every row of A, so each operand is decoded exactly once
+#define HALF_BLOCK_ROWS 64
+#define HALF_CHUNK 256
+
+typedef enum {
+	HALF_FP16,
+	HALF_BF16
+}half_format;
+
+// 16 bit matrix
+typedef struct{
+	// rows, columns
+	int m, n;
+	// pointer to item at [0,0]
+	uint16_t* matrix;
+	// flag for transpose handling
+	uint8_t transpose;
+	// half_format of the elements
+	uint8_t format;
+	uint8_t padding[2];
+}hmatrix;
+
+#define ERROR_HMATRIX (hmatrix){ 0, 0, NULL, 0, 0 }
+
+// element [i][j] of an hmatrix, as a float
+#define HALF_AT(mat, i, j) (half_to_float(MATRIX_AT(mat, i, j), (half_format)(mat).format))
+
+uint16_t float_to_half(float value, half_format format);
+float half_to_float(uint16_t value, half_format format);
+void half_encode(const float* src, uint16_t* dst, int count, half_format format);
+void half_decode(const uint16_t* src, float* dst, int count, half_format format);
+
+hmatrix hmatrix_create_zero(int m, int n, half_format format, pool* frame);
+hmatrix fmatrix_to_hmatrix(fmatrix mat, half_format format, pool* frame);
+fmatrix hmatrix_to_fmatrix(hmatrix mat, pool* frame);
+void hmatrix_transpose_in(hmatrix* mat);
+
+fmatrix hmatrix_multiply(hmatrix matA, hmatrix matB, pool* frame);
+fmatrix hmatrix_multiply_vector(hmatrix A, fmatrix x, pool* frame);
+void hmatrix_multiply_vector_in(hmatrix A, const float* x, float* y);
+
+#endif
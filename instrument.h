@@ -0,0 +1,34 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+// Instrumentation hooks for the public entry points in matrix.c
+// Every instrumented function calls INSTRUMENT_BEGIN once its inputs have been validated, and
+// INSTRUMENT_END before each return after that. The hooks forward to whichever backends are
+// compiled in. With no backend enabled, both macros expand to nothing, so the kernels are identical
+// to an uninstrumented build.
+//
+// backends (toggle with a preprocessor define, ex. /D MATRIX_PERF_COUNTERS or -DMATRIX_PERF_COUNTERS):
+//   MATRIX_PERF_COUNTERS - hardware performance counters (perfCounters.h), off unless defined
+//   MATRIX_NO_TRACE      - removes operation tracing (trace.h), which is otherwise compiled in and
+//                          switched on at runtime with trace_set_enabled
+
+#include "matrixOps.h"
+#include "perfCounters.h"
+#include "trace.h"
+
+// matA and matB are the operands of the operation. Unary operations pass ERROR_FMATRIX as matB
+#ifdef MATRIX_PERF_COUNTERS
+#define INSTRUMENT_PERF_BEGIN(op, matA, matB) perf_scope instrument_perf_scope = perf_scope_begin((op), (matA), (matB));
+#define INSTRUMENT_PERF_END() perf_scope_end(&instrument_perf_scope);
+#else
+#define INSTRUMENT_PERF_BEGIN(op, matA, matB)
+#define INSTRUMENT_PERF_END()
+#endif
+
+#define INSTRUMENT_TRACE_BEGIN(op, matA, matB) \
+	TRACE_BEGIN((op), (matA).m, (matA).n, (matB).n, (matA).transpose | ((matB).transpose << 1), 0)
+
+#define INSTRUMENT_BEGIN(op, matA, matB) INSTRUMENT_PERF_BEGIN(op, (matA), (matB)) INSTRUMENT_TRACE_BEGIN(op, (matA), (matB)) ((void)0)
+#define INSTRUMENT_END() TRACE_END() INSTRUMENT_PERF_END() ((void)0)
+
+#endif
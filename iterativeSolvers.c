@@ -0,0 +1,485 @@
+#include "iterativeSolvers.h"
+
+// vector helpers. Dot products accumulate in double, since the solvers' stopping tests depend on them
+
+static float vec_dot(const float* x, const float* y, int n) {
+	double sum = 0.0;
+	for (int i = 0; i < n; i++) { sum += (double)x[i] * y[i]; }
+	return (float)sum;
+}
+
+static float vec_norm(const float* x, int n) {
+	return sqrtf(vec_dot(x, x, n));
+}
+
+// y += c * x
+static void vec_axpy(float* y, float c, const float* x, int n) {
+	for (int i = 0; i < n; i++) { y[i] += c * x[i]; }
+}
+
+
+// Operators
+
+// wraps a square dense matrix (can be a transpose, but not packed: the solvers reject packed operators)
+linear_operator operator_from_fmatrix(fmatrix A) {
+	if (A.m != A.n) { printf("operator error: matrix must be square (%d x %d)\n", A.m, A.n); }
+	if (A.kind != FMATRIX_GENERAL) { printf("operator error: matrix must be general, unpack it first (fmatrix_unpack)\n"); }
+	return (linear_operator) { OPERATOR_DENSE, A.m, A, ERROR_FSPMATRIX, NULL, NULL };
+}
+
+// wraps a square sparse matrix (CSR or CSC)
+linear_operator operator_from_fspmatrix(fspmatrix A) {
+	if (A.m != A.n) { printf("operator error: matrix must be square (%d x %d)\n", A.m, A.n); }
+	return (linear_operator) { OPERATOR_SPARSE, A.m, ERROR_FMATRIX, A, NULL, NULL };
+}
+
+// wraps a function that computes y = Ax for an n x n A. context is passed through to apply
+//
+// linear_operator op = operator_from_callback(n, apply_laplacian, &grid);
+linear_operator operator_from_callback(int n, operator_apply apply, void* context) {
+	return (linear_operator) { OPERATOR_CALLBACK, n, ERROR_FMATRIX, ERROR_FSPMATRIX, apply, context };
+}
+
+// y = Ax, on raw arrays of A.n elements
+void operator_apply_in(linear_operator A, const float* x, float* y) {
+	switch (A.kind) {
+	case OPERATOR_DENSE:
+		if (!A.dense.transpose) {
+			for (int i = 0; i < A.n; i++) {
+				const float* row = &A.dense.matrix[i * A.n];
+				float sum = 0.0f;
+				for (int j = 0; j < A.n; j++) { sum += row[j] * x[j]; }
+				y[i] = sum;
+			}
+		}
+		else {
+			// a transpose is stored column by column, so accumulate columns instead
+			memset(y, 0, A.n * sizeof(float));
+			for (int j = 0; j < A.n; j++) {
+				vec_axpy(y, x[j], &A.dense.matrix[j * A.n], A.n);
+			}
+		}
+		break;
+	case OPERATOR_SPARSE:
+		fspmatrix_multiply_vector_in(A.sparse, x, y);
+		break;
+	case OPERATOR_CALLBACK:
+		A.apply(A.context, x, y);
+		break;
+	}
+}
+
+
+// Preconditioners
+
+// the identity (no preconditioning)
+preconditioner preconditioner_none(int n) {
+	return (preconditioner) { PRECOND_NONE, n, NULL, ERROR_FSPMATRIX, NULL };
+}
+
+// jacobi preconditioner: M = diag(A). Needs a stored A, so callback (and packed dense) operators fall back to none
+// the inverse diagonal is allocated on frame
+preconditioner preconditioner_jacobi(linear_operator A, pool* frame) {
+	if (A.kind == OPERATOR_CALLBACK || (A.kind == OPERATOR_DENSE && A.dense.kind != FMATRIX_GENERAL)) {
+		printf("jacobi preconditioner needs a stored general matrix, using no preconditioner\n");
+		return preconditioner_none(A.n);
+	}
+
+	float* inverse_diagonal = raw_pool_alloc(frame, A.n * sizeof(float));
+	if (inverse_diagonal == NULL) {
+		printf("jacobi preconditioner error: pool allocation failure\n");
+		return preconditioner_none(A.n);
+	}
+
+	for (int i = 0; i < A.n; i++) {
+		float d = (A.kind == OPERATOR_DENSE) ? MATRIX_AT(A.dense, i, i) : fspmatrix_at(A.sparse, i, i);
+		inverse_diagonal[i] = (d != 0.0f) ? 1.0f / d : 1.0f;
+	}
+
+	return (preconditioner) { PRECOND_JACOBI, A.n, inverse_diagonal, ERROR_FSPMATRIX, NULL };
+}
+
+// ILU(0) preconditioner: A ~ LU where L and U only keep the elements that are nonzero in A.
+// Works on a CSR copy of A (dense operators get compressed first) with the IKJ form of elimination.
+// Rows of A don't have to list their columns in order. Every row needs a nonzero diagonal. Falls back to no preconditioner if that fails, or if A is a callback or packed.
+// the factors are allocated on frame
+preconditioner preconditioner_ilu0(linear_operator A, pool* frame) {
+	if (A.kind == OPERATOR_CALLBACK || (A.kind == OPERATOR_DENSE && A.dense.kind != FMATRIX_GENERAL)) {
+		printf("ILU(0) preconditioner needs a stored general matrix, using no preconditioner\n");
+		return preconditioner_none(A.n);
+	}
+
+	int n = A.n;
+	void* start = frame->ptr;
+	int* diagonal = raw_pool_alloc(frame, n * sizeof(int));
+	fspmatrix LU;
+	if (A.kind == OPERATOR_DENSE) { LU = fspmatrix_create_csr(A.dense, frame); }
+	else if (A.sparse.transpose) { LU = fspmatrix_compress_rows(A.sparse, frame); }
+	else { LU = fspmatrix_copy_alloc(A.sparse, frame); }
+
+	// scratch space: position of each column in the current row
+	void* workspace = frame->ptr;
+	int* position = raw_pool_alloc(frame, n * sizeof(int));
+	if (diagonal == NULL || LU.ptr == NULL || position == NULL) {
+		printf("ILU(0) preconditioner error: pool allocation failure\n");
+		pool_free_from(frame, start);
+		return preconditioner_none(n);
+	}
+
+	// the elimination and the triangular solves walk each row left to right up to the diagonal, so its column indices have to be
+	// ascending. LU is a copy, so the rows of a CSR built out of order can be sorted in place (insertion sort: rows are short,
+	// and usually sorted already)
+	for (int i = 0; i < n; i++) {
+		for (int p = LU.ptr[i] + 1; p < LU.ptr[i + 1]; p++) {
+			int column = LU.index[p];
+			float value = LU.values[p];
+			int q = p;
+			for (; q > LU.ptr[i] && LU.index[q - 1] > column; q--) {
+				LU.index[q] = LU.index[q - 1];
+				LU.values[q] = LU.values[q - 1];
+			}
+			LU.index[q] = column;
+			LU.values[q] = value;
+		}
+	}
+
+	for (int i = 0; i < n; i++) {
+		position[i] = -1;
+		diagonal[i] = -1;
+		for (int p = LU.ptr[i]; p < LU.ptr[i + 1]; p++) {
+			if (LU.index[p] == i) { diagonal[i] = p; }
+		}
+		if (diagonal[i] == -1) {
+			printf("ILU(0) preconditioner: row %d has no diagonal, using no preconditioner\n", i);
+			pool_free_from(frame, start);
+			return preconditioner_none(n);
+		}
+	}
+
+	for (int i = 0; i < n; i++) {
+		for (int p = LU.ptr[i]; p < LU.ptr[i + 1]; p++) { position[LU.index[p]] = p; }
+
+		// eliminate with every earlier row k that row i has a nonzero in, but only update elements
+		// that are already in row i's pattern
+		for (int p = LU.ptr[i]; p < LU.ptr[i + 1] && LU.index[p] < i; p++) {
+			int k = LU.index[p];
+			float pivot = LU.values[diagonal[k]];
+			if (pivot == 0.0f) {
+				printf("ILU(0) preconditioner: 0 pivot in row %d, using no preconditioner\n", k);
+				pool_free_from(frame, start);
+				return preconditioner_none(n);
+			}
+			float factor = LU.values[p] / pivot;
+			LU.values[p] = factor;
+			for (int q = diagonal[k] + 1; q < LU.ptr[k + 1]; q++) {
+				int j = position[LU.index[q]];
+				if (j != -1) { LU.values[j] -= factor * LU.values[q]; }
+			}
+		}
+
+		for (int p = LU.ptr[i]; p < LU.ptr[i + 1]; p++) { position[LU.index[p]] = -1; }
+	}
+
+	pool_free_from(frame, workspace);
+	return (preconditioner) { PRECOND_ILU0, n, NULL, LU, diagonal };
+}
+
+// z = M^-1 r, on raw arrays of M.n elements
+void preconditioner_apply_in(preconditioner M, const float* r, float* z) {
+	switch (M.kind) {
+	case PRECOND_NONE:
+		memcpy(z, r, M.n * sizeof(float));
+		break;
+	case PRECOND_JACOBI:
+		for (int i = 0; i < M.n; i++) { z[i] = r[i] * M.inverse_diagonal[i]; }
+		break;
+	case PRECOND_ILU0:
+		// forward solve with the unit lower part, then back solve with the upper part
+		for (int i = 0; i < M.n; i++) {
+			float sum = r[i];
+			for (int p = M.LU.ptr[i]; p < M.diagonal[i]; p++) { sum -= M.LU.values[p] * z[M.LU.index[p]]; }
+			z[i] = sum;
+		}
+		for (int i = M.n - 1; i >= 0; i--) {
+			float sum = z[i];
+			for (int p = M.diagonal[i] + 1; p < M.LU.ptr[i + 1]; p++) { sum -= M.LU.values[p] * z[M.LU.index[p]]; }
+			z[i] = sum / M.LU.values[M.diagonal[i]];
+		}
+		break;
+	}
+}
+
+
+// Solvers
+
+// checks the shapes shared by every solver, and allocates the residual history (the only part of the
+// result that outlives the solver). returns 0 on failure
+static int krylov_setup(linear_operator A, fmatrix b, fmatrix x, int max_iterations, krylov_result* result, pool* frame) {
+	*result = (krylov_result){ 0, 0, 0.0f, NULL };
+	if (b.m != A.n || b.n != 1 || x.m != A.n || x.n != 1) {
+		printf("krylov solver error: b and x must be %d x 1\n", A.n);
+		return 0;
+	}
+	if (b.kind != FMATRIX_GENERAL || x.kind != FMATRIX_GENERAL || (A.kind == OPERATOR_DENSE && A.dense.kind != FMATRIX_GENERAL)) {
+		printf("krylov solver error: A, b and x must be general matrices, unpack them first (fmatrix_unpack)\n");
+		return 0;
+	}
+	if (max_iterations < 0) {
+		printf("krylov solver error: max_iterations must be positive\n");
+		return 0;
+	}
+
+	result->history = raw_pool_alloc(frame, (max_iterations + 1) * sizeof(float));
+	if (result->history == NULL) {
+		printf("krylov solver error: pool allocation failure\n");
+		return 0;
+	}
+	return 1;
+}
+
+// records the relative residual of the current iteration. returns true once it's below tolerance
+static int krylov_record(krylov_result* result, float residual, float tolerance) {
+	result->history[result->iterations] = residual;
+	result->residual = residual;
+	result->converged = residual <= tolerance;
+	return result->converged;
+}
+
+// preconditioned conjugate gradient. A and M must be symmetric positive definite
+// x holds the initial guess going in, and the solution coming out
+//
+// krylov_result info = krylov_cg(op, M, b, x, 100, 1e-6f, &frame);
+krylov_result krylov_cg(linear_operator A, preconditioner M, fmatrix b, fmatrix x, int max_iterations, float tolerance, pool* frame) {
+	krylov_result result;
+	if (!krylov_setup(A, b, x, max_iterations, &result, frame)) { return result; }
+
+	int n = A.n;
+	void* workspace = frame->ptr;
+	float* r = raw_pool_alloc(frame, 4 * n * sizeof(float));
+	if (r == NULL) {
+		printf("krylov solver error: pool allocation failure\n");
+		pool_free_from(frame, result.history);
+		result.history = NULL;
+		return result;
+	}
+	float* z = r + n;
+	float* p = z + n;
+	float* q = p + n;
+
+	float b_norm = vec_norm(b.matrix, n);
+	if (b_norm == 0.0f) { b_norm = 1.0f; }
+
+	// r = b - Ax
+	operator_apply_in(A, x.matrix, q);
+	for (int i = 0; i < n; i++) { r[i] = b.matrix[i] - q[i]; }
+
+	if (!krylov_record(&result, vec_norm(r, n) / b_norm, tolerance)) {
+		preconditioner_apply_in(M, r, z);
+		memcpy(p, z, n * sizeof(float));
+		float rz = vec_dot(r, z, n);
+
+		while (result.iterations < max_iterations) {
+			operator_apply_in(A, p, q);
+			float pq = vec_dot(p, q, n);
+			if (pq == 0.0f) { break; }				// breakdown: A isn't positive definite along p
+			float alpha = rz / pq;
+
+			vec_axpy(x.matrix, alpha, p, n);
+			vec_axpy(r, -alpha, q, n);
+
+			result.iterations++;
+			if (krylov_record(&result, vec_norm(r, n) / b_norm, tolerance)) { break; }
+
+			preconditioner_apply_in(M, r, z);
+			float rz_next = vec_dot(r, z, n);
+			float beta = rz_next / rz;
+			rz = rz_next;
+			for (int i = 0; i < n; i++) { p[i] = z[i] + beta * p[i]; }
+		}
+	}
+
+	pool_free_from(frame, workspace);
+	return result;
+}
+
+// right preconditioned BiCGSTAB for general (nonsymmetric) A
+// x holds the initial guess going in, and the solution coming out
+//
+// krylov_result info = krylov_bicgstab(op, M, b, x, 200, 1e-6f, &frame);
+krylov_result krylov_bicgstab(linear_operator A, preconditioner M, fmatrix b, fmatrix x, int max_iterations, float tolerance, pool* frame) {
+	krylov_result result;
+	if (!krylov_setup(A, b, x, max_iterations, &result, frame)) { return result; }
+
+	int n = A.n;
+	void* workspace = frame->ptr;
+	float* r = raw_pool_alloc(frame, 8 * n * sizeof(float));
+	if (r == NULL) {
+		printf("krylov solver error: pool allocation failure\n");
+		pool_free_from(frame, result.history);
+		result.history = NULL;
+		return result;
+	}
+	float* r_hat = r + n;			// shadow residual, fixed at the initial r
+	float* p = r_hat + n;
+	float* p_hat = p + n;			// M^-1 p
+	float* v = p_hat + n;
+	float* s = v + n;
+	float* s_hat = s + n;			// M^-1 s
+	float* t = s_hat + n;
+
+	float b_norm = vec_norm(b.matrix, n);
+	if (b_norm == 0.0f) { b_norm = 1.0f; }
+
+	operator_apply_in(A, x.matrix, v);
+	for (int i = 0; i < n; i++) {
+		r[i] = b.matrix[i] - v[i];
+		r_hat[i] = r[i];
+		p[i] = 0.0f;
+		v[i] = 0.0f;
+	}
+
+	float rho = 1.0f, alpha = 1.0f, omega = 1.0f;
+	int done = krylov_record(&result, vec_norm(r, n) / b_norm, tolerance);
+	while (!done && result.iterations < max_iterations) {
+		float rho_next = vec_dot(r_hat, r, n);
+		if (rho_next == 0.0f || omega == 0.0f) { break; }		// breakdown
+		float beta = (rho_next / rho) * (alpha / omega);
+		rho = rho_next;
+
+		for (int i = 0; i < n; i++) { p[i] = r[i] + beta * (p[i] - omega * v[i]); }
+		preconditioner_apply_in(M, p, p_hat);
+		operator_apply_in(A, p_hat, v);
+
+		float r_hat_v = vec_dot(r_hat, v, n);
+		if (r_hat_v == 0.0f) { break; }
+		alpha = rho / r_hat_v;
+		for (int i = 0; i < n; i++) { s[i] = r[i] - alpha * v[i]; }
+
+		result.iterations++;
+		float s_norm = vec_norm(s, n) / b_norm;
+		if (s_norm <= tolerance) {
+			vec_axpy(x.matrix, alpha, p_hat, n);
+			krylov_record(&result, s_norm, tolerance);
+			break;
+		}
+
+		preconditioner_apply_in(M, s, s_hat);
+		operator_apply_in(A, s_hat, t);
+		float tt = vec_dot(t, t, n);
+		omega = (tt != 0.0f) ? vec_dot(t, s, n) / tt : 0.0f;
+
+		for (int i = 0; i < n; i++) {
+			x.matrix[i] += alpha * p_hat[i] + omega * s_hat[i];
+			r[i] = s[i] - omega * t[i];
+		}
+		done = krylov_record(&result, vec_norm(r, n) / b_norm, tolerance);
+	}
+
+	pool_free_from(frame, workspace);
+	return result;
+}
+
+// right preconditioned GMRES, restarted every restart iterations
+// Builds an orthonormal basis V of the Krylov space with modified Gram-Schmidt, and keeps the small
+// least squares problem triangular with Givens rotations, so the residual is known at every step without
+// forming x. x is only updated at the end of each cycle, and that estimate only decides when a cycle ends: convergence is
+// decided by the true residual b - Ax of the updated x, which preconditioning or rounding can pull away from the estimate.
+// x holds the initial guess going in, and the solution coming out
+//
+// krylov_result info = krylov_gmres(op, M, b, x, 30, 300, 1e-6f, &frame);
+krylov_result krylov_gmres(linear_operator A, preconditioner M, fmatrix b, fmatrix x, int restart, int max_iterations, float tolerance, pool* frame) {
+	krylov_result result;
+	if (!krylov_setup(A, b, x, max_iterations, &result, frame)) { return result; }
+	if (restart < 1) {
+		printf("gmres error: restart must be at least 1\n");
+		pool_free_from(frame, result.history);
+		result.history = NULL;
+		return result;
+	}
+
+	int n = A.n;
+	int m = restart;
+	void* workspace = frame->ptr;
+	float* V = raw_pool_alloc(frame, (m + 1) * n * sizeof(float));	// basis vectors, one per row
+	float* H = raw_pool_alloc(frame, (m + 1) * m * sizeof(float));	// hessenberg matrix, row major
+	float* rotations = raw_pool_alloc(frame, (3 * m + 1) * sizeof(float));
+	float* w = raw_pool_alloc(frame, 2 * n * sizeof(float));
+	if (V == NULL || H == NULL || rotations == NULL || w == NULL) {
+		printf("krylov solver error: pool allocation failure\n");
+		pool_free_from(frame, result.history);
+		result.history = NULL;
+		return result;
+	}
+	float* cs = rotations;
+	float* sn = cs + m;
+	float* g = sn + m;				// right hand side of the least squares problem (m + 1)
+	float* z = w + n;
+
+	float b_norm = vec_norm(b.matrix, n);
+	if (b_norm == 0.0f) { b_norm = 1.0f; }
+
+	while (1) {
+		// r = b - Ax, the first basis vector is r / ||r||
+		operator_apply_in(A, x.matrix, w);
+		for (int i = 0; i < n; i++) { V[i] = b.matrix[i] - w[i]; }
+		float beta = vec_norm(V, n);
+
+		// the true residual replaces the estimate the last cycle ended on, so it's what decides convergence
+		if (krylov_record(&result, beta / b_norm, tolerance)) { break; }
+		if (result.iterations >= max_iterations || beta == 0.0f) { break; }
+
+		for (int i = 0; i < n; i++) { V[i] /= beta; }
+		g[0] = beta;
+		for (int i = 1; i <= m; i++) { g[i] = 0.0f; }
+
+		int j = 0;
+		while (j < m && result.iterations < max_iterations) {
+			// w = A M^-1 v_j, then orthogonalize it against the basis
+			preconditioner_apply_in(M, &V[j * n], z);
+			operator_apply_in(A, z, w);
+			for (int i = 0; i <= j; i++) {
+				float h = vec_dot(w, &V[i * n], n);
+				H[i * m + j] = h;
+				vec_axpy(w, -h, &V[i * n], n);
+			}
+			float h_next = vec_norm(w, n);
+			H[(j + 1) * m + j] = h_next;
+			if (h_next != 0.0f) {
+				for (int i = 0; i < n; i++) { V[(j + 1) * n + i] = w[i] / h_next; }
+			}
+
+			// apply the earlier rotations to the new column, then find the one that zeroes H[j + 1][j]
+			for (int i = 0; i < j; i++) {
+				float a = H[i * m + j], c = H[(i + 1) * m + j];
+				H[i * m + j] = cs[i] * a + sn[i] * c;
+				H[(i + 1) * m + j] = -sn[i] * a + cs[i] * c;
+			}
+			float a = H[j * m + j], c = H[(j + 1) * m + j];
+			float radius = sqrtf(a * a + c * c);
+			cs[j] = (radius != 0.0f) ? a / radius : 1.0f;
+			sn[j] = (radius != 0.0f) ? c / radius : 0.0f;
+			H[j * m + j] = radius;
+			H[(j + 1) * m + j] = 0.0f;
+			g[j + 1] = -sn[j] * g[j];
+			g[j] = cs[j] * g[j];
+
+			j++;
+			result.iterations++;
+			if (krylov_record(&result, fabsf(g[j]) / b_norm, tolerance) || h_next == 0.0f) { break; }
+		}
+
+		// solve the j x j triangular system Hy = g (y overwrites g), then x += M^-1 (V y)
+		for (int i = j - 1; i >= 0; i--) {
+			float sum = g[i];
+			for (int k = i + 1; k < j; k++) { sum -= H[i * m + k] * g[k]; }
+			g[i] = (H[i * m + i] != 0.0f) ? sum / H[i * m + i] : 0.0f;
+		}
+		memset(w, 0, n * sizeof(float));
+		for (int i = 0; i < j; i++) { vec_axpy(w, g[i], &V[i * n], n); }
+		preconditioner_apply_in(M, w, z);
+		vec_axpy(x.matrix, 1.0f, z, n);
+	}
+
+	pool_free_from(frame, workspace);
+	return result;
+}
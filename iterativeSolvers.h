@@ -0,0 +1,76 @@
+#ifndef ITERATIVESOLVERS_H
+#define ITERATIVESOLVERS_H
+
+#include "memoryPool.h"
+#include "matrix.h"
+#include "sparseMatrix.h"
+
+// Krylov iterative solvers for Ax = b
+//   - krylov_cg:       conjugate gradient, for symmetric positive definite A
+//   - krylov_bicgstab: BiCGSTAB, for general square A
+//   - krylov_gmres:    restarted GMRES(restart), for general square A
+//
+// A is passed as a linear_operator, which wraps a dense fmatrix, a sparse fspmatrix, or a callback that
+// computes y = Ax (so A never has to be stored). The solvers only ever need products with A.
+// Each solver allocates its workspace on the pool once, up front, and frees it before returning. Only the
+// residual history in the result stays on the pool.
+//
+// linear_operator op = operator_from_fspmatrix(S);
+// preconditioner M = preconditioner_ilu0(op, &frame);
+// krylov_result info = krylov_bicgstab(op, M, b, x, 200, 1e-6f, &frame); // x holds the initial guess
+// if (!info.converged) { ... }
+
+typedef enum {
+	OPERATOR_DENSE,
+	OPERATOR_SPARSE,
+	OPERATOR_CALLBACK
+}operator_kind;
+
+// y = Ax for an operator that isn't stored. x and y have n elements and never overlap
+typedef void (*operator_apply)(void* context, const float* x, float* y);
+
+typedef struct {
+	operator_kind kind;
+	int n;
+	fmatrix dense;
+	fspmatrix sparse;
+	operator_apply apply;
+	void* context;
+}linear_operator;
+
+typedef enum {
+	PRECOND_NONE,
+	PRECOND_JACOBI,			// divides by the diagonal of A
+	PRECOND_ILU0			// incomplete LU with the same nonzero pattern as A
+}preconditioner_kind;
+
+typedef struct {
+	preconditioner_kind kind;
+	int n;
+	float* inverse_diagonal;	// jacobi
+	fspmatrix LU;				// ilu0: L (unit diagonal, not stored) and U share A's CSR pattern
+	int* diagonal;				// ilu0: position of each row's diagonal in LU
+}preconditioner;
+
+typedef struct {
+	int iterations;
+	int converged;
+	float residual;				// final ||b - Ax|| / ||b||
+	float* history;				// relative residual before the first iteration and after each one (iterations + 1 entries)
+}krylov_result;
+
+linear_operator operator_from_fmatrix(fmatrix A);
+linear_operator operator_from_fspmatrix(fspmatrix A);
+linear_operator operator_from_callback(int n, operator_apply apply, void* context);
+void operator_apply_in(linear_operator A, const float* x, float* y);
+
+preconditioner preconditioner_none(int n);
+preconditioner preconditioner_jacobi(linear_operator A, pool* frame);
+preconditioner preconditioner_ilu0(linear_operator A, pool* frame);
+void preconditioner_apply_in(preconditioner M, const float* r, float* z);
+
+krylov_result krylov_cg(linear_operator A, preconditioner M, fmatrix b, fmatrix x, int max_iterations, float tolerance, pool* frame);
+krylov_result krylov_bicgstab(linear_operator A, preconditioner M, fmatrix b, fmatrix x, int max_iterations, float tolerance, pool* frame);
+krylov_result krylov_gmres(linear_operator A, preconditioner M, fmatrix b, fmatrix x, int restart, int max_iterations, float tolerance, pool* frame);
+
+#endif
@@ -1,4 +1,18 @@
 #include "testing.h"
+#include "perfCounters.h"
+#include "trace.h"
+#include "sparseMatrix.h"
+#include "sparseLU.h"
+#include "iterativeSolvers.h"
+#include "qrFactorization.h"
+#include "symmetricEigen.h"
+#include "svd.h"
+#include "halfMatrix.h"
+#include "quantMatrix.h"
+#include "structuredMatrix.h"
+#include "elementaryLog.h"
+#include "streamingCovariance.h"
+#include "parallel.h"
 
 void test_transpose() {
 	// 2 3x4 matrices
@@ -464,7 +478,7 @@ void test_inverse() {
 }
 
 void run_col_space(int r, int c, float* A) {
-	int count = 3; // one for the input, one for the copy of the input
+	int count = 12; // the input, the QR factorization and its scratch space, and the result
 	pool frame = create_pool(count * r * c * sizeof(float));
 
 	if (frame.start == NULL) {
@@ -486,7 +500,7 @@ void run_col_space(int r, int c, float* A) {
 }
 
 void run_col_space_transpose(int r, int c, float* A) {
-	int count = 3; // one for the input, one for the copy of the input
+	int count = 12; // the input, the QR factorization and its scratch space, and the result
 	pool frame = create_pool(count * r * c * sizeof(float));
 
 	if (frame.start == NULL) {
@@ -556,7 +570,7 @@ void test_col_space() {
 }
 
 void run_row_space(int r, int c, float* A) {
-	int count = 3; // one for the input, one for the copy of the input, one for the result
+	int count = 12; // the input, the QR factorization and its scratch space, and the result
 	pool frame = create_pool(count * r * c * sizeof(float));
 
 	if (frame.start == NULL) {
@@ -578,7 +592,7 @@ void run_row_space(int r, int c, float* A) {
 }
 
 void run_row_space_transpose(int r, int c, float* A) {
-	int count = 3; // one for the input, one for the copy of the input
+	int count = 12; // the input, the QR factorization and its scratch space, and the result
 	pool frame = create_pool(count * r * c * sizeof(float));
 
 	if (frame.start == NULL) {
@@ -769,8 +783,1801 @@ test_LU_solve() {
 	}
 }
 
+// only records anything when built with MATRIX_PERF_COUNTERS defined
+void test_perf_counters() {
+	int count = 8;
+	int r = 3, c = 3;
+	pool frame = create_pool(count * r * c * sizeof(float));
+
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	int opened = perf_counters_init();
+	printf("opened %d perf counters\n", opened);
+
+	float A[3][3] = {{0.0f, 1.0f, 3.0f}, 
+		{2.0f, -10.0f, 2.0f}, 
+		{1.0f, -3.0f, 0.0f}};
+	float b[3][1] = {-1.0f, -20.0f, -5.0};
+
+	fmatrix mat = create_fmatrix(r, c, A, &frame);
+	fmatrix vec = create_fmatrix(r, 1, b, &frame);
+
+	for (int i = 0; i < 10; i++) {
+		fmatrix AA = fmatrix_multiply(mat, mat, &frame);
+		pool_free_from(&frame, AA.matrix);
+	}
+
+	fmatrix x = fmatrix_LU_solve(mat, vec, &frame);
+	printf("x:\n");
+	print_fmatrix(x);
+
+	perf_stats s = perf_counters_get_op(MATRIX_OP_MULTIPLY);
+	printf("\nfmatrix_multiply calls recorded: %llu\n\n", (unsigned long long)s.calls);
+	perf_counters_print_summary();
+
+	perf_counters_shutdown();
+	perf_counters_reset();
+	free_pool(&frame);
+}
+
+void test_trace() {
+	int count = 8;
+	int r = 3, c = 3;
+
+	trace_set_enabled(1);
+
+	pool frame = create_pool(count * r * c * sizeof(float));
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	float A[3][3] = {{0.0f, 1.0f, 3.0f}, 
+		{2.0f, -10.0f, 2.0f}, 
+		{1.0f, -3.0f, 0.0f}};
+	float b[3][1] = {-1.0f, -20.0f, -5.0};
+
+	fmatrix mat = create_fmatrix(r, c, A, &frame);
+	fmatrix vec = create_fmatrix(r, 1, b, &frame);
+
+	fmatrix_transpose_in(&mat);
+	fmatrix AtA = fmatrix_multiply(mat, fmatrix_transpose(mat, &frame), &frame);
+	fmatrix_transpose_in(&mat);
+
+	fmatrix x = fmatrix_LU_solve(mat, vec, &frame);
+	printf("x:\n");
+	print_fmatrix(x);
+
+	free_pool(&frame);
+	trace_set_enabled(0);
+
+	printf("\nrecorded %d events\n", trace_event_count());
+	if (trace_export_chrome("trace.json") == 0) {
+		printf("wrote trace.json\n");
+	}
+
+	trace_shutdown();
+}
+
+void test_sparse() {
+	pool frame = create_pool(4096);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	float matA[4][3] = {{2.0f, 0.0f, 0.0f},
+		{0.0f, 0.0f, -1.0f},
+		{0.0f, 3.0f, 0.0f},
+		{4.0f, 0.0f, 5.0f}};
+	fmatrix A = create_fmatrix(4, 3, matA, &frame);
+	printf("A:\n");
+	print_fmatrix(A);
+
+	fspmatrix S = fspmatrix_create_csr(A, &frame);
+	printf("\nCSR of A (nnz = %d):\n", S.nnz);
+	print_fspmatrix(S);
+
+	float vecx[3][1] = {{1.0f}, {-2.0f}, {4.0f}};
+	fmatrix x = create_fmatrix(3, 1, vecx, &frame);
+	printf("\nSx:\n");
+	print_fmatrix(fspmatrix_multiply_vector(S, x, &frame));
+	printf("dense Ax:\n");
+	print_fmatrix(fmatrix_multiply(A, x, &frame));
+
+	printf("\nCSC of A, back to dense:\n");
+	print_fmatrix(fspmatrix_to_fmatrix(fspmatrix_create_csc(A, &frame), &frame));
+
+	printf("\nS^t (constant time):\n");
+	fspmatrix St = S;
+	fspmatrix_transpose_in(&St);
+	print_fspmatrix(St);
+
+	printf("\nS^t A (sparse x dense):\n");
+	print_fmatrix(fspmatrix_multiply_dense(St, A, &frame));
+	printf("A^t A (dense):\n");
+	fmatrix At = A;
+	fmatrix_transpose_in(&At);
+	print_fmatrix(fmatrix_multiply(At, A, &frame));
+
+	printf("\nA^t S (dense x sparse):\n");
+	print_fmatrix(fmatrix_multiply_sparse(At, S, &frame));
+	printf("A^t S^t^t (dense x CSC):\n");
+	fspmatrix Stt = fspmatrix_create_csc(A, &frame);
+	print_fmatrix(fmatrix_multiply_sparse(At, Stt, &frame));
+
+	free_pool(&frame);
+
+	// a product big enough to be split across threads, with a few dense rows so the split by nonzeros matters
+	{
+		int n = 60000, per_row = 5, dense_rows = 4;
+		int nnz = (n - dense_rows) * per_row + dense_rows * n;
+		pool big = create_pool((n + 1 + nnz) * sizeof(int) + (nnz + 3 * n) * sizeof(float) + 1024);
+		if (big.start == NULL) {
+			exit(1);
+		}
+		int* ptr = raw_pool_alloc(&big, (n + 1) * sizeof(int));
+		int* index = raw_pool_alloc(&big, nnz * sizeof(int));
+		float* values = raw_pool_alloc(&big, nnz * sizeof(float));
+		int p = 0;
+		for (int i = 0; i < n; i++) {
+			ptr[i] = p;
+			int dense = i % (n / dense_rows) == 0;
+			for (int k = 0; k < (dense ? n : per_row); k++) {
+				index[p] = dense ? k : (i + k * 7919) % n;
+				values[p] = sinf(0.37f * p);
+				p++;
+			}
+		}
+		ptr[n] = p;
+		fspmatrix B = (fspmatrix){ n, n, nnz, ptr, index, values, 0 };
+		float* x = raw_pool_alloc(&big, n * sizeof(float));
+		float* y = raw_pool_alloc(&big, n * sizeof(float));
+		float* y_serial = raw_pool_alloc(&big, n * sizeof(float));
+		for (int i = 0; i < n; i++) { x[i] = cosf(0.11f * i); }
+
+		parallel_set_threads(4);
+		fspmatrix_multiply_vector_in(B, x, y);
+		parallel_set_threads(1);
+		fspmatrix_multiply_vector_in(B, x, y_serial);
+		parallel_set_threads(0);
+		int same = 1;
+		float error = 0.0f;
+		for (int i = 0; i < n; i++) {
+			same &= y[i] == y_serial[i];
+			double reference = 0.0;
+			for (int q = ptr[i]; q < ptr[i + 1]; q++) { reference += (double)values[q] * x[index[q]]; }
+			error = fmaxf(error, fabsf(y[i] - (float)reference) / (1.0f + fabsf((float)reference)));
+		}
+		printf("\nthreaded SpMV: same as serial: %d, error %s\n", same, error < 1e-4f ? "< 1e-4" : "too large");
+		free_pool(&big);
+	}
+}
+
+void test_sparse_LU() {
+	pool frame = create_pool(64000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	// needs a pivot (A[0][0] = 0)
+	{
+		printf("testing matrix that requires permutation:\n");
+		float A[3][3] = {{0.0f, 1.0f, 3.0f}, 
+			{2.0f, -10.0f, 2.0f}, 
+			{1.0f, -3.0f, 0.0f}};
+		float b[3][1] = {-1.0f, -20.0f, -5.0};
+		fmatrix mat = create_fmatrix(3, 3, A, &frame);
+		fmatrix vec = create_fmatrix(3, 1, b, &frame);
+		fspmatrix S = fspmatrix_create_csr(mat, &frame);
+
+		fmatrix x = fspmatrix_LU_solve(S, vec, &frame);
+		printf("x:\n");
+		print_fmatrix(x);
+	}
+
+	// 2D laplacian on a 6 x 6 grid, factored twice with the same analysis
+	{
+		printf("\ntesting 36 x 36 laplacian:\n");
+		int g = 6, n = g * g;
+		fmatrix mat = fmatrix_create_zero(n, n, &frame);
+		for (int r = 0; r < g; r++) {
+			for (int c = 0; c < g; c++) {
+				int i = r * g + c;
+				mat.matrix[i * n + i] = 4.0f;
+				if (r > 0) { mat.matrix[i * n + i - g] = -1.0f; }
+				if (r < g - 1) { mat.matrix[i * n + i + g] = -1.0f; }
+				if (c > 0) { mat.matrix[i * n + i - 1] = -1.0f; }
+				if (c < g - 1) { mat.matrix[i * n + i + 1] = -1.0f; }
+			}
+		}
+		fmatrix b = fmatrix_create_zero(n, 1, &frame);
+		for (int i = 0; i < n; i++) { b.matrix[i] = (float)(i % 5) - 2.0f; }
+
+		fspmatrix S = fspmatrix_create_csr(mat, &frame);
+		fsplu_symbolic sym = fsplu_analyze(S, SPLU_ORDER_MIN_DEGREE, &frame);
+		fsplu_symbolic natural = fsplu_analyze(S, SPLU_ORDER_NATURAL, &frame);
+
+		for (int round = 0; round < 2; round++) {
+			fsplu_numeric N;
+			if (!fsplu_factorize(S, &sym, SPLU_DEFAULT_TOL, &N, &frame)) {
+				printf("factorization failed\n");
+				break;
+			}
+			fmatrix x = fsplu_solve(N, b, &frame);
+			fmatrix Ax = fspmatrix_multiply_vector(S, x, &frame);
+			float residual = 0.0f;
+			for (int i = 0; i < n; i++) { residual = fmaxf(residual, fabsf(Ax.matrix[i] - b.matrix[i])); }
+			printf("round %d: nnz(L) = %d, nnz(U) = %d, max residual = %g\n", round, N.L.nnz, N.U.nnz, residual);
+
+			// same pattern, different values
+			for (int p = 0; p < S.nnz; p++) { S.values[p] *= 2.0f; }
+			for (int i = 0; i < n; i++) { b.matrix[i] *= 2.0f; }
+		}
+
+		fsplu_numeric N;
+		if (fsplu_factorize(S, &natural, SPLU_DEFAULT_TOL, &N, &frame)) {
+			printf("natural order: nnz(L) = %d, nnz(U) = %d\n", N.L.nnz, N.U.nnz);
+		}
+	}
+
+	// singular
+	{
+		printf("\ntesting singular matrix:\n");
+		float A[3][3] = {{ 0.0f, 2.0f, 1.0f},
+			{0.0f, 0.0f, 0.0f}, 
+			{2.0f, 1.0f, 1.0f}};
+		float b[3][1] = {1.0f, 1.0f, 1.0f};
+		fmatrix mat = create_fmatrix(3, 3, A, &frame);
+		fmatrix vec = create_fmatrix(3, 1, b, &frame);
+		fmatrix x = fspmatrix_LU_solve(fspmatrix_create_csc(mat, &frame), vec, &frame);
+		printf("x.matrix is %s\n", x.matrix == NULL ? "NULL" : "not NULL");
+	}
+
+	free_pool(&frame);
+}
+
+// y = Ax for the 1D laplacian (2 on the diagonal, -1 beside it), without storing A
+static void apply_laplacian_1d(void* context, const float* x, float* y) {
+	int n = *(int*)context;
+	for (int i = 0; i < n; i++) {
+		y[i] = 2.0f * x[i];
+		if (i > 0) { y[i] -= x[i - 1]; }
+		if (i < n - 1) { y[i] -= x[i + 1]; }
+	}
+}
+
+void test_iterative_solvers() {
+	pool frame = create_pool(128000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	// 2D laplacian on a 6 x 6 grid, with a convection term on the second copy so it isn't symmetric
+	int g = 6, n = g * g;
+	fmatrix mat = fmatrix_create_zero(n, n, &frame);
+	fmatrix nonsym = fmatrix_create_zero(n, n, &frame);
+	for (int r = 0; r < g; r++) {
+		for (int c = 0; c < g; c++) {
+			int i = r * g + c;
+			mat.matrix[i * n + i] = 4.0f;
+			if (r > 0) { mat.matrix[i * n + i - g] = -1.0f; }
+			if (r < g - 1) { mat.matrix[i * n + i + g] = -1.0f; }
+			if (c > 0) { mat.matrix[i * n + i - 1] = -1.0f; }
+			if (c < g - 1) { mat.matrix[i * n + i + 1] = -1.0f; }
+		}
+	}
+	for (int i = 0; i < n * n; i++) { nonsym.matrix[i] = mat.matrix[i]; }
+	for (int i = 1; i < n; i++) { nonsym.matrix[i * n + i - 1] -= 0.5f; }
+
+	fmatrix b = fmatrix_create_zero(n, 1, &frame);
+	for (int i = 0; i < n; i++) { b.matrix[i] = (float)(i % 5) - 2.0f; }
+	fmatrix x = fmatrix_create_zero(n, 1, &frame);
+	fmatrix Ax = fmatrix_create_zero(n, 1, &frame);
+
+	fspmatrix S = fspmatrix_create_csr(mat, &frame);
+	fspmatrix N = fspmatrix_create_csc(nonsym, &frame);
+
+	// the same CSR as S, but with every row listed right to left
+	int* reversed_index = raw_pool_alloc(&frame, S.nnz * sizeof(int));
+	float* reversed_values = raw_pool_alloc(&frame, S.nnz * sizeof(float));
+	for (int i = 0; i < n; i++) {
+		for (int p = S.ptr[i]; p < S.ptr[i + 1]; p++) {
+			int q = S.ptr[i + 1] - 1 - (p - S.ptr[i]);
+			reversed_index[q] = S.index[p];
+			reversed_values[q] = S.values[p];
+		}
+	}
+	fspmatrix R = create_fspmatrix(n, n, S.nnz, S.ptr, reversed_index, reversed_values, &frame);
+
+	struct {
+		const char* name;
+		linear_operator A;
+		int method;				// 0 cg, 1 bicgstab, 2 gmres
+		int precond;			// 0 none, 1 jacobi, 2 ilu0
+	} cases[] = {
+		{ "cg, dense, none", operator_from_fmatrix(mat), 0, 0 },
+		{ "cg, sparse, jacobi", operator_from_fspmatrix(S), 0, 1 },
+		{ "cg, sparse, ilu0", operator_from_fspmatrix(S), 0, 2 },
+		{ "cg, unsorted, ilu0", operator_from_fspmatrix(R), 0, 2 },
+		{ "bicgstab, sparse, none", operator_from_fspmatrix(N), 1, 0 },
+		{ "bicgstab, sparse, ilu0", operator_from_fspmatrix(N), 1, 2 },
+		{ "gmres(10), dense, none", operator_from_fmatrix(nonsym), 2, 0 },
+		{ "gmres(10), sparse, ilu0", operator_from_fspmatrix(N), 2, 2 },
+	};
+
+	for (int t = 0; t < (int)(sizeof(cases) / sizeof(cases[0])); t++) {
+		void* start = frame.ptr;
+		preconditioner M = cases[t].precond == 1 ? preconditioner_jacobi(cases[t].A, &frame) :
+			cases[t].precond == 2 ? preconditioner_ilu0(cases[t].A, &frame) : preconditioner_none(n);
+
+		for (int i = 0; i < n; i++) { x.matrix[i] = 0.0f; }
+		krylov_result info;
+		if (cases[t].method == 0) { info = krylov_cg(cases[t].A, M, b, x, 100, 1e-6f, &frame); }
+		else if (cases[t].method == 1) { info = krylov_bicgstab(cases[t].A, M, b, x, 100, 1e-6f, &frame); }
+		else { info = krylov_gmres(cases[t].A, M, b, x, 10, 200, 1e-6f, &frame); }
+
+		// check the answer against the operator itself, not the solver's estimate
+		operator_apply_in(cases[t].A, x.matrix, Ax.matrix);
+		float residual = 0.0f;
+		for (int i = 0; i < n; i++) { residual = fmaxf(residual, fabsf(Ax.matrix[i] - b.matrix[i])); }
+		printf("%-24s converged = %d, iterations = %3d, max residual = %g\n", cases[t].name, info.converged, info.iterations, residual);
+		pool_free_from(&frame, start);
+	}
+
+	// matrix free
+	{
+		int size = 50;
+		fmatrix rhs = fmatrix_create_zero(size, 1, &frame);
+		fmatrix sol = fmatrix_create_zero(size, 1, &frame);
+		for (int i = 0; i < size; i++) { rhs.matrix[i] = 1.0f; }
+		linear_operator op = operator_from_callback(size, apply_laplacian_1d, &size);
+		krylov_result info = krylov_cg(op, preconditioner_none(size), rhs, sol, 100, 1e-6f, &frame);
+		// exact solution is x_i = (i + 1)(size - i) / 2
+		printf("callback cg: converged = %d, iterations = %d, x[0] = %g (expected 25), x[24] = %g (expected 325)\n",
+			info.converged, info.iterations, sol.matrix[0], sol.matrix[24]);
+	}
+
+	free_pool(&frame);
+}
+
+void test_cholesky() {
+	pool frame = create_pool(512000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	// small example with a known factor: L = {{2, 0, 0}, {6, 1, 0}, {-8, 5, 3}}
+	{
+		float A[3][3] = {{4.0f, 12.0f, -16.0f},
+			{12.0f, 37.0f, -43.0f},
+			{-16.0f, -43.0f, 98.0f}};
+		float B[3][2] = {{1.0f, 0.0f}, {2.0f, 1.0f}, {3.0f, 0.0f}};
+		fmatrix mat = create_fmatrix(3, 3, A, &frame);
+		fmatrix rhs = create_fmatrix(3, 2, B, &frame);
+
+		fmatrix L = fmatrix_cholesky_factorize(mat, &frame);
+		printf("L (packed lower: %d, %d floats):\n", L.kind == FMATRIX_LOWER, fmatrix_stored_count(L));
+		print_fmatrix(L);
+		fmatrix X = fmatrix_cholesky_solve(L, rhs, &frame);
+		printf("X (two right hand sides):\n");
+		print_fmatrix(X);
+		printf("AX:\n");
+		print_fmatrix(fmatrix_multiply(mat, X, &frame));
+	}
+
+	// not positive definite
+	{
+		float A[2][2] = {{1.0f, 2.0f}, {2.0f, 1.0f}};
+		fmatrix mat = create_fmatrix(2, 2, A, &frame);
+		printf("\nindefinite matrix:\n");
+		fmatrix L = fmatrix_cholesky_factorize(mat, &frame);
+		printf("L.matrix is %s\n", L.matrix == NULL ? "NULL" : "not NULL");
+		// LU_solve should quietly fall back to LU
+		float b[2][1] = {3.0f, 3.0f};
+		printf("LU_solve fallback x:\n");
+		print_fmatrix(fmatrix_LU_solve(mat, create_fmatrix(2, 1, b, &frame), &frame));
+	}
+
+	// larger system spanning several blocks: A = M^t M + nI
+	{
+		int n = 100;
+		fmatrix M = fmatrix_create_zero(n, n, &frame);
+		for (int i = 0; i < n * n; i++) { M.matrix[i] = (float)((i * 7919) % 13) / 13.0f - 0.5f; }
+		fmatrix Mt = M;
+		fmatrix_transpose_in(&Mt);
+		fmatrix A = fmatrix_multiply(Mt, M, &frame);
+		for (int i = 0; i < n; i++) { A.matrix[i * n + i] += (float)n; }
+		fmatrix b = fmatrix_create_zero(n, 1, &frame);
+		for (int i = 0; i < n; i++) { b.matrix[i] = (float)(i % 7) - 3.0f; }
+
+		void* start = frame.ptr;
+		fmatrix x = fmatrix_SPD_solve(A, b, &frame);
+		fmatrix Ax = fmatrix_multiply(A, x, &frame);
+		float residual = 0.0f;
+		for (int i = 0; i < n; i++) { residual = fmaxf(residual, fabsf(Ax.matrix[i] - b.matrix[i])); }
+		printf("\n100 x 100 SPD solve: symmetric = %d, max residual = %g\n", fmatrix_is_symmetric(A), residual);
+		pool_free_from(&frame, start);
+
+		// in place factor, then reuse it
+		fmatrix L = fmatrix_copy_alloc(A, &frame);
+		if (fmatrix_cholesky_factorize_in(L)) {
+			fmatrix LLt = fmatrix_multiply(L, fmatrix_transpose(L, &frame), &frame);
+			float error = 0.0f;
+			for (int i = 0; i < n * n; i++) { error = fmaxf(error, fabsf(LLt.matrix[i] - A.matrix[i])); }
+			printf("max |LL^t - A| = %g\n", error);
+		}
+	}
+
+	// big enough for the panel and trailing updates to be split across threads. The result can't depend on how many there are
+	{
+		int n = 300;
+		pool big = create_pool(4 * n * n * sizeof(float) + 1024);
+		if (big.start == NULL) {
+			exit(1);
+		}
+		fmatrix A = fmatrix_create_zero(n, n, &big);
+		for (int i = 0; i < n; i++) {
+			for (int j = 0; j <= i; j++) {
+				float value = (i == j) ? (float)n : 0.5f * sinf(0.3f * i + 0.7f * j);
+				A.matrix[i * n + j] = value;
+				A.matrix[j * n + i] = value;
+			}
+		}
+		parallel_set_threads(4);
+		fmatrix L = fmatrix_cholesky_factorize(A, &big);
+		parallel_set_threads(1);
+		fmatrix L_serial = fmatrix_cholesky_factorize(A, &big);
+		parallel_set_threads(0);
+		int same = L.matrix != NULL && L_serial.matrix != NULL;
+		for (int i = 0; same && i < fmatrix_stored_count(L); i++) { same = L.matrix[i] == L_serial.matrix[i]; }
+		fmatrix x = fmatrix_cholesky_solve(L, fmatrix_ncol_copy_alloc(A, 1, &big), &big);
+		float error = 0.0f;
+		for (int i = 0; i < n; i++) { error = fmaxf(error, fabsf(x.matrix[i] - (i == 0 ? 1.0f : 0.0f))); }
+		printf("300 x 300 threaded cholesky: same as serial: %d, A^-1 (column 0 of A) error %s\n", same, error < 1e-5f ? "< 1e-5" : "too large");
+		free_pool(&big);
+	}
+
+	free_pool(&frame);
+}
+
+void test_QR() {
+	pool frame = create_pool(2000000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	// small example
+	{
+		float A[4][3] = {{1.0f, -1.0f, 4.0f},
+			{1.0f, 4.0f, -2.0f},
+			{1.0f, 4.0f, 2.0f},
+			{1.0f, -1.0f, 0.0f}};
+		fmatrix mat = create_fmatrix(4, 3, A, &frame);
+		fqr F = fmatrix_QR_factorize(mat, &frame);
+		fmatrix Q = fqr_Q(F, &frame);
+		fmatrix R = fqr_R(F, &frame);
+		printf("Q:\n");
+		print_fmatrix(Q);
+		printf("R:\n");
+		print_fmatrix(R);
+		printf("QR:\n");
+		print_fmatrix(fmatrix_multiply(Q, R, &frame));
+	}
+
+	// several panels, so the block reflectors get used
+	{
+		int m = 90, n = 70;
+		fmatrix mat = fmatrix_create_zero(m, n, &frame);
+		for (int i = 0; i < m * n; i++) { mat.matrix[i] = (float)((i * 7919) % 23) / 23.0f - 0.5f; }
+		fqr F = fmatrix_QR_factorize(mat, &frame);
+		fmatrix QR = fmatrix_multiply(fqr_Q(F, &frame), fqr_R(F, &frame), &frame);
+		float error = 0.0f;
+		for (int i = 0; i < m * n; i++) { error = fmaxf(error, fabsf(QR.matrix[i] - mat.matrix[i])); }
+
+		// Q^t Q should be I
+		fmatrix Q = fqr_Q(F, &frame);
+		fmatrix Qt = Q;
+		fmatrix_transpose_in(&Qt);
+		fmatrix QtQ = fmatrix_multiply(Qt, Q, &frame);
+		float orthogonality = 0.0f;
+		for (int i = 0; i < n; i++) {
+			for (int j = 0; j < n; j++) { orthogonality = fmaxf(orthogonality, fabsf(QtQ.matrix[i * n + j] - (i == j))); }
+		}
+		printf("\n90 x 70: max |QR - A| = %g, max |Q^tQ - I| = %g\n", error, orthogonality);
+	}
+
+	// tall skinny least squares with a known answer (b = Ax exactly)
+	{
+		int m = 2000, n = 6;
+		fmatrix A = fmatrix_create_zero(m, n, &frame);
+		fmatrix b = fmatrix_create_zero(m, 1, &frame);
+		float x_true[6] = {1.0f, -2.0f, 0.5f, 3.0f, 0.0f, -1.0f};
+		for (int i = 0; i < m; i++) {
+			float t = (float)i / m;
+			float value = 1.0f;
+			for (int j = 0; j < n; j++) {
+				A.matrix[i * n + j] = value;		// polynomial fit
+				b.matrix[i] += value * x_true[j];
+				value *= t;
+			}
+		}
+		fmatrix x = fmatrix_least_squares(A, b, &frame);
+		printf("\nleast squares polynomial fit (expected 1, -2, 0.5, 3, 0, -1):\n");
+		print_fmatrix(x);
+
+		// R from TSQR matches R from the full factorization, up to the signs of its rows
+		fmatrix R1 = fmatrix_TSQR(A, 100, &frame);
+		fmatrix R2 = fqr_R(fmatrix_QR_factorize(A, &frame), &frame);
+		float difference = 0.0f;
+		for (int i = 0; i < n; i++) {
+			float sign = (R1.matrix[i * n + i] * R2.matrix[i * n + i] < 0.0f) ? -1.0f : 1.0f;
+			for (int j = 0; j < n; j++) {
+				difference = fmaxf(difference, fabsf(R1.matrix[i * n + j] - sign * R2.matrix[i * n + j]) / fabsf(R2.matrix[i * n + i]));
+			}
+		}
+		printf("TSQR vs QR: max relative difference in R = %g\n", difference);
+	}
+
+	// big enough for the trailing updates and the TSQR stripes to be split across threads. The result can't depend on how many
+	{
+		pool big = create_pool(4000000);
+		if (big.start == NULL) {
+			exit(1);
+		}
+		int m = 240, n = 200;
+		fmatrix A = fmatrix_create_zero(m, n, &big);
+		for (int i = 0; i < m * n; i++) { A.matrix[i] = sinf(0.37f * i) + cosf(0.011f * i); }
+		fmatrix T = fmatrix_create_zero(20000, 8, &big);
+		for (int i = 0; i < 20000 * 8; i++) { T.matrix[i] = sinf(0.73f * i); }
+
+		parallel_set_threads(4);
+		fqr F = fmatrix_QR_factorize(A, &big);
+		fmatrix R = fmatrix_TSQR(T, 0, &big);
+		parallel_set_threads(1);
+		fqr F_serial = fmatrix_QR_factorize(A, &big);
+		fmatrix R_serial = fmatrix_TSQR(T, 0, &big);
+		parallel_set_threads(0);
+		int same = 1;
+		for (int i = 0; i < m * n; i++) { same &= F.QR.matrix[i] == F_serial.QR.matrix[i]; }
+		for (int i = 0; i < 8 * 8; i++) { same &= R.matrix[i] == R_serial.matrix[i]; }
+		printf("threaded QR and TSQR: same as serial: %d\n", same);
+		free_pool(&big);
+	}
+
+	free_pool(&frame);
+}
+
+void test_subspaces() {
+	pool frame = create_pool(64000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	// rank 2: the third column is the first plus the second, and the fourth row is the first minus the second
+	float A[4][3] = {{1.0f, 2.0f, 3.0f},
+		{4.0f, 5.0f, 9.0f},
+		{7.0f, 8.0f, 15.0f},
+		{-3.0f, -3.0f, -6.0f}};
+	fmatrix mat = create_fmatrix(4, 3, A, &frame);
+	fsubspaces S = fmatrix_subspaces(mat, 0.0f, SUBSPACE_ALL, &frame);
+	printf("rank: %d\n", S.rank);
+	printf("column space (%d x %d):\n", S.col.m, S.col.n);
+	print_fmatrix(S.col);
+	printf("row space (%d x %d):\n", S.row.m, S.row.n);
+	print_fmatrix(S.row);
+	printf("null space (%d x %d):\n", S.null.m, S.null.n);
+	print_fmatrix(S.null);
+	printf("left null space (%d x %d):\n", S.left_null.m, S.left_null.n);
+	print_fmatrix(S.left_null);
+
+	// A N = 0 and N_left^t A = 0
+	printf("A * null space:\n");
+	print_fmatrix(fmatrix_multiply(mat, S.null, &frame));
+	fmatrix left_t = S.left_null;
+	fmatrix_transpose_in(&left_t);
+	printf("left null space^t * A:\n");
+	print_fmatrix(fmatrix_multiply(left_t, mat, &frame));
+
+	free_pool(&frame);
+}
+
+// max |AV - V diag(values)| and max |V^tV - I| for an eigendecomposition of A
+static void check_eigen(fmatrix A, fsymeig E, pool* frame) {
+	void* start = frame->ptr;
+	int n = E.n, k = E.count;
+	fmatrix AV = fmatrix_multiply(A, E.vectors, frame);
+	float residual = 0.0f;
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j < k; j++) {
+			residual = fmaxf(residual, fabsf(AV.matrix[i * k + j] - E.values[j] * E.vectors.matrix[i * k + j]));
+		}
+	}
+	fmatrix Vt = E.vectors;
+	fmatrix_transpose_in(&Vt);
+	fmatrix VtV = fmatrix_multiply(Vt, E.vectors, frame);
+	float orthogonality = 0.0f;
+	for (int i = 0; i < k; i++) {
+		for (int j = 0; j < k; j++) { orthogonality = fmaxf(orthogonality, fabsf(VtV.matrix[i * k + j] - (i == j))); }
+	}
+	printf("max |AV - V diag(values)| = %g, max |V^tV - I| = %g\n", residual, orthogonality);
+	pool_free_from(frame, start);
+}
+
+void test_symmetric_eigen() {
+	pool frame = create_pool(4000000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	// eigenvalues 2 - sqrt(2), 2, 2 + sqrt(2)
+	{
+		float A[3][3] = {{2.0f, -1.0f, 0.0f},
+			{-1.0f, 2.0f, -1.0f},
+			{0.0f, -1.0f, 2.0f}};
+		fmatrix mat = create_fmatrix(3, 3, A, &frame);
+		fsymeig E = fmatrix_symmetric_eigen(mat, 1, 0, -1, &frame);
+		printf("eigenvalues: %f %f %f\n", E.values[0], E.values[1], E.values[2]);
+		printf("eigenvectors:\n");
+		print_fmatrix(E.vectors);
+	}
+
+	// 1D laplacian, eigenvalues 2 - 2cos(k pi / (n + 1)). Big enough for divide and conquer to split a few times
+	{
+		int n = 120;
+		fmatrix mat = fmatrix_create_zero(n, n, &frame);
+		for (int i = 0; i < n; i++) {
+			mat.matrix[i * n + i] = 2.0f;
+			if (i > 0) { mat.matrix[i * n + i - 1] = mat.matrix[(i - 1) * n + i] = -1.0f; }
+		}
+		// shuffle it with a householder reflection, so it isn't tridiagonal already
+		fmatrix v = fmatrix_create_zero(n, 1, &frame);
+		float vv = 0.0f;
+		for (int i = 0; i < n; i++) { v.matrix[i] = (float)((i * 37) % 11) - 5.0f; vv += v.matrix[i] * v.matrix[i]; }
+		fmatrix H = fmatrix_create_identity(n, n, &frame);
+		for (int i = 0; i < n; i++) {
+			for (int j = 0; j < n; j++) { H.matrix[i * n + j] -= 2.0f * v.matrix[i] * v.matrix[j] / vv; }
+		}
+		fmatrix A = fmatrix_multiply(fmatrix_multiply(H, mat, &frame), H, &frame);
+
+		printf("\n120 x 120 laplacian, divide and conquer:\n");
+		fsymeig E = fmatrix_symmetric_eigen(A, 1, 0, -1, &frame);
+		float error = 0.0f;
+		for (int k = 0; k < n; k++) { error = fmaxf(error, fabsf(E.values[k] - (2.0f - 2.0f * cosf((k + 1) * 3.14159265f / (n + 1))))); }
+		printf("max eigenvalue error = %g\n", error);
+		check_eigen(A, E, &frame);
+
+		printf("eigenvalues only:\n");
+		fsymeig values = fmatrix_symmetric_eigen(A, 0, 0, -1, &frame);
+		error = 0.0f;
+		for (int k = 0; k < n; k++) { error = fmaxf(error, fabsf(values.values[k] - E.values[k])); }
+		printf("max difference from divide and conquer = %g\n", error);
+
+		printf("5 largest, with vectors:\n");
+		fsymeig top = fmatrix_symmetric_eigen(A, 1, n - 5, n - 1, &frame);
+		printf("%f %f %f %f %f\n", top.values[0], top.values[1], top.values[2], top.values[3], top.values[4]);
+		check_eigen(A, top, &frame);
+	}
+
+	// I + uu^t: one eigenvalue of 1 + |u|^2, and 1 repeated, so most of the merge deflates
+	{
+		int n = 80;
+		fmatrix A = fmatrix_create_identity(n, n, &frame);
+		for (int i = 0; i < n; i++) {
+			for (int j = 0; j < n; j++) { A.matrix[i * n + j] += 0.01f * (float)((i % 7) * (j % 7)); }
+		}
+		float uu = 0.0f;
+		for (int i = 0; i < n; i++) { uu += 0.01f * (float)((i % 7) * (i % 7)); }
+		printf("\nrepeated eigenvalues (expected 1 and %f):\n", 1.0f + uu);
+		fsymeig E = fmatrix_symmetric_eigen(A, 1, 0, -1, &frame);
+		printf("smallest = %f, second largest = %f, largest = %f\n", E.values[0], E.values[n - 2], E.values[n - 1]);
+		check_eigen(A, E, &frame);
+
+		printf("3 smallest by inverse iteration:\n");
+		fsymeig low = fmatrix_symmetric_eigen(A, 1, 0, 2, &frame);
+		check_eigen(A, low, &frame);
+	}
+
+	// big enough for the reduction, the merges and the back transformation to be split across threads. The result can't depend
+	// on how many there are
+	{
+		int n = 320;
+		pool big = create_pool(8000000);
+		if (big.start == NULL) {
+			exit(1);
+		}
+		fmatrix A = fmatrix_create_zero(n, n, &big);
+		for (int i = 0; i < n; i++) {
+			for (int j = 0; j <= i; j++) {
+				float value = (i == j) ? 2.0f + 0.01f * i : 0.1f * sinf(0.3f * i + 0.7f * j);
+				A.matrix[i * n + j] = value;
+				A.matrix[j * n + i] = value;
+			}
+		}
+		parallel_set_threads(4);
+		fsymeig E = fmatrix_symmetric_eigen(A, 1, 0, -1, &big);
+		parallel_set_threads(1);
+		fsymeig E_serial = fmatrix_symmetric_eigen(A, 1, 0, -1, &big);
+		parallel_set_threads(0);
+		int same = E.vectors.matrix != NULL && E_serial.vectors.matrix != NULL;
+		for (int i = 0; same && i < n; i++) { same = E.values[i] == E_serial.values[i]; }
+		for (int i = 0; same && i < n * n; i++) { same = E.vectors.matrix[i] == E_serial.vectors.matrix[i]; }
+		printf("\n320 x 320 threaded eigensolver: same as serial: %d\n", same);
+		check_eigen(A, E, &big);
+		free_pool(&big);
+	}
+
+	free_pool(&frame);
+}
+
+// max |A - U diag(values) V^t| for the first k singular triplets, and max |U^tU - I|, |V^tV - I|
+static void check_svd(fmatrix A, fsvd S, pool* frame) {
+	void* start = frame->ptr;
+	fmatrix US = fmatrix_copy_alloc(S.U, frame);
+	for (int j = 0; j < S.k; j++) { fmatrix_col_scale_in(US, j, S.values[j]); }
+	for (int j = S.k; j < US.n; j++) { fmatrix_col_scale_in(US, j, 0.0f); }
+	fmatrix Vt = S.V;
+	fmatrix_transpose_in(&Vt);
+	if (US.n > Vt.m) { US = fmatrix_ncol_copy_alloc(US, Vt.m, frame); }
+	if (Vt.m > US.n) {
+		// full V with a thin U: only the first k rows of V^t matter
+		fmatrix V = fmatrix_ncol_copy_alloc(S.V, US.n, frame);
+		Vt = V;
+		fmatrix_transpose_in(&Vt);
+	}
+	fmatrix USVt = fmatrix_multiply(US, Vt, frame);
+	float error = 0.0f;
+	for (int i = 0; i < A.m; i++) {
+		for (int j = 0; j < A.n; j++) { error = fmaxf(error, fabsf(MATRIX_AT(USVt, i, j) - MATRIX_AT(A, i, j))); }
+	}
+
+	float orthogonality = 0.0f;
+	fmatrix factors[2] = { S.U, S.V };
+	for (int f = 0; f < 2; f++) {
+		fmatrix Ft = factors[f];
+		fmatrix_transpose_in(&Ft);
+		fmatrix FtF = fmatrix_multiply(Ft, factors[f], frame);
+		for (int i = 0; i < FtF.m; i++) {
+			for (int j = 0; j < FtF.n; j++) { orthogonality = fmaxf(orthogonality, fabsf(MATRIX_AT(FtF, i, j) - (i == j))); }
+		}
+	}
+	printf("U is %d x %d, V is %d x %d, max |A - USV^t| = %g, max orthogonality error = %g\n",
+		S.U.m, S.U.n, S.V.m, S.V.n, error, orthogonality);
+	pool_free_from(frame, start);
+}
+
+void test_svd() {
+	pool frame = create_pool(4000000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	// singular values are 5 and 3
+	{
+		float A[2][3] = {{3.0f, 2.0f, 2.0f},
+			{2.0f, 3.0f, -2.0f}};
+		fmatrix mat = create_fmatrix(2, 3, A, &frame);
+		fsvd S = fmatrix_svd(mat, 1, 0, 0.0f, &frame);
+		printf("singular values: %f %f (%d sweeps)\n", S.values[0], S.values[1], S.sweeps);
+		check_svd(mat, S, &frame);
+		fmatrix_transpose_in(&mat);
+		printf("transpose, thin:\n");
+		check_svd(mat, fmatrix_svd(mat, 1, 1, 0.0f, &frame), &frame);
+	}
+
+	// ill conditioned
+	{
+		int m = 60, n = 40;
+		fmatrix A = fmatrix_create_zero(m, n, &frame);
+		for (int i = 0; i < m; i++) {
+			for (int j = 0; j < n; j++) {
+				A.matrix[i * n + j] = sinf(0.1f * i) * cosf(0.2f * j) + 0.5f * (float)((i + j) % 3) + 0.01f * (float)(i == j);
+			}
+		}
+		printf("\n60 x 40:\n");
+		fsvd S = fmatrix_svd(A, 1, 1, 0.0f, &frame);
+		printf("largest = %f, smallest = %f, condition = %f, sweeps = %d\n", S.values[0], S.values[S.k - 1], S.values[0] / S.values[S.k - 1], S.sweeps);
+		check_svd(A, S, &frame);
+		printf("full:\n");
+		check_svd(A, fmatrix_svd(A, 1, 0, 0.0f, &frame), &frame);
+
+		fsvd loose = fmatrix_svd(A, 0, 1, 1e-3f, &frame);
+		printf("tolerance 1e-3: %d sweeps, largest = %f\n", loose.sweeps, loose.values[0]);
+	}
+
+	// rank deficient, so U gets completed
+	{
+		float A[4][3] = {{1.0f, 2.0f, 3.0f},
+			{2.0f, 4.0f, 6.0f},
+			{1.0f, 0.0f, 1.0f},
+			{0.0f, 0.0f, 0.0f}};
+		fmatrix mat = create_fmatrix(4, 3, A, &frame);
+		printf("\nrank 2:\n");
+		fsvd S = fmatrix_svd(mat, 1, 1, 0.0f, &frame);
+		printf("singular values: %f %f %f\n", S.values[0], S.values[1], S.values[2]);
+		check_svd(mat, S, &frame);
+	}
+
+	// tall enough for the pairs of each round to be split across threads. The result can't depend on how many there are
+	{
+		int m = 600, n = 120;
+		pool big = create_pool(4000000);
+		if (big.start == NULL) {
+			exit(1);
+		}
+		fmatrix A = fmatrix_create_zero(m, n, &big);
+		for (int i = 0; i < m * n; i++) { A.matrix[i] = sinf(0.37f * i) + cosf(0.011f * i); }
+		parallel_set_threads(4);
+		fsvd S = fmatrix_svd(A, 1, 1, 0.0f, &big);
+		parallel_set_threads(1);
+		fsvd S_serial = fmatrix_svd(A, 1, 1, 0.0f, &big);
+		parallel_set_threads(0);
+		int same = S.values != NULL && S_serial.values != NULL && S.sweeps == S_serial.sweeps;
+		for (int i = 0; same && i < n; i++) { same = S.values[i] == S_serial.values[i]; }
+		for (int i = 0; same && i < m * n; i++) { same = S.U.matrix[i] == S_serial.U.matrix[i]; }
+		for (int i = 0; same && i < n * n; i++) { same = S.V.matrix[i] == S_serial.V.matrix[i]; }
+		printf("\n600 x 120 threaded jacobi: same as serial: %d\n", same);
+		check_svd(A, S, &big);
+		free_pool(&big);
+	}
+
+	free_pool(&frame);
+}
+
+// A x and A^t x for a dense matrix, standing in for an operator that isn't stored
+static void rsvd_apply(void* context, const float* x, float* y) {
+	fmatrix* A = context;
+	for (int i = 0; i < A->m; i++) {
+		float sum = 0.0f;
+		for (int j = 0; j < A->n; j++) { sum += MATRIX_AT((*A), i, j) * x[j]; }
+		y[i] = sum;
+	}
+}
+
+static void rsvd_apply_transpose(void* context, const float* x, float* y) {
+	fmatrix* A = context;
+	for (int j = 0; j < A->n; j++) {
+		float sum = 0.0f;
+		for (int i = 0; i < A->m; i++) { sum += MATRIX_AT((*A), i, j) * x[i]; }
+		y[j] = sum;
+	}
+}
+
+void test_randomized_svd() {
+	pool frame = create_pool(8000000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	// singular values decay geometrically
+	int m = 300, n = 200, k = 5;
+	fmatrix A = fmatrix_create_zero(m, n, &frame);
+	for (int r = 0; r < 30; r++) {
+		float scale = powf(0.6f, (float)r);
+		for (int i = 0; i < m; i++) {
+			for (int j = 0; j < n; j++) {
+				A.matrix[i * n + j] += scale * sinf(0.013f * (r + 1) * i + r) * cosf(0.021f * (r + 2) * j + 0.5f * r);
+			}
+		}
+	}
+
+	fsvd exact = fmatrix_svd(A, 0, 1, 0.0f, &frame);
+	fsvd fast = fmatrix_randomized_svd(svd_operator_from_fmatrix(A), k, 2, 42, &frame);
+	fsvd again = fmatrix_randomized_svd(svd_operator_from_fmatrix(A), k, 2, 42, &frame);
+	fsvd callback = fmatrix_randomized_svd(svd_operator_from_callback(m, n, rsvd_apply, rsvd_apply_transpose, &A), k, 2, 42, &frame);
+	printf("exact vs randomized singular values:\n");
+	for (int j = 0; j < k; j++) {
+		printf("%f %f\n", exact.values[j], fast.values[j]);
+	}
+	int same = 1;
+	for (int j = 0; j < k; j++) { same &= (fast.values[j] == again.values[j]); }
+	float difference = 0.0f;
+	for (int j = 0; j < k; j++) { difference = fmaxf(difference, fabsf(fast.values[j] - callback.values[j])); }
+	printf("same seed reproduces: %d, dense vs callback max difference = %g\n", same, difference);
+
+	// residual of the top triplet: |A v - s u|
+	float residual = 0.0f;
+	for (int i = 0; i < m; i++) {
+		float sum = 0.0f;
+		for (int j = 0; j < n; j++) { sum += A.matrix[i * n + j] * MATRIX_AT(fast.V, j, 0); }
+		residual = fmaxf(residual, fabsf(sum - fast.values[0] * MATRIX_AT(fast.U, i, 0)));
+	}
+	printf("max |A v - s u| for the top triplet = %g\n", residual);
+
+	free_pool(&frame);
+}
+
+void test_dmatrix() {
+	pool frame = create_pool(400000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	// the hilbert matrix is famously ill conditioned (about 1e10 at this size), so float LU loses most digits while double keeps plenty
+	int n = 8;
+	dmatrix H = dmatrix_create_zero(n, n, &frame);
+	dmatrix ones = dmatrix_create_zero(n, 1, &frame);
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j < n; j++) { H.matrix[i * n + j] = 1.0 / (i + j + 1); }
+		ones.matrix[i] = 1.0;
+	}
+	dmatrix b = dmatrix_multiply(H, ones, &frame);
+
+	fmatrix Hf = dmatrix_to_fmatrix(H, &frame);
+	fmatrix bf = dmatrix_to_fmatrix(b, &frame);
+	fmatrix xf = fmatrix_LU_solve(Hf, bf, &frame);
+	dmatrix xd = dmatrix_LU_solve(H, b, &frame);
+	double float_error = 0.0, double_error = 0.0;
+	for (int i = 0; i < n; i++) {
+		float_error = fmax(float_error, fabs(xf.matrix[i] - 1.0));
+		double_error = fmax(double_error, fabs(xd.matrix[i] - 1.0));
+	}
+	printf("hilbert %d x %d, x should be all ones\nfloat max error = %g, double max error = %g\n", n, n, float_error, double_error);
+
+	// transpose flags survive the conversion, and the kernels read them the same way
+	float values[2][3] = {{1, 2, 3}, {4, 5, 6}};
+	fmatrix A = create_fmatrix(2, 3, values, &frame);
+	fmatrix_transpose_in(&A);
+	dmatrix Ad = fmatrix_to_dmatrix(A, &frame);
+	dmatrix AtA = dmatrix_multiply(Ad, dmatrix_transpose(Ad, &frame), &frame);
+	printf("\nA^t as double:\n");
+	print_dmatrix(Ad);
+	printf("A^t A:\n");
+	print_dmatrix(AtA);
+
+	free_pool(&frame);
+}
+
+void test_mixed_precision() {
+	pool frame = create_pool(400000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	// diagonally dominant, not symmetric, with x = 1, 2, 3, ...
+	int n = 60;
+	dmatrix A = dmatrix_create_zero(n, n, &frame);
+	dmatrix x_true = dmatrix_create_zero(n, 1, &frame);
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j < n; j++) { A.matrix[i * n + j] = sin(0.7 * i + 1.3 * j) + ((i == j) ? n : 0.0); }
+		x_true.matrix[i] = i + 1;
+	}
+	dmatrix b = dmatrix_multiply(A, x_true, &frame);
+
+	int steps;
+	dmatrix x = dmatrix_mixed_LU_solve(A, b, &steps, &frame);
+	fmatrix xf = fmatrix_LU_solve(dmatrix_to_fmatrix(A, &frame), dmatrix_to_fmatrix(b, &frame), &frame);
+	double mixed_error = 0.0, float_error = 0.0;
+	for (int i = 0; i < n; i++) {
+		mixed_error = fmax(mixed_error, fabs(x.matrix[i] - x_true.matrix[i]) / x_true.matrix[i]);
+		float_error = fmax(float_error, fabs(xf.matrix[i] - x_true.matrix[i]) / x_true.matrix[i]);
+	}
+	printf("%d x %d: %d refinement steps\nmax relative error: float LU = %g, mixed precision = %g\n", n, n, steps, float_error, mixed_error);
+
+	// hilbert matrix: too ill conditioned for the float factors, so it falls back to a double solve
+	int h = 11;
+	dmatrix H = dmatrix_create_zero(h, h, &frame);
+	dmatrix ones = dmatrix_create_zero(h, 1, &frame);
+	for (int i = 0; i < h; i++) {
+		for (int j = 0; j < h; j++) { H.matrix[i * h + j] = 1.0 / (i + j + 1); }
+		ones.matrix[i] = 1.0;
+	}
+	dmatrix xh = dmatrix_mixed_LU_solve(H, dmatrix_multiply(H, ones, &frame), &steps, &frame);
+	double hilbert_error = 0.0;
+	for (int i = 0; i < h; i++) { hilbert_error = fmax(hilbert_error, fabs(xh.matrix[i] - 1.0)); }
+	printf("\nhilbert %d x %d: steps = %d (-1 is a double fallback), max error = %g\n", h, h, steps, hilbert_error);
+
+	free_pool(&frame);
+}
+
+void test_half_matrix() {
+	pool frame = create_pool(4000000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	float special[6] = { 1.0f, -2.5f, 65504.0f, 70000.0f, 1e-7f, 3.14159265f };
+	printf("value: fp16, bf16\n");
+	for (int i = 0; i < 6; i++) {
+		printf("%g: %g, %g\n", special[i], half_to_float(float_to_half(special[i], HALF_FP16), HALF_FP16),
+			half_to_float(float_to_half(special[i], HALF_BF16), HALF_BF16));
+	}
+
+	int m = 150, k = 130, n = 90;
+	fmatrix A = fmatrix_create_zero(m, k, &frame);
+	fmatrix B = fmatrix_create_zero(k, n, &frame);
+	for (int i = 0; i < m * k; i++) { A.matrix[i] = sinf(0.37f * i); }
+	for (int i = 0; i < k * n; i++) { B.matrix[i] = cosf(0.11f * i); }
+	fmatrix C = fmatrix_multiply(A, B, &frame);
+
+	half_format formats[2] = { HALF_FP16, HALF_BF16 };
+	const char* names[2] = { "fp16", "bf16" };
+	for (int f = 0; f < 2; f++) {
+		void* start = frame.ptr;
+		hmatrix Ah = fmatrix_to_hmatrix(A, formats[f], &frame);
+		hmatrix Bh = fmatrix_to_hmatrix(B, formats[f], &frame);
+
+		fmatrix back = hmatrix_to_fmatrix(Ah, &frame);
+		float round_trip = 0.0f;
+		for (int i = 0; i < m * k; i++) { round_trip = fmaxf(round_trip, fabsf(back.matrix[i] - A.matrix[i])); }
+
+		// product error relative to the largest element of the float product
+		fmatrix Ch = hmatrix_multiply(Ah, Bh, &frame);
+		float scale = 0.0f, product = 0.0f;
+		for (int i = 0; i < m * n; i++) {
+			scale = fmaxf(scale, fabsf(C.matrix[i]));
+			product = fmaxf(product, fabsf(Ch.matrix[i] - C.matrix[i]));
+		}
+
+		// A^t x through the transposed kernel matches a float multiply
+		fmatrix x = fmatrix_ncol_copy_alloc(A, 1, &frame);
+		hmatrix_transpose_in(&Ah);
+		fmatrix At = hmatrix_to_fmatrix(Ah, &frame);
+		fmatrix y = hmatrix_multiply_vector(Ah, x, &frame);
+		fmatrix y_float = fmatrix_multiply(At, x, &frame);
+		float vector = 0.0f;
+		for (int i = 0; i < k; i++) { vector = fmaxf(vector, fabsf(y.matrix[i] - y_float.matrix[i])); }
+
+		printf("%s: max round trip error = %g, max product error / max |C| = %g, transposed GEMV vs float = %g\n",
+			names[f], round_trip, product / scale, vector);
+		pool_free_from(&frame, start);
+	}
+
+	free_pool(&frame);
+}
+
+void test_quantized_multiply() {
+	pool frame = create_pool(4000000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	int m = 120, k = 200, n = 70;
+	fmatrix A = fmatrix_create_zero(m, k, &frame);
+	fmatrix B = fmatrix_create_zero(k, n, &frame);
+	for (int i = 0; i < m * k; i++) { A.matrix[i] = sinf(0.37f * i) + 0.3f; }		// not centered, so zero points matter
+	for (int i = 0; i < k * n; i++) { B.matrix[i] = cosf(0.11f * i) * (1.0f + (i % n) * 0.05f); }
+	fmatrix C = fmatrix_multiply(A, B, &frame);
+
+	qmatrix Aq = fmatrix_quantize(A, QUANT_PER_ROW, &frame);
+	qmatrix Bq = fmatrix_quantize(B, QUANT_PER_COL, &frame);
+	fmatrix A_back = qmatrix_dequantize(Aq, &frame);
+	float quantization = 0.0f;
+	for (int i = 0; i < m * k; i++) { quantization = fmaxf(quantization, fabsf(A_back.matrix[i] - A.matrix[i])); }
+
+	// the integer product must match a float product of the dequantized operands up to float rounding
+	fmatrix Cq = qmatrix_multiply(Aq, Bq, &frame);
+	fmatrix C_dequantized = fmatrix_multiply(A_back, qmatrix_dequantize(Bq, &frame), &frame);
+	float scale = 0.0f, error = 0.0f, consistency = 0.0f;
+	for (int i = 0; i < m * n; i++) {
+		scale = fmaxf(scale, fabsf(C.matrix[i]));
+		error = fmaxf(error, fabsf(Cq.matrix[i] - C.matrix[i]));
+		consistency = fmaxf(consistency, fabsf(Cq.matrix[i] - C_dequantized.matrix[i]));
+	}
+	printf("max quantization error of A = %g\nmax |Cq - C| / max |C| = %g\nmax |Cq - dequantized product| / max |C| = %g\n",
+		quantization, error / scale, consistency / scale);
+
+	// B stored as B^t (a weight matrix) needs no packing, and gives the same result
+	fmatrix Bt = fmatrix_transpose(B, &frame);
+	fmatrix Bt_rows = fmatrix_ncol_copy_alloc(Bt, Bt.n, &frame);		// B^t, row major
+	qmatrix Wq = fmatrix_quantize(Bt_rows, QUANT_PER_ROW, &frame);
+	qmatrix_transpose_in(&Wq);
+	fmatrix Cw = qmatrix_multiply(Aq, Wq, &frame);
+	float difference = 0.0f;
+	for (int i = 0; i < m * n; i++) { difference = fmaxf(difference, fabsf(Cw.matrix[i] - Cq.matrix[i])); }
+	printf("transposed weights vs packed: max difference = %g\n", difference);
+
+	free_pool(&frame);
+}
+
+void test_log_determinant() {
+	pool frame = create_pool(400000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	// needs a row swap, det = -5
+	float values[3][3] = {{0, 2, 1},
+		{1, 1, 1},
+		{2, 1, 4}};
+	fmatrix A = create_fmatrix(3, 3, values, &frame);
+	flu F = fmatrix_LU_decompose(A, &frame);
+	int sign;
+	float log_det = flu_log_determinant(F, &sign);
+	printf("det = %g, from the same factorization: sign = %d, log|det| = %g (exp = %g)\n", flu_determinant(F), sign, log_det, expf(log_det));
+
+	// the factorization is reused for solves
+	float rhs[3][1] = {{3}, {3}, {7}};
+	fmatrix x = flu_solve(F, create_fmatrix(3, 1, rhs, &frame), &frame);
+	printf("x = %g %g %g (should be 1 1 1)\n", x.matrix[0], x.matrix[1], x.matrix[2]);
+
+	// non square input is reported instead of exiting
+	fmatrix wide = fmatrix_create_zero(2, 3, &frame);
+	printf("non square determinant = %g\n", fmatrix_determinant(wide, &frame));
+
+	// det = 10^200 overflows a float, but its log doesn't
+	int n = 200;
+	fmatrix B = fmatrix_create_zero(n, n, &frame);
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j < n; j++) { B.matrix[i * n + j] = (i == j) ? 10.0f : 0.0f; }
+	}
+	B.matrix[0 * n + 0] = -10.0f;
+	printf("\n200 x 200: det = %g, log|det| = %g (expected %g)", fmatrix_determinant(B, &frame), fmatrix_log_determinant(B, &sign, &frame), 200 * logf(10.0f));
+	printf(", sign = %d\n", sign);
+
+	fmatrix S = fmatrix_create_zero(3, 3, &frame);
+	printf("singular: log|det| = %g\n", fmatrix_log_determinant(S, &sign, &frame));
+	printf("sign = %d\n", sign);
+
+	free_pool(&frame);
+}
+
+// prints max |A Ainv - I|
+static void check_inverse(fmatrix A, fmatrix Ainv, pool* frame) {
+	void* start = frame->ptr;
+	fmatrix product = fmatrix_multiply(A, Ainv, frame);
+	float error = 0.0f;
+	for (int i = 0; i < product.m; i++) {
+		for (int j = 0; j < product.n; j++) { error = fmaxf(error, fabsf(MATRIX_AT(product, i, j) - (i == j ? 1.0f : 0.0f))); }
+	}
+	printf("max |A A^-1 - I| = %g\n", error);
+	pool_free_from(frame, start);
+}
+
+void test_inverse_lu() {
+	pool frame = create_pool(2000000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	// needs pivoting from the first column on
+	float values[3][3] = {{0, 2, 1},
+		{1, 1, 1},
+		{2, 1, 4}};
+	fmatrix A = create_fmatrix(3, 3, values, &frame);
+	fmatrix Ainv = fmatrix_inverse(A, &frame);
+	print_fmatrix(Ainv);
+	check_inverse(A, Ainv, &frame);
+
+	// several LU_BLOCK_SIZE blocks and a partial one, inverted in place
+	int n = 100;
+	fmatrix B = fmatrix_create_zero(n, n, &frame);
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j < n; j++) { B.matrix[i * n + j] = sinf(0.7f * i + 1.3f * j) + (i == j ? 4.0f : 0.0f) + ((i * 7 + j * 3) % 5 == 0 ? 1.0f : 0.0f); }
+	}
+	fmatrix B_copy = fmatrix_copy_alloc(B, &frame);
+	printf("\n%d x %d in place: returned %d, ", n, n, fmatrix_inverse_in(B, &frame));
+	check_inverse(B_copy, B, &frame);
+
+	// transposed input, through the flag
+	fmatrix Bt = B_copy;
+	fmatrix_transpose_in(&Bt);
+	printf("transposed: ");
+	check_inverse(Bt, fmatrix_inverse(Bt, &frame), &frame);
+
+	// singular input returns 0 and doesn't leave anything on the pool
+	fmatrix S = fmatrix_create_zero(4, 4, &frame);
+	void* before = frame.ptr;
+	printf("singular: in place returned %d, ", fmatrix_inverse_in(S, &frame));
+	printf("copy is%s an error matrix, pool %s\n", fmatrix_inverse(S, &frame).matrix == NULL ? "" : " not", frame.ptr == before ? "unchanged" : "grew");
+
+	// double
+	dmatrix D = fmatrix_to_dmatrix(B_copy, &frame);
+	dmatrix Dinv = dmatrix_inverse(D, &frame);
+	dmatrix product = dmatrix_multiply(D, Dinv, &frame);
+	double error = 0.0;
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j < n; j++) { error = fmax(error, fabs(MATRIX_AT(product, i, j) - (i == j ? 1.0 : 0.0))); }
+	}
+	printf("double: max |A A^-1 - I| = %g\n", error);
+
+	free_pool(&frame);
+}
+
+// prints max |X - Y| over every element, reading both with fmatrix_at so either can be packed
+static void check_equal(const char* label, fmatrix X, fmatrix Y) {
+	float error = 0.0f;
+	for (int i = 0; i < X.m; i++) {
+		for (int j = 0; j < X.n; j++) { error = fmaxf(error, fabsf(fmatrix_at(X, i, j) - fmatrix_at(Y, i, j))); }
+	}
+	printf("%s: max difference %g\n", label, error);
+}
+
+void test_structured_matrices() {
+	pool frame = create_pool(2000000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	int n = 7;
+	fmatrix A = fmatrix_create_zero(n, n, &frame);
+	fmatrix B = fmatrix_create_zero(n, 3, &frame);
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j < n; j++) { A.matrix[i * n + j] = (float)((i * 5 + j * 3) % 7) - 3.0f + (i == j ? 8.0f : 0.0f); }
+		for (int j = 0; j < 3; j++) { B.matrix[i * 3 + j] = (float)(i - j); }
+	}
+
+	fmatrix U = fmatrix_pack(A, FMATRIX_UPPER, &frame);
+	fmatrix L = fmatrix_pack(A, FMATRIX_LOWER, &frame);
+	fmatrix S = fmatrix_pack(A, FMATRIX_SYMMETRIC, &frame);
+	fmatrix T = fmatrix_pack_banded(A, 1, 1, &frame);
+	fmatrix D = fmatrix_create_diagonal(n, 2.0f, &frame);
+	printf("stored floats: general %d, upper %d, symmetric %d, tridiagonal %d, diagonal %d\n", fmatrix_stored_count(A),
+		fmatrix_stored_count(U), fmatrix_stored_count(S), fmatrix_stored_count(T), fmatrix_stored_count(D));
+	printf("upper:\n");
+	print_fmatrix(U);
+
+	// every product against the same product of unpacked matrices
+	fmatrix Ud = fmatrix_unpack(U, &frame), Ld = fmatrix_unpack(L, &frame), Sd = fmatrix_unpack(S, &frame), Td = fmatrix_unpack(T, &frame);
+	check_equal("UB", fmatrix_multiply(U, B, &frame), fmatrix_multiply(Ud, B, &frame));
+	check_equal("SB", fmatrix_multiply(S, B, &frame), fmatrix_multiply(Sd, B, &frame));
+	check_equal("TA", fmatrix_multiply(T, A, &frame), fmatrix_multiply(Td, A, &frame));
+	check_equal("AS", fmatrix_multiply(A, S, &frame), fmatrix_multiply(A, Sd, &frame));
+	fmatrix UL = fmatrix_multiply(U, L, &frame), UU = fmatrix_multiply(U, U, &frame);
+	check_equal("UL", UL, fmatrix_multiply(Ud, Ld, &frame));
+	check_equal("UU", UU, fmatrix_multiply(Ud, Ud, &frame));
+	printf("kinds: UL %d, UU %d (upper is %d)\n", UL.kind, UU.kind, FMATRIX_UPPER);
+
+	// transposes stay packed, and are read through the flag
+	fmatrix Ut = fmatrix_transpose(U, &frame);
+	fmatrix Udt = Ud;
+	fmatrix_transpose_in(&Udt);
+	printf("U^t is kind %d (lower is %d)\n", Ut.kind, FMATRIX_LOWER);
+	check_equal("U^t B", fmatrix_multiply(Ut, B, &frame), fmatrix_multiply(Udt, B, &frame));
+	check_equal("U^t U", fmatrix_multiply(Ut, U, &frame), fmatrix_multiply(Udt, Ud, &frame));
+
+	// sums keep the smallest structure that holds both
+	fmatrix UD = fmatrix_add(U, D, &frame);
+	fmatrix DU = fmatrix_subtract(D, U, &frame);
+	fmatrix UdDd = fmatrix_add(Ud, fmatrix_unpack(D, &frame), &frame);
+	printf("U + D is kind %d, D - U is kind %d, U + L is kind %d\n", UD.kind, DU.kind, fmatrix_add(U, L, &frame).kind);
+	check_equal("U + D", UD, UdDd);
+	check_equal("D - U", DU, fmatrix_subtract(fmatrix_unpack(D, &frame), Ud, &frame));
+	check_equal("U + L", fmatrix_add(U, L, &frame), fmatrix_add(Ud, Ld, &frame));
+	fmatrix_add_in(S, D);
+	fmatrix_add_in(Sd, fmatrix_unpack(D, &frame));
+	check_equal("S += D", S, Sd);
+
+	// solves: substitution for triangles and diagonals, LU on the unpacked matrix otherwise
+	fmatrix kinds[6] = { U, L, Ut, D, S, T };
+	const char* names[6] = { "upper", "lower", "upper^t", "diagonal", "symmetric", "tridiagonal" };
+	for (int k = 0; k < 6; k++) {
+		fmatrix X = fmatrix_LU_solve(kinds[k], B, &frame);
+		printf("%s solve, ", names[k]);
+		check_equal("AX - B", fmatrix_multiply(kinds[k], X, &frame), B);
+	}
+	fmatrix singular = fmatrix_create_packed(3, FMATRIX_UPPER, &frame);
+	fmatrix b3 = fmatrix_create_zero(3, 1, &frame);
+	printf("singular triangle gives an error matrix: %d\n", fmatrix_LU_solve(singular, b3, &frame).matrix == NULL);
+
+	// the dense kernels read packed input through fmatrix_at, the copying ones unpack it, and the in place ones refuse it
+	float C[3][3] = {{2.0f, 1.0f, -1.0f},
+		{0.0f, 3.0f, 2.0f},
+		{0.0f, 0.0f, 4.0f}};
+	fmatrix U3 = fmatrix_pack(create_fmatrix(3, 3, C, &frame), FMATRIX_UPPER, &frame);
+	printf("packed upper: determinant %g\n", fmatrix_determinant(U3, &frame));
+	check_equal("packed upper, U^-1 U - I", fmatrix_multiply(fmatrix_inverse(U3, &frame), U3, &frame), fmatrix_create_identity(3, 3, &frame));
+	fmatrix swapped = fmatrix_row_swap(U3, 0, 2, &frame);
+	printf("row swapped copy is kind %d, first row %g %g %g\n", swapped.kind, MATRIX_AT(swapped, 0, 0), MATRIX_AT(swapped, 0, 1), MATRIX_AT(swapped, 0, 2));
+	fmatrix_row_swap_in(U3, 0, 2);
+	printf("in place inverse of packed: %d\n", fmatrix_inverse_in(U3, &frame));
+
+	// a symmetric positive definite system goes through cholesky on the packed triangle, and eigen/SVD read it as is
+	fmatrix G = fmatrix_syrk(A, 1, &frame);
+	fmatrix Gs = fmatrix_pack(G, FMATRIX_SYMMETRIC, &frame);
+	void* before = frame.ptr;
+	fmatrix Xs = fmatrix_LU_solve(Gs, B, &frame);
+	printf("symmetric solve left %d bytes on frame (X is %d), ", (int)((char*)frame.ptr - (char*)before), (int)(n * 3 * sizeof(float)));
+	check_equal("GX - B", fmatrix_multiply(Gs, Xs, &frame), B);
+	fsymeig Ep = fmatrix_symmetric_eigen(Gs, 0, 0, -1, &frame);
+	fsymeig Ed = fmatrix_symmetric_eigen(G, 0, 0, -1, &frame);
+	check_equal("packed vs dense eigenvalues", (fmatrix){ n, 1, Ep.values, 0 }, (fmatrix){ n, 1, Ed.values, 0 });
+	fsvd Vp = fmatrix_svd(Gs, 0, 1, 0.0f, &frame);
+	fsvd Vd = fmatrix_svd(G, 0, 1, 0.0f, &frame);
+	check_equal("packed vs dense singular values", (fmatrix){ n, 1, Vp.values, 0 }, (fmatrix){ n, 1, Vd.values, 0 });
+
+	// LU factors in n^2 floats instead of 2n^2
+	flu F = fmatrix_LU_decompose(A, &frame);
+	fmatrix Lf, Uf;
+	flu_triangles(F, &Lf, &Uf, &frame);
+	fmatrix PA = fmatrix_create_zero(n, n, &frame);
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j < n; j++) { PA.matrix[i * n + j] = A.matrix[F.perm[i] * n + j]; }
+	}
+	check_equal("LU - PA", fmatrix_multiply(Lf, Uf, &frame), PA);
+
+	free_pool(&frame);
+}
+
+void test_banded_solvers() {
+	pool frame = create_pool(4000000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	// 1D implicit heat step: (I + r(2I - shift - shift^t)) x = b, diagonally dominant
+	int n = 200;
+	float r = 0.8f;
+	float* sub = raw_pool_alloc(&frame, 5 * n * sizeof(float));
+	float* diag = &sub[n];
+	float* super = &sub[2 * n];
+	float* x = &sub[3 * n];
+	float* scratch = &sub[4 * n];
+	fmatrix T = fmatrix_create_banded(n, n, 1, 1, &frame);
+	fmatrix b = fmatrix_create_zero(n, 1, &frame);
+	for (int i = 0; i < n; i++) {
+		sub[i] = -r;
+		diag[i] = 1.0f + 2.0f * r;
+		super[i] = -r;
+		if (i > 0) { *fmatrix_ref(T, i, i - 1) = -r; }
+		*fmatrix_ref(T, i, i) = 1.0f + 2.0f * r;
+		if (i + 1 < n) { *fmatrix_ref(T, i, i + 1) = -r; }
+		b.matrix[i] = x[i] = sinf(0.05f * i);
+	}
+	printf("thomas returned %d, ", tridiagonal_solve_in(n, sub, diag, super, x, scratch));
+	fmatrix xm = { n, 1, x, 0 };
+	check_equal("Tx - b", fmatrix_multiply(T, xm, &frame), b);
+	fmatrix X = fmatrix_banded_solve(T, b, &frame);
+	check_equal("banded solve vs thomas", X, xm);
+	fmatrix D = fmatrix_create_diagonal(n, 2.0f, &frame);
+	check_equal("packed vs dense right hand sides", fmatrix_banded_solve(T, D, &frame), fmatrix_banded_solve(T, fmatrix_unpack(D, &frame), &frame));
+
+	// the same systems side by side, each with its own diagonal shift, against one at a time
+	int count = 37;
+	float* batch = raw_pool_alloc(&frame, (6 * n + 2) * count * sizeof(float));
+	float* bsub = batch;
+	float* bdiag = &batch[n * count];
+	float* bsuper = &batch[2 * n * count];
+	float* bx = &batch[3 * n * count];
+	float* bscratch = &batch[4 * n * count];
+	for (int i = 0; i < n; i++) {
+		for (int s = 0; s < count; s++) {
+			bsub[i * count + s] = -r;
+			bdiag[i * count + s] = 1.0f + 2.0f * r + 0.01f * s;
+			bsuper[i * count + s] = -r;
+			bx[i * count + s] = sinf(0.05f * i + s);
+		}
+	}
+	printf("batch failures: %d\n", tridiagonal_solve_batch(n, count, bsub, bdiag, bsuper, bx, bscratch));
+	float error = 0.0f;
+	for (int s = 0; s < count; s++) {
+		for (int i = 0; i < n; i++) {
+			diag[i] = 1.0f + 2.0f * r + 0.01f * s;
+			x[i] = sinf(0.05f * i + s);
+		}
+		tridiagonal_solve_in(n, sub, diag, super, x, scratch);
+		for (int i = 0; i < n; i++) { error = fmaxf(error, fabsf(x[i] - bx[i * count + s])); }
+	}
+	printf("batch vs one at a time: max difference %g\n", error);
+	bdiag[5 * count + 3] = 0.0f;
+	bsub[5 * count + 3] = 0.0f;
+	bsuper[4 * count + 3] = 0.0f;
+	for (int i = 0; i < n * count; i++) { bx[i] = 1.0f; }
+	printf("batch failures with one zero pivot: %d\n", tridiagonal_solve_batch(n, count, bsub, bdiag, bsuper, bx, bscratch));
+
+	// a diagonally dominant tridiagonal matrix with rows 2k and 2k + 1 swapped. That's kl = ku = 2 with the big elements off
+	// the diagonal, so every other step has to pivot. Checked against LU on the unpacked matrix
+	int m = 60;
+	fmatrix P = fmatrix_create_banded(m, m, 2, 2, &frame);
+	fmatrix B = fmatrix_create_zero(m, 3, &frame);
+	for (int i = 0; i < m; i++) {
+		int row = i ^ 1;
+		for (int j = (row > 0 ? row - 1 : 0); j < m && j <= row + 1; j++) {
+			*fmatrix_ref(P, i, j) = (row == j) ? 4.0f : (float)((row * 3 + j * 5) % 7) / 7.0f - 0.5f;
+		}
+		for (int c = 0; c < 3; c++) { B.matrix[i * 3 + c] = (float)(i % 5) - c; }
+	}
+	fmatrix Y = fmatrix_LU_solve(P, B, &frame);
+	check_equal("pivoted band: PY - B", fmatrix_multiply(P, Y, &frame), B);
+	check_equal("pivoted band vs dense LU", Y, flu_solve(fmatrix_LU_decompose(fmatrix_unpack(P, &frame), &frame), B, &frame));
+	fmatrix Pt = P;
+	fmatrix_transpose_in(&Pt);
+	fmatrix Z = fmatrix_banded_solve(Pt, B, &frame);
+	check_equal("transposed band: P^tZ - B", fmatrix_multiply(Pt, Z, &frame), B);
+
+	fmatrix S = fmatrix_create_banded(4, 4, 1, 1, &frame);
+	fmatrix zero = fmatrix_create_zero(4, 1, &frame);
+	void* before = frame.ptr;
+	printf("singular band gives an error matrix: %d", fmatrix_banded_solve(S, zero, &frame).matrix == NULL);
+	printf(", pool %s\n", frame.ptr == before ? "unchanged" : "leaked");
+
+	free_pool(&frame);
+}
+
+void test_row_view() {
+	pool frame = create_pool(400000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	// the same swaps through a view and through fmatrix_row_swap_in, on a transposed matrix so the swaps would be strided
+	int m = 6, n = 4;
+	fmatrix A = fmatrix_create_zero(n, m, &frame);
+	for (int i = 0; i < n * m; i++) { A.matrix[i] = (float)i; }
+	fmatrix_transpose_in(&A);
+	fmatrix swapped = fmatrix_copy_alloc(A, &frame);
+	frowview V = fmatrix_row_view(A, &frame);
+	int swaps[5][2] = { {0, 3}, {1, 5}, {3, 4}, {2, 2}, {0, 1} };
+	for (int s = 0; s < 5; s++) {
+		frowview_swap(V, swaps[s][0], swaps[s][1]);
+		fmatrix_row_swap_in(swapped, swaps[s][0], swaps[s][1]);
+	}
+	printf("view rows:");
+	for (int i = 0; i < m; i++) { printf(" %d", V.rows[i]); }
+	printf("\n");
+	check_equal("gather vs row swaps", frowview_gather(V, &frame), swapped);
+	frowview_apply_in(V, &frame);
+	check_equal("apply_in vs row swaps", A, swapped);
+	printf("view after apply_in:");
+	for (int i = 0; i < m; i++) { printf(" %d", V.rows[i]); }
+	printf("\n");
+
+	// PA = LU with pivots from the view
+	float values[4][4] = {{0, 2, 1, 3},
+		{0, 0, 4, 1},
+		{2, 1, 1, 0},
+		{1, 3, 0, 2}};
+	fmatrix B = create_fmatrix(4, 4, values, &frame);
+	for (int t = 0; t < 2; t++) {
+		fmatrix PLU[3];
+		if (fmatrix_LU_factorize(B, PLU, &frame) == NULL) { printf("no LU\n"); continue; }
+		print_fmatrix(PLU[0]);
+		check_equal(t ? "transposed: PA - LU" : "PA - LU", fmatrix_multiply(PLU[0], B, &frame), fmatrix_multiply(PLU[1], PLU[2], &frame));
+		fmatrix_transpose_in(&B);
+	}
+
+	free_pool(&frame);
+}
+
+void test_elementary_log() {
+	pool frame = create_pool(2000000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	// the same random ops through a log and one by one, on a plain and a transposed target
+	srand(7);
+	int m = 30, n = 20;
+	fmatrix A = fmatrix_create_zero(m, n, &frame);
+	fmatrix At = fmatrix_create_zero(n, m, &frame);
+	for (int i = 0; i < m * n; i++) {
+		A.matrix[i] = sinf(0.37f * i);
+		At.matrix[i] = cosf(0.53f * i);
+	}
+	fmatrix_transpose_in(&At);
+	fmatrix expected = fmatrix_copy_alloc(A, &frame);
+	fmatrix expected_t = fmatrix_copy_alloc(At, &frame);
+
+	elem_log log = elem_log_create(m, n, 64, &frame);
+	for (int k = 0; k < 60; k++) {
+		int kind = rand() % 6;
+		int size = kind < ELEM_COL_SCALE ? m : n;
+		int dest = rand() % size, src = rand() % size;
+		float c = 0.5f + (float)(rand() % 4) * 0.25f;
+		fmatrix targets[2] = { expected, expected_t };
+		for (int t = 0; t < 2; t++) {
+			switch (kind) {
+			case ELEM_ROW_SCALE: fmatrix_row_scale_in(targets[t], dest, c); break;
+			case ELEM_ROW_SWAP: fmatrix_row_swap_in(targets[t], dest, src); break;
+			case ELEM_ROW_SUM: fmatrix_row_sum_in(targets[t], dest, 1.0f, src, -c); break;
+			case ELEM_COL_SCALE: fmatrix_col_scale_in(targets[t], dest, c); break;
+			case ELEM_COL_SWAP: fmatrix_col_swap_in(targets[t], dest, src); break;
+			case ELEM_COL_SUM: fmatrix_col_sum_in(targets[t], dest, 1.0f, src, -c); break;
+			}
+		}
+		switch (kind) {
+		case ELEM_ROW_SCALE: elem_log_row_scale(&log, dest, c); break;
+		case ELEM_ROW_SWAP: elem_log_row_swap(&log, dest, src); break;
+		case ELEM_ROW_SUM: elem_log_row_sum(&log, dest, 1.0f, src, -c); break;
+		case ELEM_COL_SCALE: elem_log_col_scale(&log, dest, c); break;
+		case ELEM_COL_SWAP: elem_log_col_swap(&log, dest, src); break;
+		case ELEM_COL_SUM: elem_log_col_sum(&log, dest, 1.0f, src, -c); break;
+		}
+	}
+	printf("recorded %d ops, out of bounds op %s\n", log.count, elem_log_row_swap(&log, 0, m) ? "recorded" : "rejected");
+
+	elem_transform T = elem_log_compile(log, &frame);
+	printf("left side %s (nnz %d), right side %s (nnz %d)\n", T.left.matrix ? "dense" : "sparse", T.left_sparse.nnz,
+		T.right.matrix ? "dense" : "sparse", T.right_sparse.nnz);
+	fmatrix batch[2] = { A, At };
+	void* before = frame.ptr;
+	elem_transform_apply_many_in(T, batch, 2, &frame);
+	printf("workspace %s\n", frame.ptr == before ? "freed" : "leaked");
+	check_equal("batch, plain target", A, expected);
+	check_equal("batch, transposed target", At, expected_t);
+
+	// a handful of ops stays sparse, and a log of only row ops leaves the right side empty
+	elem_log rows = elem_log_create(m, n, 4, &frame);
+	elem_log_row_sum(&rows, 3, 1.0f, 0, 2.0f);
+	elem_log_row_swap(&rows, 1, 2);
+	elem_log_row_scale(&rows, 5, -1.0f);
+	fmatrix B = fmatrix_copy_alloc(A, &frame);
+	fmatrix expected_b = fmatrix_copy_alloc(B, &frame);
+	fmatrix_row_sum_in(expected_b, 3, 1.0f, 0, 2.0f);
+	fmatrix_row_swap_in(expected_b, 1, 2);
+	fmatrix_row_scale_in(expected_b, 5, -1.0f);
+	elem_transform TR = elem_log_compile(rows, &frame);
+	printf("row log: left nnz %d, right side %s\n", TR.left_sparse.nnz, TR.right.matrix || TR.right_sparse.ptr ? "present" : "empty");
+	elem_transform_apply_in(TR, B, &frame);
+	check_equal("row ops only", B, expected_b);
+
+	// running sums down the rows fill in a triangle, which is dense enough to skip the CSR
+	elem_log sums = elem_log_create(m, n, m, &frame);
+	fmatrix C = fmatrix_copy_alloc(A, &frame);
+	fmatrix expected_c = fmatrix_copy_alloc(A, &frame);
+	for (int i = 1; i < m; i++) {
+		elem_log_row_sum(&sums, i, 1.0f, i - 1, 1.0f);
+		fmatrix_row_sum_in(expected_c, i, 1.0f, i - 1, 1.0f);
+	}
+	elem_transform TS = elem_log_compile(sums, &frame);
+	printf("running sums: left side %s\n", TS.left.matrix ? "dense" : "sparse");
+	elem_transform_apply_in(TS, C, &frame);
+	check_equal("running sums", C, expected_c);
+
+	free_pool(&frame);
+}
+
+void test_matrix_functions() {
+	pool frame = create_pool(2000000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	// powers against repeated multiplication, on a transposed matrix
+	int n = 6;
+	fmatrix A = fmatrix_create_zero(n, n, &frame);
+	for (int i = 0; i < n * n; i++) { A.matrix[i] = 0.3f * sinf(1.7f * i); }
+	for (int i = 0; i < n; i++) { A.matrix[i * n + i] += 1.0f; }
+	fmatrix_transpose_in(&A);
+	fmatrix repeated = fmatrix_create_identity(n, n, &frame);
+	for (int k = 0; k < 13; k++) { repeated = fmatrix_multiply(repeated, A, &frame); }
+	void* before = frame.ptr;
+	fmatrix P = fmatrix_power(A, 13, &frame);
+	printf("power pool use: %s\n", (void*)P.matrix >= before && frame.ptr == (void*)(P.matrix + n * n) ? "only the result" : "leaked");
+	check_equal("A^13 vs 13 products", P, repeated);
+	check_equal("A^0 vs I", fmatrix_power(A, 0, &frame), fmatrix_create_identity(n, n, &frame));
+	check_equal("A^-3 A^3 vs I", fmatrix_multiply(fmatrix_power(A, -3, &frame), fmatrix_power(A, 3, &frame), &frame),
+		fmatrix_create_identity(n, n, &frame));
+
+	// exp of a rotation generator is a rotation. t = 10 needs scaling and squaring
+	float t = 10.0f;
+	float generator[2][2] = { {0, -t}, {t, 0} };
+	float rotation[2][2] = { {cosf(t), -sinf(t)}, {sinf(t), cosf(t)} };
+	check_equal("exp(rotation generator)", fmatrix_expm(create_fmatrix(2, 2, generator, &frame), &frame),
+		create_fmatrix(2, 2, rotation, &frame));
+	float nilpotent[3][3] = { {0, 1, 0}, {0, 0, 2}, {0, 0, 0} };
+	float nilpotent_exp[3][3] = { {1, 1, 1}, {0, 1, 2}, {0, 0, 1} };
+	check_equal("exp(nilpotent)", fmatrix_expm(create_fmatrix(3, 3, nilpotent, &frame), &frame),
+		create_fmatrix(3, 3, nilpotent_exp, &frame));
+
+	// exp(A) exp(-A) = I, and float (degree 7) against double (degree 13)
+	for (int s = 0; s < 2; s++) {
+		fmatrix B = fmatrix_scale(A, s ? 4.0f : 0.1f, &frame);
+		fmatrix E = fmatrix_expm(B, &frame);
+		check_equal(s ? "exp(4A) exp(-4A) vs I" : "exp(A/10) exp(-A/10) vs I",
+			fmatrix_multiply(E, fmatrix_expm(fmatrix_scale(B, -1.0f, &frame), &frame), &frame), fmatrix_create_identity(n, n, &frame));
+		fmatrix Ed = dmatrix_to_fmatrix(dmatrix_expm(fmatrix_to_dmatrix(B, &frame), &frame), &frame);
+		float error = 0.0f, largest = 0.0f;
+		for (int i = 0; i < n * n; i++) {
+			error = fmaxf(error, fabsf(E.matrix[i] - Ed.matrix[i]));
+			largest = fmaxf(largest, fabsf(Ed.matrix[i]));
+		}
+		printf("float vs double expm: relative difference %s\n", error / largest < 1e-5f ? "< 1e-5" : "too large");
+	}
+
+	free_pool(&frame);
+}
+
+void test_low_rank_updates() {
+	pool frame = create_pool(2000000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	int n = 8, k = 2;
+	fmatrix A = fmatrix_create_zero(n, n, &frame);
+	for (int i = 0; i < n * n; i++) { A.matrix[i] = 0.5f * sinf(0.9f * i + 0.3f); }
+	for (int i = 0; i < n; i++) { A.matrix[i * n + i] += 3.0f; }
+	fmatrix U = fmatrix_create_zero(n, k, &frame);
+	fmatrix V = fmatrix_create_zero(n, k, &frame);
+	for (int i = 0; i < n * k; i++) {
+		U.matrix[i] = cosf(1.3f * i);
+		V.matrix[i] = 0.4f * sinf(0.7f * i + 1.0f);
+	}
+	fmatrix updated = fmatrix_add(A, fmatrix_multiply(U, fmatrix_transpose(V, &frame), &frame), &frame);
+
+	// Woodbury against a fresh inverse, on a transposed copy too
+	fmatrix Ainv = fmatrix_inverse(A, &frame);
+	fmatrix Ainv_t = fmatrix_transpose(fmatrix_inverse(fmatrix_transpose(A, &frame), &frame), &frame);
+	void* before = frame.ptr;
+	printf("inverse update: %d, transposed: %d, pool %s\n", fmatrix_inverse_update_in(Ainv, U, V, &frame),
+		fmatrix_inverse_update_in(Ainv_t, U, V, &frame), frame.ptr == before ? "unchanged" : "leaked");
+	check_inverse(updated, Ainv, &frame);
+	check_inverse(updated, Ainv_t, &frame);
+
+	// LU update, then a solve with the updated factors
+	flu F = fmatrix_LU_decompose(A, &frame);
+	printf("LU update: %d\n", flu_update_in(F, U, V, &frame));
+	fmatrix b = fmatrix_create_zero(n, 1, &frame);
+	for (int i = 0; i < n; i++) { b.matrix[i] = (float)(i + 1); }
+	fmatrix x = flu_solve(F, b, &frame);
+	check_equal("(A + UV^t) x vs b", fmatrix_multiply(updated, x, &frame), b);
+
+	// cholesky update and the downdate that undoes it
+	fmatrix S = fmatrix_add(fmatrix_multiply(A, fmatrix_transpose(A, &frame), &frame), fmatrix_create_identity(n, n, &frame), &frame);
+	fmatrix L = fmatrix_cholesky_factorize(S, &frame);
+	fmatrix S_plus = fmatrix_add(S, fmatrix_multiply(U, fmatrix_transpose(U, &frame), &frame), &frame);
+	printf("cholesky update: %d\n", fmatrix_cholesky_update_in(L, U, 1, &frame));
+	check_equal("LL^t vs A + XX^t", fmatrix_multiply(L, fmatrix_transpose(L, &frame), &frame), S_plus);
+	printf("cholesky downdate: %d\n", fmatrix_cholesky_update_in(L, U, -1, &frame));
+	check_equal("LL^t vs A", fmatrix_multiply(L, fmatrix_transpose(L, &frame), &frame), S);
+
+	// unsafe updates are refused, and leave their input as it was
+	fmatrix Ainv_copy = fmatrix_copy_alloc(Ainv, &frame);
+	fmatrix u = fmatrix_ncol_copy_alloc(fmatrix_scale(updated, -1.0f, &frame), 1, &frame);
+	fmatrix e0 = fmatrix_create_zero(n, 1, &frame);
+	e0.matrix[0] = 1.0f;
+	printf("singular inverse update: %d\n", fmatrix_inverse_update_in(Ainv, u, e0, &frame));
+	check_equal("inverse after refused update", Ainv, Ainv_copy);
+
+	fmatrix L_copy = fmatrix_copy_alloc(L, &frame);
+	fmatrix too_big = fmatrix_scale(fmatrix_ncol_copy_alloc(L, 1, &frame), 2.0f, &frame);
+	printf("indefinite downdate: %d\n", fmatrix_cholesky_update_in(L, too_big, -1, &frame));
+	check_equal("L after refused downdate", L, L_copy);
+
+	// I + xy^t is the swap [[0, 1], [1, 0]]: nonsingular, but the identity's P can't factor it
+	flu G = fmatrix_LU_decompose(fmatrix_create_identity(2, 2, &frame), &frame);
+	float xs[2][1] = { {1}, {-1} };
+	float ys[2][1] = { {-1}, {1} };
+	printf("LU update needing a pivot: %d\n", flu_update_in(G, create_fmatrix(2, 1, xs, &frame), create_fmatrix(2, 1, ys, &frame), &frame));
+	check_equal("LU after refused update", G.LU, fmatrix_create_identity(2, 2, &frame));
+
+	free_pool(&frame);
+}
+
+void test_syrk() {
+	pool frame = create_pool(4000000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	// every combination of trans and A's transpose flag against the general multiply (on a copied transpose, so it isn't routed)
+	int m = 70, n = 45;
+	fmatrix A = fmatrix_create_zero(m, n, &frame);
+	for (int i = 0; i < m * n; i++) { A.matrix[i] = sinf(0.31f * i) + 0.1f * cosf(0.07f * i); }
+	for (int t = 0; t < 2; t++) {
+		fmatrix At = fmatrix_transpose(A, &frame);
+		check_equal(t ? "transposed A, A^t A" : "A^t A", fmatrix_syrk(A, 1, &frame), fmatrix_multiply(At, A, &frame));
+		check_equal(t ? "transposed A, A A^t" : "A A^t", fmatrix_syrk(A, 0, &frame), fmatrix_multiply(A, At, &frame));
+		fmatrix_transpose_in(&A);
+	}
+
+	// fmatrix_multiply picks up X^t X when both operands share a buffer
+	fmatrix X = A;
+	fmatrix Xt = A;
+	fmatrix_transpose_in(&Xt);
+	check_equal("routed X^t X", fmatrix_multiply(Xt, X, &frame), fmatrix_multiply(fmatrix_copy_alloc(Xt, &frame), X, &frame));
+	check_equal("routed X X^t", fmatrix_multiply(X, Xt, &frame), fmatrix_multiply(X, fmatrix_copy_alloc(Xt, &frame), &frame));
+
+	// accumulating two row batches with beta = 1 gives the Gram matrix of the whole, and the upper triangle is left alone
+	fmatrix top = create_fmatrix(m / 2, n, A.matrix, &frame);
+	fmatrix bottom = create_fmatrix(m - m / 2, n, &A.matrix[(m / 2) * n], &frame);
+	fmatrix G = fmatrix_create_zero(n, n, &frame);
+	for (int i = 0; i < n; i++) {
+		for (int j = i + 1; j < n; j++) { G.matrix[i * n + j] = -1.0f; }
+	}
+	fmatrix_syrk_in(0.5f, top, 1, 0.0f, G);
+	fmatrix_syrk_in(0.5f, bottom, 1, 1.0f, G);
+	fmatrix full = fmatrix_scale(fmatrix_syrk(A, 1, &frame), 0.5f, &frame);
+	float error = 0.0f;
+	int untouched = 1;
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j < n; j++) {
+			if (j <= i) { error = fmaxf(error, fabsf(G.matrix[i * n + j] - full.matrix[i * n + j])); }
+			else if (G.matrix[i * n + j] != -1.0f) { untouched = 0; }
+		}
+	}
+	printf("batched syrk: max difference %g, upper triangle %s\n", error, untouched ? "untouched" : "written");
+
+	// packed A is unpacked first by fmatrix_syrk, and refused by the in place version
+	float B[3][3] = {{2.0f, 1.0f, -1.0f},
+		{0.0f, 3.0f, 2.0f},
+		{0.0f, 0.0f, 4.0f}};
+	fmatrix U = fmatrix_pack(create_fmatrix(3, 3, B, &frame), FMATRIX_UPPER, &frame);
+	fmatrix dense = fmatrix_unpack(U, &frame);
+	fmatrix dense_t = fmatrix_transpose(dense, &frame);
+	check_equal("packed upper, U^t U", fmatrix_syrk(U, 1, &frame), fmatrix_multiply(dense_t, dense, &frame));
+	printf("in place syrk on packed A: %d\n", fmatrix_syrk_in(1.0f, U, 1, 0.0f, fmatrix_create_zero(3, 3, &frame)));
+
+	// enough bands for them to be split across threads. The result can't depend on how many there are
+	{
+		int rows = 300, cols = 200;
+		fmatrix T = fmatrix_create_zero(rows, cols, &frame);
+		for (int i = 0; i < rows * cols; i++) { T.matrix[i] = sinf(0.37f * i) + cosf(0.011f * i); }
+		parallel_set_threads(4);
+		fmatrix outer = fmatrix_syrk(T, 1, &frame);
+		fmatrix dots = fmatrix_syrk(T, 0, &frame);
+		parallel_set_threads(1);
+		fmatrix outer_serial = fmatrix_syrk(T, 1, &frame);
+		fmatrix dots_serial = fmatrix_syrk(T, 0, &frame);
+		parallel_set_threads(0);
+		int same = 1;
+		for (int i = 0; i < cols * cols; i++) { same &= outer.matrix[i] == outer_serial.matrix[i]; }
+		for (int i = 0; i < rows * rows; i++) { same &= dots.matrix[i] == dots_serial.matrix[i]; }
+		printf("threaded syrk: same as serial: %d\n", same);
+	}
+
+	free_pool(&frame);
+}
+
+void test_streaming_covariance() {
+	pool frame = create_pool(4000000);
+	if (frame.start == NULL) {
+		exit(1);
+	}
+
+	// rows with a large common offset, where E[xx^t] - mean mean^t in float would lose every digit
+	int rows = 1000, n = 6;
+	fmatrix data = fmatrix_create_zero(rows, n, &frame);
+	for (int r = 0; r < rows; r++) {
+		for (int j = 0; j < n; j++) { data.matrix[r * n + j] = 10000.0f + sinf(0.37f * r * (j + 1)) + 0.5f * cosf(0.11f * r + j); }
+	}
+
+	// reference: two pass in double, mean first, then the centered products
+	double mean[6] = { 0 };
+	double reference[6][6] = { { 0 } };
+	for (int r = 0; r < rows; r++) {
+		for (int j = 0; j < n; j++) { mean[j] += data.matrix[r * n + j] / (double)rows; }
+	}
+	for (int r = 0; r < rows; r++) {
+		for (int i = 0; i < n; i++) {
+			for (int j = 0; j < n; j++) {
+				reference[i][j] += (data.matrix[r * n + i] - mean[i]) * (data.matrix[r * n + j] - mean[j]) / (rows - 1);
+			}
+		}
+	}
+	fmatrix expected = fmatrix_create_zero(n, n, &frame);
+	for (int i = 0; i < n * n; i++) { expected.matrix[i] = (float)reference[i / n][i % n]; }
+
+	// one accumulator fed uneven batches, half raw and half as transposed fmatrices
+	fcov_accumulator acc = fcov_create(n, &frame);
+	int sizes[5] = { 1, 99, 300, 37, 63 };
+	int start = 0;
+	for (int b = 0; b < 5; b++) {
+		if (b % 2 == 0) { fcov_add_rows(&acc, &data.matrix[start * n], sizes[b]); }
+		else {
+			fmatrix batch = fmatrix_transpose(create_fmatrix(sizes[b], n, &data.matrix[start * n], &frame), &frame);
+			fmatrix_transpose_in(&batch);
+			fcov_add_batch(&acc, batch);
+		}
+		start += sizes[b];
+	}
+
+	// and two more "threads" for the rest, merged in
+	fcov_accumulator left = fcov_create(n, &frame);
+	fcov_accumulator right = fcov_create(n, &frame);
+	int half = (rows - start) / 2;
+	fcov_add_rows(&left, &data.matrix[start * n], half);
+	fcov_add_rows(&right, &data.matrix[(start + half) * n], rows - start - half);
+	fcov_merge(&left, &right);
+	fcov_merge(&acc, &left);
+
+	printf("rows accumulated: %lld\n", acc.count);
+	float error = 0.0f;
+	fmatrix mu = fcov_mean(acc, &frame);
+	for (int j = 0; j < n; j++) { error = fmaxf(error, fabsf(mu.matrix[j] - (float)mean[j])); }
+	printf("mean: max difference %g\n", error);
+	check_equal("streamed covariance", fcov_covariance(acc, 1, &frame), expected);
+
+	fcov_reset(&acc);
+	fcov_add_rows(&acc, data.matrix, 1);
+	printf("covariance of one row: %s\n", fcov_covariance(acc, 1, &frame).matrix == NULL ? "refused" : "returned");
+
+	free_pool(&frame);
+}
+
 int main() {
-	switch(15){
+	switch(40){
 	case 1:
 		test_transpose();
 		break;
@@ -816,6 +2623,81 @@ int main() {
 	case 15:
 		test_LU_solve();
 		break;
+	case 16:
+		test_perf_counters();
+		break;
+	case 17:
+		test_trace();
+		break;
+	case 18:
+		test_sparse();
+		break;
+	case 19:
+		test_sparse_LU();
+		break;
+	case 20:
+		test_iterative_solvers();
+		break;
+	case 21:
+		test_cholesky();
+		break;
+	case 22:
+		test_QR();
+		break;
+	case 23:
+		test_subspaces();
+		break;
+	case 24:
+		test_symmetric_eigen();
+		break;
+	case 25:
+		test_svd();
+		break;
+	case 26:
+		test_randomized_svd();
+		break;
+	case 27:
+		test_dmatrix();
+		break;
+	case 28:
+		test_mixed_precision();
+		break;
+	case 29:
+		test_half_matrix();
+		break;
+	case 30:
+		test_quantized_multiply();
+		break;
+	case 31:
+		test_log_determinant();
+		break;
+	case 32:
+		test_inverse_lu();
+		break;
+	case 33:
+		test_structured_matrices();
+		break;
+	case 34:
+		test_banded_solvers();
+		break;
+	case 35:
+		test_row_view();
+		break;
+	case 36:
+		test_elementary_log();
+		break;
+	case 37:
+		test_matrix_functions();
+		break;
+	case 38:
+		test_low_rank_updates();
+		break;
+	case 39:
+		test_syrk();
+		break;
+	case 40:
+		test_streaming_covariance();
+		break;
 	default:
 		printf("no tests\n");
 	}
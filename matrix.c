@@ -1,112 +1,79 @@
+#include <float.h>
+
 #include "matrix.h"
+#include "instrument.h"
+#include "qrFactorization.h"
+#include "structuredMatrix.h"
+#include "parallel.h"
 
 // Checklist:
 //        1) potentially add faster paths for non transpose matrices?
 //		  2) extend LU factorization to non square matrices?
-//		  3) make fmatrix_col_space more in place?
+// (done) 3) make fmatrix_col_space more in place?
 //		  4) Look into optimization, especially for multiplication and inverse
 //		  5) Implement a bunch of stuff related to graphics (more specificity on this later)
 //
 
-// allocates m by n blocks of memory of a given size in a pool, returns a struct with a pointer to it,
-// the dimensions of the matrix, and if it is a transpose or not.
-// Used for adding a matrix to the pool so you can start doing operations to it.
-// failure returns the ERROR_FMATRIX, (macro located in matrix.h) which has 0 rows, 0 cols, a NULL
-// pointer for the matrix, and is not a transpose
-//
-// fmatrix A = create_fmatrix(3, 3, matA, &frame);
-fmatrix create_fmatrix(int m, int n, float* matrix, pool* frame) {
-	if (m < 0 || n < 0) {
-		printf("fmatrix must have positive row/columns\n");
-		return ERROR_FMATRIX;
-	}
-	if (!frame || !frame->start) {
-		printf("failed to create matrix (faulty input frame). Returning empty matrix\n");
-		return ERROR_FMATRIX;
-	}
-
-	if ((matrix = pool_alloc(frame, matrix, m * n * sizeof(float))) == NULL) {
-		printf("pool allocation for matrix failed, returing empty matrix\n");
-		return ERROR_FMATRIX;
-	}
-	// initially not a transpose, so field starts as 0
-	return (fmatrix) {m, n, matrix, 0};
-}
-
-// returns an identity matrix of size m x n, allocated on frame
-// returns ERROR_FMATRIX upon failure
-fmatrix fmatrix_create_identity(int m, int n, pool* frame) {
-	if (m < 0 || n < 0) {
-		printf("fmatrix must have positive row/columns\n");
-		return ERROR_FMATRIX;
-	}
-	if (!frame || !frame->start) {
-		printf("failed to create matrix (faulty input frame). Returning empty matrix\n");
-		return ERROR_FMATRIX;
-	}
-
-	float* matrix = raw_pool_alloc(frame, m * n * sizeof(float));
-	if (matrix == NULL) {
-		printf("pool allocation for identity matrix failed, returning error matrix");
-		return ERROR_FMATRIX;
-	}
-
-	fmatrix mat = (fmatrix) {m, n, matrix, 0};
-
-	// initialize all values to 0 except where i = j
-	for (int i = 0; i < m; i++) {
-		for (int j = 0; j < n; j++) {
-			if(i == j){ matrix[INDEX_AT(mat, i, j)] = 1.0f; }
-			else{ matrix[INDEX_AT(mat, i, j)] = 0.0f; }
-		}
-	}
-
-	return mat;
-}
 
-// creates an m x n matrix with all elements set to 0.
-fmatrix fmatrix_create_zero(int m, int n, pool* frame) {
-	if (m < 0 || n < 0) {
-		printf("fmatrix must have positive row/columns\n");
-		return ERROR_FMATRIX;
-	}
-	if (!frame || !frame->start) {
-		printf("failed to create matrix (faulty input frame). Returning empty matrix\n");
-		return ERROR_FMATRIX;
-	}
-
-	float* matrix = raw_pool_alloc(frame, m * n * sizeof(float));
-	if (matrix == NULL) {
-		printf("pool allocation for identity matrix failed, returning error matrix");
-		return ERROR_FMATRIX;
-	}
-
-	fmatrix mat = (fmatrix) {m, n, matrix, 0};
-
-	// initialize all values to 0 except where i = j
-	for (int i = 0; i < m; i++) {
-		for (int j = 0; j < n; j++) {
-			matrix[INDEX_AT(mat, i, j)] = 0.0f;
-		}
-	}
-
-	return mat;
-}
+// Kernels (see matrixTemplate.h). float ones are instrumented, double ones aren't
+
+#define MT_TYPE float
+#define MT_MATRIX fmatrix
+#define MT_ERROR ERROR_FMATRIX
+#define MT_NAME "fmatrix"
+#define MT_PREFIX fmatrix_
+#define MT_SUFFIX _f
+#define MT_CREATE create_fmatrix
+#define MT_PRINT print_fmatrix
+#define MT_GET_MULTIPLIED get_fmultiplied
+#define MT_SWAP fswap
+#define MT_FIND_PIVOT_ROW find_pivot_row
+#define MT_LU flu
+#define MT_LU_PREFIX flu_
+#define MT_VIEW frowview
+#define MT_VIEW_PREFIX frowview_
+#define MT_SQRT sqrtf
+#define MT_INSTRUMENT_BEGIN INSTRUMENT_BEGIN
+#define MT_INSTRUMENT_END INSTRUMENT_END
+#define MT_STRUCTURED
+#include "matrixTemplate.h"
+
+#define MT_TYPE double
+#define MT_MATRIX dmatrix
+#define MT_ERROR ERROR_DMATRIX
+#define MT_NAME "dmatrix"
+#define MT_PREFIX dmatrix_
+#define MT_SUFFIX _d
+#define MT_CREATE create_dmatrix
+#define MT_PRINT print_dmatrix
+#define MT_GET_MULTIPLIED get_dmultiplied
+#define MT_SWAP dswap
+#define MT_FIND_PIVOT_ROW dmatrix_find_pivot_row
+#define MT_LU dlu
+#define MT_LU_PREFIX dlu_
+#define MT_VIEW drowview
+#define MT_VIEW_PREFIX drowview_
+#define MT_SQRT sqrt
+#define MT_INSTRUMENT_BEGIN(...) ((void)0)
+#define MT_INSTRUMENT_END() ((void)0)
+#include "matrixTemplate.h"
 
 // Utilities
 
-// prints an input matrix in row major order.
+// returns the name of the function an instrumentation op id refers to (see matrixOps.h)
 //
-// print_fmatrix(matA);
-void print_fmatrix(fmatrix mat) {
-	for (int i = 0; i < mat.m; i++) {
-		for (int j = 0; j < mat.n; j++) {
-			printf("%4.3f ", MATRIX_AT(mat, i, j));
-		}
-		printf("\n");
-	}
+// printf("%s\n", matrix_op_name(MATRIX_OP_MULTIPLY)); // prints fmatrix_multiply
+const char* matrix_op_name(matrix_op op) {
+	static const char* names[MATRIX_OP_COUNT] = {
+#define MATRIX_OP_NAME(id, name) name,
+		MATRIX_OP_LIST(MATRIX_OP_NAME)
+#undef MATRIX_OP_NAME
+	};
+	if (op < 0 || op >= MATRIX_OP_COUNT) { return "unknown"; }
+	return names[op];
 }
 
+
 // prints floats from a pool linearly
 // used for debugging weird memory things, or tracking how transposes are stored
 //
@@ -133,14 +100,14 @@ void print_as_array(fmatrix mat) {
 
 	for(int i = 0; i < mat.m; i++){
 		for (int j = 0; j < mat.n; j++) {
-			printf("%g ", MATRIX_AT(mat, i, j));
+			printf("%g ", fmatrix_at(mat, i, j));
 		}
 	}
 	printf("\n");
 }
 
 void print_memory_layout(fmatrix mat) {
-	int size = mat.m * mat.n;
+	int size = fmatrix_stored_count(mat);
 
 	for (int i = 0; i < size; i++) {
 		printf("%f ", mat.matrix[i]);
@@ -149,57 +116,6 @@ void print_memory_layout(fmatrix mat) {
 	printf("\n");
 }
 
-// takes an exisitng matrix, allocates space for a clone, copies its properties, and returns a deep copy
-// used to reduce how verbose non inplace functions are, because many of them shared this procedure 
-//
-// copyA = fmatrix_copy_alloc(matA, &frame);
-fmatrix fmatrix_copy_alloc(fmatrix mat, pool* frame) {
-	int size = mat.m * mat.n * sizeof(float);
-	float* result;
-
-	if ((result = (float*)raw_pool_alloc(frame, size)) == NULL) {
-		printf("error while allocating matrix\n");
-		return ERROR_FMATRIX;
-	}
-
-	memcpy(result, mat.matrix, size);
-
-	return (fmatrix) { mat.m, mat.n, result, mat.transpose};
-}
-
-// takes an exisitng fmatrix and a number of columns to copy, then creates a new fmatrix with 
-// the first c columns of mat, allocated on frame
-// for now, it does not retain mat's transpose state
-fmatrix fmatrix_ncol_copy_alloc(fmatrix mat, int c, pool* frame) {
-	int size = mat.m * c;
-	float* result = (float*)raw_pool_alloc(frame, size * sizeof(float));
-
-	if (result  == NULL) {
-		printf("error while allocating matrix\n");
-		return ERROR_FMATRIX;
-	}
-
-	int offset; // for accessing result array linearly from a nested for loop
-	for (int i = 0; i < mat.m; i++) {
-		offset = i * c;
-		for (int j = 0; j < c; j++) {
-			result[offset + j] = MATRIX_AT(mat, i, j);
-			//result[offset + j] = mat.transpose ?  MATRIX_AT(mat, j, i) : MATRIX_AT(mat, i, j);
-		}
-	}
-
-	return (fmatrix) { mat.m, c, result, 0};
-}
-
-// swaps the values of floats located at a and b
-// used for a few row operations
-//
-// fswap(&mat[INDEX_AT(mat, 1, 2)], &mat[INDEX_AT(mat, 0, 2)]); 
-void fswap(float *a, float *b) {
-	float temp = *a;
-	*a = *b;
-	*b = temp;
-}
 
 // swaps the values of integers located at a and b
 // literally only used for swapping m and n for transposing a matrix
@@ -212,481 +128,28 @@ void intswap(int* a, int* b) {
 }
 
 
-// from here on out, there are inplace versions of most functions. These do the same thing as their non inplace 
-// counterparts, but they store their results in one of the inputs, avoiding extra memory allocation.
-// Also, upon failure, an error message is printed, and no change is made to the inputs, rather than returning 
-// an ERROR_FMATRIX.
-// Keep in mind that many of the non inplace variants actually use the inplace version after copying one of
-// their inputs.
-
-
-// Basic matrix operations
-
-// Adds two input matrices into matA, given that they have the same dimensions
-// 
-// fmatrix_add_in(A, B);
-void fmatrix_add_in(fmatrix matA, fmatrix matB) {
-	if (matA.m != matB.m || matA.n != matB.n) {
-		printf("error while adding: \ndimension mismatch: ");
-		printf("matrix a: (%d x %d)  matrix b: (%d x %d)\n", matA.m, matA.n, matB.m, matB.n);
-		return;
-	}
-	for(int i = 0; i < matB.m; i++){
-		for (int j = 0; j < matA.n; j++) {
-			matA.matrix[INDEX_AT(matA, i, j)] += matB.matrix[INDEX_AT(matB, i, j)];
-		}
-	}
-}
-
-// fmatrix sumAB = fmatrix_add(A, B, &frame)
-fmatrix fmatrix_add(fmatrix matA, fmatrix matB, pool *frame) {
-	if (matA.m != matB.m || matA.n != matB.n) {
-		printf("error while adding: \ndimension mismatch: ");
-		printf("matrix a: (%d x %d)  matrix b: (%d x %d)\n", matA.m, matA.n, matB.m, matB.n);
-		return ERROR_FMATRIX;
-	}
-
-	float* matrix;
-	if ((matrix = (float*)raw_pool_alloc(frame, matA.m * matA.n * sizeof(float))) == NULL) {
-		printf("error while adding: pool allocation failure\n");
-		return ERROR_FMATRIX;
-	}
-
-	fmatrix result = (fmatrix) {matA.m, matA.n, matrix};
-
-	for (int i = 0; i < matA.m; i++) {
-		for(int j = 0; j < matA.n; j++){
-			result.matrix[INDEX_AT(result, i, j)] = MATRIX_AT(matA, i, j) + MATRIX_AT(matB, i, j);
-		}
-	}
-
-	return result;
-}
-
-// subtracts values of matB from values of matA, given that they have the same dimensions
-// 
-// fmatrix_subtract_in(A, B);
-void fmatrix_subtract_in(fmatrix matA, fmatrix matB) {
-	if (matA.m != matB.m || matA.n != matB.n) {
-		printf("error while adding: \ndimension mismatch: ");
-		printf("matrix a: (%d x %d)  matrix b: (%d x %d)\n", matA.m, matA.n, matB.m, matB.n);
-		return;
-	}
-	for(int i = 0; i < matB.m; i++){
-		for (int j = 0; j < matA.n; j++) {
-			matA.matrix[INDEX_AT(matA, i, j)] -= matB.matrix[INDEX_AT(matB, i, j)];
-		}
-	}
-}
-
-// fmatrix diffAB = fmatrix_subtract_in(A, B);
-fmatrix fmatrix_subtract(fmatrix matA, fmatrix matB, pool *frame) {
-	if (matA.m != matB.m || matA.n != matB.n) {
-		printf("error while subtracting: \ndimension mismatch: ");
-		printf("matrix a: (%d x %d)  matrix b: (%d x %d)\n", matA.m, matA.n, matB.m, matB.n);
-		return ERROR_FMATRIX;
-	}
-
-	float* matrix;
-	if ((matrix = (float*)raw_pool_alloc(frame, matA.m * matA.n * sizeof(float))) == NULL) {
-		printf("error while adding: pool allocation failure\n");
-		return ERROR_FMATRIX;
-	}
-
-	fmatrix result = (fmatrix) {matA.m, matA.n, matrix};
-
-	for (int i = 0; i < matA.m; i++) {
-		for(int j = 0; j < matA.n; j++){
-			result.matrix[INDEX_AT(result, i, j)] = MATRIX_AT(matA, i, j) - MATRIX_AT(matB, i, j);
-		}
-	}
-
-	return result;
-}
-
-// scales all elements of mat by a float factor c
-// if c = 1 or c = 0, it tries to save time by following a different proceedure
-//
-// fmatrix_scale_in(A, 2.5);
-void fmatrix_scale_in(fmatrix mat, float c) {
-	if(c == 1.0) { return; }
-	int size = mat.m * mat.n;
-	if(c == 0.0) { memset(mat.matrix, 0, size); return; }
-
-	for(int i = 0; i < size; i++)
-		mat.matrix[i] *= c;
-}
-
-// fmatrix scaledA = fmatrix_scale_in(A, 2.5);
-fmatrix fmatrix_scale(fmatrix mat, float c, pool *frame) {
-	float* matrix;
-	int size = mat.m * mat.n;
-	if ((matrix = (float*)raw_pool_alloc(frame, size * sizeof(float))) == NULL) {
-		printf("error while scaling: \npool allocation failure\n");
-		return ERROR_FMATRIX;
-	}
-	fmatrix result = { mat.m, mat.n, matrix};
-
-	for (int i = 0; i < mat.m; i++) {
-		for(int j = 0; j < mat.n; j++){
-			result.matrix[INDEX_AT(result, i, j)] = c * mat.matrix[INDEX_AT(mat, i, j)];
-		}
-	}
-
-	return result;
-}
-
-// takes the sum of the products of elements of row i of matA times elements of col j of matB
-// assumes that matA.m = matB.n
-// used for fmatrix_multiply
-// may change slightly and rename to dot product
-//
-// prod[INDEX_AT(prod, i, j)] = get_fmultiplied(matA, matB, i, j);
-float get_fmultiplied(fmatrix matA, fmatrix matB, int i, int j) {
-	float result = 0.0;
-
-	for (int a = 0; a < matA.n; a++) {
-		//printf("matA[%d][%d] = %g, matB[%d][%d] = %g\n", i, a, MATRIX_AT(matA, i, a), a, j, (MATRIX_AT(matB, a, j)));
-		//print_fmatrix(matB);
-		result += (MATRIX_AT(matA, i, a)) * (MATRIX_AT(matB, a, j));
-	}
-
-	return result;
-}
-
-// inplace matrix multiplcation is possible, but hardly practical for general use.
-// maybe implement it for square matrices in the future
-void fmatrix_multiply_in(fmatrix matA, fmatrix matB) {
-	return; 
-}
-
-// multiplies matA and matB, given matA.n = matB.n. stores result in a new matrix in a pool
-// very basic and brute force. 
-//
-// fmatrix AB = fmatrix_multiply(A, B, &frame);
-fmatrix fmatrix_multiply(fmatrix matA, fmatrix matB, pool *frame) {
-	if (matA.n != matB.m) {
-		printf("error while multiplying: \ndimension mismatch: ");
-		printf("matrix a: (%d x _%d_)  matrix b: (_%d_ x %d)\n", matA.m, matA.n, matB.m, matB.n);
-		return ERROR_FMATRIX;
-	}
-	// new matrix has row count of A and col count of B
-	float* matrix;
-	if ((matrix = (float*)raw_pool_alloc(frame, matA.m * matB.n * sizeof(float))) == NULL) {
-		printf("error while multiplying: \npool allocation failure\n");
-		return ERROR_FMATRIX;
-	}
-
-	fmatrix result = (fmatrix){ matA.m, matB.n, matrix};
-
-	for (int i = 0; i < matA.m; i++) {
-		for(int j = 0; j < matB.n; j++){
-			matrix[INDEX_AT(result, i, j)] = get_fmultiplied(matA, matB, i, j);
-		}
-	}
-
-	return result;
-}
-
-// transposes mat in place
-// literally just swaps mat.m and mat.n, then flips the transpose flag
-// this works because the macros that read matrixes will check for the transpose flag and change
-// how it reads if so.
-// Regular matrix transpose is not that hard, so do it later, but still. This is constant time, 
-// (at the cost of branching while reading) and it doesn't require much overhead.
-// However, it could definitely lead to some problems if people don't know how transpose works 
-// in this library. Hence why I want to have both implementations
-//  
-// the inplace version is also useful for implementing column operations later
-//
-// fmatrix_transpose_int(&A);
-void fmatrix_transpose_in(fmatrix *mat) {
-	// swaps m and n, and marks mat as a transpose
-	intswap(&mat->m, &mat->n);
-	mat->transpose = !mat->transpose;
-}
-
-// fmatrix At = fmatrix_transpose(A, &frame);
-fmatrix fmatrix_transpose(fmatrix mat, pool* frame) {
-	fmatrix result = fmatrix_copy_alloc(mat, frame);
-	if (!result.matrix) { return result; }
-
-	fmatrix_transpose_in(&result);
-	return result;
-}
-
-
-// Elementary row operations (make sure to 0 index row)
-
-// multiplies all elements in row of mat by float c
-// tries to save on time if c = 0 or c = 1
-//
-// fmatrix_row_scale_in(A, 0, 2.5); // scales elements of row 1 by 2.5
-void fmatrix_row_scale_in(fmatrix mat, int row, float c) {
-	if (row >= mat.m || row < 0) {
-		printf("row_scale error: \nrow %d out of bounds (make sure you are 0-indexed)\n", row);
-		return;
-	}
-	if (c == 1.0) { return; }
-	if (c == 0.0 && !mat.transpose) { 
-		memset(&mat.matrix[INDEX_AT(mat, row, 0)], 0, mat.n * sizeof(float)); 
-		return; 
-	}
-
-	for (int i = 0; i < mat.n; i++) 
-		mat.matrix[INDEX_AT(mat, row, i)] *= c;
-}
-
-// fmatrix scaleR1 = fmatrix_row_scale(A, 0, 2.5), &frame; // scales elements of row 1 by 2.5
-fmatrix fmatrix_row_scale(fmatrix mat, int row, float c, pool *frame) {
-	if (row >= mat.m || row < 0) {
-		printf("row_scale error: \nrow %d out of bounds (make sure you are 0-indexed)\n", row);
-		return ERROR_FMATRIX;
-	}
-
-	fmatrix result = fmatrix_copy_alloc(mat, frame);
-	if(!result.matrix){return result;}
-
-	fmatrix_row_scale_in(result, row, c);
-	return result;
-}
-
-// swaps elements of row1 of mat with elements of row2
-//
-// fmatrix_row_swap_in(A, 0, 2); // swaps R1 and R2 of A
-void fmatrix_row_swap_in(fmatrix mat, int row1, int row2) {
-	if (row1 >= mat.m || row1 < 0) {
-		printf("row_swap error: \nrow1 %d out of bounds (make sure you are 0-indexed)\n", row1);
-		return;
-	}
-	if (row2 >= mat.m || row2 < 0) {
-		printf("row_swap error: \nrow2 %d out of bounds (make sure you are 0-indexed)\n", row2);
-		return;
-	}
-
-	if(row1 == row2){ return; } // no change necessary
-
-	for (int i = 0; i < mat.n; i++) {
-		fswap(&mat.matrix[INDEX_AT(mat, row1, i)], 
-			  &mat.matrix[INDEX_AT(mat, row2, i)]);
-	}
-}
-
-// fmatrix swapR12 = fmatrix_row_swap(A, 0, 2, &frame); // swaps R1 and R2 of A
-fmatrix fmatrix_row_swap(fmatrix mat, int row1, int row2, pool *frame) {
-	if (row1 >= mat.m || row1 < 0) {
-		printf("row_swap error: \nrow1 %d out of bounds (make sure you are 0-indexed)\n", row1);
-		return (fmatrix){ 0, 0, NULL};
-	}
-	if (row2 >= mat.m || row2 < 0) {
-		printf("row_swap error: \nrow2 %d out of bounds (make sure you are 0-indexed)\n", row2);
-		return (fmatrix){ 0, 0, NULL};
-	}
-
-	fmatrix result = fmatrix_copy_alloc(mat, frame);
-	if(!result.matrix){return result;}
-
-	fmatrix_row_swap_in(result, row1, row2);
-	return result;
-}
-
-// elements of dest row of mat becomes c1 * dest added to c2 * elements of src row
-// tries to save time if c1 or c2 equal 0
-//
-// fmatrix_row_sum_in(A, 0, 3, 1, 0.5) // R1 <- 3R1 + 0.5R2
-void fmatrix_row_sum_in(fmatrix mat, int dest, float c1, int src, float c2) {
-	if (dest >= mat.m || dest < 0) {
-		printf("row_sum error: dest row %d out of bounds (make sure you are 0-indexed)\n", dest);
-		return;
-	}
-	if (src >= mat.m || src < 0) {
-		printf("row_sum error: src row %d out of bounds (make sure you are 0-indexed)\n", src);
-		return;
-	}
-
-	float value;
-	for (int i = 0; i < mat.n; i++) {
-		value = 0.0f;
-		if(c1 != 0){value += (c1 * MATRIX_AT(mat, dest, i));}
-		if(c2 != 0){value += (c2 * MATRIX_AT(mat, src,  i));}
-		// result[INDEX_AT(mat, dest, i)] = (c1 * (MATRIX_AT(mat, dest, i))) + (c2 * (MATRIX_AT(mat, src, i)));
-		mat.matrix[INDEX_AT(mat, dest, i)] = value;
-	}
-}
-
-// fmatrix A2 = fmatrix_row_sum(A, 0, 3, 1, 0.5) // R1 <- 3R1 + 0.5R2
-fmatrix fmatrix_row_sum(fmatrix mat, int dest, float c1, int src, float c2, pool* frame) {
-	if (dest >= mat.m || dest < 0) {
-		printf("row_sum error: dest row %d out of bounds (make sure you are 0-indexed)\n", dest);
-		return (fmatrix){ 0, 0, NULL};
-	}
-	if (src >= mat.m || src < 0) {
-		printf("row_sum error: src row %d out of bounds (make sure you are 0-indexed)\n", src);
-		return (fmatrix){ 0, 0, NULL};
-	}
-
-	fmatrix result = fmatrix_copy_alloc(mat, frame);
-	if(!result.matrix){ return result; }
-
-	fmatrix_row_sum_in(result, dest, c1, src, c2);
-	return result;
-}
-
-
-// elementary column operations
-// This are all the "easy" methods. They transpose the input matrix, then run their respective row operation on
-// it, then transpose it back. I'll implement direct methods later, but I wanted to demonstrate how efficient 
-// transpose could be
-
-// scales elements of a column by a factor of c
-void fmatrix_col_scale_in(fmatrix mat, int col, float c) {
-	if (col >= mat.n || col < 0) {
-		printf("col_scale error: \ncol %d out of bounds (make sure you are 0-indexed)\n", col);
-		return;
-	}
-
-	fmatrix_transpose_in(&mat);
-	fmatrix_row_scale_in(mat, col, c);
-	fmatrix_transpose_in(&mat);
-}
-
-fmatrix fmatrix_col_scale(fmatrix mat, int col, float c, pool* frame) {
-	if (col >= mat.n || col < 0) {
-		printf("col_scale error: \ncol %d out of bounds (make sure you are 0-indexed)\n", col);
-		return ERROR_FMATRIX;
-	}
-
-	fmatrix result = fmatrix_copy_alloc(mat, frame);
-	if(!result.matrix){ return result; }
-
-	fmatrix_col_scale_in(mat, col, c);
-	return result;
-}
-
-void fmatrix_col_swap_in(fmatrix mat, int col1, int col2) {
-	if (col1 >= mat.m || col1 < 0) {
-		printf("col_swap error: \ncol1 %d out of bounds (make sure you are 0-indexed)\n", col1);
-		return;
-	}
-	if (col2 >= mat.m || col2 < 0) {
-		printf("col_swap error: \ncol2 %d out of bounds (make sure you are 0-indexed)\n", col2);
-		return;
-	}
-
-	if(col1 == col2){ return; } // no change necessary
-
-	fmatrix_transpose_in(&mat);
-	fmatrix_row_swap_in(mat, col1, col2);
-	fmatrix_transpose_in(&mat);
-}
-
-fmatrix fmatrix_col_swap(fmatrix mat, int col1, int col2, pool* frame) {
-	if (col1 >= mat.m || col1 < 0) {
-		printf("col_swap error: \ncol1 %d out of bounds (make sure you are 0-indexed)\n", col1);
-		return ERROR_FMATRIX;
-	}
-	if (col2 >= mat.m || col2 < 0) {
-		printf("col_swap error: \ncol2 %d out of bounds (make sure you are 0-indexed)\n", col2);
-		return ERROR_FMATRIX;
-	}
-
-	fmatrix result = fmatrix_copy_alloc(mat, frame);
-	if(!result.matrix){ return result; }
-
-	fmatrix_col_swap_in(mat, col1, col2);
-	return result;
-}
-
-void fmatrix_col_sum_in(fmatrix mat, int dest, float c1, int src, float c2) {
-	if (dest >= mat.m || dest < 0) {
-		printf("col_sum error: \ndest col %d out of bounds (make sure you are 0-indexed)\n", dest);
-		return;
-	}
-	if (src >= mat.m || src < 0) {
-		printf("col_sum error: \nsrc col %d out of bounds (make sure you are 0-indexed)\n", src);
-		return;
-	}
-
-	fmatrix_transpose_in(&mat);
-	fmatrix_row_sum_in(mat, dest, c1, src, c2);
-	fmatrix_transpose_in(&mat);
-}
-
-fmatrix fmatrix_col_sum(fmatrix mat, int dest, float c1, int src, float c2, pool *frame) {
-	if (dest >= mat.m || dest < 0) {
-		printf("col_sum error: \ndest col %d out of bounds (make sure you are 0-indexed)\n", dest);
-		return ERROR_FMATRIX;
-	}
-	if (src >= mat.m || src < 0) {
-		printf("col_sum error: \nsrc col %d out of bounds (make sure you are 0-indexed)\n", src);
-		return ERROR_FMATRIX;
-	}
-
-	fmatrix result = fmatrix_copy_alloc(mat, frame);
-	if(!result.matrix){ return result;}
-
-	fmatrix_col_sum_in(result, dest, c1, src, c2);
-	return result;
-}
-
-
 // Determinants
 // This is probably the second place where I can really hone down and optimize. For now, I'll just do basic
 // cofactor expansion because it is recursive and that's cool
 
 
-// finds a row to swap a 0 pivot with. returns -1 if none is found
-// used in functions that use gaussian elimination, such as fmatrix_triangle_determinant
-int find_pivot_row(fmatrix mat, int pivot_row, int col) {
-	for (int j = pivot_row; j < mat.m; j++) {
-		if (MATRIX_AT(mat, j, col) != 0) { return j; }
-	}
-	return -1;
-}
 
 // Cofactor expansion is complicated to implement. I'll do it later. For now, I think getting det from triangulating a matrix is a 
 // better idea. The stuff I figure out here will be useful for finding inverses as well.
 // Maybe move the gaussian elimination stuff to its own function? many matrix things use it. Maybe have an "eliminate from column" thing
 
-// calculates determinant of a square matrix by triangulating it.
-// copies the matrix to do operations to for now. It seems like you could do this lazily without copying or editing the matrix at all,
-// but worry about that later
+// calculates determinant of a square matrix by triangulating it, with the pivoted LU from fmatrix_LU_decompose: det(A) is the
+// product of U's diagonal times the sign of the row permutation. The factorization is freed before returning.
+// (it used to scale rows during elimination and divide the scaling back out at the end, which overflowed for moderate sizes)
 // Assumes that mat is a square matrix
 float fmatrix_triangle_determinant(fmatrix mat, pool *frame) {
-
-	fmatrix temp_mat = fmatrix_copy_alloc(mat, frame); // allocate a temporary copy of the input mat
-
-	float track = 1.0; // row operations will influence this value, which we divide by at the end
-
-	// gauss jordan (for each column, turn each element underneath the pivot into a 0 with row operations. Track the row operations in track
-	int pivot_row;
-	float pivot, row_value, result = 1.0;
-	for (int i = 0; i < temp_mat.n; i++) {
-		pivot_row = find_pivot_row(temp_mat, i, i);							// find a pivot in col i
-		if(pivot_row == -1) { result = 0; break; }							// if none is found, det is 0
-		if(pivot_row != i){ fmatrix_row_swap_in(temp_mat, i, pivot_row); }  // if pivot is not at row i, swap it in
-		pivot = MATRIX_AT(temp_mat, i, i);
-
-		// now that pivot is found, eliminate elements below it
-		for (int j = i + 1; j < temp_mat.m; j++) {
-			//printf("\nA: (pivot is %g)\n", pivot);
-			//print_fmatrix(temp_mat);
-			row_value = MATRIX_AT(temp_mat, j, i);
-			if (row_value == 0.0) { continue; } // if element is already 0, don't eliminate
-			fmatrix_row_sum_in(temp_mat, j, pivot, i, -row_value);
-			track *= pivot;
-		}
-		result *= pivot; // multiply the found diagonal into result
-	}
-
-	// free the temporary metrix from the pool
-	void* check = pool_free_from(frame, temp_mat.matrix);
-	if (check == NULL) {
-		printf("Failed to free temporary copy matrix from triangle determinant\n");
-		return -1;
-	}
-
-	return result / track;
+	INSTRUMENT_BEGIN(MATRIX_OP_TRIANGLE_DETERMINANT, mat, ERROR_FMATRIX);
+	void* start = frame->ptr;
+	flu F = fmatrix_LU_decompose(mat, frame);
+	float result = flu_determinant(F);
+	pool_free_from(frame, start);
+	INSTRUMENT_END();
+	return result;
 }
 
 // takes a matrix, its upper and low row index, and its upper and lower column index. These indices bound the matrix we are finidng
@@ -711,278 +174,242 @@ float fmatrix_cofactor_expansion(fmatrix mat, int lr, int lc, int ur, int uc) {
 }
 
 // checks if mat is non square, then calls whichever determinent function to use
-
+// returns NAN for a non square matrix. For large matrices, where the determinant easily overflows or underflows a float, use
+// fmatrix_log_determinant. To get the determinant of a matrix that's already factored, use flu_determinant
+//
+// float det = fmatrix_determinant(A, &frame);
 float fmatrix_determinant(fmatrix mat, pool *frame) {
 	if (mat.m != mat.n) {
 		printf("The determinant for a non square matrix (%d x %d) does not exist\n", mat.m, mat.n);
-		exit(0); // okay do something else instead 
+		return NAN;
 	}
 
 	//return fmatrix_cofactor_expansion(mat, 0, 0, mat.m - 1, mat.n - 1);
 	//return fmatrix_triangle_determinant(mat);
-	return fmatrix_triangle_determinant(mat, frame);
+	INSTRUMENT_BEGIN(MATRIX_OP_DETERMINANT, mat, ERROR_FMATRIX);
+	float result = fmatrix_triangle_determinant(mat, frame);
+	INSTRUMENT_END();
+	return result;
 }
 
-
-// matrix inversion stuff
-
-// finds and returns the inverse of mat. 
-// returns ERROR_FMATRIX if an mat is not invertible
-fmatrix fmatrix_inverse(fmatrix mat, pool* frame) {
-	if (mat.m != mat.n) { return ERROR_FMATRIX; }
-
-	fmatrix result = fmatrix_create_identity(mat.m, mat.n, frame);	// initialize an identity matrix
-	fmatrix mat_copy = fmatrix_copy_alloc(mat, frame);				// for not modifying the input matrix. allocate second to free later
-
-	int pivot_row;
-	float row_value;												// for checking if we even need to make an elimination for an element
-	for (int i = 0; i < mat_copy.n; i++) {							// for each column, iterate and eliminate elements below pivots
-		pivot_row = find_pivot_row(mat_copy, i, i);
-		if(pivot_row == -1) { return ERROR_FMATRIX; }				// no pivot was found, so mat is not invertible
-		if(pivot_row != i) { 
-			fmatrix_row_swap_in(mat_copy, i, pivot_row);			// swap the located pivot to the proper row
-			fmatrix_row_swap_in(result, i, pivot_row);				// do it for the result matrix as well
-		}
-
-		float normalize = 1.0f / MATRIX_AT(mat_copy, i, i);
-		fmatrix_row_scale_in(mat_copy, i, normalize);				// set the pivot to 1 by scaling its row
-		fmatrix_row_scale_in(result, i, normalize);
-		
-		// for each row, eliminate elements under the pivot
-		for (int j = 0; j < mat_copy.m; j++) {
-			if(i == j) { continue; }								// don't eliminate the pivot
-			row_value = MATRIX_AT(mat_copy, j, i);
-			if(row_value == 0){ continue; }							// no elimination necessary
-			fmatrix_row_sum_in(mat_copy, j, 1.0f, i, -row_value);	// eliminate the element
-			fmatrix_row_sum_in(result,	 j, 1.0f, i, -row_value);
-		}
-	}
-
-	// free the temporary matrix from the pool
-	void* check = pool_free_from(frame, mat_copy.matrix);
-	if (check == NULL) {
-		printf("Failed to free temporary copy matrix from triangle determinant\n");
-		return ERROR_FMATRIX;
-	}
-
-	return(result);
+// returns log|det(mat)|, and sets sign (if it isn't NULL) to the sign of the determinant (-1, 0 or 1), so det = sign * exp(result).
+// stays finite where the determinant itself would overflow. Singular matrices give -INFINITY with a sign of 0, and non square ones
+// give NAN. Nothing is left on frame
+//
+// int sign;
+// float log_det = fmatrix_log_determinant(A, &sign, &frame);
+float fmatrix_log_determinant(fmatrix mat, int* sign, pool* frame) {
+	if (mat.m != mat.n) {
+		printf("The determinant for a non square matrix (%d x %d) does not exist\n", mat.m, mat.n);
+		if (sign != NULL) { *sign = 0; }
+		return NAN;
+	}
+	INSTRUMENT_BEGIN(MATRIX_OP_LOG_DETERMINANT, mat, ERROR_FMATRIX);
+	void* start = frame->ptr;
+	flu F = fmatrix_LU_decompose(mat, frame);
+	float result = flu_log_determinant(F, sign);
+	pool_free_from(frame, start);
+	INSTRUMENT_END();
+	return result;
 }
 
 
 // functions for finding basis for the 4 spaces (row/column space, null/left null space)
 
-// finds and returns a basis for the column space of mat
-// uses gaussian elimination to find the pivot columns
-// as we iterate through columns, "organize" the matrix s.t:
-//	-pivot columns are on the left
-//	-free columns are on the right
-// The goal is to then edit the copied matrix to only include the vectors that form a basis for the null space
-// However, even if I swap free columns to the right, they show up in memory in row major order. 
-// So, I can't just use pool_free_from starting from the first free column.
-// I could potentially write a proper in place transpose function, then use free from, then edit the fmatrix dimensions, then transpose back
-// But there could be an easier and more efficient way
-// For now, I am allocating another fmatrix on the pool, putting the pivot columns into it, then returning that
-// you could allocate room for the result fmatrix, then the copy, and then at the end, free from the start of unused columns in result?
-// I would rather work towards doing it all inside the copy matrix
+// finds and returns an orthonormal basis for the column space of mat, one basis vector per column (m x rank)
+// uses a column pivoted QR (see qrFactorization.h), so the rank is decided with a tolerance instead of exact 0 pivot tests,
+// and nothing but the result is left on frame. For the other subspaces, or several at once, use fmatrix_subspaces.
+// if mat is the 0 matrix, returns a single 0 vector (the span of the columns of a 0 matrix is just 0)
+//
+// fmatrix basis = fmatrix_col_space(A, &frame);
 fmatrix fmatrix_col_space(fmatrix mat, pool* frame) {
-	fmatrix mat_cpy = fmatrix_copy_alloc(mat, frame);
-
-	int pivot_row;					// the row number of a located pivot
-	int check_row = 0;				// indicates which row to swap with the located pivot
-	int swap_col = -1;				// indicates index of a column where no pivot was located. If column is found to have a pivot, swap it with this one.
-	int rank = 0;					// counts the number of pivot columns
-	float pivot_value, row_value;
-	//float pivot_value;
-
-	// iterate through each column. If a pivot is found, eliminate all values below it, then add the column to our column space. 
-	//  If not, check the next column for a pivot, without increasing the row at which to check for that pivot
-	for (int i = 0; i < mat_cpy.n; i++) {
-		pivot_row = find_pivot_row(mat_cpy, check_row, i);
-		if (pivot_row == -1) {						// if no pivot is found, then the column is not part of the col space
-			if(swap_col == -1) { swap_col = i; }	// if no free column has been marked for swapping, mark this one.
-			continue; 
-		} 
-
-		if (pivot_row != check_row) { fmatrix_row_swap_in(mat_cpy, pivot_row, check_row); }
-		pivot_value = MATRIX_AT(mat_cpy, check_row, i);
-
-		// eliminate all elements under the pivot
-		for (int j = check_row + 1; j < mat_cpy.m; j++) {
-			row_value = MATRIX_AT(mat_cpy, j, i);
-			if (row_value == 0.0) { continue; } // if element is already 0, don't eliminate
-			fmatrix_row_sum_in(mat_cpy, j, pivot_value, pivot_row, -row_value); // eliminate the element
-			//print_fmatrix(mat_cpy);
-		}
-
-		check_row++;	// increment which row to check for pivots
-		rank++;			// another free column has been found, so increase the rank.
-
-		// if a marked free column exists for swapping, swap with the located pivot
-		if(swap_col == -1) { continue; }
-		
-		fmatrix_col_swap_in(mat_cpy, swap_col, i);		// swap the column
-		swap_col++;										// increment which column to swap.
-	}
-
-	// if the rank is 0 (mat is the 0 matrix), then return {0}
-	// The span of the columns of a 0 matrix is just 0
-	if (rank == 0) {
-		float zero[1][1] = {{0.0f}};
-		fmatrix result = create_fmatrix(1, 1, zero, frame);
-		return result;
-	}
-
-	// allocate another fmatrix, then store the pivot columns inside it. 
-	fmatrix result = fmatrix_ncol_copy_alloc(mat_cpy, rank, frame);
-
+	INSTRUMENT_BEGIN(MATRIX_OP_COL_SPACE, mat, ERROR_FMATRIX);
+	fmatrix result = fmatrix_subspaces(mat, 0.0f, SUBSPACE_COL, frame).col;
+	INSTRUMENT_END();
 	return result;
 }
 
 
-// row space of A is equal to the col space of the transpose of A
-// seems to fail when passed already transposed matrices
+// finds and returns an orthonormal basis for the row space of mat, one basis vector per row (rank x n)
+// comes from the same factorization as the column space, so it works on transposed matrices too
+//
+// fmatrix basis = fmatrix_row_space(A, &frame);
 fmatrix fmatrix_row_space(fmatrix mat, pool* frame) {
-	fmatrix_transpose_in(&mat);
-	fmatrix result = fmatrix_col_space(mat, frame);
-	fmatrix_transpose_in(&result);
-	//print_fmatrix(result);
-	fmatrix_transpose_in(&mat);
+	INSTRUMENT_BEGIN(MATRIX_OP_ROW_SPACE, mat, ERROR_FMATRIX);
+	fmatrix result = fmatrix_subspaces(mat, 0.0f, SUBSPACE_ROW, frame).row;
+	INSTRUMENT_END();
 	return result;
 }
 
 
-// Factorizations and Decompositions
-// These functions take in a matrix input, but need to return multiple matrices that make up the respective factorization/decompositon
-// Each factorization has a defined number of matrices that make up its factorization, so for now, convention is to simply return an array of fmatrix pointers
-
-
-// Technically, this function does PLU factorization
-// PA = LU such that L is lower triangular, U is upper triangular, and P is a permutation matrix
-// A permutation matrix is simply an identity matrix that has undergone row swaps. In this case, the row swaps we do correspond to the row
-// swaps required to get A to be able to be row reduced to an upper triangular matrix. For matrices that need no row swaps, P is just identity
-// 
-// This function takes in mat, and populates an fmatrix array, with the first element being P, the second being L and the third being U
-// Works for matrices that require partial pivoting, but not non-square matrices FOR NOW
-// In the case that no LU factorization exists, (mat is "rank-deficient") free data from pool starting from U.matrix, then return NULL.
-// Usage: This one requires you to pass in a declared fmatrix array:
-// fmatrix PLU[3];
-// if(fmatrix_LU_factorize(A, PLU, &frame) == NULL){
-//     printf("LU factorization for A does not exist");
-// }
-fmatrix* fmatrix_LU_factorize(fmatrix mat, fmatrix PLU[3], pool* frame) {
-	if (mat.m != mat.n) { return NULL; } // does not handle rectangular matrices for now
-
-	// initialize P, L, and U
-	fmatrix P, L, U;
-	if((P = fmatrix_create_identity(mat.m, mat.n, frame)).matrix == NULL){ return NULL; }
-	if((L = fmatrix_create_identity(mat.m, mat.n, frame)).matrix == NULL){ return NULL; }
-	if((U = fmatrix_copy_alloc(mat, frame)).matrix == NULL){ return NULL; }
-
-	// row reduce U into an upper triangular matrix
-	int pivot_row;
-	float pivot_value;
-	for (int i = 0; i < U.n; i++) {
-		pivot_row = find_pivot_row(U, i, i);
-		if (pivot_row == -1) {						// if no pivot row is found, mat is rank-deficient
-			pool_free_from(frame, P.matrix);
-			return NULL;
-		}
-		if (pivot_row != i) {						// pivot row is found, but requires a pivot (row swap)
-			fmatrix_row_swap_in(U, i, pivot_row);	// track row swaps in the permutation/pivot matrix P
-			fmatrix_row_swap_in(P, i, pivot_row);
-		}
-		pivot_value = MATRIX_AT(U, i, i);
+// Precision conversions
+// Both keep mat's storage layout and transpose flag, so the copy is one linear pass over the elements. A packed fmatrix is the
+// exception, since dmatrix has no kinds: it's unpacked into a dense double copy
 
-		// eliminate lower elements
-		for (int j = i + 1; j < U.m; j++) {
-			float row_value = MATRIX_AT(U, j, i);
-			if(row_value == 0){ continue; } 
-
-			float k = (row_value / pivot_value);
-			fmatrix_row_sum_in(U, j, 1, i, -k);
-			L.matrix[INDEX_AT(L, j, i)] = k;		// track eliminations in L
+// returns a double copy of mat, allocated on frame
+//
+// dmatrix Ad = fmatrix_to_dmatrix(A, &frame);
+dmatrix fmatrix_to_dmatrix(fmatrix mat, pool* frame) {
+	INSTRUMENT_BEGIN(MATRIX_OP_TO_DOUBLE, mat, ERROR_FMATRIX);
+	int size = mat.m * mat.n;
+	double* matrix = raw_pool_alloc(frame, size * sizeof(double));
+	if (matrix == NULL) {
+		printf("error while converting to double: pool allocation failure\n");
+		INSTRUMENT_END();
+		return ERROR_DMATRIX;
+	}
+	// dmatrix has no packed kinds, so a packed mat comes out dense and row major
+	if (mat.kind != FMATRIX_GENERAL) {
+		for (int i = 0; i < mat.m; i++) {
+			for (int j = 0; j < mat.n; j++) { matrix[i * mat.n + j] = (double)fmatrix_at(mat, i, j); }
 		}
+		INSTRUMENT_END();
+		return (dmatrix) { mat.m, mat.n, matrix, 0 };
 	}
-	// populate the passed in array
-	PLU[0] = P;
-	PLU[1] = L;
-	PLU[2] = U;
+	for (int i = 0; i < size; i++) { matrix[i] = (double)mat.matrix[i]; }
 
-	return PLU;
+	INSTRUMENT_END();
+	return (dmatrix) { mat.m, mat.n, matrix, mat.transpose };
 }
 
-// You can solve a system of n equations in n variables quickly using LU factorization. 
-// let Ax = b (A and b are given, A is m x m, and b = m x 1)
-// let PA = LU (where P is a permutation matrix, L is lower triangular, and U is upper triangular)
-// so: P^tLUx = b, and LUx = Pb
-// let y = Ux
-// so: Ly = Pb
-// L is lower triangular, so it is easy to solve for y in Ly = b
-// Ux = y
-// U is upper triangular, and y is now known, so it is easy to solve for x
-// 
-// Takes in m x m matrix A, m x 1 vector b, then returns an m x 1 vector x
-// If LU_factorize returns NULL, then handle that somehow.
-// If this happens, then there are either infinite solutions, or zero. Maybe return matrices that indicate this?
-// They need to be seperate from ERROR_FMATRIX, which should only return on actual errors
-fmatrix fmatrix_LU_solve(fmatrix A, fmatrix b, pool* frame) {
-	if (A.m != A.n) {
-		printf("Solving a system requires a square matrix (for now)\n");
+// returns a float copy of mat, allocated on frame. Values are rounded to the nearest float
+//
+// fmatrix x = dmatrix_to_fmatrix(xd, &frame);
+fmatrix dmatrix_to_fmatrix(dmatrix mat, pool* frame) {
+	INSTRUMENT_BEGIN(MATRIX_OP_TO_FLOAT, ((fmatrix){ mat.m, mat.n, NULL, mat.transpose }), ERROR_FMATRIX);
+	int size = mat.m * mat.n;
+	float* matrix = raw_pool_alloc(frame, size * sizeof(float));
+	if (matrix == NULL) {
+		printf("error while converting to float: pool allocation failure\n");
+		INSTRUMENT_END();
 		return ERROR_FMATRIX;
 	}
-	if (b.m != A.m && b.n != 1) {
-		printf("Solving a system requires b to be m x 1, where m is A.m\n");
-		return ERROR_FMATRIX;
+	for (int i = 0; i < size; i++) { matrix[i] = (float)mat.matrix[i]; }
+
+	INSTRUMENT_END();
+	return (fmatrix) { mat.m, mat.n, matrix, mat.transpose };
+}
+
+
+// Mixed precision solve
+// Factoring in float is the expensive part of a solve (O(n^3)), while a residual is only O(n^2). So A is factored once in float, and
+// the answer is polished in double by iterative refinement:
+//   r = b - Ax (in double), solve LUd = Pr with the float factors, x += d, repeat
+// Each step gains roughly as many digits as float has over log10 of A's condition number, so for reasonably conditioned A a few
+// steps reach double accuracy. If the residual stops shrinking (A is too ill conditioned for the float factors to help), it
+// falls back to dmatrix_LU_solve.
+
+// ||r||_inf
+static double max_abs(const double* r, int n) {
+	double result = 0.0;
+	for (int i = 0; i < n; i++) { result = fmax(result, fabs(r[i])); }
+	return result;
+}
+
+// r = b - Ax for n x n A and n x 1 x, b, all in double
+static void residual(dmatrix A, const double* x, const double* b, double* r) {
+	for (int i = 0; i < A.m; i++) {
+		double sum = b[i];
+		for (int j = 0; j < A.n; j++) { sum -= MATRIX_AT(A, i, j) * x[j]; }
+		r[i] = sum;
 	}
+}
 
-	// get the PLU factorization of A, and check if it even exists. 
-	// for now, just return, but in the future actually handle the case
-	fmatrix PLU[3];
-	if (fmatrix_LU_factorize(A, PLU, frame) == NULL) { return A; }
-	fmatrix P = PLU[0];
-	fmatrix L = PLU[1];
-	fmatrix U = PLU[2];
-
-	// allocate space for x and y, but do x first so we can free up y at the end
-	fmatrix x = fmatrix_create_zero(A.m, 1, frame);
-	if (x.matrix == NULL) {return ERROR_FMATRIX; }
-	fmatrix y = fmatrix_create_zero(A.m, 1, frame);
-	if (y.matrix == NULL) { 
-		pool_free_from(frame, x.matrix);
-		return ERROR_FMATRIX; 
+// solves LUd = Pr with the float factors from fmatrix_LU_factorize, where perm[i] is the row of r that P moves to row i.
+// d doubles as the forward substitution's scratch
+static void plu_correction(fmatrix L, fmatrix U, const int* perm, const double* r, double* d) {
+	int n = L.m;
+	for (int i = 0; i < n; i++) {
+		float sum = (float)r[perm[i]];
+		for (int j = 0; j < i; j++) { sum -= MATRIX_AT(L, i, j) * (float)d[j]; }
+		d[i] = sum;
 	}
+	for (int i = n - 1; i >= 0; i--) {
+		float sum = (float)d[i];
+		for (int j = i + 1; j < n; j++) { sum -= MATRIX_AT(U, i, j) * (float)d[j]; }
+		d[i] = sum / MATRIX_AT(U, i, i);
+	}
+}
 
-	// also allocate a copy of p, so we can permute it (LUx = Pb)
-	// I wonder if we can do this lazily, just by accessing the correct element of b
-	fmatrix Pb = fmatrix_multiply(P, b, frame);
+// solves Ax = b to double accuracy with a float factorization (see above). A is n x n and b is n x 1, x is allocated on frame.
+// if iterations isn't NULL, it gets the number of refinement steps taken, or -1 if it had to fall back to a double solve
+// returns ERROR_DMATRIX on failure
+//
+// int steps;
+// dmatrix x = dmatrix_mixed_LU_solve(A, b, &steps, &frame);
+dmatrix dmatrix_mixed_LU_solve(dmatrix A, dmatrix b, int* iterations, pool* frame) {
+	if (A.m != A.n || b.m != A.m || b.n != 1) {
+		printf("mixed precision solve requires an n x n A and an n x 1 b (A is %d x %d, b is %d x %d)\n", A.m, A.n, b.m, b.n);
+		return ERROR_DMATRIX;
+	}
+	INSTRUMENT_BEGIN(MATRIX_OP_MIXED_LU_SOLVE, ((fmatrix){ A.m, A.n, NULL, A.transpose }), ((fmatrix){ b.m, b.n, NULL, b.transpose }));
+	int n = A.m;
+	if (iterations != NULL) { *iterations = 0; }
+
+	void* start = frame->ptr;
+	dmatrix x = dmatrix_create_zero(n, 1, frame);
+	void* workspace = frame->ptr;
+	double* rhs = raw_pool_alloc(frame, n * sizeof(double));
+	double* r = raw_pool_alloc(frame, n * sizeof(double));
+	double* d = raw_pool_alloc(frame, n * sizeof(double));
+	int* perm = raw_pool_alloc(frame, n * sizeof(int));
+	fmatrix Af = dmatrix_to_fmatrix(A, frame);
+	if (x.matrix == NULL || rhs == NULL || r == NULL || d == NULL || perm == NULL || Af.matrix == NULL) {
+		printf("mixed precision solve error: pool allocation failure\n");
+		pool_free_from(frame, start);
+		INSTRUMENT_END();
+		return ERROR_DMATRIX;
+	}
+	for (int i = 0; i < n; i++) { rhs[i] = MATRIX_AT(b, i, 0); }
 
-	// consider putting the following two loops into their own functions (forward solve/back solve)
-	// It isn't very difficult to do this, but I don't need it at the moment, so I'll leave them as they are.
+	fmatrix PLU[3];
+	int converged = 0;
+	if (fmatrix_LU_factorize(Af, PLU, frame) != NULL) {
+		// P is an identity with swapped rows, so row i of Pr is r[perm[i]]
+		for (int i = 0; i < n; i++) {
+			for (int j = 0; j < n; j++) {
+				if (MATRIX_AT(PLU[0], i, j) != 0.0f) { perm[i] = j; break; }
+			}
+		}
 
-	// Ly = Pb, solve for y
-	for (int r = 0; r < L.m; r++) {
-		// iterate through the current row until you reach the diagonal 
-		float b_r = Pb.matrix[r]; // use elements of b to determine corresponding elements of y
-		for (int c = 0; c < r; c++) {
-			b_r -= (y.matrix[c] * MATRIX_AT(L, r, c));
-			//printf("uh: %f * %f = %f\n", y.matrix[c], MATRIX_AT(L, r, c), y.matrix[c] * MATRIX_AT(L, r, c));
+		// scale for the stopping test: the residual can't get much below the rounding error of computing Ax
+		double norm_A = 0.0;
+		for (int i = 0; i < n; i++) {
+			double sum = 0.0;
+			for (int j = 0; j < n; j++) { sum += fabs(MATRIX_AT(A, i, j)); }
+			norm_A = fmax(norm_A, sum);
 		}
-		y.matrix[r] = b_r; // For now, diagonal elements of L are 1.0. Make sure to change this line if that changes
-	}
 
-	// Ux = y, solve for x (iterate from the bottom)
-	for (int r = U.m - 1; r >= 0; r--) {
-		// iterate backwards through the current row until you reach the diagonal 
-		float y_r = y.matrix[r]; // use elements of y to determine corresponding elements of x
-		for (int c = U.n - 1; c > r; c--) {
-			y_r -= (x.matrix[c] * MATRIX_AT(U, r, c));
-			//printf("uh: %f * %f = %f\n", y.matrix[c], MATRIX_AT(L, r, c), y.matrix[c] * MATRIX_AT(L, r, c));
+		memcpy(r, rhs, n * sizeof(double));		// x starts at 0
+		double previous = max_abs(r, n);
+		for (int step = 1; step <= MIXED_REFINE_MAX_ITERATIONS; step++) {
+			plu_correction(PLU[1], PLU[2], perm, r, d);
+			for (int i = 0; i < n; i++) { x.matrix[i] += d[i]; }
+			residual(A, x.matrix, rhs, r);
+			if (iterations != NULL) { *iterations = step; }
+
+			double norm_r = max_abs(r, n);
+			if (norm_r <= n * DBL_EPSILON * norm_A * max_abs(x.matrix, n)) { converged = 1; break; }
+			if (!(norm_r < 0.5 * previous)) { break; }		// stalled (or NaN)
+			previous = norm_r;
 		}
-		x.matrix[r] = y_r / MATRIX_AT(U, r, r); 
+	}
+	pool_free_from(frame, workspace);
+
+	// the float factors couldn't get there, so pay for a double factorization
+	if (!converged) {
+		if (iterations != NULL) { *iterations = -1; }
+		dmatrix solved = dmatrix_LU_solve(A, b, frame);
+		if (solved.matrix == NULL || solved.matrix == A.matrix) {		// dmatrix_LU_solve returns A when it's singular
+			printf("mixed precision solve failed: A is singular\n");
+			pool_free_from(frame, x.matrix);
+			INSTRUMENT_END();
+			return ERROR_DMATRIX;
+		}
+		memcpy(x.matrix, solved.matrix, n * sizeof(double));
+		pool_free_from(frame, workspace);
 	}
 
-	// free up y, which won't be used anymore
-	pool_free_from(frame, y.matrix);
-
+	INSTRUMENT_END();
 	return x;
 }
@@ -21,6 +21,7 @@
 
 // error matrix
 # define ERROR_FMATRIX (fmatrix){ 0, 0, NULL, 0 }
+# define ERROR_DMATRIX (dmatrix){ 0, 0, NULL, 0 }
  /*
 // I have a really strange idea that I want to work with later.
 // I'll use the transpose operation as an example. normally, it takes O(mn), because we
@@ -55,6 +56,17 @@
 //				(Do it in a column-major accumulation process so we aren't jumping around the array)
 */
 
+// structure of an fmatrix, which decides how its elements are stored (see structuredMatrix.h). Everything but
+// FMATRIX_GENERAL is packed, so MATRIX_AT/INDEX_AT only work on general matrices; fmatrix_at reads any of them
+typedef enum {
+	FMATRIX_GENERAL,			// m x n, every element stored
+	FMATRIX_UPPER,				// n x n upper triangular, n(n + 1)/2 stored
+	FMATRIX_LOWER,				// n x n lower triangular, n(n + 1)/2 stored
+	FMATRIX_SYMMETRIC,			// n x n symmetric, its upper triangle stored
+	FMATRIX_DIAGONAL,			// n x n diagonal, n stored
+	FMATRIX_BANDED				// m x n, kl diagonals below the main one and ku above it, (kl + ku + 1) per row stored
+}fmatrix_kind;
+
 // float matrix
 typedef struct{
 	// rows, columns
@@ -63,10 +75,24 @@ typedef struct{
 	float* matrix; 
 	// flag for transpose handling
 	uint8_t transpose;
+	// fmatrix_kind. 0 is general, so every matrix that doesn't set it is a plain dense one
+	uint8_t kind;
 	// padding for muh cache
-	uint8_t padding[3];
+	uint8_t padding[2];
+	// bandwidths of an FMATRIX_BANDED matrix (below and above the diagonal, as it's read), 0 otherwise
+	int kl, ku;
 }fmatrix;
 
+// double matrix, same layout and transpose semantics as fmatrix. Its kernels are generated from the same source as the float
+// ones (see matrixTemplate.h), so every dmatrix_ function behaves like its fmatrix_ counterpart. Use it for solves that are
+// too ill conditioned for float, and convert with fmatrix_to_dmatrix/dmatrix_to_fmatrix
+typedef struct{
+	int m, n;
+	double* matrix;
+	uint8_t transpose;
+	uint8_t padding[3];
+}dmatrix;
+
 fmatrix create_fmatrix(int m, int n, float* matrix, pool *frame);
 fmatrix fmatrix_create_identity(int m, int n, pool* frame);
 fmatrix fmatrix_create_zero(int m, int n, pool* frame);
@@ -94,6 +120,13 @@ float get_fmultiplied(fmatrix matA, fmatrix matB, int i, int j);
 void fmatrix_multiply_in(fmatrix matA, fmatrix matB);
 fmatrix fmatrix_multiply(fmatrix matA, fmatrix matB, pool *frame);
 
+// tile width of the syrk kernels. Two 32 row tiles of A (for the dot products) or a 32 row band of C (for the rank 1 updates)
+// stay in L1/L2 for the usual widths
+#define SYRK_BLOCK_SIZE 32
+
+int fmatrix_syrk_in(float alpha, fmatrix A, int trans, float beta, fmatrix C);
+fmatrix fmatrix_syrk(fmatrix A, int trans, pool* frame);
+
 void fmatrix_transpose_in(fmatrix *mat);
 fmatrix fmatrix_transpose(fmatrix mat, pool *frame);
 
@@ -112,16 +145,161 @@ void fmatrix_col_sum_in(fmatrix mat, int dest, float c1, int src, float c2);
 fmatrix fmatrix_col_sum(fmatrix mat, int dest, float c1, int src, float c2, pool *frame);
 
 int find_pivot_row(fmatrix mat, int pivot_row, int col);
+
+// row permuted view of an fmatrix, for pivoting without moving rows (see matrixTemplate.h). Row i of the view is row rows[i] of mat
+typedef struct {
+	fmatrix mat;
+	int* rows;
+}frowview;
+
+// gets element [i][j] of a row view
+#define ROWVIEW_AT(view, i, j) MATRIX_AT((view).mat, (view).rows[i], (j))
+
+frowview fmatrix_row_view(fmatrix mat, pool* frame);
+void frowview_swap(frowview view, int row1, int row2);
+void frowview_row_sum_in(frowview view, int dest, float c1, int src, float c2);
+int frowview_find_pivot_row(frowview view, int pivot_row, int col);
+fmatrix frowview_gather(frowview view, pool* frame);
+void frowview_apply_in(frowview view, pool* frame);
+
 float fmatrix_triangle_determinant(fmatrix mat, pool* frame);
 float fmatrix_cofactor_expansion(fmatrix mat, int lr, int lc, int ur, int uc);
 float fmatrix_determinant(fmatrix mat, pool *frame);
 
+int fmatrix_inverse_in(fmatrix mat, pool* frame);
 fmatrix fmatrix_inverse(fmatrix mat, pool* frame);
 
+fmatrix fmatrix_power(fmatrix mat, int k, pool* frame);
+fmatrix fmatrix_expm(fmatrix mat, pool* frame);
+
 fmatrix fmatrix_col_space(fmatrix mat, pool* frame);
 fmatrix fmatrix_row_space(fmatrix mat, pool* frame);
 
 fmatrix* fmatrix_LU_factorize(fmatrix mat, fmatrix result[3], pool* frame);
 fmatrix fmatrix_LU_solve(fmatrix A, fmatrix b, pool* frame);
 
+// width of the panels in the blocked LU factorization and inverse (same reasoning as CHOLESKY_BLOCK_SIZE below)
+#define LU_BLOCK_SIZE 32
+
+// compact LU factorization with partial pivoting, PA = LU
+typedef struct {
+	fmatrix LU;					// n x n row major. U on and above the diagonal, the multipliers of L (unit diagonal, not stored) below it
+	int* perm;					// row i of PA is row perm[i] of A
+	int sign;					// determinant of P, 1 or -1
+	int singular;				// set if some column had no nonzero pivot, so U has a 0 on its diagonal
+}flu;
+
+flu fmatrix_LU_decompose(fmatrix mat, pool* frame);
+float flu_determinant(flu F);
+float flu_log_determinant(flu F, int* sign);
+fmatrix flu_solve(flu F, fmatrix B, pool* frame);
+float fmatrix_log_determinant(fmatrix mat, int* sign, pool* frame);
+
+// width of the diagonal blocks in the blocked cholesky factorization. 32 x 32 floats (4KB) keeps a block and the panel rows being
+// updated against it in L1
+#define CHOLESKY_BLOCK_SIZE 32
+
+int fmatrix_is_symmetric(fmatrix mat);
+int fmatrix_cholesky_factorize_in(fmatrix mat);
+fmatrix fmatrix_cholesky_factorize(fmatrix mat, pool* frame);
+fmatrix fmatrix_cholesky_solve(fmatrix L, fmatrix B, pool* frame);
+fmatrix fmatrix_SPD_solve(fmatrix A, fmatrix B, pool* frame);
+
+// low rank updates to an inverse, LU or cholesky factor are refused (leaving it untouched) once a pivot they divide by drops below
+// UPDATE_TOLERANCE times the magnitude it was computed from, since that much cancellation means the caller should refactor instead
+#define UPDATE_TOLERANCE 1e-4
+
+int fmatrix_inverse_update_in(fmatrix Ainv, fmatrix U, fmatrix V, pool* frame);
+int flu_update_in(flu F, fmatrix U, fmatrix V, pool* frame);
+int fmatrix_cholesky_update_in(fmatrix L, fmatrix X, int sign, pool* frame);
+
+// double versions of the kernels above
+dmatrix create_dmatrix(int m, int n, double* matrix, pool* frame);
+dmatrix dmatrix_create_identity(int m, int n, pool* frame);
+dmatrix dmatrix_create_zero(int m, int n, pool* frame);
+void print_dmatrix(dmatrix mat);
+dmatrix dmatrix_copy_alloc(dmatrix mat, pool* frame);
+dmatrix dmatrix_ncol_copy_alloc(dmatrix mat, int c, pool* frame);
+void dswap(double* a, double* b);
+
+void dmatrix_add_in(dmatrix matA, dmatrix matB);
+dmatrix dmatrix_add(dmatrix matA, dmatrix matB, pool* frame);
+void dmatrix_subtract_in(dmatrix matA, dmatrix matB);
+dmatrix dmatrix_subtract(dmatrix matA, dmatrix matB, pool* frame);
+void dmatrix_scale_in(dmatrix mat, double c);
+dmatrix dmatrix_scale(dmatrix mat, double c, pool* frame);
+
+double get_dmultiplied(dmatrix matA, dmatrix matB, int i, int j);
+void dmatrix_multiply_in(dmatrix matA, dmatrix matB);
+dmatrix dmatrix_multiply(dmatrix matA, dmatrix matB, pool* frame);
+int dmatrix_syrk_in(double alpha, dmatrix A, int trans, double beta, dmatrix C);
+dmatrix dmatrix_syrk(dmatrix A, int trans, pool* frame);
+
+void dmatrix_transpose_in(dmatrix* mat);
+dmatrix dmatrix_transpose(dmatrix mat, pool* frame);
+
+void dmatrix_row_scale_in(dmatrix mat, int row, double c);
+dmatrix dmatrix_row_scale(dmatrix mat, int row, double c, pool* frame);
+void dmatrix_row_swap_in(dmatrix mat, int row1, int row2);
+dmatrix dmatrix_row_swap(dmatrix mat, int row1, int row2, pool* frame);
+void dmatrix_row_sum_in(dmatrix mat, int dest, double c1, int src, double c2);
+dmatrix dmatrix_row_sum(dmatrix mat, int dest, double c1, int src, double c2, pool* frame);
+
+void dmatrix_col_scale_in(dmatrix mat, int col, double c);
+dmatrix dmatrix_col_scale(dmatrix mat, int col, double c, pool* frame);
+void dmatrix_col_swap_in(dmatrix mat, int col1, int col2);
+dmatrix dmatrix_col_swap(dmatrix mat, int col1, int col2, pool* frame);
+void dmatrix_col_sum_in(dmatrix mat, int dest, double c1, int src, double c2);
+dmatrix dmatrix_col_sum(dmatrix mat, int dest, double c1, int src, double c2, pool* frame);
+
+int dmatrix_find_pivot_row(dmatrix mat, int pivot_row, int col);
+
+typedef struct {
+	dmatrix mat;
+	int* rows;
+}drowview;
+
+drowview dmatrix_row_view(dmatrix mat, pool* frame);
+void drowview_swap(drowview view, int row1, int row2);
+void drowview_row_sum_in(drowview view, int dest, double c1, int src, double c2);
+int drowview_find_pivot_row(drowview view, int pivot_row, int col);
+dmatrix drowview_gather(drowview view, pool* frame);
+void drowview_apply_in(drowview view, pool* frame);
+dmatrix* dmatrix_LU_factorize(dmatrix mat, dmatrix PLU[3], pool* frame);
+dmatrix dmatrix_LU_solve(dmatrix A, dmatrix b, pool* frame);
+
+typedef struct {
+	dmatrix LU;
+	int* perm;
+	int sign;
+	int singular;
+}dlu;
+
+dlu dmatrix_LU_decompose(dmatrix mat, pool* frame);
+double dlu_determinant(dlu F);
+double dlu_log_determinant(dlu F, int* sign);
+dmatrix dlu_solve(dlu F, dmatrix B, pool* frame);
+int dmatrix_inverse_in(dmatrix mat, pool* frame);
+dmatrix dmatrix_inverse(dmatrix mat, pool* frame);
+dmatrix dmatrix_power(dmatrix mat, int k, pool* frame);
+dmatrix dmatrix_expm(dmatrix mat, pool* frame);
+
+int dmatrix_is_symmetric(dmatrix mat);
+int dmatrix_cholesky_factorize_in(dmatrix mat);
+dmatrix dmatrix_cholesky_factorize(dmatrix mat, pool* frame);
+dmatrix dmatrix_cholesky_solve(dmatrix L, dmatrix B, pool* frame);
+dmatrix dmatrix_SPD_solve(dmatrix A, dmatrix B, pool* frame);
+
+int dmatrix_inverse_update_in(dmatrix Ainv, dmatrix U, dmatrix V, pool* frame);
+int dlu_update_in(dlu F, dmatrix U, dmatrix V, pool* frame);
+int dmatrix_cholesky_update_in(dmatrix L, dmatrix X, int sign, pool* frame);
+
+dmatrix fmatrix_to_dmatrix(fmatrix mat, pool* frame);
+fmatrix dmatrix_to_fmatrix(dmatrix mat, pool* frame);
+
+// refinement steps dmatrix_mixed_LU_solve takes at most before falling back to a double factorization
+#define MIXED_REFINE_MAX_ITERATIONS 30
+
+dmatrix dmatrix_mixed_LU_solve(dmatrix A, dmatrix b, int* iterations, pool* frame);
+
 #endif MATRIX_H
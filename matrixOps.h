@@ -0,0 +1,77 @@
+#ifndef MATRIXOPS_H
+#define MATRIXOPS_H
+
+// ids for the public entry points of matrix.c and memoryPool.c, used by the instrumentation backends
+// (see instrument.h and trace.h) to tag what they measured. The list is an X macro so the enum and the
+// name table can't drift apart. Adding an op only takes a new line here and a BEGIN/END pair in the
+// function itself. The pool ops stay at the end of the list, starting at MATRIX_OP_CREATE_POOL.
+#define MATRIX_OP_LIST(X)										\
+	X(MATRIX_OP_CREATE,				"create_fmatrix")			\
+	X(MATRIX_OP_CREATE_IDENTITY,	"fmatrix_create_identity")	\
+	X(MATRIX_OP_CREATE_ZERO,		"fmatrix_create_zero")		\
+	X(MATRIX_OP_COPY,				"fmatrix_copy_alloc")		\
+	X(MATRIX_OP_NCOL_COPY,			"fmatrix_ncol_copy_alloc")	\
+	X(MATRIX_OP_ADD_IN,				"fmatrix_add_in")			\
+	X(MATRIX_OP_ADD,				"fmatrix_add")				\
+	X(MATRIX_OP_SUBTRACT_IN,		"fmatrix_subtract_in")		\
+	X(MATRIX_OP_SUBTRACT,			"fmatrix_subtract")			\
+	X(MATRIX_OP_SCALE_IN,			"fmatrix_scale_in")			\
+	X(MATRIX_OP_SCALE,				"fmatrix_scale")			\
+	X(MATRIX_OP_MULTIPLY,			"fmatrix_multiply")			\
+	X(MATRIX_OP_SYRK_IN,			"fmatrix_syrk_in")			\
+	X(MATRIX_OP_SYRK,				"fmatrix_syrk")				\
+	X(MATRIX_OP_TRANSPOSE_IN,		"fmatrix_transpose_in")		\
+	X(MATRIX_OP_TRANSPOSE,			"fmatrix_transpose")		\
+	X(MATRIX_OP_ROW_SCALE_IN,		"fmatrix_row_scale_in")		\
+	X(MATRIX_OP_ROW_SCALE,			"fmatrix_row_scale")		\
+	X(MATRIX_OP_ROW_SWAP_IN,		"fmatrix_row_swap_in")		\
+	X(MATRIX_OP_ROW_SWAP,			"fmatrix_row_swap")			\
+	X(MATRIX_OP_ROW_SUM_IN,			"fmatrix_row_sum_in")		\
+	X(MATRIX_OP_ROW_SUM,			"fmatrix_row_sum")			\
+	X(MATRIX_OP_COL_SCALE_IN,		"fmatrix_col_scale_in")		\
+	X(MATRIX_OP_COL_SCALE,			"fmatrix_col_scale")		\
+	X(MATRIX_OP_COL_SWAP_IN,		"fmatrix_col_swap_in")		\
+	X(MATRIX_OP_COL_SWAP,			"fmatrix_col_swap")			\
+	X(MATRIX_OP_COL_SUM_IN,			"fmatrix_col_sum_in")		\
+	X(MATRIX_OP_COL_SUM,			"fmatrix_col_sum")			\
+	X(MATRIX_OP_TRIANGLE_DETERMINANT, "fmatrix_triangle_determinant") \
+	X(MATRIX_OP_DETERMINANT,		"fmatrix_determinant")		\
+	X(MATRIX_OP_INVERSE_IN,			"fmatrix_inverse_in")		\
+	X(MATRIX_OP_INVERSE,			"fmatrix_inverse")			\
+	X(MATRIX_OP_POWER,				"fmatrix_power")			\
+	X(MATRIX_OP_EXPM,				"fmatrix_expm")				\
+	X(MATRIX_OP_INVERSE_UPDATE_IN,	"fmatrix_inverse_update_in") \
+	X(MATRIX_OP_COL_SPACE,			"fmatrix_col_space")		\
+	X(MATRIX_OP_ROW_SPACE,			"fmatrix_row_space")		\
+	X(MATRIX_OP_LU_FACTORIZE,		"fmatrix_LU_factorize")		\
+	X(MATRIX_OP_LU_SOLVE,			"fmatrix_LU_solve")			\
+	X(MATRIX_OP_LU_DECOMPOSE,		"fmatrix_LU_decompose")		\
+	X(MATRIX_OP_LU_UPDATE_IN,		"flu_update_in")			\
+	X(MATRIX_OP_LOG_DETERMINANT,	"fmatrix_log_determinant")	\
+	X(MATRIX_OP_CHOLESKY_FACTORIZE_IN, "fmatrix_cholesky_factorize_in") \
+	X(MATRIX_OP_CHOLESKY_FACTORIZE,	"fmatrix_cholesky_factorize") \
+	X(MATRIX_OP_CHOLESKY_SOLVE,		"fmatrix_cholesky_solve")	\
+	X(MATRIX_OP_CHOLESKY_UPDATE_IN,	"fmatrix_cholesky_update_in") \
+	X(MATRIX_OP_SPD_SOLVE,			"fmatrix_SPD_solve")		\
+	X(MATRIX_OP_TO_DOUBLE,			"fmatrix_to_dmatrix")		\
+	X(MATRIX_OP_TO_FLOAT,			"dmatrix_to_fmatrix")		\
+	X(MATRIX_OP_MIXED_LU_SOLVE,		"dmatrix_mixed_LU_solve")	\
+	X(MATRIX_OP_CREATE_POOL,		"create_pool")				\
+	X(MATRIX_OP_HEAP_CREATE_POOL,	"heap_create_pool")			\
+	X(MATRIX_OP_POOL_REALLOC,		"pool_realloc")				\
+	X(MATRIX_OP_POOL_ALLOC,			"pool_alloc")				\
+	X(MATRIX_OP_RAW_POOL_ALLOC,		"raw_pool_alloc")			\
+	X(MATRIX_OP_POOL_FREE_FROM,		"pool_free_from")			\
+	X(MATRIX_OP_FREE_POOL,			"free_pool")				\
+	X(MATRIX_OP_HEAP_FREE_POOL,		"heap_free_pool")
+
+typedef enum {
+#define MATRIX_OP_ENUM(id, name) id,
+	MATRIX_OP_LIST(MATRIX_OP_ENUM)
+#undef MATRIX_OP_ENUM
+	MATRIX_OP_COUNT
+}matrix_op;
+
+const char* matrix_op_name(matrix_op op);
+
+#endif
@@ -0,0 +1,2344 @@
+// Type generic matrix kernels
+// This file is a template, not a normal header: it has no include guard, and every time it's included it defines the kernels
+// below for one element type. matrix.c includes it once for float (fmatrix) and once for double (dmatrix), so both come from
+// this one source. Before including it, define:
+//   MT_TYPE                     element type (float)
+//   MT_MATRIX, MT_ERROR         matrix struct and its error value (fmatrix, ERROR_FMATRIX)
+//   MT_NAME                     name of the matrix struct as a string, for error messages ("fmatrix")
+//   MT_PREFIX                   prefix of the public kernels (fmatrix_ gives fmatrix_add, fmatrix_LU_solve, ...)
+//   MT_SUFFIX                   suffix that keeps the static helpers of each instance apart (_f)
+//   MT_CREATE, MT_PRINT         names of the constructor and printer (create_fmatrix, print_fmatrix)
+//   MT_GET_MULTIPLIED, MT_SWAP  names of the dot product and swap helpers (get_fmultiplied, fswap)
+//   MT_FIND_PIVOT_ROW           name of the pivot search (find_pivot_row)
+//   MT_LU, MT_LU_PREFIX         compact LU struct and the prefix of the functions that take it (flu, flu_)
+//   MT_VIEW, MT_VIEW_PREFIX     row permuted view struct and the prefix of the functions that take it (frowview, frowview_)
+//   MT_SQRT                     square root for MT_TYPE (sqrtf)
+//   MT_INSTRUMENT_BEGIN/END     instrumentation hooks, or ((void)0) for an uninstrumented instance
+//   MT_STRUCTURED               (optional) define it if the matrix has a kind (only fmatrix does), so the kernels that can take
+//                               packed matrices hand them to structuredMatrix.c, or read them through fmatrix_at
+// All of them are undefined again at the end of the file.
+//
+// Usage examples in the comments are written for the float instance. The double ones are the same with dmatrix in place of
+// fmatrix (create_dmatrix, dmatrix_add, get_dmultiplied, dswap, dmatrix_find_pivot_row, dlu, dlu_solve, drowview, ...)
+
+#define MT_PASTE_(a, b) a##b
+#define MT_PASTE(a, b) MT_PASTE_(a, b)
+#define MT_FN(name) MT_PASTE(MT_PREFIX, name)
+#define MT_LOCAL(name) MT_PASTE(name, MT_SUFFIX)
+#define MT_LU_FN(name) MT_PASTE(MT_LU_PREFIX, name)
+#define MT_VIEW_FN(name) MT_PASTE(MT_VIEW_PREFIX, name)
+
+// element [i][j] of a matrix that's only read. Packed kinds go through fmatrix_at, so kernels that copy or read their input
+// take any kind, while the ones that write through INDEX_AT check for a general matrix first (see require_general)
+#ifdef MT_STRUCTURED
+#define MT_AT(mat, i, j) (((mat).kind == FMATRIX_GENERAL) ? MATRIX_AT(mat, i, j) : fmatrix_at(mat, i, j))
+#else
+#define MT_AT(mat, i, j) MATRIX_AT(mat, i, j)
+#endif
+
+// allocates m by n blocks of memory of a given size in a pool, returns a struct with a pointer to it,
+// the dimensions of the matrix, and if it is a transpose or not.
+// Used for adding a matrix to the pool so you can start doing operations to it.
+// failure returns the ERROR_FMATRIX, (macro located in matrix.h) which has 0 rows, 0 cols, a NULL
+// pointer for the matrix, and is not a transpose
+//
+// fmatrix A = create_fmatrix(3, 3, matA, &frame);
+MT_MATRIX MT_CREATE(int m, int n, MT_TYPE* matrix, pool* frame) {
+	if (m < 0 || n < 0) {
+		printf(MT_NAME " must have positive row/columns\n");
+		return MT_ERROR;
+	}
+	if (!frame || !frame->start) {
+		printf("failed to create matrix (faulty input frame). Returning empty matrix\n");
+		return MT_ERROR;
+	}
+
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_CREATE, ((MT_MATRIX){ m, n, matrix, 0 }), MT_ERROR);
+	if ((matrix = pool_alloc(frame, matrix, m * n * sizeof(MT_TYPE))) == NULL) {
+		printf("pool allocation for matrix failed, returing empty matrix\n");
+		MT_INSTRUMENT_END();
+		return MT_ERROR;
+	}
+	MT_INSTRUMENT_END();
+	// initially not a transpose, so field starts as 0
+	return (MT_MATRIX) {m, n, matrix, 0};
+}
+
+// returns an identity matrix of size m x n, allocated on frame
+// returns ERROR_FMATRIX upon failure
+MT_MATRIX MT_FN(create_identity)(int m, int n, pool* frame) {
+	if (m < 0 || n < 0) {
+		printf(MT_NAME " must have positive row/columns\n");
+		return MT_ERROR;
+	}
+	if (!frame || !frame->start) {
+		printf("failed to create matrix (faulty input frame). Returning empty matrix\n");
+		return MT_ERROR;
+	}
+
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_CREATE_IDENTITY, ((MT_MATRIX){ m, n, NULL, 0 }), MT_ERROR);
+	MT_TYPE* matrix = raw_pool_alloc(frame, m * n * sizeof(MT_TYPE));
+	if (matrix == NULL) {
+		printf("pool allocation for identity matrix failed, returning error matrix");
+		MT_INSTRUMENT_END();
+		return MT_ERROR;
+	}
+
+	MT_MATRIX mat = (MT_MATRIX) {m, n, matrix, 0};
+
+	// initialize all values to 0 except where i = j
+	for (int i = 0; i < m; i++) {
+		for (int j = 0; j < n; j++) {
+			if(i == j){ matrix[INDEX_AT(mat, i, j)] = 1.0f; }
+			else{ matrix[INDEX_AT(mat, i, j)] = 0.0f; }
+		}
+	}
+
+	MT_INSTRUMENT_END();
+	return mat;
+}
+
+// creates an m x n matrix with all elements set to 0.
+MT_MATRIX MT_FN(create_zero)(int m, int n, pool* frame) {
+	if (m < 0 || n < 0) {
+		printf(MT_NAME " must have positive row/columns\n");
+		return MT_ERROR;
+	}
+	if (!frame || !frame->start) {
+		printf("failed to create matrix (faulty input frame). Returning empty matrix\n");
+		return MT_ERROR;
+	}
+
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_CREATE_ZERO, ((MT_MATRIX){ m, n, NULL, 0 }), MT_ERROR);
+	MT_TYPE* matrix = raw_pool_alloc(frame, m * n * sizeof(MT_TYPE));
+	if (matrix == NULL) {
+		printf("pool allocation for identity matrix failed, returning error matrix");
+		MT_INSTRUMENT_END();
+		return MT_ERROR;
+	}
+
+	MT_MATRIX mat = (MT_MATRIX) {m, n, matrix, 0};
+
+	// initialize all values to 0 except where i = j
+	for (int i = 0; i < m; i++) {
+		for (int j = 0; j < n; j++) {
+			matrix[INDEX_AT(mat, i, j)] = 0.0f;
+		}
+	}
+
+	MT_INSTRUMENT_END();
+	return mat;
+}
+
+// prints an input matrix in row major order.
+//
+// print_fmatrix(matA);
+void MT_PRINT(MT_MATRIX mat) {
+	for (int i = 0; i < mat.m; i++) {
+		for (int j = 0; j < mat.n; j++) {
+#ifdef MT_STRUCTURED
+			printf("%4.3f ", fmatrix_at(mat, i, j));
+#else
+			printf("%4.3f ", MATRIX_AT(mat, i, j));
+#endif
+		}
+		printf("\n");
+	}
+}
+
+// takes an exisitng matrix, allocates space for a clone, copies its properties, and returns a deep copy
+// used to reduce how verbose non inplace functions are, because many of them shared this procedure 
+//
+// copyA = fmatrix_copy_alloc(matA, &frame);
+MT_MATRIX MT_FN(copy_alloc)(MT_MATRIX mat, pool* frame) {
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_COPY, mat, MT_ERROR);
+#ifdef MT_STRUCTURED
+	int size = fmatrix_stored_count(mat) * sizeof(MT_TYPE);
+#else
+	int size = mat.m * mat.n * sizeof(MT_TYPE);
+#endif
+	MT_TYPE* result;
+
+	if ((result = (MT_TYPE*)raw_pool_alloc(frame, size)) == NULL) {
+		printf("error while allocating matrix\n");
+		MT_INSTRUMENT_END();
+		return MT_ERROR;
+	}
+
+	memcpy(result, mat.matrix, size);
+
+	// keeps everything else about mat, including its kind
+	MT_MATRIX copy = mat;
+	copy.matrix = result;
+	MT_INSTRUMENT_END();
+	return copy;
+}
+
+// takes an exisitng fmatrix and a number of columns to copy, then creates a new fmatrix with 
+// the first c columns of mat, allocated on frame
+// for now, it does not retain mat's transpose state
+MT_MATRIX MT_FN(ncol_copy_alloc)(MT_MATRIX mat, int c, pool* frame) {
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_NCOL_COPY, mat, MT_ERROR);
+	int size = mat.m * c;
+	MT_TYPE* result = (MT_TYPE*)raw_pool_alloc(frame, size * sizeof(MT_TYPE));
+
+	if (result  == NULL) {
+		printf("error while allocating matrix\n");
+		MT_INSTRUMENT_END();
+		return MT_ERROR;
+	}
+
+	int offset; // for accessing result array linearly from a nested for loop
+	for (int i = 0; i < mat.m; i++) {
+		offset = i * c;
+		for (int j = 0; j < c; j++) {
+			result[offset + j] = MT_AT(mat, i, j);
+		}
+	}
+
+	MT_INSTRUMENT_END();
+	return (MT_MATRIX) { mat.m, c, result, 0};
+}
+
+// swaps the values located at a and b
+// used for a few row operations
+//
+// fswap(&mat[INDEX_AT(mat, 1, 2)], &mat[INDEX_AT(mat, 0, 2)]); 
+void MT_SWAP(MT_TYPE *a, MT_TYPE *b) {
+	MT_TYPE temp = *a;
+	*a = *b;
+	*b = temp;
+}
+
+// in place kernels write through INDEX_AT, which only knows the general layout. prints an error for op and returns 0 if mat is
+// packed (the double instance has no kinds, so it always returns 1)
+static int MT_LOCAL(require_general)(MT_MATRIX mat, const char* op) {
+#ifdef MT_STRUCTURED
+	if (mat.kind != FMATRIX_GENERAL) {
+		printf("%s error: \nrequires a general matrix, unpack the packed one first (fmatrix_unpack)\n", op);
+		return 0;
+	}
+#endif
+	return 1;
+}
+
+// copy of mat for a non inplace variant to work on. A packed mat is unpacked, since the result of a row operation or an
+// inverse generally doesn't keep its structure
+static MT_MATRIX MT_LOCAL(general_copy)(MT_MATRIX mat, pool* frame) {
+#ifdef MT_STRUCTURED
+	if (mat.kind != FMATRIX_GENERAL) { return fmatrix_unpack(mat, frame); }
+#endif
+	return MT_FN(copy_alloc)(mat, frame);
+}
+
+// from here on out, there are inplace versions of most functions. These do the same thing as their non inplace 
+// counterparts, but they store their results in one of the inputs, avoiding extra memory allocation.
+// Also, upon failure, an error message is printed, and no change is made to the inputs, rather than returning 
+// an ERROR_FMATRIX.
+// Keep in mind that many of the non inplace variants actually use the inplace version after copying one of
+// their inputs.
+
+
+// Basic matrix operations
+
+// Adds two input matrices into matA, given that they have the same dimensions
+// 
+// fmatrix_add_in(A, B);
+void MT_FN(add_in)(MT_MATRIX matA, MT_MATRIX matB) {
+	if (matA.m != matB.m || matA.n != matB.n) {
+		printf("error while adding: \ndimension mismatch: ");
+		printf("matrix a: (%d x %d)  matrix b: (%d x %d)\n", matA.m, matA.n, matB.m, matB.n);
+		return;
+	}
+#ifdef MT_STRUCTURED
+	if (matA.kind != FMATRIX_GENERAL || matB.kind != FMATRIX_GENERAL) { fmatrix_structured_add_in(matA, matB, 1.0f); return; }
+#endif
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_ADD_IN, matA, matB);
+	for(int i = 0; i < matB.m; i++){
+		for (int j = 0; j < matA.n; j++) {
+			matA.matrix[INDEX_AT(matA, i, j)] += matB.matrix[INDEX_AT(matB, i, j)];
+		}
+	}
+	MT_INSTRUMENT_END();
+}
+
+// fmatrix sumAB = fmatrix_add(A, B, &frame)
+MT_MATRIX MT_FN(add)(MT_MATRIX matA, MT_MATRIX matB, pool *frame) {
+	if (matA.m != matB.m || matA.n != matB.n) {
+		printf("error while adding: \ndimension mismatch: ");
+		printf("matrix a: (%d x %d)  matrix b: (%d x %d)\n", matA.m, matA.n, matB.m, matB.n);
+		return MT_ERROR;
+	}
+#ifdef MT_STRUCTURED
+	if (matA.kind != FMATRIX_GENERAL || matB.kind != FMATRIX_GENERAL) { return fmatrix_structured_add(matA, matB, 1.0f, frame); }
+#endif
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_ADD, matA, matB);
+
+	MT_TYPE* matrix;
+	if ((matrix = (MT_TYPE*)raw_pool_alloc(frame, matA.m * matA.n * sizeof(MT_TYPE))) == NULL) {
+		printf("error while adding: pool allocation failure\n");
+		MT_INSTRUMENT_END();
+		return MT_ERROR;
+	}
+
+	MT_MATRIX result = (MT_MATRIX) {matA.m, matA.n, matrix};
+
+	for (int i = 0; i < matA.m; i++) {
+		for(int j = 0; j < matA.n; j++){
+			result.matrix[INDEX_AT(result, i, j)] = MATRIX_AT(matA, i, j) + MATRIX_AT(matB, i, j);
+		}
+	}
+
+	MT_INSTRUMENT_END();
+	return result;
+}
+
+// subtracts values of matB from values of matA, given that they have the same dimensions
+// 
+// fmatrix_subtract_in(A, B);
+void MT_FN(subtract_in)(MT_MATRIX matA, MT_MATRIX matB) {
+	if (matA.m != matB.m || matA.n != matB.n) {
+		printf("error while adding: \ndimension mismatch: ");
+		printf("matrix a: (%d x %d)  matrix b: (%d x %d)\n", matA.m, matA.n, matB.m, matB.n);
+		return;
+	}
+#ifdef MT_STRUCTURED
+	if (matA.kind != FMATRIX_GENERAL || matB.kind != FMATRIX_GENERAL) { fmatrix_structured_add_in(matA, matB, -1.0f); return; }
+#endif
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_SUBTRACT_IN, matA, matB);
+	for(int i = 0; i < matB.m; i++){
+		for (int j = 0; j < matA.n; j++) {
+			matA.matrix[INDEX_AT(matA, i, j)] -= matB.matrix[INDEX_AT(matB, i, j)];
+		}
+	}
+	MT_INSTRUMENT_END();
+}
+
+// fmatrix diffAB = fmatrix_subtract_in(A, B);
+MT_MATRIX MT_FN(subtract)(MT_MATRIX matA, MT_MATRIX matB, pool *frame) {
+	if (matA.m != matB.m || matA.n != matB.n) {
+		printf("error while subtracting: \ndimension mismatch: ");
+		printf("matrix a: (%d x %d)  matrix b: (%d x %d)\n", matA.m, matA.n, matB.m, matB.n);
+		return MT_ERROR;
+	}
+#ifdef MT_STRUCTURED
+	if (matA.kind != FMATRIX_GENERAL || matB.kind != FMATRIX_GENERAL) { return fmatrix_structured_add(matA, matB, -1.0f, frame); }
+#endif
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_SUBTRACT, matA, matB);
+
+	MT_TYPE* matrix;
+	if ((matrix = (MT_TYPE*)raw_pool_alloc(frame, matA.m * matA.n * sizeof(MT_TYPE))) == NULL) {
+		printf("error while adding: pool allocation failure\n");
+		MT_INSTRUMENT_END();
+		return MT_ERROR;
+	}
+
+	MT_MATRIX result = (MT_MATRIX) {matA.m, matA.n, matrix};
+
+	for (int i = 0; i < matA.m; i++) {
+		for(int j = 0; j < matA.n; j++){
+			result.matrix[INDEX_AT(result, i, j)] = MATRIX_AT(matA, i, j) - MATRIX_AT(matB, i, j);
+		}
+	}
+
+	MT_INSTRUMENT_END();
+	return result;
+}
+
+// scales all elements of mat by a factor c
+// if c = 1 or c = 0, it tries to save time by following a different proceedure
+//
+// fmatrix_scale_in(A, 2.5);
+void MT_FN(scale_in)(MT_MATRIX mat, MT_TYPE c) {
+	if(c == 1.0) { return; }
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_SCALE_IN, mat, MT_ERROR);
+#ifdef MT_STRUCTURED
+	int size = fmatrix_stored_count(mat);
+#else
+	int size = mat.m * mat.n;
+#endif
+	if(c == 0.0) { memset(mat.matrix, 0, size * sizeof(MT_TYPE)); MT_INSTRUMENT_END(); return; }
+
+	for(int i = 0; i < size; i++)
+		mat.matrix[i] *= c;
+	MT_INSTRUMENT_END();
+}
+
+// fmatrix scaledA = fmatrix_scale_in(A, 2.5);
+MT_MATRIX MT_FN(scale)(MT_MATRIX mat, MT_TYPE c, pool *frame) {
+#ifdef MT_STRUCTURED
+	if (mat.kind != FMATRIX_GENERAL) {
+		MT_MATRIX result = MT_FN(copy_alloc)(mat, frame);
+		if (result.matrix != NULL) { MT_FN(scale_in)(result, c); }
+		return result;
+	}
+#endif
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_SCALE, mat, MT_ERROR);
+	MT_TYPE* matrix;
+	int size = mat.m * mat.n;
+	if ((matrix = (MT_TYPE*)raw_pool_alloc(frame, size * sizeof(MT_TYPE))) == NULL) {
+		printf("error while scaling: \npool allocation failure\n");
+		MT_INSTRUMENT_END();
+		return MT_ERROR;
+	}
+	MT_MATRIX result = { mat.m, mat.n, matrix};
+
+	for (int i = 0; i < mat.m; i++) {
+		for(int j = 0; j < mat.n; j++){
+			result.matrix[INDEX_AT(result, i, j)] = c * mat.matrix[INDEX_AT(mat, i, j)];
+		}
+	}
+
+	MT_INSTRUMENT_END();
+	return result;
+}
+
+// takes the sum of the products of elements of row i of matA times elements of col j of matB
+// assumes that matA.m = matB.n
+// used for fmatrix_multiply
+// may change slightly and rename to dot product
+//
+// prod[INDEX_AT(prod, i, j)] = get_fmultiplied(matA, matB, i, j);
+MT_TYPE MT_GET_MULTIPLIED(MT_MATRIX matA, MT_MATRIX matB, int i, int j) {
+	MT_TYPE result = 0.0;
+
+	for (int a = 0; a < matA.n; a++) {
+		//printf("matA[%d][%d] = %g, matB[%d][%d] = %g\n", i, a, MATRIX_AT(matA, i, a), a, j, (MATRIX_AT(matB, a, j)));
+		//print_fmatrix(matB);
+		result += (MT_AT(matA, i, a)) * (MT_AT(matB, a, j));
+	}
+
+	return result;
+}
+
+// inplace matrix multiplcation is possible, but hardly practical for general use.
+// maybe implement it for square matrices in the future
+void MT_FN(multiply_in)(MT_MATRIX matA, MT_MATRIX matB) {
+	return; 
+}
+
+// multiplies matA and matB, given matA.n = matB.n. stores result in a new matrix in a pool
+// very basic and brute force. 
+//
+// fmatrix AB = fmatrix_multiply(A, B, &frame);
+MT_MATRIX MT_FN(multiply)(MT_MATRIX matA, MT_MATRIX matB, pool *frame) {
+	if (matA.n != matB.m) {
+		printf("error while multiplying: \ndimension mismatch: ");
+		printf("matrix a: (%d x _%d_)  matrix b: (_%d_ x %d)\n", matA.m, matA.n, matB.m, matB.n);
+		return MT_ERROR;
+	}
+#ifdef MT_STRUCTURED
+	if (matA.kind != FMATRIX_GENERAL || matB.kind != FMATRIX_GENERAL) { return fmatrix_structured_multiply(matA, matB, frame); }
+#endif
+	// matB is the transpose of matA (same buffer, opposite flags), so the product is matA matA^t: a symmetric rank k update
+	if (matA.matrix == matB.matrix && matA.transpose != matB.transpose && matA.m == matB.n && matA.n == matB.m) {
+		return MT_FN(syrk)(matA, 0, frame);
+	}
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_MULTIPLY, matA, matB);
+	// new matrix has row count of A and col count of B
+	MT_TYPE* matrix;
+	if ((matrix = (MT_TYPE*)raw_pool_alloc(frame, matA.m * matB.n * sizeof(MT_TYPE))) == NULL) {
+		printf("error while multiplying: \npool allocation failure\n");
+		MT_INSTRUMENT_END();
+		return MT_ERROR;
+	}
+
+	MT_MATRIX result = (MT_MATRIX){ matA.m, matB.n, matrix};
+
+	for (int i = 0; i < matA.m; i++) {
+		for(int j = 0; j < matB.n; j++){
+			matrix[INDEX_AT(result, i, j)] = MT_GET_MULTIPLIED(matA, matB, i, j);
+		}
+	}
+
+	MT_INSTRUMENT_END();
+	return result;
+}
+
+// transposes mat in place
+// literally just swaps mat.m and mat.n, then flips the transpose flag
+// this works because the macros that read matrixes will check for the transpose flag and change
+// how it reads if so.
+// Regular matrix transpose is not that hard, so do it later, but still. This is constant time, 
+// (at the cost of branching while reading) and it doesn't require much overhead.
+// However, it could definitely lead to some problems if people don't know how transpose works 
+// in this library. Hence why I want to have both implementations
+//  
+// the inplace version is also useful for implementing column operations later
+//
+// fmatrix_transpose_int(&A);
+void MT_FN(transpose_in)(MT_MATRIX *mat) {
+#ifdef MT_STRUCTURED
+	if (mat->kind != FMATRIX_GENERAL) { fmatrix_structured_transpose_in(mat); return; }
+#endif
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_TRANSPOSE_IN, *mat, MT_ERROR);
+	// swaps m and n, and marks mat as a transpose
+	intswap(&mat->m, &mat->n);
+	mat->transpose = !mat->transpose;
+	MT_INSTRUMENT_END();
+}
+
+// fmatrix At = fmatrix_transpose(A, &frame);
+MT_MATRIX MT_FN(transpose)(MT_MATRIX mat, pool* frame) {
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_TRANSPOSE, mat, MT_ERROR);
+	MT_MATRIX result = MT_FN(copy_alloc)(mat, frame);
+	if (!result.matrix) { MT_INSTRUMENT_END(); return result; }
+
+	MT_FN(transpose_in)(&result);
+	MT_INSTRUMENT_END();
+	return result;
+}
+
+
+// Elementary row operations (make sure to 0 index row)
+
+// multiplies all elements in row of mat by c
+// tries to save on time if c = 0 or c = 1
+//
+// fmatrix_row_scale_in(A, 0, 2.5); // scales elements of row 1 by 2.5
+void MT_FN(row_scale_in)(MT_MATRIX mat, int row, MT_TYPE c) {
+	if (row >= mat.m || row < 0) {
+		printf("row_scale error: \nrow %d out of bounds (make sure you are 0-indexed)\n", row);
+		return;
+	}
+	if (!MT_LOCAL(require_general)(mat, "row_scale")) { return; }
+	if (c == 1.0) { return; }
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_ROW_SCALE_IN, mat, MT_ERROR);
+	if (c == 0.0 && !mat.transpose) { 
+		memset(&mat.matrix[INDEX_AT(mat, row, 0)], 0, mat.n * sizeof(MT_TYPE)); 
+		MT_INSTRUMENT_END();
+		return; 
+	}
+
+	for (int i = 0; i < mat.n; i++) 
+		mat.matrix[INDEX_AT(mat, row, i)] *= c;
+	MT_INSTRUMENT_END();
+}
+
+// fmatrix scaleR1 = fmatrix_row_scale(A, 0, 2.5), &frame; // scales elements of row 1 by 2.5
+MT_MATRIX MT_FN(row_scale)(MT_MATRIX mat, int row, MT_TYPE c, pool *frame) {
+	if (row >= mat.m || row < 0) {
+		printf("row_scale error: \nrow %d out of bounds (make sure you are 0-indexed)\n", row);
+		return MT_ERROR;
+	}
+
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_ROW_SCALE, mat, MT_ERROR);
+	MT_MATRIX result = MT_LOCAL(general_copy)(mat, frame);
+	if(!result.matrix){MT_INSTRUMENT_END(); return result;}
+
+	MT_FN(row_scale_in)(result, row, c);
+	MT_INSTRUMENT_END();
+	return result;
+}
+
+// swaps elements of row1 of mat with elements of row2
+//
+// fmatrix_row_swap_in(A, 0, 2); // swaps R1 and R2 of A
+void MT_FN(row_swap_in)(MT_MATRIX mat, int row1, int row2) {
+	if (row1 >= mat.m || row1 < 0) {
+		printf("row_swap error: \nrow1 %d out of bounds (make sure you are 0-indexed)\n", row1);
+		return;
+	}
+	if (row2 >= mat.m || row2 < 0) {
+		printf("row_swap error: \nrow2 %d out of bounds (make sure you are 0-indexed)\n", row2);
+		return;
+	}
+
+	if (!MT_LOCAL(require_general)(mat, "row_swap")) { return; }
+	if(row1 == row2){ return; } // no change necessary
+
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_ROW_SWAP_IN, mat, MT_ERROR);
+	for (int i = 0; i < mat.n; i++) {
+		MT_SWAP(&mat.matrix[INDEX_AT(mat, row1, i)], 
+			  &mat.matrix[INDEX_AT(mat, row2, i)]);
+	}
+	MT_INSTRUMENT_END();
+}
+
+// fmatrix swapR12 = fmatrix_row_swap(A, 0, 2, &frame); // swaps R1 and R2 of A
+MT_MATRIX MT_FN(row_swap)(MT_MATRIX mat, int row1, int row2, pool *frame) {
+	if (row1 >= mat.m || row1 < 0) {
+		printf("row_swap error: \nrow1 %d out of bounds (make sure you are 0-indexed)\n", row1);
+		return (MT_MATRIX){ 0, 0, NULL};
+	}
+	if (row2 >= mat.m || row2 < 0) {
+		printf("row_swap error: \nrow2 %d out of bounds (make sure you are 0-indexed)\n", row2);
+		return (MT_MATRIX){ 0, 0, NULL};
+	}
+
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_ROW_SWAP, mat, MT_ERROR);
+	MT_MATRIX result = MT_LOCAL(general_copy)(mat, frame);
+	if(!result.matrix){MT_INSTRUMENT_END(); return result;}
+
+	MT_FN(row_swap_in)(result, row1, row2);
+	MT_INSTRUMENT_END();
+	return result;
+}
+
+// elements of dest row of mat becomes c1 * dest added to c2 * elements of src row
+// tries to save time if c1 or c2 equal 0
+//
+// fmatrix_row_sum_in(A, 0, 3, 1, 0.5) // R1 <- 3R1 + 0.5R2
+void MT_FN(row_sum_in)(MT_MATRIX mat, int dest, MT_TYPE c1, int src, MT_TYPE c2) {
+	if (dest >= mat.m || dest < 0) {
+		printf("row_sum error: dest row %d out of bounds (make sure you are 0-indexed)\n", dest);
+		return;
+	}
+	if (src >= mat.m || src < 0) {
+		printf("row_sum error: src row %d out of bounds (make sure you are 0-indexed)\n", src);
+		return;
+	}
+	if (!MT_LOCAL(require_general)(mat, "row_sum")) { return; }
+
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_ROW_SUM_IN, mat, MT_ERROR);
+	MT_TYPE value;
+	for (int i = 0; i < mat.n; i++) {
+		value = 0.0f;
+		if(c1 != 0){value += (c1 * MATRIX_AT(mat, dest, i));}
+		if(c2 != 0){value += (c2 * MATRIX_AT(mat, src,  i));}
+		// result[INDEX_AT(mat, dest, i)] = (c1 * (MATRIX_AT(mat, dest, i))) + (c2 * (MATRIX_AT(mat, src, i)));
+		mat.matrix[INDEX_AT(mat, dest, i)] = value;
+	}
+	MT_INSTRUMENT_END();
+}
+
+// fmatrix A2 = fmatrix_row_sum(A, 0, 3, 1, 0.5) // R1 <- 3R1 + 0.5R2
+MT_MATRIX MT_FN(row_sum)(MT_MATRIX mat, int dest, MT_TYPE c1, int src, MT_TYPE c2, pool* frame) {
+	if (dest >= mat.m || dest < 0) {
+		printf("row_sum error: dest row %d out of bounds (make sure you are 0-indexed)\n", dest);
+		return (MT_MATRIX){ 0, 0, NULL};
+	}
+	if (src >= mat.m || src < 0) {
+		printf("row_sum error: src row %d out of bounds (make sure you are 0-indexed)\n", src);
+		return (MT_MATRIX){ 0, 0, NULL};
+	}
+
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_ROW_SUM, mat, MT_ERROR);
+	MT_MATRIX result = MT_LOCAL(general_copy)(mat, frame);
+	if(!result.matrix){ MT_INSTRUMENT_END(); return result; }
+
+	MT_FN(row_sum_in)(result, dest, c1, src, c2);
+	MT_INSTRUMENT_END();
+	return result;
+}
+
+
+// elementary column operations
+// This are all the "easy" methods. They transpose the input matrix, then run their respective row operation on
+// it, then transpose it back. I'll implement direct methods later, but I wanted to demonstrate how efficient 
+// transpose could be
+
+// scales elements of a column by a factor of c
+void MT_FN(col_scale_in)(MT_MATRIX mat, int col, MT_TYPE c) {
+	if (col >= mat.n || col < 0) {
+		printf("col_scale error: \ncol %d out of bounds (make sure you are 0-indexed)\n", col);
+		return;
+	}
+	if (!MT_LOCAL(require_general)(mat, "col_scale")) { return; }
+
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_COL_SCALE_IN, mat, MT_ERROR);
+	MT_FN(transpose_in)(&mat);
+	MT_FN(row_scale_in)(mat, col, c);
+	MT_FN(transpose_in)(&mat);
+	MT_INSTRUMENT_END();
+}
+
+MT_MATRIX MT_FN(col_scale)(MT_MATRIX mat, int col, MT_TYPE c, pool* frame) {
+	if (col >= mat.n || col < 0) {
+		printf("col_scale error: \ncol %d out of bounds (make sure you are 0-indexed)\n", col);
+		return MT_ERROR;
+	}
+
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_COL_SCALE, mat, MT_ERROR);
+	MT_MATRIX result = MT_LOCAL(general_copy)(mat, frame);
+	if(!result.matrix){ MT_INSTRUMENT_END(); return result; }
+
+	MT_FN(col_scale_in)(result, col, c);
+	MT_INSTRUMENT_END();
+	return result;
+}
+
+void MT_FN(col_swap_in)(MT_MATRIX mat, int col1, int col2) {
+	if (col1 >= mat.m || col1 < 0) {
+		printf("col_swap error: \ncol1 %d out of bounds (make sure you are 0-indexed)\n", col1);
+		return;
+	}
+	if (col2 >= mat.m || col2 < 0) {
+		printf("col_swap error: \ncol2 %d out of bounds (make sure you are 0-indexed)\n", col2);
+		return;
+	}
+
+	if (!MT_LOCAL(require_general)(mat, "col_swap")) { return; }
+	if(col1 == col2){ return; } // no change necessary
+
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_COL_SWAP_IN, mat, MT_ERROR);
+	MT_FN(transpose_in)(&mat);
+	MT_FN(row_swap_in)(mat, col1, col2);
+	MT_FN(transpose_in)(&mat);
+	MT_INSTRUMENT_END();
+}
+
+MT_MATRIX MT_FN(col_swap)(MT_MATRIX mat, int col1, int col2, pool* frame) {
+	if (col1 >= mat.m || col1 < 0) {
+		printf("col_swap error: \ncol1 %d out of bounds (make sure you are 0-indexed)\n", col1);
+		return MT_ERROR;
+	}
+	if (col2 >= mat.m || col2 < 0) {
+		printf("col_swap error: \ncol2 %d out of bounds (make sure you are 0-indexed)\n", col2);
+		return MT_ERROR;
+	}
+
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_COL_SWAP, mat, MT_ERROR);
+	MT_MATRIX result = MT_LOCAL(general_copy)(mat, frame);
+	if(!result.matrix){ MT_INSTRUMENT_END(); return result; }
+
+	MT_FN(col_swap_in)(result, col1, col2);
+	MT_INSTRUMENT_END();
+	return result;
+}
+
+void MT_FN(col_sum_in)(MT_MATRIX mat, int dest, MT_TYPE c1, int src, MT_TYPE c2) {
+	if (dest >= mat.m || dest < 0) {
+		printf("col_sum error: \ndest col %d out of bounds (make sure you are 0-indexed)\n", dest);
+		return;
+	}
+	if (src >= mat.m || src < 0) {
+		printf("col_sum error: \nsrc col %d out of bounds (make sure you are 0-indexed)\n", src);
+		return;
+	}
+	if (!MT_LOCAL(require_general)(mat, "col_sum")) { return; }
+
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_COL_SUM_IN, mat, MT_ERROR);
+	MT_FN(transpose_in)(&mat);
+	MT_FN(row_sum_in)(mat, dest, c1, src, c2);
+	MT_FN(transpose_in)(&mat);
+	MT_INSTRUMENT_END();
+}
+
+MT_MATRIX MT_FN(col_sum)(MT_MATRIX mat, int dest, MT_TYPE c1, int src, MT_TYPE c2, pool *frame) {
+	if (dest >= mat.m || dest < 0) {
+		printf("col_sum error: \ndest col %d out of bounds (make sure you are 0-indexed)\n", dest);
+		return MT_ERROR;
+	}
+	if (src >= mat.m || src < 0) {
+		printf("col_sum error: \nsrc col %d out of bounds (make sure you are 0-indexed)\n", src);
+		return MT_ERROR;
+	}
+
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_COL_SUM, mat, MT_ERROR);
+	MT_MATRIX result = MT_LOCAL(general_copy)(mat, frame);
+	if(!result.matrix){ MT_INSTRUMENT_END(); return result;}
+
+	MT_FN(col_sum_in)(result, dest, c1, src, c2);
+	MT_INSTRUMENT_END();
+	return result;
+}
+
+// finds a row to swap a 0 pivot with. returns -1 if none is found
+// used in functions that use gaussian elimination, such as fmatrix_triangle_determinant
+int MT_FIND_PIVOT_ROW(MT_MATRIX mat, int pivot_row, int col) {
+	for (int j = pivot_row; j < mat.m; j++) {
+		if (MT_AT(mat, j, col) != 0) { return j; }
+	}
+	return -1;
+}
+
+// Row permuted views
+// Pivoting only reorders rows, so instead of swapping two rows element by element (strided through INDEX_AT if the matrix is
+// transposed), a view keeps a vector of row indices next to the matrix: row i of the view is row rows[i] of mat. A swap is then
+// two ints, elimination reads and writes the physical rows where they are (contiguous if mat isn't transposed), and the rows
+// are put in order once at the end with frowview_gather or frowview_apply_in, or never, if reading through the view is enough.
+//
+// frowview V = fmatrix_row_view(A, &frame);
+// frowview_swap(V, 0, 2);
+// float a = ROWVIEW_AT(V, 0, 1);				// A[2][1]
+// frowview_apply_in(V, &frame);				// A's rows are physically in view order now
+
+static MT_MATRIX MT_LOCAL(copy_row_major)(MT_MATRIX mat, pool* frame);
+
+// returns a view of mat in its own row order, with the index vector allocated on frame. The view shares mat's elements, so mat
+// has to be general. upon failure, the view's rows are NULL
+MT_VIEW MT_FN(row_view)(MT_MATRIX mat, pool* frame) {
+	if (!MT_LOCAL(require_general)(mat, "row view")) { return (MT_VIEW){ mat, NULL }; }
+	MT_VIEW view = { mat, raw_pool_alloc(frame, mat.m * sizeof(int)) };
+	if (view.rows == NULL) {
+		printf("error while creating row view: pool allocation failure\n");
+		return view;
+	}
+	for (int i = 0; i < mat.m; i++) { view.rows[i] = i; }
+	return view;
+}
+
+// swaps rows row1 and row2 of the view in constant time (mat isn't touched)
+void MT_VIEW_FN(swap)(MT_VIEW view, int row1, int row2) {
+	if (row1 < 0 || row2 < 0 || row1 >= view.mat.m || row2 >= view.mat.m) {
+		printf("row view swap error: rows %d and %d out of bounds (make sure you are 0-indexed)\n", row1, row2);
+		return;
+	}
+	if (row1 == row2) { return; }			// intswap would zero it
+	intswap(&view.rows[row1], &view.rows[row2]);
+}
+
+// fmatrix_row_sum_in on the rows of the view: dest <- c1 * dest + c2 * src
+void MT_VIEW_FN(row_sum_in)(MT_VIEW view, int dest, MT_TYPE c1, int src, MT_TYPE c2) {
+	MT_MATRIX mat = view.mat;
+	if (dest < 0 || src < 0 || dest >= mat.m || src >= mat.m) {
+		printf("row view sum error: rows %d and %d out of bounds (make sure you are 0-indexed)\n", dest, src);
+		return;
+	}
+	int d = view.rows[dest], s = view.rows[src];
+	if (!mat.transpose) {
+		MT_TYPE* row_d = &mat.matrix[d * mat.n];
+		const MT_TYPE* row_s = &mat.matrix[s * mat.n];
+		for (int j = 0; j < mat.n; j++) {
+			MT_TYPE value = 0.0f;
+			if (c1 != 0) { value += c1 * row_d[j]; }
+			if (c2 != 0) { value += c2 * row_s[j]; }
+			row_d[j] = value;
+		}
+		return;
+	}
+	for (int j = 0; j < mat.n; j++) {
+		MT_TYPE value = 0.0f;
+		if (c1 != 0) { value += c1 * MATRIX_AT(mat, d, j); }
+		if (c2 != 0) { value += c2 * MATRIX_AT(mat, s, j); }
+		mat.matrix[INDEX_AT(mat, d, j)] = value;
+	}
+}
+
+// find_pivot_row through the view: the first row from pivot_row down with a nonzero in col, or -1
+int MT_VIEW_FN(find_pivot_row)(MT_VIEW view, int pivot_row, int col) {
+	for (int j = pivot_row; j < view.mat.m; j++) {
+		if (ROWVIEW_AT(view, j, col) != 0) { return j; }
+	}
+	return -1;
+}
+
+// returns the view as a new row major matrix, allocated on frame. One pass, a row copy per row if mat isn't transposed
+//
+// fmatrix PA = frowview_gather(V, &frame);
+MT_MATRIX MT_VIEW_FN(gather)(MT_VIEW view, pool* frame) {
+	MT_MATRIX mat = view.mat;
+	MT_MATRIX result = MT_FN(create_zero)(mat.m, mat.n, frame);
+	if (result.matrix == NULL) { return result; }
+	for (int i = 0; i < mat.m; i++) {
+		MT_TYPE* row = &result.matrix[i * mat.n];
+		if (!mat.transpose) { memcpy(row, &mat.matrix[view.rows[i] * mat.n], mat.n * sizeof(MT_TYPE)); }
+		else {
+			for (int j = 0; j < mat.n; j++) { row[j] = MATRIX_AT(mat, view.rows[i], j); }
+		}
+	}
+	return result;
+}
+
+// physically reorders the rows of the view's matrix into view order, and resets the view to the identity. Follows the cycles of
+// the permutation, so every row moves once, with one row of workspace from frame
+void MT_VIEW_FN(apply_in)(MT_VIEW view, pool* frame) {
+	MT_MATRIX mat = view.mat;
+	void* workspace = frame->ptr;
+	MT_TYPE* buffer = raw_pool_alloc(frame, mat.n * sizeof(MT_TYPE));
+	if (buffer == NULL) {
+		printf("error while applying row view: pool allocation failure\n");
+		return;
+	}
+
+	// the row that belongs in i comes from rows[i], so walk each cycle, holding its first row in buffer
+	for (int i = 0; i < mat.m; i++) {
+		if (view.rows[i] == i) { continue; }
+		for (int c = 0; c < mat.n; c++) { buffer[c] = MATRIX_AT(mat, i, c); }
+		int j = i;
+		while (view.rows[j] != i) {
+			int next = view.rows[j];
+			for (int c = 0; c < mat.n; c++) { mat.matrix[INDEX_AT(mat, j, c)] = MATRIX_AT(mat, next, c); }
+			view.rows[j] = j;
+			j = next;
+		}
+		for (int c = 0; c < mat.n; c++) { mat.matrix[INDEX_AT(mat, j, c)] = buffer[c]; }
+		view.rows[j] = j;
+	}
+
+	pool_free_from(frame, workspace);
+}
+
+// Factorizations and Decompositions
+// These functions take in a matrix input, but need to return multiple matrices that make up the respective factorization/decompositon
+// Each factorization has a defined number of matrices that make up its factorization, so for now, convention is to simply return an array of fmatrix pointers
+
+
+// Technically, this function does PLU factorization
+// PA = LU such that L is lower triangular, U is upper triangular, and P is a permutation matrix
+// A permutation matrix is simply an identity matrix that has undergone row swaps. In this case, the row swaps we do correspond to the row
+// swaps required to get A to be able to be row reduced to an upper triangular matrix. For matrices that need no row swaps, P is just identity
+// 
+// This function takes in mat, and populates an fmatrix array, with the first element being P, the second being L and the third being U
+// Works for matrices that require partial pivoting, but not non-square matrices FOR NOW
+// In the case that no LU factorization exists, (mat is "rank-deficient") free data from pool starting from U.matrix, then return NULL.
+// Usage: This one requires you to pass in a declared fmatrix array:
+// fmatrix PLU[3];
+// if(fmatrix_LU_factorize(A, PLU, &frame) == NULL){
+//     printf("LU factorization for A does not exist");
+// }
+MT_MATRIX* MT_FN(LU_factorize)(MT_MATRIX mat, MT_MATRIX PLU[3], pool* frame) {
+	if (mat.m != mat.n) { return NULL; } // does not handle rectangular matrices for now
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_LU_FACTORIZE, mat, MT_ERROR);
+
+	// initialize P, L, and U. U is eliminated through a row view, so pivots only swap indices, and it's put in pivoted order
+	// once at the end. P is filled in from the same indices
+	MT_MATRIX P, L, U;
+	if((P = MT_FN(create_zero)(mat.m, mat.n, frame)).matrix == NULL){ MT_INSTRUMENT_END(); return NULL; }
+	if((L = MT_FN(create_identity)(mat.m, mat.n, frame)).matrix == NULL){ MT_INSTRUMENT_END(); return NULL; }
+	if((U = MT_LOCAL(copy_row_major)(mat, frame)).matrix == NULL){ MT_INSTRUMENT_END(); return NULL; }
+	MT_VIEW V = MT_FN(row_view)(U, frame);
+	if (V.rows == NULL) {
+		pool_free_from(frame, P.matrix);
+		MT_INSTRUMENT_END();
+		return NULL;
+	}
+
+	// row reduce U into an upper triangular matrix
+	int pivot_row;
+	MT_TYPE pivot_value;
+	for (int i = 0; i < U.n; i++) {
+		pivot_row = MT_VIEW_FN(find_pivot_row)(V, i, i);
+		if (pivot_row == -1) {						// if no pivot row is found, mat is rank-deficient
+			pool_free_from(frame, P.matrix);
+			MT_INSTRUMENT_END();
+			return NULL;
+		}
+		if (pivot_row != i) {						// pivot row is found, but requires a pivot (row swap)
+			MT_VIEW_FN(swap)(V, i, pivot_row);
+			// the multipliers found so far belong to the rows, so they move with them
+			for (int c = 0; c < i; c++) { MT_SWAP(&L.matrix[INDEX_AT(L, i, c)], &L.matrix[INDEX_AT(L, pivot_row, c)]); }
+		}
+		pivot_value = ROWVIEW_AT(V, i, i);
+
+		// eliminate lower elements
+		for (int j = i + 1; j < U.m; j++) {
+			MT_TYPE row_value = ROWVIEW_AT(V, j, i);
+			if(row_value == 0){ continue; } 
+
+			MT_TYPE k = (row_value / pivot_value);
+			MT_VIEW_FN(row_sum_in)(V, j, 1, i, -k);
+			L.matrix[INDEX_AT(L, j, i)] = k;		// track eliminations in L
+		}
+	}
+
+	// row i of PA is row rows[i] of A
+	for (int i = 0; i < P.m; i++) { P.matrix[i * P.n + V.rows[i]] = 1; }
+	MT_VIEW_FN(apply_in)(V, frame);
+	pool_free_from(frame, V.rows);
+
+	// populate the passed in array
+	PLU[0] = P;
+	PLU[1] = L;
+	PLU[2] = U;
+
+	MT_INSTRUMENT_END();
+	return PLU;
+}
+
+static MT_MATRIX MT_LOCAL(spd_solve)(MT_MATRIX A, MT_MATRIX B, int quiet, pool* frame);
+
+// You can solve a system of n equations in n variables quickly using LU factorization. 
+// let Ax = b (A and b are given, A is m x m, and b = m x 1)
+// let PA = LU (where P is a permutation matrix, L is lower triangular, and U is upper triangular)
+// so: P^tLUx = b, and LUx = Pb
+// let y = Ux
+// so: Ly = Pb
+// L is lower triangular, so it is easy to solve for y in Ly = b
+// Ux = y
+// U is upper triangular, and y is now known, so it is easy to solve for x
+// 
+// Takes in m x m matrix A, m x 1 vector b, then returns an m x 1 vector x
+// If LU_factorize returns NULL, then handle that somehow.
+// If this happens, then there are either infinite solutions, or zero. Maybe return matrices that indicate this?
+// They need to be seperate from ERROR_FMATRIX, which should only return on actual errors
+MT_MATRIX MT_FN(LU_solve)(MT_MATRIX A, MT_MATRIX b, pool* frame) {
+	if (A.m != A.n) {
+		printf("Solving a system requires a square matrix (for now)\n");
+		return MT_ERROR;
+	}
+#ifdef MT_STRUCTURED
+	if (A.kind != FMATRIX_GENERAL) { return fmatrix_structured_solve(A, b, frame); }
+#endif
+	if (b.m != A.m && b.n != 1) {
+		printf("Solving a system requires b to be m x 1, where m is A.m\n");
+		return MT_ERROR;
+	}
+
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_LU_SOLVE, A, b);
+
+	// symmetric systems try cholesky first, which is about twice as fast and skips the pivot search.
+	// if A turns out not to be positive definite, nothing is left on the pool and we fall through to LU
+	if (MT_FN(is_symmetric)(A)) {
+		MT_MATRIX x = MT_LOCAL(spd_solve)(A, b, 1, frame);
+		if (x.matrix != NULL) { MT_INSTRUMENT_END(); return x; }
+	}
+
+	// get the PLU factorization of A, and check if it even exists. 
+	// for now, just return, but in the future actually handle the case
+	MT_MATRIX PLU[3];
+	if (MT_FN(LU_factorize)(A, PLU, frame) == NULL) { MT_INSTRUMENT_END(); return A; }
+	MT_MATRIX P = PLU[0];
+	MT_MATRIX L = PLU[1];
+	MT_MATRIX U = PLU[2];
+
+	// allocate space for x and y, but do x first so we can free up y at the end
+	MT_MATRIX x = MT_FN(create_zero)(A.m, 1, frame);
+	if (x.matrix == NULL) { MT_INSTRUMENT_END(); return MT_ERROR; }
+	MT_MATRIX y = MT_FN(create_zero)(A.m, 1, frame);
+	if (y.matrix == NULL) { 
+		pool_free_from(frame, x.matrix);
+		MT_INSTRUMENT_END();
+		return MT_ERROR; 
+	}
+
+	// also allocate a copy of p, so we can permute it (LUx = Pb)
+	// I wonder if we can do this lazily, just by accessing the correct element of b
+	MT_MATRIX Pb = MT_FN(multiply)(P, b, frame);
+
+	// consider putting the following two loops into their own functions (forward solve/back solve)
+	// It isn't very difficult to do this, but I don't need it at the moment, so I'll leave them as they are.
+
+	// Ly = Pb, solve for y
+	for (int r = 0; r < L.m; r++) {
+		// iterate through the current row until you reach the diagonal 
+		MT_TYPE b_r = Pb.matrix[r]; // use elements of b to determine corresponding elements of y
+		for (int c = 0; c < r; c++) {
+			b_r -= (y.matrix[c] * MATRIX_AT(L, r, c));
+			//printf("uh: %f * %f = %f\n", y.matrix[c], MATRIX_AT(L, r, c), y.matrix[c] * MATRIX_AT(L, r, c));
+		}
+		y.matrix[r] = b_r; // For now, diagonal elements of L are 1.0. Make sure to change this line if that changes
+	}
+
+	// Ux = y, solve for x (iterate from the bottom)
+	for (int r = U.m - 1; r >= 0; r--) {
+		// iterate backwards through the current row until you reach the diagonal 
+		MT_TYPE y_r = y.matrix[r]; // use elements of y to determine corresponding elements of x
+		for (int c = U.n - 1; c > r; c--) {
+			y_r -= (x.matrix[c] * MATRIX_AT(U, r, c));
+			//printf("uh: %f * %f = %f\n", y.matrix[c], MATRIX_AT(L, r, c), y.matrix[c] * MATRIX_AT(L, r, c));
+		}
+		x.matrix[r] = y_r / MATRIX_AT(U, r, r); 
+	}
+
+	// free up y, which won't be used anymore
+	pool_free_from(frame, y.matrix);
+
+	MT_INSTRUMENT_END();
+	return x;
+}
+
+// Compact LU factorization
+// The same PA = LU as fmatrix_LU_factorize, but packed into one matrix, with P kept as a row permutation instead of a matrix, and
+// with partial pivoting: each column pivots on its largest element, which keeps the multipliers in L at most 1 in magnitude.
+// It's blocked like LAPACK's getrf: a panel of LU_BLOCK_SIZE columns is factored, the rows of U to its right are solved with the
+// panel's L, and then the whole trailing matrix gets one rank LU_BLOCK_SIZE update. That update is where almost all the work is,
+// and it's a GEMM over contiguous rows. The factorization is returned as a struct so it can be reused for determinants and any
+// number of solves without refactoring.
+
+// factors the n x n row major array a into LU in place. ipiv[k] is the row that was swapped with row k at step k (LAPACK style),
+// and sign gets the determinant of the permutation. returns 0 if some column had no nonzero pivot (the factorization still
+// finishes, with a 0 on U's diagonal), 1 otherwise
+static int MT_LOCAL(lu_factor_raw)(MT_TYPE* a, int n, int* ipiv, int* sign) {
+	int nonsingular = 1;
+	*sign = 1;
+	for (int k0 = 0; k0 < n; k0 += LU_BLOCK_SIZE) {
+		int k1 = (k0 + LU_BLOCK_SIZE < n) ? k0 + LU_BLOCK_SIZE : n;
+
+		// panel: unblocked elimination of columns k0 to k1 - 1. Swaps move whole rows, so they apply to both sides at once
+		for (int k = k0; k < k1; k++) {
+			int pivot = k;
+			MT_TYPE largest = (MT_TYPE)fabs(a[k * n + k]);
+			for (int i = k + 1; i < n; i++) {
+				MT_TYPE value = (MT_TYPE)fabs(a[i * n + k]);
+				if (value > largest) { largest = value; pivot = i; }
+			}
+			ipiv[k] = pivot;
+			if (largest == 0) { nonsingular = 0; continue; }		// nothing to eliminate with, the column is already 0 below k
+			if (pivot != k) {
+				for (int j = 0; j < n; j++) { MT_SWAP(&a[k * n + j], &a[pivot * n + j]); }
+				*sign = -*sign;
+			}
+
+			MT_TYPE* row_k = &a[k * n];
+			MT_TYPE inverse = 1 / row_k[k];
+			for (int i = k + 1; i < n; i++) {
+				MT_TYPE* row_i = &a[i * n];
+				MT_TYPE l = row_i[k] * inverse;
+				row_i[k] = l;
+				if (l == 0) { continue; }
+				for (int j = k + 1; j < k1; j++) { row_i[j] -= l * row_k[j]; }
+			}
+		}
+		if (k1 == n) { break; }
+
+		// U12 = L11^-1 A12, for the block rows right of the panel
+		for (int k = k0; k < k1; k++) {
+			const MT_TYPE* row_k = &a[k * n];
+			for (int i = k + 1; i < k1; i++) {
+				MT_TYPE* row_i = &a[i * n];
+				MT_TYPE l = row_i[k];
+				if (l == 0) { continue; }
+				for (int j = k1; j < n; j++) { row_i[j] -= l * row_k[j]; }
+			}
+		}
+
+		// A22 -= L21 U12
+		for (int i = k1; i < n; i++) {
+			MT_TYPE* row_i = &a[i * n];
+			for (int p = k0; p < k1; p++) {
+				MT_TYPE l = row_i[p];
+				if (l == 0) { continue; }
+				const MT_TYPE* row_p = &a[p * n];
+				for (int j = k1; j < n; j++) { row_i[j] -= l * row_p[j]; }
+			}
+		}
+	}
+	return nonsingular;
+}
+
+// factors square mat into a compact PA = LU, allocated on frame (mat isn't modified). A matrix with a column that has no nonzero
+// pivot is still factored, with singular set and a 0 on U's diagonal. upon failure, returns a factorization with a NULL LU.matrix
+//
+// flu F = fmatrix_LU_decompose(A, &frame);
+// float det = flu_determinant(F);
+MT_LU MT_FN(LU_decompose)(MT_MATRIX mat, pool* frame) {
+	MT_LU F = { MT_ERROR, NULL, 1, 0 };
+	if (mat.m != mat.n) {
+		printf("LU decomposition requires a square matrix (%d x %d)\n", mat.m, mat.n);
+		return F;
+	}
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_LU_DECOMPOSE, mat, MT_ERROR);
+	int n = mat.n;
+
+	void* start = frame->ptr;
+	MT_MATRIX LU = MT_LOCAL(copy_row_major)(mat, frame);
+	int* perm = raw_pool_alloc(frame, n * sizeof(int));
+	void* workspace = frame->ptr;
+	int* ipiv = raw_pool_alloc(frame, n * sizeof(int));
+	if (LU.matrix == NULL || perm == NULL || ipiv == NULL) {
+		printf("LU decomposition error: pool allocation failure\n");
+		pool_free_from(frame, start);
+		MT_INSTRUMENT_END();
+		return F;
+	}
+
+	// replay the swaps in order to turn them into a permutation
+	F.singular = !MT_LOCAL(lu_factor_raw)(LU.matrix, n, ipiv, &F.sign);
+	for (int i = 0; i < n; i++) { perm[i] = i; }
+	for (int k = 0; k < n; k++) {
+		if (ipiv[k] != k) { intswap(&perm[k], &perm[ipiv[k]]); }
+	}
+	pool_free_from(frame, workspace);
+
+	F.LU = LU;
+	F.perm = perm;
+	MT_INSTRUMENT_END();
+	return F;
+}
+
+// returns det(A) from its factorization: the product of U's diagonal, times the sign of the permutation
+// the product can overflow or underflow for large matrices even when the determinant itself is representable, so use
+// flu_log_determinant for those
+//
+// float det = flu_determinant(F);
+MT_TYPE MT_LU_FN(determinant)(MT_LU F) {
+	if (F.LU.matrix == NULL) { return NAN; }
+	if (F.singular) { return 0; }
+	MT_TYPE result = (MT_TYPE)F.sign;
+	for (int i = 0; i < F.LU.n; i++) { result *= F.LU.matrix[i * F.LU.n + i]; }
+	return result;
+}
+
+// returns log|det(A)| from its factorization, and sets sign to the sign of det(A) (-1, 0 or 1). The log is a sum instead of a
+// product, so it stays finite for any size. A singular A gives -INFINITY and a sign of 0
+//
+// int sign;
+// float log_det = flu_log_determinant(F, &sign);
+MT_TYPE MT_LU_FN(log_determinant)(MT_LU F, int* sign) {
+	if (F.LU.matrix == NULL) {
+		if (sign != NULL) { *sign = 0; }
+		return NAN;
+	}
+	if (F.singular) {
+		if (sign != NULL) { *sign = 0; }
+		return -INFINITY;
+	}
+	int s = F.sign;
+	double sum = 0.0;
+	for (int i = 0; i < F.LU.n; i++) {
+		MT_TYPE u = F.LU.matrix[i * F.LU.n + i];
+		if (u < 0) { s = -s; }
+		sum += log(fabs((double)u));
+	}
+	if (sign != NULL) { *sign = s; }
+	return (MT_TYPE)sum;
+}
+
+// solves AX = B with a factorization of A from fmatrix_LU_decompose. B is n x k, and X is returned allocated on frame.
+// returns MT_ERROR if A is singular
+//
+// flu F = fmatrix_LU_decompose(A, &frame);
+// fmatrix X = flu_solve(F, B, &frame);
+MT_MATRIX MT_LU_FN(solve)(MT_LU F, MT_MATRIX B, pool* frame) {
+	int n = F.LU.n;
+	if (F.LU.matrix == NULL || B.m != n) {
+		printf("LU solve requires a factorization of an n x n A and an n x k B (A is %d x %d, B is %d x %d)\n", n, n, B.m, B.n);
+		return MT_ERROR;
+	}
+	if (F.singular) {
+		printf("LU solve failed: matrix is singular\n");
+		return MT_ERROR;
+	}
+	int k = B.n;
+
+	// X = PB, then forward and back substitution on whole rows of X, like the cholesky solve
+	MT_MATRIX X = MT_FN(create_zero)(n, k, frame);
+	if (X.matrix == NULL) { return MT_ERROR; }
+	for (int i = 0; i < n; i++) {
+		for (int c = 0; c < k; c++) { X.matrix[i * k + c] = MT_AT(B, F.perm[i], c); }
+	}
+
+	const MT_TYPE* a = F.LU.matrix;
+	for (int i = 0; i < n; i++) {
+		MT_TYPE* x_i = &X.matrix[i * k];
+		for (int j = 0; j < i; j++) {
+			MT_TYPE l = a[i * n + j];
+			if (l == 0) { continue; }
+			const MT_TYPE* x_j = &X.matrix[j * k];
+			for (int c = 0; c < k; c++) { x_i[c] -= l * x_j[c]; }
+		}
+	}
+	for (int i = n - 1; i >= 0; i--) {
+		MT_TYPE* x_i = &X.matrix[i * k];
+		for (int j = i + 1; j < n; j++) {
+			MT_TYPE u = a[i * n + j];
+			if (u == 0) { continue; }
+			const MT_TYPE* x_j = &X.matrix[j * k];
+			for (int c = 0; c < k; c++) { x_i[c] -= u * x_j[c]; }
+		}
+		MT_TYPE inverse = 1 / a[i * n + i];
+		for (int c = 0; c < k; c++) { x_i[c] *= inverse; }
+	}
+
+	return X;
+}
+
+// Inverse
+// Computed like LAPACK's getrf + getri, in the input's own buffer, with only an n x LU_BLOCK_SIZE strip of workspace:
+//   1) PA = LU in place (blocked, above)
+//   2) U is inverted in place, one block column at a time
+//   3) X L = U^-1 is solved for X = U^-1 L^-1 from the last block column back, which is mostly a GEMM against the strip
+//   4) A^-1 = X P, which is the pivot swaps replayed backwards, as column swaps
+
+// inverts the upper triangle of the n x n row major array a in place (the strict lower triangle isn't touched). Blocked like
+// LAPACK's trtri: going down the diagonal, with T the already inverted top left block, A12 = -T A12 A22^-1, then A22 is
+// inverted on its own
+static void MT_LOCAL(upper_inverse_raw)(MT_TYPE* a, int n) {
+	for (int j0 = 0; j0 < n; j0 += LU_BLOCK_SIZE) {
+		int j1 = (j0 + LU_BLOCK_SIZE < n) ? j0 + LU_BLOCK_SIZE : n;
+		int jb = j1 - j0;
+
+		// A12 = T A12. Row i of the result only reads rows i and below, which are still untouched going top down
+		for (int i = 0; i < j0; i++) {
+			MT_TYPE* x_i = &a[i * n + j0];
+			MT_TYPE t = a[i * n + i];
+			for (int c = 0; c < jb; c++) { x_i[c] *= t; }
+			for (int p = i + 1; p < j0; p++) {
+				t = a[i * n + p];
+				if (t == 0) { continue; }
+				const MT_TYPE* x_p = &a[p * n + j0];
+				for (int c = 0; c < jb; c++) { x_i[c] += t * x_p[c]; }
+			}
+		}
+
+		// A12 = -A12 A22^-1: every row solves y A22 = -x from left to right
+		for (int i = 0; i < j0; i++) {
+			MT_TYPE* x_i = &a[i * n];
+			for (int c = j0; c < j1; c++) {
+				MT_TYPE sum = -x_i[c];
+				for (int p = j0; p < c; p++) { sum -= x_i[p] * a[p * n + c]; }
+				x_i[c] = sum / a[c * n + c];
+			}
+		}
+
+		// A22^-1, a column at a time: column j above the diagonal is -T x / u_jj, with T the part of the block inverted so far
+		for (int j = j0; j < j1; j++) {
+			a[j * n + j] = 1 / a[j * n + j];
+			MT_TYPE scale = -a[j * n + j];
+			for (int i = j0; i < j; i++) {
+				MT_TYPE sum = a[i * n + i] * a[i * n + j];
+				for (int p = i + 1; p < j; p++) { sum += a[i * n + p] * a[p * n + j]; }
+				a[i * n + j] = sum * scale;
+			}
+		}
+	}
+}
+
+// with U^-1 on and above the diagonal of a and L's multipliers below it, overwrites a with U^-1 L^-1. Block columns go from
+// last to first, and each one moves its part of L into work (n x LU_BLOCK_SIZE) first, so a can be overwritten
+static void MT_LOCAL(unit_lower_right_inverse_raw)(MT_TYPE* a, int n, MT_TYPE* work) {
+	for (int j0 = ((n - 1) / LU_BLOCK_SIZE) * LU_BLOCK_SIZE; j0 >= 0; j0 -= LU_BLOCK_SIZE) {
+		int j1 = (j0 + LU_BLOCK_SIZE < n) ? j0 + LU_BLOCK_SIZE : n;
+		int jb = j1 - j0;
+
+		// work row i, column c is L[i][j0 + c] (0 on and above the diagonal)
+		for (int i = j0; i < n; i++) {
+			for (int c = 0; c < jb; c++) {
+				if (i > j0 + c) {
+					work[i * jb + c] = a[i * n + j0 + c];
+					a[i * n + j0 + c] = 0;
+				}
+				else { work[i * jb + c] = 0; }
+			}
+		}
+
+		// X[:, j0:j1] -= X[:, j1:n] L[j1:n, j0:j1], the columns right of the block are already final
+		for (int i = 0; i < n; i++) {
+			MT_TYPE* x_i = &a[i * n + j0];
+			for (int p = j1; p < n; p++) {
+				MT_TYPE t = a[i * n + p];
+				if (t == 0) { continue; }
+				const MT_TYPE* l_p = &work[p * jb];
+				for (int c = 0; c < jb; c++) { x_i[c] -= t * l_p[c]; }
+			}
+		}
+
+		// X[:, j0:j1] = X[:, j0:j1] L11^-1: every row solves y L11 = x from right to left (L11 has a unit diagonal)
+		for (int i = 0; i < n; i++) {
+			MT_TYPE* x_i = &a[i * n + j0];
+			for (int c = jb - 1; c >= 0; c--) {
+				MT_TYPE sum = x_i[c];
+				for (int p = c + 1; p < jb; p++) { sum -= x_i[p] * work[(j0 + p) * jb + c]; }
+				x_i[c] = sum;
+			}
+		}
+	}
+}
+
+// inverts square mat in its own buffer. Only the pivots and an n x LU_BLOCK_SIZE strip are taken from frame, and they're freed
+// before returning. A transposed mat works too, since inverting its storage gives the transpose of its inverse.
+// returns 1 on success, and 0 if mat is singular (then mat is left holding its LU factors)
+//
+// if (!fmatrix_inverse_in(A, &frame)) { printf("A is singular\n"); }
+int MT_FN(inverse_in)(MT_MATRIX mat, pool* frame) {
+	if (mat.m != mat.n) {
+		printf("inverse requires a square matrix (%d x %d)\n", mat.m, mat.n);
+		return 0;
+	}
+	if (!MT_LOCAL(require_general)(mat, "in place inverse")) { return 0; }
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_INVERSE_IN, mat, MT_ERROR);
+	int n = mat.n;
+	MT_TYPE* a = mat.matrix;
+
+	void* workspace = frame->ptr;
+	int* ipiv = raw_pool_alloc(frame, n * sizeof(int));
+	MT_TYPE* work = raw_pool_alloc(frame, n * LU_BLOCK_SIZE * sizeof(MT_TYPE));
+	if (ipiv == NULL || work == NULL) {
+		printf("inverse error: pool allocation failure\n");
+		pool_free_from(frame, workspace);
+		MT_INSTRUMENT_END();
+		return 0;
+	}
+
+	int sign;
+	if (!MT_LOCAL(lu_factor_raw)(a, n, ipiv, &sign)) {
+		pool_free_from(frame, workspace);
+		MT_INSTRUMENT_END();
+		return 0;
+	}
+	MT_LOCAL(upper_inverse_raw)(a, n);
+	MT_LOCAL(unit_lower_right_inverse_raw)(a, n, work);
+
+	// A^-1 = U^-1 L^-1 P. P swapped row k with row ipiv[k] in order, so undo it on the columns in reverse
+	for (int k = n - 1; k >= 0; k--) {
+		int swapped = ipiv[k];
+		if (swapped == k) { continue; }
+		for (int i = 0; i < n; i++) { MT_SWAP(&a[i * n + k], &a[i * n + swapped]); }
+	}
+
+	pool_free_from(frame, workspace);
+	MT_INSTRUMENT_END();
+	return 1;
+}
+
+// finds and returns the inverse of mat, allocated on frame (see fmatrix_inverse_in). The copy keeps mat's transpose flag, and a
+// packed mat is unpacked into it first. returns ERROR_FMATRIX if mat is not invertible, and leaves nothing on frame
+//
+// fmatrix Ainv = fmatrix_inverse(A, &frame);
+MT_MATRIX MT_FN(inverse)(MT_MATRIX mat, pool* frame) {
+	if (mat.m != mat.n) {
+		printf("inverse requires a square matrix (%d x %d)\n", mat.m, mat.n);
+		return MT_ERROR;
+	}
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_INVERSE, mat, MT_ERROR);
+
+	MT_MATRIX result = MT_LOCAL(general_copy)(mat, frame);
+	if (result.matrix == NULL) { MT_INSTRUMENT_END(); return MT_ERROR; }
+	if (!MT_FN(inverse_in)(result, frame)) {
+		pool_free_from(frame, result.matrix);
+		MT_INSTRUMENT_END();
+		return MT_ERROR;
+	}
+
+	MT_INSTRUMENT_END();
+	return result;
+}
+
+// Matrix functions
+// fmatrix_power works up the bits of k by repeated squaring: log2(k) squarings, plus one product per set bit. fmatrix_expm uses
+// scaling and squaring (Higham 2005, the method behind MATLAB's expm):
+//   exp(A) = exp(A / 2^s)^(2^s), with s picked so that ||A / 2^s||_1 is below theta_m, the largest norm for which the degree m Pade
+//   approximant r_m(A) = q_m(A)^-1 p_m(A) matches exp to working precision. With U the odd terms and V the even ones,
+//   p_m = V + U and q_m = V - U, so the approximant is one LU solve, and then it's squared s times.
+// Float only ever needs degree 7, double goes up to 13. Both work on row major scratch copies, and every product goes through
+// multiply_raw into a preallocated buffer, so the squaring loops trade pointers instead of allocating a matrix per step.
+
+// c = ab for n x n row major arrays (c can't be a or b). Row i of c is built from whole rows of b, like the LU's trailing update
+static void MT_LOCAL(multiply_raw)(const MT_TYPE* a, const MT_TYPE* b, MT_TYPE* c, int n) {
+	memset(c, 0, n * n * sizeof(MT_TYPE));
+	for (int i = 0; i < n; i++) {
+		MT_TYPE* c_i = &c[i * n];
+		for (int p = 0; p < n; p++) {
+			MT_TYPE a_ip = a[i * n + p];
+			if (a_ip == 0) { continue; }
+			const MT_TYPE* b_p = &b[p * n];
+			for (int j = 0; j < n; j++) { c_i[j] += a_ip * b_p[j]; }
+		}
+	}
+}
+
+// solves AX = B in place in x (n x k, row major) with the factors and swaps left by lu_factor_raw in a
+static void MT_LOCAL(lu_solve_raw)(const MT_TYPE* a, int n, const int* ipiv, MT_TYPE* x, int k) {
+	for (int r = 0; r < n; r++) {
+		if (ipiv[r] == r) { continue; }
+		for (int c = 0; c < k; c++) { MT_SWAP(&x[r * k + c], &x[ipiv[r] * k + c]); }
+	}
+	for (int i = 0; i < n; i++) {
+		MT_TYPE* x_i = &x[i * k];
+		for (int j = 0; j < i; j++) {
+			MT_TYPE l = a[i * n + j];
+			if (l == 0) { continue; }
+			const MT_TYPE* x_j = &x[j * k];
+			for (int c = 0; c < k; c++) { x_i[c] -= l * x_j[c]; }
+		}
+	}
+	for (int i = n - 1; i >= 0; i--) {
+		MT_TYPE* x_i = &x[i * k];
+		for (int j = i + 1; j < n; j++) {
+			MT_TYPE u = a[i * n + j];
+			if (u == 0) { continue; }
+			const MT_TYPE* x_j = &x[j * k];
+			for (int c = 0; c < k; c++) { x_i[c] -= u * x_j[c]; }
+		}
+		MT_TYPE inverse = 1 / a[i * n + i];
+		for (int c = 0; c < k; c++) { x_i[c] *= inverse; }
+	}
+}
+
+// returns mat^k, allocated on frame. k = 0 gives the identity, and a negative k is a power of the inverse.
+// only the result and two n x n buffers are allocated, whatever k is. returns ERROR_FMATRIX if k < 0 and mat is singular
+//
+// fmatrix P = fmatrix_power(A, 10, &frame);		// 4 products instead of 9
+MT_MATRIX MT_FN(power)(MT_MATRIX mat, int k, pool* frame) {
+	if (mat.m != mat.n) {
+		printf("matrix power requires a square matrix (%d x %d)\n", mat.m, mat.n);
+		return MT_ERROR;
+	}
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_POWER, mat, MT_ERROR);
+	int n = mat.n;
+
+	MT_MATRIX result = MT_FN(create_identity)(n, n, frame);
+	if (result.matrix == NULL) { MT_INSTRUMENT_END(); return MT_ERROR; }
+	if (k == 0) { MT_INSTRUMENT_END(); return result; }
+
+	void* workspace = frame->ptr;
+	MT_MATRIX base = MT_LOCAL(copy_row_major)(mat, frame);
+	MT_TYPE* scratch = raw_pool_alloc(frame, n * n * sizeof(MT_TYPE));
+	if (base.matrix == NULL || scratch == NULL) {
+		printf("matrix power error: pool allocation failure\n");
+		pool_free_from(frame, result.matrix);
+		MT_INSTRUMENT_END();
+		return MT_ERROR;
+	}
+	if (k < 0 && !MT_FN(inverse_in)(base, frame)) {
+		printf("matrix power error: negative power of a singular matrix\n");
+		pool_free_from(frame, result.matrix);
+		MT_INSTRUMENT_END();
+		return MT_ERROR;
+	}
+
+	// r (the product so far, NULL while it's still I), b (mat^(2^bit)) and scratch are always three different buffers.
+	// each product goes into scratch, and the buffer it replaces becomes the new scratch
+	unsigned int bits = k < 0 ? 0u - (unsigned int)k : (unsigned int)k;
+	MT_TYPE* r = NULL;
+	MT_TYPE* b = base.matrix;
+	while (1) {
+		if (bits & 1) {
+			if (r == NULL) {
+				r = result.matrix;
+				memcpy(r, b, n * n * sizeof(MT_TYPE));
+			}
+			else {
+				MT_LOCAL(multiply_raw)(r, b, scratch, n);
+				MT_TYPE* t = r; r = scratch; scratch = t;
+			}
+		}
+		bits >>= 1;
+		if (bits == 0) { break; }
+		MT_LOCAL(multiply_raw)(b, b, scratch, n);
+		MT_TYPE* t = b; b = scratch; scratch = t;
+	}
+	if (r != result.matrix) { memcpy(result.matrix, r, n * n * sizeof(MT_TYPE)); }
+
+	pool_free_from(frame, workspace);
+	MT_INSTRUMENT_END();
+	return result;
+}
+
+// out = sum over j < terms of c[first + 2j] A^(2j), where powers[j] = A^(2j) for j >= 1 (A^0 = I isn't stored)
+static void MT_LOCAL(even_sum_raw)(MT_TYPE* out, MT_TYPE* const* powers, const double* c, int first, int terms, int n) {
+	for (int i = 0; i < n * n; i++) {
+		double sum = 0.0;
+		for (int j = 1; j < terms; j++) { sum += c[first + 2 * j] * powers[j][i]; }
+		out[i] = (MT_TYPE)sum;
+	}
+	for (int i = 0; i < n; i++) { out[i * n + i] += (MT_TYPE)c[first]; }
+}
+
+// returns the matrix exponential exp(mat), allocated on frame (see Matrix functions above)
+// returns ERROR_FMATRIX on allocation failure, or if the norm is infinite or NaN
+//
+// fmatrix P = fmatrix_expm(fmatrix_scale(Q, t, &frame), &frame);		// transition matrix of a continuous time Markov chain
+MT_MATRIX MT_FN(expm)(MT_MATRIX mat, pool* frame) {
+	if (mat.m != mat.n) {
+		printf("matrix exponential requires a square matrix (%d x %d)\n", mat.m, mat.n);
+		return MT_ERROR;
+	}
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_EXPM, mat, MT_ERROR);
+	int n = mat.n;
+	int size = n * n;
+
+	MT_MATRIX result = MT_FN(create_zero)(n, n, frame);
+	void* workspace = frame->ptr;
+	MT_MATRIX A = MT_LOCAL(copy_row_major)(mat, frame);
+	// A^2, A^4, A^6, A^8, U, V and a product
+	MT_TYPE* buffers = raw_pool_alloc(frame, 7 * size * sizeof(MT_TYPE));
+	int* ipiv = raw_pool_alloc(frame, n * sizeof(int));
+	if (result.matrix == NULL || A.matrix == NULL || buffers == NULL || ipiv == NULL) {
+		printf("matrix exponential error: pool allocation failure\n");
+		if (result.matrix != NULL) { pool_free_from(frame, result.matrix); }
+		MT_INSTRUMENT_END();
+		return MT_ERROR;
+	}
+	MT_TYPE* a = A.matrix;
+	MT_TYPE* powers[5] = { NULL, buffers, buffers + size, buffers + 2 * size, buffers + 3 * size };
+	MT_TYPE* U = buffers + 4 * size;
+	MT_TYPE* V = buffers + 5 * size;
+	MT_TYPE* T = buffers + 6 * size;
+
+	// 1 norm: the largest absolute column sum
+	double norm = 0.0;
+	for (int j = 0; j < n; j++) {
+		double sum = 0.0;
+		for (int i = 0; i < n; i++) { sum += fabs((double)a[i * n + j]); }
+		if (sum > norm) { norm = sum; }
+	}
+	if (!isfinite(norm)) {
+		printf("matrix exponential error: matrix has an infinite or NaN element\n");
+		pool_free_from(frame, result.matrix);
+		MT_INSTRUMENT_END();
+		return MT_ERROR;
+	}
+
+	// the smallest degree whose theta covers the norm, or the largest one after scaling by 2^-s
+	static const int degrees[5] = { 3, 5, 7, 9, 13 };
+	static const double theta_single[3] = { 4.258730016922831e-1, 1.880152677804762, 3.925724783138660 };
+	static const double theta_double[5] = { 1.495585217958292e-2, 2.539398330063230e-1, 9.504178996162932e-1,
+		2.097847961257068, 5.371920351148152 };
+	int single = sizeof(MT_TYPE) == sizeof(float);
+	const double* theta = single ? theta_single : theta_double;
+	int last = single ? 2 : 4;
+	int d = 0;
+	while (d < last && norm > theta[d]) { d++; }
+	int s = 0;
+	if (norm > theta[last]) {
+		s = (int)ceil(log2(norm / theta[last]));
+		MT_TYPE factor = (MT_TYPE)ldexp(1.0, -s);
+		for (int i = 0; i < size; i++) { a[i] *= factor; }
+	}
+	int m = degrees[d];
+
+	// Pade coefficients, c[j] = (2m - j)! m! / ((2m)! j! (m - j)!)
+	double c[14];
+	c[0] = 1.0;
+	for (int j = 0; j < m; j++) { c[j + 1] = c[j] * (m - j) / ((double)(2 * m - j) * (j + 1)); }
+
+	MT_LOCAL(multiply_raw)(a, a, powers[1], n);
+	if (m <= 9) {
+		int terms = (m + 1) / 2;
+		for (int j = 2; j < terms; j++) { MT_LOCAL(multiply_raw)(powers[j - 1], powers[1], powers[j], n); }
+		MT_LOCAL(even_sum_raw)(V, powers, c, 0, terms, n);
+		MT_LOCAL(even_sum_raw)(T, powers, c, 1, terms, n);
+		MT_LOCAL(multiply_raw)(a, T, U, n);
+	}
+	else {
+		// degree 13 only forms A^2, A^4 and A^6, and gets the higher terms as A^6 times a polynomial in them:
+		// U = A [A^6 (c13 A^6 + c11 A^4 + c9 A^2 + c7 I) + c5 A^4 + c3 A^2 + c1 I], and V the same with the even coefficients
+		MT_TYPE* W = powers[4];
+		MT_LOCAL(multiply_raw)(powers[1], powers[1], powers[2], n);
+		MT_LOCAL(multiply_raw)(powers[2], powers[1], powers[3], n);
+
+		MT_LOCAL(even_sum_raw)(T, powers, c, 7, 4, n);
+		MT_LOCAL(multiply_raw)(powers[3], T, W, n);
+		MT_LOCAL(even_sum_raw)(T, powers, c, 1, 3, n);
+		for (int i = 0; i < size; i++) { T[i] += W[i]; }
+		MT_LOCAL(multiply_raw)(a, T, U, n);
+
+		MT_LOCAL(even_sum_raw)(T, powers, c, 6, 4, n);
+		MT_LOCAL(multiply_raw)(powers[3], T, V, n);
+		MT_LOCAL(even_sum_raw)(T, powers, c, 0, 3, n);
+		for (int i = 0; i < size; i++) { V[i] += T[i]; }
+	}
+
+	// (V - U) X = V + U, factored in U's buffer and solved in V's
+	for (int i = 0; i < size; i++) {
+		MT_TYPE u = U[i];
+		U[i] = V[i] - u;
+		V[i] += u;
+	}
+	int sign;
+	if (!MT_LOCAL(lu_factor_raw)(U, n, ipiv, &sign)) {
+		printf("matrix exponential error: singular Pade denominator\n");
+		pool_free_from(frame, result.matrix);
+		MT_INSTRUMENT_END();
+		return MT_ERROR;
+	}
+	MT_LOCAL(lu_solve_raw)(U, n, ipiv, V, n);
+
+	// undo the scaling
+	MT_TYPE* X = V;
+	for (int k = 0; k < s; k++) {
+		MT_LOCAL(multiply_raw)(X, X, T, n);
+		MT_TYPE* t = X; X = T; T = t;
+	}
+	memcpy(result.matrix, X, size * sizeof(MT_TYPE));
+
+	pool_free_from(frame, workspace);
+	MT_INSTRUMENT_END();
+	return result;
+}
+
+// Cholesky factorization
+// A symmetric positive definite (SPD) matrix A can be factored as A = LL^t, where L is lower triangular with a positive diagonal.
+// Compared to LU, it needs no pivoting, half the flops, and only one triangular factor, and it only ever reads the lower triangle of A.
+// A isn't positive definite exactly when a diagonal element would need the square root of something <= 0, so trying to factor it
+// doubles as the SPD test.
+//
+// The factorization is blocked: each step factors a CHOLESKY_BLOCK_SIZE wide diagonal block, solves the panel of rows below it, then
+// updates the trailing lower triangle with that panel. Every inner loop is a dot product of two contiguous row segments, so the
+// working set of a step stays in cache instead of streaming the whole matrix once per column. The rows of the panel, and of the
+// trailing update, don't depend on each other, so both are split across threads (see parallel.h) on large enough matrices.
+// Only the lower triangle is ever touched, so fmatrix_cholesky_factorize returns L packed (FMATRIX_LOWER, n(n + 1)/2 floats). dmatrix
+// has no packed kinds, so the double version returns it dense with the upper triangle zeroed.
+
+// returns 1 if mat is square and exactly equal to its transpose, 0 otherwise
+// cheap (reads each element once), used to decide if a system can take the cholesky path
+//
+// if (fmatrix_is_symmetric(A)) { ... }
+int MT_FN(is_symmetric)(MT_MATRIX mat) {
+	if (mat.m != mat.n) { return 0; }
+#ifdef MT_STRUCTURED
+	if (mat.kind == FMATRIX_SYMMETRIC || mat.kind == FMATRIX_DIAGONAL) { return 1; }
+#endif
+	for (int i = 0; i < mat.m; i++) {
+		for (int j = 0; j < i; j++) {
+			if (MT_AT(mat, i, j) != MT_AT(mat, j, i)) { return 0; }
+		}
+	}
+	return 1;
+}
+
+// dot product of two contiguous row segments
+static MT_TYPE MT_LOCAL(row_dot)(const MT_TYPE* a, const MT_TYPE* b, int count) {
+	MT_TYPE sum = 0.0f;
+	for (int p = 0; p < count; p++) { sum += a[p] * b[p]; }
+	return sum;
+}
+
+// offset of row i in an n x n lower triangle stored either dense (row major) or packed (row i holds columns 0 to i, FMATRIX_LOWER's
+// layout). Either way [i][j] for j <= i is at lower_row(i) + j, so the cholesky kernels below work on both
+static int MT_LOCAL(lower_row)(int i, int n, int packed) {
+	return packed ? i * (i + 1) / 2 : i * n;
+}
+
+// one block step of the factorization, shared by the threads working on it
+typedef struct {
+	MT_TYPE* a;
+	int n, packed;
+	int k0, k1;
+}MT_LOCAL(cholesky_step);
+
+// panel rows k1 + begin to k1 + end - 1: L21 = A21 L11^-t
+static void MT_LOCAL(cholesky_panel)(void* context, int begin, int end) {
+	MT_LOCAL(cholesky_step)* step = context;
+	MT_TYPE* a = step->a;
+	int k0 = step->k0;
+	for (int i = step->k1 + begin; i < step->k1 + end; i++) {
+		MT_TYPE* row_i = &a[MT_LOCAL(lower_row)(i, step->n, step->packed)];
+		for (int j = k0; j < step->k1; j++) {
+			MT_TYPE* row_j = &a[MT_LOCAL(lower_row)(j, step->n, step->packed)];
+			row_i[j] = (row_i[j] - MT_LOCAL(row_dot)(&row_i[k0], &row_j[k0], j - k0)) / row_j[j];
+		}
+	}
+}
+
+// trailing rows: A22 -= L21 L21^t. Item t is row k1 + t together with row n - 1 - t, so every item is the same amount of work
+// (a short row and a long one) and contiguous chunks of items are balanced
+static void MT_LOCAL(cholesky_trailing)(void* context, int begin, int end) {
+	MT_LOCAL(cholesky_step)* step = context;
+	MT_TYPE* a = step->a;
+	int k0 = step->k0, k1 = step->k1;
+	for (int t = begin; t < end; t++) {
+		for (int side = 0; side < 2; side++) {
+			int i = side ? step->n - 1 - t : k1 + t;
+			if (side && i == k1 + t) { break; }
+			MT_TYPE* row_i = &a[MT_LOCAL(lower_row)(i, step->n, step->packed)];
+			for (int j = k1; j <= i; j++) {
+				row_i[j] -= MT_LOCAL(row_dot)(&row_i[k0], &a[MT_LOCAL(lower_row)(j, step->n, step->packed) + k0], k1 - k0);
+			}
+		}
+	}
+}
+
+// factors the lower triangle of the n x n array a into L, in place. a is row major, or packed like FMATRIX_LOWER if packed is set.
+// The upper triangle of a dense a is never read, and is zeroed on success
+// returns 0 as soon as a pivot isn't positive (a is not positive definite), leaving a partially factored
+static int MT_LOCAL(cholesky_factor_raw)(MT_TYPE* a, int n, int packed) {
+	for (int k0 = 0; k0 < n; k0 += CHOLESKY_BLOCK_SIZE) {
+		int k1 = (k0 + CHOLESKY_BLOCK_SIZE < n) ? k0 + CHOLESKY_BLOCK_SIZE : n;
+
+		// diagonal block (earlier blocks were already subtracted by the trailing updates)
+		for (int j = k0; j < k1; j++) {
+			MT_TYPE* row_j = &a[MT_LOCAL(lower_row)(j, n, packed)];
+			MT_TYPE d = row_j[j] - MT_LOCAL(row_dot)(&row_j[k0], &row_j[k0], j - k0);
+			if (!(d > 0.0f)) { return 0; }		// also catches NaN
+			d = MT_SQRT(d);
+			row_j[j] = d;
+			for (int i = j + 1; i < k1; i++) {
+				MT_TYPE* row_i = &a[MT_LOCAL(lower_row)(i, n, packed)];
+				row_i[j] = (row_i[j] - MT_LOCAL(row_dot)(&row_i[k0], &row_j[k0], j - k0)) / d;
+			}
+		}
+
+		// panel, then the trailing triangle. A panel row is about width^2 / 2 multiply adds, and a trailing item (two rows) is
+		// rows * width
+		MT_LOCAL(cholesky_step) step = { a, n, packed, k0, k1 };
+		int rows = n - k1, width = k1 - k0;
+		if (rows == 0) { continue; }
+		parallel_for(rows, PARALLEL_MIN_WORK / (width * width / 2 + 1) + 1, MT_LOCAL(cholesky_panel), &step);
+		parallel_for((rows + 1) / 2, PARALLEL_MIN_WORK / (rows * width) + 1, MT_LOCAL(cholesky_trailing), &step);
+	}
+
+	// clear the upper triangle so the result reads as L
+	if (!packed) {
+		for (int i = 0; i < n; i++) {
+			for (int j = i + 1; j < n; j++) { a[i * n + j] = 0.0f; }
+		}
+	}
+	return 1;
+}
+
+// solves LL^t X = X in place, for n x n L (row major, or packed like FMATRIX_LOWER if packed is set) and n x k row major X
+// both substitutions walk rows of L and update whole rows of X, so every inner loop is contiguous
+static void MT_LOCAL(cholesky_solve_raw)(const MT_TYPE* L, int n, int packed, MT_TYPE* X, int k) {
+	// Ly = b
+	for (int i = 0; i < n; i++) {
+		const MT_TYPE* l_i = &L[MT_LOCAL(lower_row)(i, n, packed)];
+		MT_TYPE* x_i = &X[i * k];
+		for (int j = 0; j < i; j++) {
+			MT_TYPE l = l_i[j];
+			if (l == 0.0f) { continue; }
+			const MT_TYPE* x_j = &X[j * k];
+			for (int c = 0; c < k; c++) { x_i[c] -= l * x_j[c]; }
+		}
+		MT_TYPE d = l_i[i];
+		for (int c = 0; c < k; c++) { x_i[c] /= d; }
+	}
+
+	// L^t x = y. Column i of L^t is row i of L, so eliminate with it from the bottom up
+	for (int i = n - 1; i >= 0; i--) {
+		const MT_TYPE* l_i = &L[MT_LOCAL(lower_row)(i, n, packed)];
+		MT_TYPE* x_i = &X[i * k];
+		MT_TYPE d = l_i[i];
+		for (int c = 0; c < k; c++) { x_i[c] /= d; }
+		for (int j = 0; j < i; j++) {
+			MT_TYPE l = l_i[j];
+			if (l == 0.0f) { continue; }
+			MT_TYPE* x_j = &X[j * k];
+			for (int c = 0; c < k; c++) { x_j[c] -= l * x_i[c]; }
+		}
+	}
+}
+
+// copies the lower triangle of n x n mat into a packed array (FMATRIX_LOWER's layout) on frame, or returns NULL
+static MT_TYPE* MT_LOCAL(pack_lower)(MT_MATRIX mat, pool* frame) {
+	int n = mat.n;
+	MT_TYPE* packed = raw_pool_alloc(frame, (n * (n + 1) / 2) * sizeof(MT_TYPE));
+	if (packed == NULL) { return NULL; }
+	for (int i = 0; i < n; i++) {
+		MT_TYPE* row = &packed[MT_LOCAL(lower_row)(i, n, 1)];
+		for (int j = 0; j <= i; j++) { row[j] = MT_AT(mat, i, j); }
+	}
+	return packed;
+}
+
+// copies mat into a new general row major matrix on frame, in the same layout no matter mat's transpose flag or kind
+static MT_MATRIX MT_LOCAL(copy_row_major)(MT_MATRIX mat, pool* frame) {
+	MT_MATRIX copy = MT_FN(create_zero)(mat.m, mat.n, frame);
+	if (copy.matrix == NULL) { return MT_ERROR; }
+	for (int i = 0; i < mat.m; i++) {
+		for (int j = 0; j < mat.n; j++) { copy.matrix[i * mat.n + j] = MT_AT(mat, i, j); }
+	}
+	return copy;
+}
+
+// factors SPD mat into L in place (A = LL^t). Only the lower triangle of mat is read; the upper one is zeroed on success.
+// mat can also be a packed lower triangle (FMATRIX_LOWER), which holds the lower triangle of A and is overwritten with L.
+// returns 1 on success, and 0 if mat isn't positive definite (then mat is left partially factored, so factor a copy if you need
+// to fall back to something else)
+// needs a non transposed mat
+//
+// if (!fmatrix_cholesky_factorize_in(A)) { printf("A is not positive definite\n"); }
+int MT_FN(cholesky_factorize_in)(MT_MATRIX mat) {
+	if (mat.m != mat.n) {
+		printf("cholesky factorization requires a square matrix (%d x %d)\n", mat.m, mat.n);
+		return 0;
+	}
+	if (mat.transpose) {
+		printf("in place cholesky factorization requires a non transposed matrix\n");
+		return 0;
+	}
+	int packed = 0;
+#ifdef MT_STRUCTURED
+	if (mat.kind != FMATRIX_GENERAL && mat.kind != FMATRIX_LOWER) {
+		printf("in place cholesky factorization requires a general or packed lower triangular matrix\n");
+		return 0;
+	}
+	packed = mat.kind == FMATRIX_LOWER;
+#endif
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_CHOLESKY_FACTORIZE_IN, mat, MT_ERROR);
+	int result = MT_LOCAL(cholesky_factor_raw)(mat.matrix, mat.n, packed);
+	MT_INSTRUMENT_END();
+	return result;
+}
+
+// returns the cholesky factor L of SPD mat (A = LL^t), allocated on frame as a packed lower triangle (FMATRIX_LOWER, so n(n + 1)/2
+// floats; dmatrix_cholesky_factorize returns it dense). Only the lower triangle of mat is read.
+// returns ERROR_FMATRIX if mat is not positive definite, and frees what it allocated
+//
+// fmatrix L = fmatrix_cholesky_factorize(A, &frame);
+MT_MATRIX MT_FN(cholesky_factorize)(MT_MATRIX mat, pool* frame) {
+	if (mat.m != mat.n) {
+		printf("cholesky factorization requires a square matrix (%d x %d)\n", mat.m, mat.n);
+		return MT_ERROR;
+	}
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_CHOLESKY_FACTORIZE, mat, MT_ERROR);
+
+#ifdef MT_STRUCTURED
+	MT_MATRIX L = { mat.n, mat.n, MT_LOCAL(pack_lower)(mat, frame), 0, FMATRIX_LOWER };
+	int packed = 1;
+#else
+	MT_MATRIX L = MT_LOCAL(copy_row_major)(mat, frame);
+	int packed = 0;
+#endif
+	if (L.matrix == NULL) { MT_INSTRUMENT_END(); return MT_ERROR; }
+	if (!MT_LOCAL(cholesky_factor_raw)(L.matrix, L.n, packed)) {
+		printf("cholesky factorization failed: matrix is not positive definite\n");
+		pool_free_from(frame, L.matrix);
+		MT_INSTRUMENT_END();
+		return MT_ERROR;
+	}
+
+	MT_INSTRUMENT_END();
+	return L;
+}
+
+// solves LL^t X = B given a cholesky factor L from fmatrix_cholesky_factorize (packed) or fmatrix_cholesky_factorize_in (dense).
+// B is n x k, so one factorization can be reused for any number of right hand sides (as columns of B, or across calls).
+// returns X allocated on frame
+//
+// fmatrix L = fmatrix_cholesky_factorize(A, &frame);
+// fmatrix X = fmatrix_cholesky_solve(L, B, &frame);
+MT_MATRIX MT_FN(cholesky_solve)(MT_MATRIX L, MT_MATRIX B, pool* frame) {
+	if (L.m != L.n || B.m != L.m) {
+		printf("cholesky solve requires an n x n L and an n x k B (L is %d x %d, B is %d x %d)\n", L.m, L.n, B.m, B.n);
+		return MT_ERROR;
+	}
+	if (L.transpose) {
+		printf("cholesky solve requires a non transposed L\n");
+		return MT_ERROR;
+	}
+	int packed = 0;
+#ifdef MT_STRUCTURED
+	if (L.kind != FMATRIX_GENERAL && L.kind != FMATRIX_LOWER) {
+		printf("cholesky solve requires L to be general or packed lower triangular\n");
+		return MT_ERROR;
+	}
+	packed = L.kind == FMATRIX_LOWER;
+#endif
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_CHOLESKY_SOLVE, L, B);
+
+	MT_MATRIX X = MT_LOCAL(copy_row_major)(B, frame);
+	if (X.matrix == NULL) { MT_INSTRUMENT_END(); return MT_ERROR; }
+	MT_LOCAL(cholesky_solve_raw)(L.matrix, L.n, packed, X.matrix, X.n);
+
+	MT_INSTRUMENT_END();
+	return X;
+}
+
+// solves AX = B for SPD A by factoring it once with cholesky. The (packed) factor is freed before returning, so only X stays on
+// frame.
+// if quiet is set, a matrix that isn't positive definite is not reported (used by fmatrix_LU_solve to probe for the fast path)
+static MT_MATRIX MT_LOCAL(spd_solve)(MT_MATRIX A, MT_MATRIX B, int quiet, pool* frame) {
+	MT_MATRIX X = MT_LOCAL(copy_row_major)(B, frame);
+	if (X.matrix == NULL) { return MT_ERROR; }
+
+	void* workspace = frame->ptr;
+	MT_TYPE* L = MT_LOCAL(pack_lower)(A, frame);
+	if (L == NULL) {
+		pool_free_from(frame, X.matrix);
+		return MT_ERROR;
+	}
+	if (!MT_LOCAL(cholesky_factor_raw)(L, A.n, 1)) {
+		if (!quiet) { printf("SPD solve failed: matrix is not positive definite\n"); }
+		pool_free_from(frame, X.matrix);
+		return MT_ERROR;
+	}
+	MT_LOCAL(cholesky_solve_raw)(L, A.n, 1, X.matrix, X.n);
+
+	pool_free_from(frame, workspace);
+	return X;
+}
+
+// solves AX = B for symmetric positive definite A (only its lower triangle is read). B can have any number of columns.
+// returns ERROR_FMATRIX if A is not positive definite
+//
+// fmatrix x = fmatrix_SPD_solve(A, b, &frame);
+MT_MATRIX MT_FN(SPD_solve)(MT_MATRIX A, MT_MATRIX B, pool* frame) {
+	if (A.m != A.n || B.m != A.m) {
+		printf("SPD solve requires an n x n A and an n x k B (A is %d x %d, B is %d x %d)\n", A.m, A.n, B.m, B.n);
+		return MT_ERROR;
+	}
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_SPD_SOLVE, A, B);
+	MT_MATRIX X = MT_LOCAL(spd_solve)(A, B, 0, frame);
+	MT_INSTRUMENT_END();
+	return X;
+}
+// Symmetric rank k update
+// A^t A and A A^t are symmetric, so only one triangle needs computing, which is half the flops of fmatrix_multiply. The lower
+// triangle is computed from whichever side of A is contiguous, so the kernels never read through INDEX_AT:
+//   - from rows that hold the vectors being dotted (A A^t of a plain A, or A^t A of a transposed one), it's a dot product per
+//     element, tiled SYRK_BLOCK_SIZE x SYRK_BLOCK_SIZE so both sets of rows stay in cache while the tile is filled
+//   - from rows that are the terms of the sum (A^t A of a plain A, or A A^t of a transposed one), it's a rank 1 update per row,
+//     done one SYRK_BLOCK_SIZE row band of C at a time so the band stays in cache while all of A streams past it
+// Either way each band of C is written by one thread: the bands are split across threads (see parallel.h), a short band paired
+// with a long one so every chunk gets about the same work, and the result is the same for any number of threads.
+// fmatrix_multiply sends X^t X and X X^t here when both operands are the same buffer with opposite transpose flags, so the usual
+// fmatrix_transpose_in(&At); fmatrix_multiply(At, A, &frame); gets it for free.
+//
+// fmatrix G = fmatrix_syrk(A, 1, &frame);				// Gram matrix A^t A
+
+// C[i][j] = alpha * (row i . row j) + beta * C[i][j] for j <= i and i in the band starting at row i0, over count rows of
+// length len (row major, so C is count x count)
+static void MT_LOCAL(syrk_dots_band)(const MT_TYPE* rows, int count, int len, MT_TYPE alpha, MT_TYPE beta, MT_TYPE* c, int i0) {
+	int i1 = (i0 + SYRK_BLOCK_SIZE < count) ? i0 + SYRK_BLOCK_SIZE : count;
+	for (int j0 = 0; j0 <= i0; j0 += SYRK_BLOCK_SIZE) {
+		int j1 = (j0 + SYRK_BLOCK_SIZE < count) ? j0 + SYRK_BLOCK_SIZE : count;
+		for (int i = i0; i < i1; i++) {
+			MT_TYPE* c_i = &c[i * count];
+			int last = (j1 - 1 < i) ? j1 - 1 : i;
+			for (int j = j0; j <= last; j++) {
+				MT_TYPE dot = alpha * MT_LOCAL(row_dot)(&rows[i * len], &rows[j * len], len);
+				c_i[j] = (beta == 0) ? dot : dot + beta * c_i[j];
+			}
+		}
+	}
+}
+
+// C[i][j] = alpha * sum over rows r of (r[i] r[j]) + beta * C[i][j] for j <= i and i in the band starting at row i0, over count
+// rows of length len (C is len x len)
+static void MT_LOCAL(syrk_outer_band)(const MT_TYPE* rows, int count, int len, MT_TYPE alpha, MT_TYPE beta, MT_TYPE* c, int i0) {
+	int i1 = (i0 + SYRK_BLOCK_SIZE < len) ? i0 + SYRK_BLOCK_SIZE : len;
+	for (int i = i0; i < i1; i++) {
+		MT_TYPE* c_i = &c[i * len];
+		if (beta == 0) { memset(c_i, 0, (i + 1) * sizeof(MT_TYPE)); }
+		else if (beta != 1) {
+			for (int j = 0; j <= i; j++) { c_i[j] *= beta; }
+		}
+	}
+	for (int r = 0; r < count; r++) {
+		const MT_TYPE* row = &rows[r * len];
+		for (int i = i0; i < i1; i++) {
+			MT_TYPE a = alpha * row[i];
+			if (a == 0) { continue; }
+			MT_TYPE* c_i = &c[i * len];
+			for (int j = 0; j <= i; j++) { c_i[j] += a * row[j]; }
+		}
+	}
+}
+
+// one syrk, split by bands of C. Band b's work grows with b, so item t is band t together with band bands - 1 - t
+typedef struct {
+	const MT_TYPE* rows;
+	int count, len;
+	MT_TYPE alpha, beta;
+	MT_TYPE* c;
+	int bands;
+	int dots;					// 1 for syrk_dots_band, 0 for syrk_outer_band
+}MT_LOCAL(syrk_job);
+
+static void MT_LOCAL(syrk_bands)(void* context, int begin, int end) {
+	MT_LOCAL(syrk_job)* job = context;
+	for (int t = begin; t < end; t++) {
+		for (int side = 0; side < 2; side++) {
+			int band = side ? job->bands - 1 - t : t;
+			if (side && band == t) { break; }
+			if (job->dots) { MT_LOCAL(syrk_dots_band)(job->rows, job->count, job->len, job->alpha, job->beta, job->c, band * SYRK_BLOCK_SIZE); }
+			else { MT_LOCAL(syrk_outer_band)(job->rows, job->count, job->len, job->alpha, job->beta, job->c, band * SYRK_BLOCK_SIZE); }
+		}
+	}
+}
+
+// C <- alpha A^t A + beta C (trans = 1) or alpha A A^t + beta C (trans = 0), on the lower triangle of C only (the strictly upper
+// triangle isn't read or written). A can be transposed, C has to be non transposed, and beta = 0 ignores C's old contents.
+// Both have to be general (fmatrix_syrk takes packed A). returns 1 on success, and 0 if C is the wrong size or either is packed
+//
+// fmatrix_syrk_in(1.0f, batch, 1, 1.0f, G);				// G += batch^t batch
+int MT_FN(syrk_in)(MT_TYPE alpha, MT_MATRIX A, int trans, MT_TYPE beta, MT_MATRIX C) {
+	int size = trans ? A.n : A.m;
+	if (C.m != size || C.n != size || C.transpose) {
+		printf("syrk requires a non transposed %d x %d C (C is %d x %d%s)\n", size, size, C.m, C.n, C.transpose ? ", transposed" : "");
+		return 0;
+	}
+#ifdef MT_STRUCTURED
+	if (A.kind != FMATRIX_GENERAL || C.kind != FMATRIX_GENERAL) {
+		printf("in place syrk requires general (not packed) A and C, unpack them first\n");
+		return 0;
+	}
+#endif
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_SYRK_IN, A, C);
+
+	// the rows of the buffer are the rows of A, or its columns if A is transposed. A A^t dots rows of A, and A^t A sums them.
+	// Either way a pair of bands is about stored_rows * stored_len * SYRK_BLOCK_SIZE multiply adds
+	int stored_rows = A.transpose ? A.n : A.m;
+	int stored_len = A.transpose ? A.m : A.n;
+	int bands = (size + SYRK_BLOCK_SIZE - 1) / SYRK_BLOCK_SIZE;
+	MT_LOCAL(syrk_job) job = { A.matrix, stored_rows, stored_len, alpha, beta, C.matrix, bands, trans == A.transpose };
+	long long pair_work = (long long)stored_rows * stored_len * SYRK_BLOCK_SIZE;
+	parallel_for((bands + 1) / 2, (int)(PARALLEL_MIN_WORK / (pair_work + 1)) + 1, MT_LOCAL(syrk_bands), &job);
+
+	MT_INSTRUMENT_END();
+	return 1;
+}
+
+// returns A^t A (trans = 1) or A A^t (trans = 0) as a full matrix allocated on frame. The lower triangle is computed by
+// fmatrix_syrk_in and mirrored into the upper one. A packed A is unpacked first
+//
+// fmatrix G = fmatrix_syrk(A, 0, &frame);				// A A^t
+MT_MATRIX MT_FN(syrk)(MT_MATRIX A, int trans, pool* frame) {
+	int size = trans ? A.n : A.m;
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_SYRK, A, MT_ERROR);
+	MT_TYPE* matrix = (MT_TYPE*)raw_pool_alloc(frame, size * size * sizeof(MT_TYPE));
+	if (matrix == NULL) {
+		printf("error while computing syrk: \npool allocation failure\n");
+		MT_INSTRUMENT_END();
+		return MT_ERROR;
+	}
+	MT_MATRIX result = { size, size, matrix };
+
+#ifdef MT_STRUCTURED
+	// a packed A is unpacked into scratch behind the result
+	void* workspace = frame->ptr;
+	if (A.kind != FMATRIX_GENERAL) {
+		A = fmatrix_unpack(A, frame);
+		if (A.matrix == NULL) {
+			printf("error while computing syrk: \npool allocation failure\n");
+			pool_free_from(frame, matrix);
+			MT_INSTRUMENT_END();
+			return MT_ERROR;
+		}
+	}
+	MT_FN(syrk_in)(1, A, trans, 0, result);
+	pool_free_from(frame, workspace);
+#else
+	MT_FN(syrk_in)(1, A, trans, 0, result);
+#endif
+	for (int i = 0; i < size; i++) {
+		for (int j = i + 1; j < size; j++) { matrix[i * size + j] = matrix[j * size + i]; }
+	}
+
+	MT_INSTRUMENT_END();
+	return result;
+}
+
+
+// Low rank updates
+// When A changes by a rank k term, A + UV^t (U and V n x k), its inverse and factorizations can be patched in O(n^2 k) instead of
+// being recomputed in O(n^3):
+//   - inverse: Sherman-Morrison-Woodbury, (A + UV^t)^-1 = A^-1 - A^-1 U (I + V^t A^-1 U)^-1 V^t A^-1, so only a k x k system is solved
+//   - LU: Bennett's algorithm, one pass over L and U per column of U. P is kept, so no new pivoting happens
+//   - cholesky: LL^t +- XX^t, one sweep of rotations per column of X (LINPACK's chud/chdd)
+// None of them can pivot their way out of trouble, so each one checks the quantity it divides by: the pivots of the k x k system,
+// the new diagonal of U, or the new diagonal of L. If one drops below UPDATE_TOLERANCE times the magnitude it was computed from
+// (a near singular update, a pivot the fixed P can't handle, or a downdate that isn't positive definite anymore), the update is
+// refused and the input is left exactly as it was, so the caller can refactor A + UV^t from scratch instead.
+//
+// if (!fmatrix_inverse_update_in(Ainv, U, V, &frame)) { Ainv = fmatrix_inverse(A, &frame); }
+
+// replaces Ainv (the inverse of some A) with the inverse of A + UV^t. U and V are n x k, and any of the three can be transposed.
+// returns 1 on success, and 0 (leaving Ainv untouched) on a dimension mismatch, allocation failure or an unsafe update
+//
+// fmatrix_inverse_update_in(Ainv, u, v, &frame);			// Sherman-Morrison, for n x 1 u and v
+int MT_FN(inverse_update_in)(MT_MATRIX Ainv, MT_MATRIX U, MT_MATRIX V, pool* frame) {
+	int n = Ainv.n, k = U.n;
+	if (Ainv.m != n || U.m != n || V.m != n || V.n != k) {
+		printf("inverse update requires an n x n inverse and n x k U and V (inverse is %d x %d, U is %d x %d, V is %d x %d)\n",
+			Ainv.m, Ainv.n, U.m, U.n, V.m, V.n);
+		return 0;
+	}
+	if (!MT_LOCAL(require_general)(Ainv, "inverse update")) { return 0; }
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_INVERSE_UPDATE_IN, Ainv, U);
+
+	void* workspace = frame->ptr;
+	MT_TYPE* Y = raw_pool_alloc(frame, n * k * sizeof(MT_TYPE));		// A^-1 U, n x k
+	MT_TYPE* Z = raw_pool_alloc(frame, k * n * sizeof(MT_TYPE));		// V^t A^-1, k x n
+	MT_TYPE* S = raw_pool_alloc(frame, k * k * sizeof(MT_TYPE));		// I + V^t A^-1 U
+	int* ipiv = raw_pool_alloc(frame, k * sizeof(int));
+	if (Y == NULL || Z == NULL || S == NULL || ipiv == NULL) {
+		printf("inverse update error: pool allocation failure\n");
+		pool_free_from(frame, workspace);
+		MT_INSTRUMENT_END();
+		return 0;
+	}
+
+	memset(Y, 0, n * k * sizeof(MT_TYPE));
+	memset(Z, 0, k * n * sizeof(MT_TYPE));
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j < n; j++) {
+			MT_TYPE a = MATRIX_AT(Ainv, i, j);
+			if (a == 0) { continue; }
+			for (int c = 0; c < k; c++) {
+				Y[i * k + c] += a * MT_AT(U, j, c);
+				Z[c * n + j] += MT_AT(V, i, c) * a;
+			}
+		}
+	}
+	for (int r = 0; r < k; r++) {
+		for (int c = 0; c < k; c++) {
+			MT_TYPE sum = (r == c) ? 1 : 0;
+			for (int i = 0; i < n; i++) { sum += MT_AT(V, i, r) * Y[i * k + c]; }
+			S[r * k + c] = sum;
+		}
+	}
+
+	// the largest absolute row sum of S is what its pivots are measured against
+	MT_TYPE norm = 0;
+	for (int r = 0; r < k; r++) {
+		MT_TYPE sum = 0;
+		for (int c = 0; c < k; c++) { sum += (MT_TYPE)fabs(S[r * k + c]); }
+		if (sum > norm) { norm = sum; }
+	}
+	int sign;
+	int safe = MT_LOCAL(lu_factor_raw)(S, k, ipiv, &sign);
+	for (int r = 0; r < k && safe; r++) {
+		if (!((MT_TYPE)fabs(S[r * k + r]) > UPDATE_TOLERANCE * norm)) { safe = 0; }		// also catches NaN
+	}
+	if (!safe) {
+		printf("inverse update refused: the updated matrix is (nearly) singular\n");
+		pool_free_from(frame, workspace);
+		MT_INSTRUMENT_END();
+		return 0;
+	}
+
+	// Z <- S^-1 Z, then A^-1 -= Y Z
+	MT_LOCAL(lu_solve_raw)(S, k, ipiv, Z, n);
+	for (int i = 0; i < n; i++) {
+		for (int c = 0; c < k; c++) {
+			MT_TYPE y = Y[i * k + c];
+			if (y == 0) { continue; }
+			const MT_TYPE* z = &Z[c * n];
+			for (int j = 0; j < n; j++) { Ainv.matrix[INDEX_AT(Ainv, i, j)] -= y * z[j]; }
+		}
+	}
+
+	pool_free_from(frame, workspace);
+	MT_INSTRUMENT_END();
+	return 1;
+}
+
+// updates the factorization F of A (from fmatrix_LU_decompose) in place, so it factors A + UV^t with the same row permutation.
+// U and V are n x k (downdating is just a negated U). returns 1 on success, and 0 (leaving F untouched) on a dimension mismatch,
+// a singular F, allocation failure or an unsafe update. The sign and singular fields stay valid, since P doesn't change
+//
+// if (!flu_update_in(F, u, v, &frame)) { F = fmatrix_LU_decompose(A, &frame); }
+int MT_LU_FN(update_in)(MT_LU F, MT_MATRIX U, MT_MATRIX V, pool* frame) {
+	int n = F.LU.n, k = U.n;
+	if (F.LU.matrix == NULL || U.m != n || V.m != n || V.n != k) {
+		printf("LU update requires an n x n factorization and n x k U and V (LU is %d x %d, U is %d x %d, V is %d x %d)\n",
+			n, n, U.m, U.n, V.m, V.n);
+		return 0;
+	}
+	if (F.singular) {
+		printf("LU update requires a nonsingular factorization\n");
+		return 0;
+	}
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_LU_UPDATE_IN, F.LU, U);
+
+	// Bennett's algorithm doesn't know it's going to fail until it reaches the bad pivot, so the factors are backed up first
+	MT_TYPE* a = F.LU.matrix;
+	void* workspace = frame->ptr;
+	MT_TYPE* backup = raw_pool_alloc(frame, n * n * sizeof(MT_TYPE));
+	MT_TYPE* x = raw_pool_alloc(frame, n * sizeof(MT_TYPE));
+	MT_TYPE* y = raw_pool_alloc(frame, n * sizeof(MT_TYPE));
+	if (backup == NULL || x == NULL || y == NULL) {
+		printf("LU update error: pool allocation failure\n");
+		pool_free_from(frame, workspace);
+		MT_INSTRUMENT_END();
+		return 0;
+	}
+	memcpy(backup, a, n * n * sizeof(MT_TYPE));
+
+	int safe = 1;
+	for (int c = 0; c < k && safe; c++) {
+		// PA + (Pu)v^t = LU + xy^t
+		for (int i = 0; i < n; i++) {
+			x[i] = MT_AT(U, F.perm[i], c);
+			y[i] = MT_AT(V, i, c);
+		}
+
+		// peels off row and column i of the update: u_ii and row i of U absorb x[i]y, column i of L absorbs the rest of x,
+		// and what's left of x and y is a rank 1 update of the trailing factors
+		for (int i = 0; i < n; i++) {
+			MT_TYPE* row_i = &a[i * n];
+			MT_TYPE old = row_i[i];
+			row_i[i] += x[i] * y[i];
+			if (!((MT_TYPE)fabs(row_i[i]) > UPDATE_TOLERANCE * ((MT_TYPE)fabs(old) + (MT_TYPE)fabs(x[i] * y[i])))) {
+				safe = 0;
+				break;
+			}
+			MT_TYPE gamma = y[i] / row_i[i];
+			for (int j = i + 1; j < n; j++) {
+				row_i[j] += x[i] * y[j];
+				x[j] -= x[i] * a[j * n + i];
+				a[j * n + i] += gamma * x[j];
+				y[j] -= gamma * row_i[j];
+			}
+		}
+	}
+	if (!safe) {
+		printf("LU update refused: a pivot cancelled out, so the update needs a new row permutation\n");
+		memcpy(a, backup, n * n * sizeof(MT_TYPE));
+	}
+
+	pool_free_from(frame, workspace);
+	MT_INSTRUMENT_END();
+	return safe;
+}
+
+// updates the cholesky factor L of A (packed from fmatrix_cholesky_factorize, or dense from fmatrix_cholesky_factorize_in) in
+// place, so it factors A + XX^t (sign = 1) or A - XX^t (sign = -1). X is n x k, and L has to be non transposed. returns 1 on
+// success, and 0 (leaving L untouched) on a dimension mismatch, allocation failure, or a downdate that leaves A not safely
+// positive definite
+//
+// fmatrix_cholesky_update_in(L, x, -1, &frame);			// drop an observation x from a Gram matrix
+int MT_FN(cholesky_update_in)(MT_MATRIX L, MT_MATRIX X, int sign, pool* frame) {
+	int n = L.n, k = X.n;
+	if (L.m != n || X.m != n || L.transpose) {
+		printf("cholesky update requires a non transposed n x n L and an n x k X (L is %d x %d, X is %d x %d)\n", L.m, L.n, X.m, X.n);
+		return 0;
+	}
+	int packed = 0;
+#ifdef MT_STRUCTURED
+	if (L.kind != FMATRIX_GENERAL && L.kind != FMATRIX_LOWER) {
+		printf("cholesky update requires L to be general or packed lower triangular\n");
+		return 0;
+	}
+	packed = L.kind == FMATRIX_LOWER;
+#endif
+	MT_INSTRUMENT_BEGIN(MATRIX_OP_CHOLESKY_UPDATE_IN, L, X);
+
+	MT_TYPE* a = L.matrix;
+	MT_TYPE s = sign < 0 ? -1 : 1;
+	int stored = packed ? n * (n + 1) / 2 : n * n;
+	void* workspace = frame->ptr;
+	MT_TYPE* backup = raw_pool_alloc(frame, stored * sizeof(MT_TYPE));
+	MT_TYPE* x = raw_pool_alloc(frame, n * sizeof(MT_TYPE));
+	if (backup == NULL || x == NULL) {
+		printf("cholesky update error: pool allocation failure\n");
+		pool_free_from(frame, workspace);
+		MT_INSTRUMENT_END();
+		return 0;
+	}
+	memcpy(backup, a, stored * sizeof(MT_TYPE));
+
+	int safe = 1;
+	for (int c = 0; c < k && safe; c++) {
+		for (int i = 0; i < n; i++) { x[i] = MT_AT(X, i, c); }
+
+		// a rotation (hyperbolic for a downdate) of column j of L against x zeroes x[j], and leaves the rest of x for the trailing columns
+		for (int j = 0; j < n; j++) {
+			MT_TYPE* l_jj = &a[MT_LOCAL(lower_row)(j, n, packed) + j];
+			MT_TYPE l = *l_jj;
+			MT_TYPE r2 = l * l + s * x[j] * x[j];
+			if (!(r2 > UPDATE_TOLERANCE * l * l)) {
+				safe = 0;
+				break;
+			}
+			MT_TYPE r = MT_SQRT(r2);
+			MT_TYPE cosine = r / l, sine = x[j] / l;
+			*l_jj = r;
+			for (int i = j + 1; i < n; i++) {
+				MT_TYPE* l_ij = &a[MT_LOCAL(lower_row)(i, n, packed) + j];
+				*l_ij = (*l_ij + s * sine * x[i]) / cosine;
+				x[i] = cosine * x[i] - sine * *l_ij;
+			}
+		}
+	}
+	if (!safe) {
+		printf("cholesky update refused: the downdated matrix is not (safely) positive definite\n");
+		memcpy(a, backup, stored * sizeof(MT_TYPE));
+	}
+
+	pool_free_from(frame, workspace);
+	MT_INSTRUMENT_END();
+	return safe;
+}
+
+#undef MT_PASTE_
+#undef MT_PASTE
+#undef MT_FN
+#undef MT_LOCAL
+#undef MT_LU_FN
+#undef MT_VIEW_FN
+#undef MT_AT
+#undef MT_VIEW
+#undef MT_VIEW_PREFIX
+#undef MT_LU
+#undef MT_LU_PREFIX
+#undef MT_TYPE
+#undef MT_MATRIX
+#undef MT_ERROR
+#undef MT_NAME
+#undef MT_PREFIX
+#undef MT_SUFFIX
+#undef MT_CREATE
+#undef MT_PRINT
+#undef MT_GET_MULTIPLIED
+#undef MT_SWAP
+#undef MT_FIND_PIVOT_ROW
+#undef MT_SQRT
+#undef MT_INSTRUMENT_BEGIN
+#undef MT_INSTRUMENT_END
+#undef MT_STRUCTURED
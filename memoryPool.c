@@ -1,6 +1,7 @@
 // Refactor checklist:
 
 #include "memoryPool.h"
+#include "trace.h"
 
 // prints a void pointer
 // used mostly for debugging if you run into memory issues
@@ -24,12 +25,15 @@ int is_in_pool(pool frame, void* place) {
 // 
 // pool frame = create_pool((rows * columns * 5) * sizeof(float));
 pool create_pool(int size) {
+	TRACE_BEGIN(MATRIX_OP_CREATE_POOL, 0, 0, 0, 0, size);
 	void* start = malloc(size);
 	if (start == NULL) {
 		printf("createPool allocation failed, returning pool of NULL\n");
+		TRACE_END();
 		return (pool){NULL, -1, NULL, NULL};
 	}
 
+	TRACE_END();
 	return (pool) {
 		start,			// start of pool
 		size,			// size of pool
@@ -43,15 +47,18 @@ pool create_pool(int size) {
 // so it can be referenced later by a previous pool
 // returns NULL on malloc failure
 pool* heap_create_pool(int size) {
+	TRACE_BEGIN(MATRIX_OP_HEAP_CREATE_POOL, 0, 0, 0, 0, size);
 	void* start;
 	if ((start = malloc(size)) == NULL) {
 		printf("failed to allocate memory for a new pool, returning NULL\n");
+		TRACE_END();
 		return NULL;
 	}
 
 	pool* result = malloc(sizeof(pool));
 	if (result == NULL) {
 		printf("failed to allocate memory for a pool struct, returning NULL\n");
+		TRACE_END();
 		return NULL;
 	}
 
@@ -60,13 +67,23 @@ pool* heap_create_pool(int size) {
 	result->ptr = start;
 	result->next = NULL;
 
+	TRACE_END();
 	return result;
 }
 
-// tests if pool frame is large enough for an input of input_size
+// bytes between frame->ptr and where an allocation of size bytes will start
+// the start is aligned to the largest power of two dividing size (up to POOL_ALIGNMENT). An array of any type has a size that's
+// a multiple of the type's alignment, so it always lands aligned, while a run of float allocations is never padded at all
+static int pool_padding(pool* frame, int size) {
+	uintptr_t align = POOL_ALIGNMENT;
+	while (align > 1 && size % align != 0) { align /= 2; }
+	return (int)((align - (uintptr_t)frame->ptr % align) % align);
+}
+
+// tests if pool frame is large enough for an input of input_size (after padding it to an aligned spot)
 // returns true if 
 int pool_has_capacity(pool* frame, int input_size) {
-	int new_size = ((char*)frame->ptr + input_size) - (char*)frame->start;
+	int new_size = ((char*)frame->ptr + pool_padding(frame, input_size) + input_size) - (char*)frame->start;
 	return(new_size <= frame->size);
 }
 
@@ -78,11 +95,14 @@ int pool_has_capacity(pool* frame, int input_size) {
 //   - increases pool size by GROWTH_FACTOR * previous size
 //       > if this is not big enough for the new input, then it increases it by GROWTH_FACTOR * (old_size + input_size)
 pool* pool_realloc(pool* frame, int input_size) {
+	// bytes for this event come out as the size of the new pool, if one had to be created
+	TRACE_BEGIN(MATRIX_OP_POOL_REALLOC, 0, 0, 0, 0, 0);
 
 	// locate the first pool with capacity
 	while (frame->next != NULL) {
 		frame = frame->next;
 		if (pool_has_capacity(frame, input_size)) { // if a pool with capacity is found, return it
+			TRACE_END();
 			return frame; 
 		}
 	}
@@ -90,6 +110,7 @@ pool* pool_realloc(pool* frame, int input_size) {
 	// determine new pool size
 	if (frame->size + input_size > POOL_SIZE_CAP) {
 		printf("Pool size cap hit, returning NULL\n");
+		TRACE_END();
 		return NULL;
 	}
 	int new_size = frame->size * GROWTH_FACTOR;
@@ -108,6 +129,7 @@ pool* pool_realloc(pool* frame, int input_size) {
 	// set the previous pool's next pointer to the new pool
 	frame->next = new_pool;
 
+	TRACE_END();
 	return new_pool;
 }
 
@@ -118,6 +140,7 @@ pool* pool_realloc(pool* frame, int input_size) {
 // float in = 2.5;
 // float* x = pool_alloc(&frame, &in, sizeof(float)); // x now points to 2.5
 void* pool_alloc(pool* frame, void* input, int input_size) {
+	TRACE_BEGIN(MATRIX_OP_POOL_ALLOC, 0, 0, 0, 0, input_size);
 	if (!pool_has_capacity(frame, input_size)) {
 		printf("pool ran out of space, reallocating\n");
 		frame = pool_realloc(frame, input_size);
@@ -128,8 +151,10 @@ void* pool_alloc(pool* frame, void* input, int input_size) {
 		exit(1);
 	}
 
-	void* result = memcpy(frame->ptr, input, input_size);	// copy data from input
-	frame->ptr = (char*)frame->ptr + input_size;			// update the start ptr in frame
+	void* result = (char*)frame->ptr + pool_padding(frame, input_size);	// aligned spot for the data
+	memcpy(result, input, input_size);						// copy data from input
+	frame->ptr = (char*)result + input_size;				// update the start ptr in frame
+	TRACE_END();
 	return result;											// return pointer to the start of allocated data
 }
 
@@ -141,13 +166,15 @@ void* pool_alloc(pool* frame, void* input, int input_size) {
 // float* x = raw_pool_alloc(&frame, sizeof(float));
 // *x = 2.5;
 void* raw_pool_alloc(pool* frame, int size) {
+	TRACE_BEGIN(MATRIX_OP_RAW_POOL_ALLOC, 0, 0, 0, 0, size);
 	if (!pool_has_capacity(frame, size)) {
 		printf("pool ran out of space, reallocating\n");
 		frame = pool_realloc(frame, size);
 	}
 
-	void* result = frame->ptr;
-	frame->ptr = (char*)frame->ptr + size;
+	void* result = (char*)frame->ptr + pool_padding(frame, size);
+	frame->ptr = (char*)result + size;
+	TRACE_END();
 	return result;
 }
 
@@ -159,10 +186,34 @@ void* raw_pool_alloc(pool* frame, int size) {
 // for later (ex determinant by triangulation wants to not modify the input matrix, but have a matrix to 
 // do row operations on, so it duplicates input, then gets its determinant, then frees it with this
 void* pool_free_from(pool* frame, void* start) {
-	return is_in_pool(*frame, start) ? frame->ptr = start : printf("pool_free_from failed: input pointer not in frame!\n"); return NULL;
+	if (!is_in_pool(*frame, start)) {
+		printf("pool_free_from failed: input pointer not in frame!\n");
+		return NULL;
+	}
+
+	// records the freed bytes as a negative allocation
+	TRACE_BEGIN(MATRIX_OP_POOL_FREE_FROM, 0, 0, 0, 0, -((char*)frame->ptr - (char*)start));
+	frame->ptr = start;
+	TRACE_END();
+	return start;
+}
+
+// keeps only the size bytes at data: frees everything from start on, then moves data down to the first allocation after start
+// and returns its new address. data has to have been allocated after start. Used by kernels whose result was computed after
+// (on top of) their workspace, so the result ends up where the workspace began
+//
+// X.matrix = pool_compact(frame, workspace, X.matrix, n * sizeof(float));
+void* pool_compact(pool* frame, void* start, void* data, int size) {
+	pool_free_from(frame, start);
+	// the allocation is at or before data (same size so same alignment, and start <= data), and doesn't touch the bytes, so
+	// moving after is safe
+	void* result = raw_pool_alloc(frame, size);
+	memmove(result, data, size);
+	return result;
 }
 
 void free_pool(pool* frame) {
+	TRACE_BEGIN(MATRIX_OP_FREE_POOL, 0, 0, 0, 0, -frame->size);
 	if (frame->next != NULL) {
 		heap_free_pool(frame->next);
 	}
@@ -172,15 +223,18 @@ void free_pool(pool* frame) {
 	frame->size -1; //maybe set to negative for checks
 	frame->ptr = NULL;
 	frame->next = NULL;
+	TRACE_END();
 }
 
 // recursively frees pools from the end of the chain to the start
 // the first pool is not on the heap. Don't free it
 void heap_free_pool(pool* frame) {
+	TRACE_BEGIN(MATRIX_OP_HEAP_FREE_POOL, 0, 0, 0, 0, -frame->size);
 	if (frame->next != NULL) {
 		free_pool(frame->next);
 	}
 	//printf("freeing pool with size %d\n", frame->size);
 	free(frame->start);
 	free(frame);
+	TRACE_END();
 }
\ No newline at end of file
@@ -4,10 +4,21 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h> // for memcpy
+#include <stddef.h> // for max_align_t (outside of MSVC)
+#include <stdint.h>
 
 #define POOL_SIZE_CAP 16000
 #define GROWTH_FACTOR 1.5
 
+// allocations are padded to start on a multiple of (up to) this, so a double or int64 array is aligned no matter what odd sized
+// float, int8 or uint16 block was allocated right before it. See pool_padding
+// the MSVC project builds in its default C mode, which has no _Alignof or max_align_t, so it uses malloc's 16 byte alignment
+#if defined(_MSC_VER)
+#define POOL_ALIGNMENT 16
+#else
+#define POOL_ALIGNMENT _Alignof(max_align_t)
+#endif
+
 void print_void_ptr(void* ptr);
 
 
@@ -33,6 +44,7 @@ void* pool_alloc(pool* frame, void* input, int input_size);
 void* raw_pool_alloc(pool* frame, int size);
 
 void* pool_free_from(pool* frame, void* start);
+void* pool_compact(pool* frame, void* start, void* data, int size);
 void free_pool(pool* frame);
 void heap_free_pool(pool* frame);
 
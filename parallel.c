@@ -0,0 +1,122 @@
+// needed for sysconf(_SC_NPROCESSORS_ONLN) when compiling with a strict -std flag
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "parallel.h"
+
+#if defined(MATRIX_NO_THREADS)
+// no thread headers
+#elif defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+// 0 until the first call works out how many cores there are
+static int thread_count = 0;
+
+// number of threads a parallel loop is split across at most
+//
+// int threads = parallel_threads();
+int parallel_threads(void) {
+	if (thread_count == 0) {
+#if defined(MATRIX_NO_THREADS)
+		thread_count = 1;
+#elif defined(_WIN32)
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		thread_count = (int)info.dwNumberOfProcessors;
+#else
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		thread_count = (cores > 0) ? (int)cores : 1;
+#endif
+		if (thread_count < 1) { thread_count = 1; }
+		if (thread_count > PARALLEL_MAX_THREADS) { thread_count = PARALLEL_MAX_THREADS; }
+	}
+	return thread_count;
+}
+
+// caps the threads used by every later parallel loop (1 runs them all on the calling thread, 0 goes back to one per core)
+// call it from the main thread, not while a parallel loop is running
+//
+// parallel_set_threads(1);		// serial, e.g. to compare timings
+void parallel_set_threads(int threads) {
+	if (threads > PARALLEL_MAX_THREADS) { threads = PARALLEL_MAX_THREADS; }
+	thread_count = (threads < 0) ? 0 : threads;
+}
+
+typedef struct {
+	parallel_body body;
+	void* context;
+	int begin;
+	int end;
+}parallel_chunk;
+
+#if !defined(MATRIX_NO_THREADS)
+#if defined(_WIN32)
+static DWORD WINAPI run_chunk(LPVOID arg) {
+	parallel_chunk* chunk = arg;
+	chunk->body(chunk->context, chunk->begin, chunk->end);
+	return 0;
+}
+#else
+static void* run_chunk(void* arg) {
+	parallel_chunk* chunk = arg;
+	chunk->body(chunk->context, chunk->begin, chunk->end);
+	return NULL;
+}
+#endif
+#endif
+
+// runs body over [0, count) split into chunks of at least min_chunk items, one per thread, and waits for all of them
+// if a thread can't be started, its chunk runs on the calling thread instead
+//
+// parallel_for(A.m, 64, scale_rows, &A);
+void parallel_for(int count, int min_chunk, parallel_body body, void* context) {
+	if (count <= 0) { return; }
+	if (min_chunk < 1) { min_chunk = 1; }
+
+	int chunks = count / min_chunk;
+	int threads = parallel_threads();
+	if (chunks > threads) { chunks = threads; }
+	if (chunks <= 1) {
+		body(context, 0, count);
+		return;
+	}
+
+#if defined(MATRIX_NO_THREADS)
+	body(context, 0, count);
+#else
+	parallel_chunk work[PARALLEL_MAX_THREADS];
+	for (int c = 0; c < chunks; c++) {
+		work[c] = (parallel_chunk){ body, context, (int)((long long)count * c / chunks), (int)((long long)count * (c + 1) / chunks) };
+	}
+
+#if defined(_WIN32)
+	HANDLE handles[PARALLEL_MAX_THREADS];
+	for (int c = 1; c < chunks; c++) {
+		handles[c] = CreateThread(NULL, 0, run_chunk, &work[c], 0, NULL);
+		if (handles[c] == NULL) { run_chunk(&work[c]); }
+	}
+	run_chunk(&work[0]);
+	for (int c = 1; c < chunks; c++) {
+		if (handles[c] == NULL) { continue; }
+		WaitForSingleObject(handles[c], INFINITE);
+		CloseHandle(handles[c]);
+	}
+#else
+	pthread_t handles[PARALLEL_MAX_THREADS];
+	int started[PARALLEL_MAX_THREADS];
+	for (int c = 1; c < chunks; c++) {
+		started[c] = pthread_create(&handles[c], NULL, run_chunk, &work[c]) == 0;
+		if (!started[c]) { run_chunk(&work[c]); }
+	}
+	run_chunk(&work[0]);
+	for (int c = 1; c < chunks; c++) {
+		if (started[c]) { pthread_join(handles[c], NULL); }
+	}
+#endif
+#endif
+}
@@ -0,0 +1,37 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// Threading
+// One fork/join primitive shared by every kernel that splits its work across threads (sparse matrix vector products, cholesky,
+// syrk, the jacobi SVD, the symmetric eigensolver). parallel_for cuts [0, count) into contiguous chunks of at least min_chunk,
+// runs body on each chunk on its own thread (the calling thread takes the first one), and returns once all of them are done.
+// Threads are started per call, so it's meant for loops with at least tens of microseconds of work in them. Callers pick
+// min_chunk so that smaller problems end up with a single chunk, which runs inline with no threads at all.
+//
+// Bodies can't allocate from a pool or call instrumented fmatrix_ functions (neither the pool nor the trace is thread safe), so
+// kernels allocate everything first and only hand raw pointers to their bodies. Each chunk has to write only its own outputs,
+// which also keeps results the same for any number of threads.
+// Uses pthreads, or the Win32 API on windows. Defining MATRIX_NO_THREADS, or calling parallel_set_threads(1), runs every body
+// on the calling thread.
+//
+// static void scale_rows(void* context, int begin, int end) { ... rows begin to end - 1 ... }
+// parallel_for(A.m, 64, scale_rows, &A);
+
+#include <stdlib.h>
+#include <stdio.h>
+
+// upper bound on the number of chunks a loop is split into
+#define PARALLEL_MAX_THREADS 64
+
+// multiply adds a chunk should have at least before it's worth a thread of its own. Kernels divide it by the work of one item
+// to get their min_chunk
+#define PARALLEL_MIN_WORK 65536
+
+// runs items begin to end - 1 of a parallel loop. context is whatever was passed to parallel_for
+typedef void (*parallel_body)(void* context, int begin, int end);
+
+int parallel_threads(void);
+void parallel_set_threads(int threads);
+void parallel_for(int count, int min_chunk, parallel_body body, void* context);
+
+#endif
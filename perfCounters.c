@@ -0,0 +1,238 @@
+// needed for syscall() when compiling with a strict -std flag
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "perfCounters.h"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define PERF_THREAD_LOCAL __declspec(thread)
+#define PERF_ADD(dest, value) _InterlockedExchangeAdd64((volatile long long*)(dest), (long long)(value))
+#else
+#define PERF_THREAD_LOCAL _Thread_local
+#define PERF_ADD(dest, value) __sync_fetch_and_add((dest), (value))
+#endif
+
+// every counter is opened on its own with inherit set, so it also counts the threads the calling thread starts afterwards
+// (parallel_for's workers). The kernel doesn't support inherit on an event group, so each one is read separately
+static int event_fds[PERF_EVENT_COUNT];
+static int open_count = 0;
+static int event_open[PERF_EVENT_COUNT];
+
+// nesting depth of instrumented calls on this thread, and the totals, which any thread can add to
+static PERF_THREAD_LOCAL int scope_depth = 0;
+static perf_stats stats[MATRIX_OP_COUNT][PERF_BUCKET_COUNT];
+
+static const char* event_names[PERF_EVENT_COUNT] = { "cycles", "instructions", "L1D misses", "LLC misses", "branch misses" };
+
+#if defined(__linux__)
+
+// glibc has no wrapper for perf_event_open
+static int open_event(uint32_t type, uint64_t config) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;						// every counter starts disabled, and they're enabled together once all are open
+	attr.inherit = 1;						// count threads started later too. A read sums the thread and all of them
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// reads every open counter into values (indexed by perf_event). returns 0 on failure
+static int read_counters(uint64_t values[PERF_EVENT_COUNT]) {
+	for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+		if (!event_open[e]) { continue; }
+		if (read(event_fds[e], &values[e], sizeof(uint64_t)) != (ssize_t)sizeof(uint64_t)) { return 0; }
+	}
+	return 1;
+}
+
+#endif
+
+// opens the counters for the calling thread (and the threads it starts from now on) and starts them
+// returns the number of counters that could be opened. 0 means counting is unavailable (not linux,
+// perf_event_paranoid too strict, running in a VM without a PMU, ...) but calls are still tallied.
+int perf_counters_init(void) {
+	if (open_count != 0) { return open_count; }		// already running
+
+	for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+		event_fds[i] = -1;
+		event_open[i] = 0;
+	}
+
+#if defined(__linux__)
+	const uint32_t types[PERF_EVENT_COUNT] = {
+		PERF_TYPE_HARDWARE,
+		PERF_TYPE_HARDWARE,
+		PERF_TYPE_HW_CACHE,
+		PERF_TYPE_HARDWARE,
+		PERF_TYPE_HARDWARE
+	};
+	const uint64_t configs[PERF_EVENT_COUNT] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES
+	};
+
+	for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+		int fd = open_event(types[i], configs[i]);
+		if (fd == -1) {
+			printf("perf counter '%s' is not available\n", event_names[i]);
+			continue;
+		}
+		event_fds[i] = fd;
+		event_open[i] = 1;
+		open_count++;
+	}
+
+	for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+		if (!event_open[i]) { continue; }
+		ioctl(event_fds[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(event_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+#else
+	printf("perf counters are only supported on linux\n");
+#endif
+
+	return open_count;
+}
+
+// closes every counter. The collected stats are kept until perf_counters_reset
+void perf_counters_shutdown(void) {
+#if defined(__linux__)
+	for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+		if (event_fds[i] != -1) { close(event_fds[i]); }
+	}
+#endif
+	for (int i = 0; i < PERF_EVENT_COUNT; i++) {
+		event_fds[i] = -1;
+		event_open[i] = 0;
+	}
+	open_count = 0;
+}
+
+// returns true if event is being counted
+int perf_counters_available(perf_event event) {
+	return event >= 0 && event < PERF_EVENT_COUNT && event_open[event];
+}
+
+// clears all collected stats
+void perf_counters_reset(void) {
+	memset(stats, 0, sizeof(stats));
+}
+
+// the shape bucket of an operation is decided by the largest dimension of its operands
+//
+// int b = perf_shape_bucket(A, B); // A is 100 x 3, so b is 7 (64 < 100 <= 128)
+int perf_shape_bucket(fmatrix matA, fmatrix matB) {
+	int largest = matA.m;
+	if (matA.n > largest) { largest = matA.n; }
+	if (matB.m > largest) { largest = matB.m; }
+	if (matB.n > largest) { largest = matB.n; }
+
+	int bucket = 0;
+	while (bucket < PERF_BUCKET_COUNT - 1 && (1 << bucket) < largest) { bucket++; }
+	return bucket;
+}
+
+// returns the totals collected for op in a single shape bucket
+perf_stats perf_counters_get(matrix_op op, int bucket) {
+	if (op < 0 || op >= MATRIX_OP_COUNT || bucket < 0 || bucket >= PERF_BUCKET_COUNT) {
+		printf("perf_counters_get error: op %d / bucket %d out of range\n", op, bucket);
+		return (perf_stats){ 0 };
+	}
+	return stats[op][bucket];
+}
+
+// returns the totals collected for op, summed over every shape bucket
+perf_stats perf_counters_get_op(matrix_op op) {
+	perf_stats result = { 0 };
+	if (op < 0 || op >= MATRIX_OP_COUNT) {
+		printf("perf_counters_get_op error: op %d out of range\n", op);
+		return result;
+	}
+
+	for (int b = 0; b < PERF_BUCKET_COUNT; b++) {
+		result.calls += stats[op][b].calls;
+		for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+			result.counts[e] += stats[op][b].counts[e];
+		}
+	}
+	return result;
+}
+
+// prints one line per (operation, shape bucket) that has been called, with per call averages,
+// instructions per cycle and the miss counts. Events that couldn't be opened print as "-"
+void perf_counters_print_summary(void) {
+	printf("%-30s %8s %8s", "operation", "dims <=", "calls");
+	for (int e = 0; e < PERF_EVENT_COUNT; e++) { printf(" %14s", event_names[e]); }
+	printf(" %6s\n", "IPC");
+
+	for (int op = 0; op < MATRIX_OP_COUNT; op++) {
+		for (int b = 0; b < PERF_BUCKET_COUNT; b++) {
+			perf_stats s = stats[op][b];
+			if (s.calls == 0) { continue; }
+
+			printf("%-30s %8d %8llu", matrix_op_name((matrix_op)op), 1 << b, (unsigned long long)s.calls);
+			for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+				if (!event_open[e]) { printf(" %14s", "-"); continue; }
+				printf(" %14.1f", (double)s.counts[e] / s.calls);
+			}
+			if (event_open[PERF_CYCLES] && event_open[PERF_INSTRUCTIONS] && s.counts[PERF_CYCLES] != 0) {
+				printf(" %6.2f\n", (double)s.counts[PERF_INSTRUCTIONS] / s.counts[PERF_CYCLES]);
+			}
+			else {
+				printf(" %6s\n", "-");
+			}
+		}
+	}
+}
+
+// called by INSTRUMENT_BEGIN. Only the outermost call on a thread reads the counters. The counts it gets include the worker
+// threads of any parallel loop inside the call, since the counters are inherited
+perf_scope perf_scope_begin(matrix_op op, fmatrix matA, fmatrix matB) {
+	perf_scope scope = { op, perf_shape_bucket(matA, matB), 0 };
+
+	if (scope_depth++ != 0) { return scope; }
+
+#if defined(__linux__)
+	if (open_count != 0) {
+		memset(scope.start, 0, sizeof(scope.start));
+		scope.sampled = read_counters(scope.start);
+	}
+#endif
+	return scope;
+}
+
+// called by INSTRUMENT_END. Adds the counts since the matching begin to the scope's bucket
+void perf_scope_end(perf_scope* scope) {
+	if (--scope_depth != 0) { return; }
+
+	perf_stats* s = &stats[scope->op][scope->bucket];
+	PERF_ADD(&s->calls, 1);
+
+#if defined(__linux__)
+	if (!scope->sampled) { return; }
+
+	uint64_t end[PERF_EVENT_COUNT] = { 0 };
+	if (!read_counters(end)) { return; }
+
+	for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+		if (event_open[e]) { PERF_ADD(&s->counts[e], end[e] - scope->start[e]); }
+	}
+#endif
+}
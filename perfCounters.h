@@ -0,0 +1,69 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+// Hardware performance counters for the matrix kernels (Linux perf_event_open)
+// Compiled into the kernels only when MATRIX_PERF_COUNTERS is defined (see instrument.h). The API here
+// is always available, so calling code doesn't need its own ifdefs. Without the define, or on a platform
+// without perf_event_open, perf_counters_init just reports that no counters are available.
+//
+// Counts are attributed to the outermost instrumented call only. fmatrix_LU_solve calls
+// fmatrix_LU_factorize, which calls fmatrix_row_sum_in many times. All of that work shows up under
+// fmatrix_LU_solve, and the nested calls don't read the counters (a read is a syscall, so reading in the
+// inner loop would swamp what we are trying to measure).
+// The counters measure the thread that called perf_counters_init and every thread it starts afterwards (they're inherited),
+// so the work a kernel hands to parallel_for's worker threads is counted under the call that started them. The nesting depth
+// is per thread and the totals are added atomically, but a read covers all of those threads at once, so the counts are only
+// meaningful while one thread at a time is making instrumented calls.
+//
+// if (perf_counters_init() > 0) {
+//     ... fmatrix work ...
+//     perf_counters_print_summary();
+// }
+// perf_counters_shutdown();
+
+#include <stdint.h>
+
+#include "matrix.h"
+#include "matrixOps.h"
+
+// shape bucket b holds operations whose largest dimension d satisfies 2^(b-1) < d <= 2^b.
+// The last bucket also takes everything larger than that.
+#define PERF_BUCKET_COUNT 16
+
+typedef enum {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_L1D_MISSES,		// L1 data cache read misses
+	PERF_LLC_MISSES,		// last level cache misses
+	PERF_BRANCH_MISSES,
+	PERF_EVENT_COUNT
+}perf_event;
+
+// totals for one (operation, shape bucket) pair
+typedef struct {
+	uint64_t calls;
+	uint64_t counts[PERF_EVENT_COUNT];
+}perf_stats;
+
+// state for one instrumented call, lives on the caller's stack between begin and end
+typedef struct {
+	matrix_op op;
+	int bucket;
+	int sampled;							// set if this is the outermost call and the counters were read
+	uint64_t start[PERF_EVENT_COUNT];
+}perf_scope;
+
+int perf_counters_init(void);
+void perf_counters_shutdown(void);
+int perf_counters_available(perf_event event);
+void perf_counters_reset(void);
+
+int perf_shape_bucket(fmatrix matA, fmatrix matB);
+perf_stats perf_counters_get(matrix_op op, int bucket);
+perf_stats perf_counters_get_op(matrix_op op);
+void perf_counters_print_summary(void);
+
+perf_scope perf_scope_begin(matrix_op op, fmatrix matA, fmatrix matB);
+void perf_scope_end(perf_scope* scope);
+
+#endif
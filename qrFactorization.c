@@ -0,0 +1,664 @@
+#include <float.h>
+
+#include "qrFactorization.h"
+#include "parallel.h"
+
+// Householder kernels. They work on raw row major arrays with an explicit row length (lda), so they can
+// run on a sub block of a larger matrix
+
+// turns column j of a (rows j to m - 1) into a reflector. a[j][j] becomes the new diagonal element of R (beta),
+// the rest of the column becomes v (scaled so its leading element is 1), and tau is returned.
+// tau = 0 means H = I (the column is already zero below the diagonal)
+static float householder_vector(float* a, int lda, int m, int j) {
+	float alpha = a[j * lda + j];
+	float scale = 0.0f;
+	for (int i = j + 1; i < m; i++) { scale = fmaxf(scale, fabsf(a[i * lda + j])); }
+	if (scale == 0.0f) { return 0.0f; }
+
+	// scaled norm, so squaring can't overflow
+	scale = fmaxf(scale, fabsf(alpha));
+	float sum = 0.0f;
+	for (int i = j; i < m; i++) {
+		float x = a[i * lda + j] / scale;
+		sum += x * x;
+	}
+	float beta = (alpha >= 0.0f) ? -scale * sqrtf(sum) : scale * sqrtf(sum);
+
+	float tau = (beta - alpha) / beta;
+	float inverse = 1.0f / (alpha - beta);
+	for (int i = j + 1; i < m; i++) { a[i * lda + j] *= inverse; }
+	a[j * lda + j] = beta;
+	return tau;
+}
+
+// applies H_j = I - tau v v^t to columns c0 to c1 - 1 of b (rows j to m - 1), where v is stored in column j of a
+// w is scratch space for c1 - c0 floats. a and b may be the same matrix as long as c0 > j
+static void apply_reflector(const float* a, int lda, int m, int j, float tau, float* b, int ldb, int c0, int c1, float* w) {
+	if (tau == 0.0f || c1 <= c0) { return; }
+	int width = c1 - c0;
+
+	// w = v^t B, accumulated a row at a time
+	memcpy(w, &b[j * ldb + c0], width * sizeof(float));
+	for (int i = j + 1; i < m; i++) {
+		float v = a[i * lda + j];
+		if (v == 0.0f) { continue; }
+		const float* row = &b[i * ldb + c0];
+		for (int c = 0; c < width; c++) { w[c] += v * row[c]; }
+	}
+
+	// B -= tau v w^t
+	float* row = &b[j * ldb + c0];
+	for (int c = 0; c < width; c++) { row[c] -= tau * w[c]; }
+	for (int i = j + 1; i < m; i++) {
+		float v = tau * a[i * lda + j];
+		if (v == 0.0f) { continue; }
+		row = &b[i * ldb + c0];
+		for (int c = 0; c < width; c++) { row[c] -= v * w[c]; }
+	}
+}
+
+// panel width for an m x n matrix (small matrices don't need a full QR_BLOCK_SIZE of scratch space)
+static int householder_block(int m, int n) {
+	int k = (m < n) ? m : n;
+	return (k < QR_BLOCK_SIZE) ? k : QR_BLOCK_SIZE;
+}
+
+// floats of scratch space householder_qr_raw needs for an m x n matrix
+static int householder_work_size(int m, int n) {
+	int nb = householder_block(m, n);
+	return m * nb + nb * nb + nb * n + n;
+}
+
+// the block reflector of one panel, applied to the trailing columns. Every column of C (and of W) is updated on its own, so
+// threads take contiguous ranges of columns
+typedef struct {
+	float* a;
+	const float* V;
+	const float* T;
+	float* W;
+	int n, k0, rows, kb, c0, width;
+}wy_update;
+
+// C = (I - V T^t V^t) C for columns c0 + begin to c0 + end - 1, as W = V^t C, W = T^t W, C -= V W
+static void wy_update_columns(void* context, int begin, int end) {
+	wy_update* u = context;
+	const float* V = u->V;
+	const float* T = u->T;
+	float* W = u->W;
+	int n = u->n, kb = u->kb, width = u->width;
+
+	for (int p = 0; p < kb; p++) { memset(&W[p * width + begin], 0, (end - begin) * sizeof(float)); }
+	for (int r = 0; r < u->rows; r++) {
+		const float* c_row = &u->a[(u->k0 + r) * n + u->c0];
+		for (int p = 0; p < kb && p <= r; p++) {
+			float v = V[r * kb + p];
+			if (v == 0.0f) { continue; }
+			float* w_row = &W[p * width];
+			for (int c = begin; c < end; c++) { w_row[c] += v * c_row[c]; }
+		}
+	}
+	// bottom up, so the rows of W each step reads are still unscaled
+	for (int p = kb - 1; p >= 0; p--) {
+		float* w_row = &W[p * width];
+		for (int c = begin; c < end; c++) { w_row[c] *= T[p * kb + p]; }
+		for (int q = 0; q < p; q++) {
+			float t = T[q * kb + p];
+			if (t == 0.0f) { continue; }
+			const float* w_q = &W[q * width];
+			for (int c = begin; c < end; c++) { w_row[c] += t * w_q[c]; }
+		}
+	}
+	for (int r = 0; r < u->rows; r++) {
+		float* c_row = &u->a[(u->k0 + r) * n + u->c0];
+		for (int p = 0; p < kb && p <= r; p++) {
+			float v = V[r * kb + p];
+			if (v == 0.0f) { continue; }
+			const float* w_row = &W[p * width];
+			for (int c = begin; c < end; c++) { c_row[c] -= v * w_row[c]; }
+		}
+	}
+}
+
+// blocked householder QR of the m x n row major array a, in place. tau gets min(m, n) entries
+// the trailing update of each panel is split across threads by columns, so the result doesn't depend on the number of threads
+static void householder_qr_raw(float* a, int m, int n, float* tau, float* work) {
+	int k = (m < n) ? m : n;
+	int nb = householder_block(m, n);
+	float* V = work;						// (m - k0) x kb, the panel's reflectors with the zeros and ones filled in
+	float* T = V + m * nb;					// kb x kb upper triangular
+	float* W = T + nb * nb;					// kb x (trailing columns)
+	float* w = W + nb * n;
+
+	for (int k0 = 0; k0 < k; k0 += nb) {
+		int kb = (k0 + nb < k) ? nb : k - k0;
+		int panel_end = k0 + kb;
+
+		// factor the panel one column at a time
+		for (int j = k0; j < panel_end; j++) {
+			tau[j] = householder_vector(a, n, m, j);
+			apply_reflector(a, n, m, j, tau[j], a, n, j + 1, panel_end, w);
+		}
+		if (panel_end >= n) { continue; }
+
+		// V, with the implied zeros above and ones on the diagonal written out
+		int rows = m - k0;
+		for (int r = 0; r < rows; r++) {
+			for (int p = 0; p < kb; p++) {
+				V[r * kb + p] = (r < p) ? 0.0f : (r == p) ? 1.0f : a[(k0 + r) * n + k0 + p];
+			}
+		}
+
+		// T such that H_k0 ... H_(k0 + kb - 1) = I - V T V^t. Column i is -tau_i T (V^t v_i), built left to right
+		for (int i = 0; i < kb; i++) {
+			for (int p = 0; p < i; p++) {
+				float sum = 0.0f;
+				for (int r = i; r < rows; r++) { sum += V[r * kb + p] * V[r * kb + i]; }
+				T[p * kb + i] = sum;
+			}
+			for (int p = 0; p < i; p++) {
+				float sum = 0.0f;
+				for (int q = p; q < i; q++) { sum += T[p * kb + q] * T[q * kb + i]; }
+				T[p * kb + i] = -tau[k0 + i] * sum;
+			}
+			T[i * kb + i] = tau[k0 + i];
+			for (int p = i + 1; p < kb; p++) { T[p * kb + i] = 0.0f; }
+		}
+
+		// trailing columns. A column costs about 2 rows kb multiply adds
+		wy_update update = { a, V, T, W, n, k0, rows, kb, panel_end, n - panel_end };
+		parallel_for(update.width, PARALLEL_MIN_WORK / (2 * rows * kb) + 1, wy_update_columns, &update);
+	}
+}
+
+// QR factorization
+
+// factors mat (any shape) into its compact QR form, allocated on frame. mat is not changed
+// upon failure, returns an fqr with an ERROR_FMATRIX QR and a NULL tau
+//
+// fqr F = fmatrix_QR_factorize(A, &frame);
+fqr fmatrix_QR_factorize(fmatrix mat, pool* frame) {
+	fqr error = { ERROR_FMATRIX, NULL, NULL, 0 };
+	if (mat.m < 1 || mat.n < 1) {
+		printf("QR factorization requires a non empty matrix (%d x %d)\n", mat.m, mat.n);
+		return error;
+	}
+
+	int k = (mat.m < mat.n) ? mat.m : mat.n;
+	fmatrix QR = fmatrix_ncol_copy_alloc(mat, mat.n, frame);		// row major copy, regardless of mat's transpose flag
+	float* tau = raw_pool_alloc(frame, k * sizeof(float));
+	void* workspace = frame->ptr;
+	float* work = raw_pool_alloc(frame, householder_work_size(mat.m, mat.n) * sizeof(float));
+	if (QR.matrix == NULL || tau == NULL || work == NULL) {
+		printf("QR factorization error: pool allocation failure\n");
+		if (QR.matrix != NULL) { pool_free_from(frame, QR.matrix); }
+		return error;
+	}
+
+	householder_qr_raw(QR.matrix, QR.m, QR.n, tau, work);
+
+	pool_free_from(frame, workspace);
+	return (fqr) { QR, tau, NULL, k };
+}
+
+// returns the min(m, n) x n upper triangular factor R, allocated on frame
+//
+// fmatrix R = fqr_R(F, &frame);
+fmatrix fqr_R(fqr F, pool* frame) {
+	int k = (F.QR.m < F.QR.n) ? F.QR.m : F.QR.n;
+	fmatrix R = fmatrix_create_zero(k, F.QR.n, frame);
+	if (R.matrix == NULL) { return ERROR_FMATRIX; }
+	for (int i = 0; i < k; i++) {
+		memcpy(&R.matrix[i * R.n + i], &F.QR.matrix[i * F.QR.n + i], (R.n - i) * sizeof(float));
+	}
+	return R;
+}
+
+// writes columns c0 to c1 - 1 of Q = H_0 H_1 ... H_(k-1) into the m x (c1 - c0) row major array out, where the reflectors
+// are stored in the m x n row major array a. w is scratch space for c1 - c0 floats
+static void reflectors_to_columns(const float* a, int m, int n, int k, const float* tau, int c0, int c1, float* out, float* w) {
+	int width = c1 - c0;
+	for (int i = 0; i < m; i++) {
+		for (int c = 0; c < width; c++) { out[i * width + c] = (i == c0 + c) ? 1.0f : 0.0f; }
+	}
+
+	// Q e_l = H_0 (... (H_(k-1) e_l)). H_j only touches rows j and down, so it leaves e_l alone until j <= l. That means
+	// each reflector only has to be applied to the columns at or right of it
+	for (int j = k - 1; j >= 0; j--) {
+		int first = (j > c0) ? j - c0 : 0;
+		apply_reflector(a, n, m, j, tau[j], out, width, first, width, w);
+	}
+}
+
+// returns the first min(m, n) columns of Q (the "thin" Q, an orthonormal basis for the column space of a full rank A),
+// allocated on frame. For the full m x m Q, use fqr_apply_Q on an identity matrix
+//
+// fmatrix Q = fqr_Q(F, &frame);
+fmatrix fqr_Q(fqr F, pool* frame) {
+	int m = F.QR.m, n = F.QR.n;
+	int k = (m < n) ? m : n;
+	void* start = frame->ptr;
+	fmatrix Q = fmatrix_create_zero(m, k, frame);
+	void* workspace = frame->ptr;
+	float* w = raw_pool_alloc(frame, k * sizeof(float));
+	if (Q.matrix == NULL || w == NULL) {
+		printf("fqr_Q error: pool allocation failure\n");
+		pool_free_from(frame, start);
+		return ERROR_FMATRIX;
+	}
+
+	reflectors_to_columns(F.QR.matrix, m, n, k, F.tau, 0, k, Q.matrix, w);
+
+	pool_free_from(frame, workspace);
+	return Q;
+}
+
+// shared by fqr_apply_Qt and fqr_apply_Q
+static fmatrix fqr_apply(fqr F, fmatrix B, int transpose, pool* frame) {
+	int m = F.QR.m, n = F.QR.n;
+	int k = (m < n) ? m : n;
+	if (B.m != m) {
+		printf("applying Q requires B to have %d rows (B is %d x %d)\n", m, B.m, B.n);
+		return ERROR_FMATRIX;
+	}
+
+	void* start = frame->ptr;
+	fmatrix result = fmatrix_ncol_copy_alloc(B, B.n, frame);
+	void* workspace = frame->ptr;
+	float* w = raw_pool_alloc(frame, B.n * sizeof(float));
+	if (result.matrix == NULL || w == NULL) {
+		printf("applying Q error: pool allocation failure\n");
+		pool_free_from(frame, start);
+		return ERROR_FMATRIX;
+	}
+
+	// Q^t = H_(k-1) ... H_0, so Q^t B applies H_0 first. Q B applies them in reverse
+	for (int s = 0; s < k; s++) {
+		int j = transpose ? s : k - 1 - s;
+		apply_reflector(F.QR.matrix, n, m, j, F.tau[j], result.matrix, result.n, 0, result.n, w);
+	}
+
+	pool_free_from(frame, workspace);
+	return result;
+}
+
+// returns Q^t B, allocated on frame. B must have m rows
+//
+// fmatrix QtB = fqr_apply_Qt(F, B, &frame);
+fmatrix fqr_apply_Qt(fqr F, fmatrix B, pool* frame) {
+	return fqr_apply(F, B, 1, frame);
+}
+
+// returns Q B, allocated on frame. B must have m rows
+//
+// fmatrix Q = fqr_apply_Q(F, fmatrix_create_identity(m, m, &frame), &frame); // full m x m Q
+fmatrix fqr_apply_Q(fqr F, fmatrix B, pool* frame) {
+	return fqr_apply(F, B, 0, frame);
+}
+
+
+// Column pivoted QR
+
+// column pivoted householder QR of the m x n row major array a, in place (Businger-Golub).
+// Column norms are downdated after each step instead of recomputed, unless too much cancellation happened. The factorization
+// stops as soon as every remaining column is below tol times the largest column norm, since the rest of R is numerical noise.
+// returns the rank, and sets tau to 0 past it. norms needs 2n floats, w needs n
+static int pivoted_qr_raw(float* a, int m, int n, float tol, float* tau, int* perm, float* norms, float* w) {
+	int k = (m < n) ? m : n;
+	float* partial = norms;			// norm of the part of each column below the rows done so far
+	float* original = norms + n;	// the norm the last time it was computed exactly
+	float largest = 0.0f;
+	for (int c = 0; c < n; c++) {
+		perm[c] = c;
+		float sum = 0.0f;
+		for (int i = 0; i < m; i++) { sum += a[i * n + c] * a[i * n + c]; }
+		partial[c] = original[c] = sqrtf(sum);
+		largest = fmaxf(largest, partial[c]);
+	}
+	float threshold = tol * largest;
+	float downdate_limit = sqrtf(FLT_EPSILON);
+
+	int rank = 0;
+	for (int j = 0; j < k; j++) {
+		int pivot = j;
+		for (int c = j + 1; c < n; c++) {
+			if (partial[c] > partial[pivot]) { pivot = c; }
+		}
+		if (!(partial[pivot] > threshold) || largest == 0.0f) {
+			for (int i = j; i < k; i++) { tau[i] = 0.0f; }
+			break;
+		}
+
+		if (pivot != j) {
+			for (int i = 0; i < m; i++) { fswap(&a[i * n + j], &a[i * n + pivot]); }
+			intswap(&perm[j], &perm[pivot]);
+			fswap(&partial[j], &partial[pivot]);
+			fswap(&original[j], &original[pivot]);
+		}
+
+		tau[j] = householder_vector(a, n, m, j);
+		apply_reflector(a, n, m, j, tau[j], a, n, j + 1, n, w);
+		rank++;
+
+		// row j is done, so take its element out of each remaining norm
+		for (int c = j + 1; c < n; c++) {
+			if (partial[c] == 0.0f) { continue; }
+			float ratio = fabsf(a[j * n + c]) / partial[c];
+			float remaining = fmaxf(0.0f, 1.0f - ratio * ratio);
+			float drift = remaining * (partial[c] / original[c]) * (partial[c] / original[c]);
+			if (drift <= downdate_limit) {
+				float sum = 0.0f;
+				for (int i = j + 1; i < m; i++) { sum += a[i * n + c] * a[i * n + c]; }
+				partial[c] = original[c] = sqrtf(sum);
+			}
+			else {
+				partial[c] *= sqrtf(remaining);
+			}
+		}
+	}
+	return rank;
+}
+
+// factors mat into AP = QR with column pivoting, allocated on frame. mat is not changed.
+// Stops at the numerical rank: the number of columns whose remaining norm is above tol times the largest column norm of mat.
+// tol <= 0 uses max(m, n) * FLT_EPSILON. The rank and the column order are stored in the result
+// upon failure, returns an fqr with an ERROR_FMATRIX QR and a NULL tau
+//
+// fqr F = fmatrix_QRP_factorize(A, 0.0f, &frame);
+// printf("rank %d\n", F.rank);
+fqr fmatrix_QRP_factorize(fmatrix mat, float tol, pool* frame) {
+	fqr error = { ERROR_FMATRIX, NULL, NULL, 0 };
+	if (mat.m < 1 || mat.n < 1) {
+		printf("QR factorization requires a non empty matrix (%d x %d)\n", mat.m, mat.n);
+		return error;
+	}
+	if (tol <= 0.0f) { tol = ((mat.m > mat.n) ? mat.m : mat.n) * FLT_EPSILON; }
+
+	int k = (mat.m < mat.n) ? mat.m : mat.n;
+	fmatrix QR = fmatrix_ncol_copy_alloc(mat, mat.n, frame);
+	float* tau = raw_pool_alloc(frame, k * sizeof(float));
+	int* perm = raw_pool_alloc(frame, mat.n * sizeof(int));
+	void* workspace = frame->ptr;
+	float* norms = raw_pool_alloc(frame, 3 * mat.n * sizeof(float));
+	if (QR.matrix == NULL || tau == NULL || perm == NULL || norms == NULL) {
+		printf("QR factorization error: pool allocation failure\n");
+		if (QR.matrix != NULL) { pool_free_from(frame, QR.matrix); }
+		return error;
+	}
+
+	int rank = pivoted_qr_raw(QR.matrix, QR.m, QR.n, tol, tau, perm, norms, norms + 2 * mat.n);
+
+	pool_free_from(frame, workspace);
+	return (fqr) { QR, tau, perm, rank };
+}
+
+// finds orthonormal bases for the fundamental subspaces of mat picked by which (SUBSPACE_COL, SUBSPACE_ROW, SUBSPACE_NULL,
+// SUBSPACE_LEFT_NULL, or SUBSPACE_ALL), all from one column pivoted QR. tol is the rank tolerance (see fmatrix_QRP_factorize).
+// Subspaces that weren't asked for are ERROR_FMATRIX. Only the results stay on frame
+//
+// the row space and null space need the complete orthogonal decomposition: with R1 the first r rows of R, A = Q1 R1 P^t, so
+// the row space of A is the column space of P R1^t (n x r, full rank). Factoring that as Z S, the first r columns of Z span
+// the row space and the rest span its orthogonal complement, the null space.
+//
+// fsubspaces S = fmatrix_subspaces(A, 0.0f, SUBSPACE_COL | SUBSPACE_NULL, &frame);
+fsubspaces fmatrix_subspaces(fmatrix mat, float tol, int which, pool* frame) {
+	fsubspaces result = { 0, ERROR_FMATRIX, ERROR_FMATRIX, ERROR_FMATRIX, ERROR_FMATRIX };
+	int m = mat.m, n = mat.n;
+	void* start = frame->ptr;
+
+	fqr F = fmatrix_QRP_factorize(mat, tol, frame);
+	if (F.QR.matrix == NULL) { return result; }
+	int r = F.rank;
+	int k = (m < n) ? m : n;
+	result.rank = r;
+
+	// scratch for applying reflectors, and the complete orthogonal decomposition if it's needed
+	int need_z = (which & (SUBSPACE_ROW | SUBSPACE_NULL)) && r > 0;
+	float* w = raw_pool_alloc(frame, ((m > n) ? m : n) * sizeof(float));
+	float* Z = NULL;
+	float* z_tau = NULL;
+	if (need_z) {
+		Z = raw_pool_alloc(frame, n * r * sizeof(float));
+		z_tau = raw_pool_alloc(frame, r * sizeof(float));
+		float* work = raw_pool_alloc(frame, householder_work_size(n, r) * sizeof(float));
+		if (Z != NULL && z_tau != NULL && work != NULL) {
+			// Z = P R1^t: row perm[c] of Z is column c of R1
+			for (int c = 0; c < n; c++) {
+				float* z_row = &Z[F.perm[c] * r];
+				for (int i = 0; i < r; i++) { z_row[i] = (c >= i) ? F.QR.matrix[i * n + c] : 0.0f; }
+			}
+			householder_qr_raw(Z, n, r, z_tau, work);
+		}
+	}
+	if (w == NULL || (need_z && (Z == NULL || z_tau == NULL))) {
+		printf("subspaces error: pool allocation failure\n");
+		pool_free_from(frame, start);
+		return result;
+	}
+
+	// results go after the workspace for now, then get moved down over it once it's no longer needed
+	char* results = NULL;
+	fmatrix* outputs[4] = { &result.col, &result.row, &result.null, &result.left_null };
+	int flags[4] = { SUBSPACE_COL, SUBSPACE_ROW, SUBSPACE_NULL, SUBSPACE_LEFT_NULL };
+	for (int s = 0; s < 4; s++) {
+		if (!(which & flags[s])) { continue; }
+
+		// columns c0 to c1 - 1 of either Q (m x m) or Z (n x n)
+		int rows = (s == 0 || s == 3) ? m : n;
+		int c0 = (s == 0 || s == 1) ? 0 : r;
+		int c1 = (s == 0 || s == 1) ? r : rows;
+		int width = (c1 > c0) ? c1 - c0 : 1;		// a zero subspace is one zero vector
+		fmatrix basis = fmatrix_create_zero(rows, width, frame);
+		if (basis.matrix == NULL) {
+			printf("subspaces error: pool allocation failure\n");
+			pool_free_from(frame, start);
+			return (fsubspaces) { 0, ERROR_FMATRIX, ERROR_FMATRIX, ERROR_FMATRIX, ERROR_FMATRIX };
+		}
+		if (c1 > c0) {
+			if (rows == m) { reflectors_to_columns(F.QR.matrix, m, n, k, F.tau, c0, c1, basis.matrix, w); }
+			else { reflectors_to_columns(Z, n, r, r, z_tau, c0, c1, basis.matrix, w); }
+		}
+		if (s == 1) { fmatrix_transpose_in(&basis); }		// one basis vector per row
+
+		*outputs[s] = basis;
+		if (results == NULL) { results = (char*)basis.matrix; }
+	}
+
+	// move the results to where the factorization started, and give the rest of the pool back
+	// (the bases are all floats, so the padding between them moves with them and every one stays 4 byte aligned)
+	if (results == NULL) {
+		pool_free_from(frame, start);
+		return result;
+	}
+	int total = (int)((char*)frame->ptr - results);
+	char* moved = pool_compact(frame, start, results, total);
+	for (int s = 0; s < 4; s++) {
+		if (outputs[s]->matrix != NULL) { outputs[s]->matrix = (float*)(moved + ((char*)outputs[s]->matrix - results)); }
+	}
+	return result;
+}
+
+
+// Tall skinny QR
+
+// reduces rows r0 to r1 - 1 of [A B] into the upper triangular (n + k) x (n + k) R of their QR factorization, where B has k columns
+// (B.n = 0 for plain A). Only block_rows rows of the input are in the workspace at a time: each block is stacked under the R
+// of everything before it and factored again, so the result is the same R as factoring [A B] in one go (up to the signs
+// of its rows). The blocks don't depend on each other until they're stacked, so the order of the reduction is free to change.
+// buf must hold (cols + block_rows) x cols floats
+static void tsqr_raw(fmatrix A, fmatrix B, int r0, int r1, int block_rows, float* R, float* buf, float* tau, float* work) {
+	int cols = A.n + B.n;
+	int held = 0;				// rows of buf in use. After the first block, the top cols rows are the running R
+	int i = r0;
+	while (i < r1) {
+		// append the next block of rows
+		int end = (i + block_rows < r1) ? i + block_rows : r1;
+		for (; i < end; i++, held++) {
+			float* row = &buf[held * cols];
+			if (!A.transpose) { memcpy(row, &A.matrix[i * A.n], A.n * sizeof(float)); }
+			else { for (int j = 0; j < A.n; j++) { row[j] = MATRIX_AT(A, i, j); } }
+			for (int j = 0; j < B.n; j++) { row[A.n + j] = MATRIX_AT(B, i, j); }
+		}
+
+		householder_qr_raw(buf, held, cols, tau, work);
+
+		// keep only R, and clear the reflectors out from under it
+		held = (held < cols) ? held : cols;
+		for (int r = 0; r < held; r++) {
+			for (int c = 0; c < r; c++) { buf[r * cols + c] = 0.0f; }
+		}
+	}
+
+	memset(R, 0, cols * cols * sizeof(float));
+	memcpy(R, buf, held * cols * sizeof(float));
+}
+
+// number of row stripes tsqr splits A into. A stripe is at least 4 blocks, and enough work (about 2 cols^2 multiply adds a row)
+// to be worth a thread. It only depends on the shape, so the result is the same however many threads there are
+static int tsqr_stripe_count(int m, int cols, int block_rows) {
+	int min_rows = PARALLEL_MIN_WORK / (2 * cols * cols) + 1;
+	if (min_rows < 4 * block_rows) { min_rows = 4 * block_rows; }
+	int stripes = m / min_rows;
+	if (stripes > QR_TSQR_STRIPES) { stripes = QR_TSQR_STRIPES; }
+	return (stripes < 1) ? 1 : stripes;
+}
+
+typedef struct {
+	fmatrix A, B;
+	int block_rows, stripes, cols;
+	float* R;					// stripes R's of cols x cols, stacked
+	float* scratch;				// stripes blocks of scratch_size floats: buf, tau and work for each stripe
+	int scratch_size;
+}tsqr_context;
+
+static void tsqr_stripes(void* context, int begin, int end) {
+	tsqr_context* t = context;
+	int cols = t->cols;
+	for (int s = begin; s < end; s++) {
+		float* buf = &t->scratch[s * t->scratch_size];
+		float* tau = buf + (cols + t->block_rows) * cols;
+		tsqr_raw(t->A, t->B, (int)((long long)t->A.m * s / t->stripes), (int)((long long)t->A.m * (s + 1) / t->stripes), t->block_rows,
+			&t->R[s * cols * cols], buf, tau, tau + cols);
+	}
+}
+
+// the R of [A B] (cols = A.n + B.n), written into the cols x cols array R. Tall inputs are cut into row stripes that are reduced
+// on their own threads, and then their R's are stacked and reduced once more (a two level TSQR tree). returns 0 on allocation
+// failure. Its workspace is freed before returning
+static int tsqr(fmatrix A, fmatrix B, int block_rows, float* R, pool* frame) {
+	int cols = A.n + B.n;
+	int stripes = tsqr_stripe_count(A.m, cols, block_rows);
+	int scratch_size = (cols + block_rows) * cols + cols + householder_work_size(cols + block_rows, cols);
+
+	void* workspace = frame->ptr;
+	float* scratch = raw_pool_alloc(frame, stripes * scratch_size * sizeof(float));
+	float* stacked = (stripes > 1) ? raw_pool_alloc(frame, stripes * cols * cols * sizeof(float)) : NULL;
+	if (scratch == NULL || (stripes > 1 && stacked == NULL)) {
+		pool_free_from(frame, workspace);
+		return 0;
+	}
+
+	float* tau = scratch + (cols + block_rows) * cols;
+	if (stripes == 1) {
+		tsqr_raw(A, B, 0, A.m, block_rows, R, scratch, tau, tau + cols);
+	}
+	else {
+		tsqr_context context = { A, B, block_rows, stripes, cols, stacked, scratch, scratch_size };
+		parallel_for(stripes, 1, tsqr_stripes, &context);
+		fmatrix Rs = (fmatrix){ stripes * cols, cols, stacked, 0 };
+		tsqr_raw(Rs, (fmatrix){ 0 }, 0, Rs.m, block_rows, R, scratch, tau, tau + cols);
+	}
+
+	pool_free_from(frame, workspace);
+	return 1;
+}
+
+// returns the n x n upper triangular factor R of tall skinny mat (m >= n), allocated on frame.
+// reads mat block_rows rows at a time (pass 0 for QR_TSQR_BLOCK_ROWS), so the workspace is independent of m
+//
+// fmatrix R = fmatrix_TSQR(A, 0, &frame);
+fmatrix fmatrix_TSQR(fmatrix mat, int block_rows, pool* frame) {
+	if (mat.m < mat.n || mat.n < 1) {
+		printf("TSQR requires a tall matrix (m >= n), got %d x %d\n", mat.m, mat.n);
+		return ERROR_FMATRIX;
+	}
+	if (mat.kind != FMATRIX_GENERAL) {
+		printf("TSQR requires a general matrix, unpack it first (fmatrix_unpack)\n");
+		return ERROR_FMATRIX;
+	}
+	if (block_rows <= 0) { block_rows = QR_TSQR_BLOCK_ROWS; }
+
+	fmatrix R = fmatrix_create_zero(mat.n, mat.n, frame);
+	if (R.matrix == NULL || !tsqr(mat, ERROR_FMATRIX, block_rows, R.matrix, frame)) {
+		printf("TSQR error: pool allocation failure\n");
+		if (R.matrix != NULL) { pool_free_from(frame, R.matrix); }
+		return ERROR_FMATRIX;
+	}
+	return R;
+}
+
+// Least squares
+
+// returns the X that minimizes ||AX - B|| (each column of X separately), allocated on frame.
+// A is m x n with m >= n and full column rank, B is m x k
+//
+// R of [A B] is [R1 C; 0 R2], where R1 is R of A and C = Q^t B (its first n rows). So AX = B reduces to R1 X = C without
+// forming Q, A^t A, or even a full copy of A, since the rows of [A B] are reduced QR_TSQR_BLOCK_ROWS at a time.
+// ||R2|| is the size of the residual.
+// returns ERROR_FMATRIX if A is (numerically) rank deficient
+//
+// fmatrix x = fmatrix_least_squares(A, b, &frame);
+fmatrix fmatrix_least_squares(fmatrix A, fmatrix B, pool* frame) {
+	if (A.m < A.n || A.n < 1) {
+		printf("least squares requires a tall matrix (m >= n), got %d x %d\n", A.m, A.n);
+		return ERROR_FMATRIX;
+	}
+	if (B.m != A.m || B.n < 1) {
+		printf("least squares requires B to be %d x k (B is %d x %d)\n", A.m, B.m, B.n);
+		return ERROR_FMATRIX;
+	}
+	if (A.kind != FMATRIX_GENERAL || B.kind != FMATRIX_GENERAL) {
+		printf("least squares requires general matrices, unpack them first (fmatrix_unpack)\n");
+		return ERROR_FMATRIX;
+	}
+
+	int n = A.n, k = B.n;
+	int cols = n + k;
+	int block_rows = (QR_TSQR_BLOCK_ROWS > cols) ? QR_TSQR_BLOCK_ROWS : cols;
+
+	fmatrix X = fmatrix_create_zero(n, k, frame);
+	void* workspace = frame->ptr;
+	float* R = raw_pool_alloc(frame, cols * cols * sizeof(float));
+	if (X.matrix == NULL || R == NULL || !tsqr(A, B, block_rows, R, frame)) {
+		printf("least squares error: pool allocation failure\n");
+		if (X.matrix != NULL) { pool_free_from(frame, X.matrix); }
+		return ERROR_FMATRIX;
+	}
+
+	// rank check on R1's diagonal
+	float largest = 0.0f;
+	for (int i = 0; i < n; i++) { largest = fmaxf(largest, fabsf(R[i * cols + i])); }
+	float tolerance = largest * n * FLT_EPSILON;
+	for (int i = 0; i < n; i++) {
+		if (!(fabsf(R[i * cols + i]) > tolerance)) {
+			printf("least squares error: A is rank deficient\n");
+			pool_free_from(frame, X.matrix);
+			return ERROR_FMATRIX;
+		}
+	}
+
+	// R1 X = C, back substitution on whole rows of X
+	for (int i = n - 1; i >= 0; i--) {
+		float* x_i = &X.matrix[i * k];
+		for (int c = 0; c < k; c++) { x_i[c] = R[i * cols + n + c]; }
+		for (int j = i + 1; j < n; j++) {
+			float r = R[i * cols + j];
+			const float* x_j = &X.matrix[j * k];
+			for (int c = 0; c < k; c++) { x_i[c] -= r * x_j[c]; }
+		}
+		float d = R[i * cols + i];
+		for (int c = 0; c < k; c++) { x_i[c] /= d; }
+	}
+
+	pool_free_from(frame, workspace);
+	return X;
+}
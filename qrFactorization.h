@@ -0,0 +1,75 @@
+#ifndef QRFACTORIZATION_H
+#define QRFACTORIZATION_H
+
+#include "memoryPool.h"
+#include "matrix.h"
+
+// Householder QR factorization, A = QR
+// Q (m x m, orthogonal) is never formed unless asked for. It's kept as the k = min(m, n) Householder reflectors
+// H_j = I - tau_j v_j v_j^t, with Q = H_0 H_1 ... H_(k-1). v_j is stored below the diagonal of column j (its leading 1 is
+// implied), and R is stored on and above the diagonal, the same compact layout LAPACK uses.
+//
+// The factorization is blocked: each panel of QR_BLOCK_SIZE columns is factored one reflector at a time, then its reflectors
+// are combined into a single block reflector I - V T V^t (the compact WY form) and applied to the rest of the matrix at once.
+// That turns the bulk of the work into three matrix-matrix products with contiguous inner loops, which are split across threads
+// by columns (see parallel.h).
+//
+// For tall skinny A, fmatrix_TSQR only ever holds QR_TSQR_BLOCK_ROWS rows at a time: it factors a block of rows, keeps its
+// R, stacks the next block under it, and repeats. fmatrix_least_squares uses it on [A B], which gives Q^t B for free, so
+// neither Q, A^t A, nor a copy of A is ever formed. Tall enough inputs are cut into up to QR_TSQR_STRIPES row stripes that are
+// reduced that way on their own threads, and their R's are then stacked and reduced once more.
+//
+// fmatrix_QRP_factorize adds column pivoting (AP = QR): each step picks the remaining column with the largest norm, so the
+// diagonal of R decreases in size and the numerical rank is the number of diagonal elements above a tolerance.
+// fmatrix_subspaces gets orthonormal bases for all four fundamental subspaces from that one factorization:
+//   - column space:    the first r columns of Q
+//   - left null space: the other m - r columns of Q
+//   - row space and null space: from the QR of the first r rows of R (transposed and unpivoted), which is only r x n
+//
+// fqr F = fmatrix_QR_factorize(A, &frame);
+// fmatrix R = fqr_R(F, &frame);
+// fmatrix x = fmatrix_least_squares(A, b, &frame);
+// fsubspaces S = fmatrix_subspaces(A, 0.0f, SUBSPACE_ALL, &frame);
+
+#define QR_BLOCK_SIZE 32
+#define QR_TSQR_BLOCK_ROWS 256
+// most row stripes TSQR splits a tall matrix into (the count only depends on its shape, not on the number of threads)
+#define QR_TSQR_STRIPES 8
+
+// which subspaces fmatrix_subspaces should find (or them together)
+#define SUBSPACE_COL 1
+#define SUBSPACE_ROW 2
+#define SUBSPACE_NULL 4
+#define SUBSPACE_LEFT_NULL 8
+#define SUBSPACE_ALL 15
+
+typedef struct {
+	fmatrix QR;					// R on and above the diagonal, reflectors below it (row major)
+	float* tau;					// scale of each reflector, min(m, n) entries
+	int* perm;					// pivoted only: column j of R belongs to column perm[j] of A. NULL if unpivoted
+	int rank;					// pivoted only: numerical rank. min(m, n) if unpivoted
+}fqr;
+
+// orthonormal bases, one per column (except row, which has one per row, like fmatrix_row_space)
+// a zero subspace is given as a single zero vector of the right length
+typedef struct {
+	int rank;
+	fmatrix col;				// m x r
+	fmatrix row;				// r x n
+	fmatrix null;				// n x (n - r)
+	fmatrix left_null;			// m x (m - r)
+}fsubspaces;
+
+fqr fmatrix_QR_factorize(fmatrix mat, pool* frame);
+fmatrix fqr_R(fqr F, pool* frame);
+fmatrix fqr_Q(fqr F, pool* frame);
+fmatrix fqr_apply_Qt(fqr F, fmatrix B, pool* frame);
+fmatrix fqr_apply_Q(fqr F, fmatrix B, pool* frame);
+
+fqr fmatrix_QRP_factorize(fmatrix mat, float tol, pool* frame);
+fsubspaces fmatrix_subspaces(fmatrix mat, float tol, int which, pool* frame);
+
+fmatrix fmatrix_TSQR(fmatrix mat, int block_rows, pool* frame);
+fmatrix fmatrix_least_squares(fmatrix A, fmatrix B, pool* frame);
+
+#endif
@@ -0,0 +1,208 @@
+#include <string.h>
+
+#include "quantMatrix.h"
+
+#if defined(__AVX512VNNI__) && defined(__AVX512BW__)
+#define QUANT_VNNI
+#elif defined(__AVX2__)
+#define QUANT_AVX2
+#endif
+#if defined(QUANT_VNNI) || defined(QUANT_AVX2)
+#include <immintrin.h>
+#endif
+
+// rounds and clamps to the int8 range
+static int8_t saturate(float value) {
+	long q = lrintf(value);
+	if (q < -128) { q = -128; }
+	if (q > 127) { q = 127; }
+	return (int8_t)q;
+}
+
+// quantizes mat to int8, with a scale and zero point per row or per column (see quantMatrix.h). The result is allocated on frame,
+// and keeps mat's layout and transpose flag, so mat has to be general
+//
+// qmatrix Aq = fmatrix_quantize(A, QUANT_PER_ROW, &frame);
+qmatrix fmatrix_quantize(fmatrix mat, quant_axis axis, pool* frame) {
+	if (mat.kind != FMATRIX_GENERAL) {
+		printf("error while quantizing: \nrequires a general matrix, unpack it first (fmatrix_unpack)\n");
+		return ERROR_QMATRIX;
+	}
+	int groups = (axis == QUANT_PER_ROW) ? mat.m : mat.n;
+	int length = (axis == QUANT_PER_ROW) ? mat.n : mat.m;
+
+	void* start = frame->ptr;
+	int8_t* matrix = raw_pool_alloc(frame, mat.m * mat.n * sizeof(int8_t));
+	float* scale = raw_pool_alloc(frame, groups * sizeof(float));
+	int32_t* zero = raw_pool_alloc(frame, groups * sizeof(int32_t));
+	if (matrix == NULL || scale == NULL || zero == NULL) {
+		printf("error while quantizing: pool allocation failure\n");
+		pool_free_from(frame, start);
+		return ERROR_QMATRIX;
+	}
+
+	for (int g = 0; g < groups; g++) {
+		// the range always includes 0, so a 0 in the input comes back as exactly 0
+		float lo = 0.0f, hi = 0.0f;
+		for (int t = 0; t < length; t++) {
+			float value = (axis == QUANT_PER_ROW) ? MATRIX_AT(mat, g, t) : MATRIX_AT(mat, t, g);
+			lo = fminf(lo, value);
+			hi = fmaxf(hi, value);
+		}
+		float s = (hi - lo) / 255.0f;
+		if (s == 0.0f) { s = 1.0f; }			// all zeros
+		int8_t z = saturate(-128.0f - lo / s);
+		scale[g] = s;
+		zero[g] = z;
+
+		float inverse = 1.0f / s;
+		for (int t = 0; t < length; t++) {
+			int index = (axis == QUANT_PER_ROW) ? INDEX_AT(mat, g, t) : INDEX_AT(mat, t, g);
+			matrix[index] = saturate(mat.matrix[index] * inverse + (float)z);
+		}
+	}
+
+	return (qmatrix) { mat.m, mat.n, matrix, scale, zero, mat.transpose, (uint8_t)axis };
+}
+
+// returns scale * (q - zero) for every element, allocated on frame, with the same layout and transpose flag
+//
+// fmatrix A_approx = qmatrix_dequantize(Aq, &frame);
+fmatrix qmatrix_dequantize(qmatrix mat, pool* frame) {
+	float* matrix = raw_pool_alloc(frame, mat.m * mat.n * sizeof(float));
+	if (matrix == NULL) {
+		printf("error while dequantizing: pool allocation failure\n");
+		return ERROR_FMATRIX;
+	}
+	fmatrix result = { mat.m, mat.n, matrix, mat.transpose };
+
+	for (int i = 0; i < mat.m; i++) {
+		for (int j = 0; j < mat.n; j++) {
+			int g = (mat.axis == QUANT_PER_ROW) ? i : j;
+			int index = INDEX_AT(mat, i, j);
+			matrix[index] = mat.scale[g] * (float)(mat.matrix[index] - mat.zero[g]);
+		}
+	}
+	return result;
+}
+
+// constant time, like fmatrix_transpose_in. Rows become columns, so the scales flip axis too
+void qmatrix_transpose_in(qmatrix* mat) {
+	intswap(&mat->m, &mat->n);
+	mat->transpose = !mat->transpose;
+	mat->axis = (mat->axis == QUANT_PER_ROW) ? QUANT_PER_COL : QUANT_PER_ROW;
+}
+
+
+// int8 dot product of two contiguous k element vectors, exact in int32
+// b_sum is the sum of b, which the VNNI path needs: vpdpbusd multiplies unsigned by signed bytes, so a is shifted up by 128 and
+// 128 * b_sum is taken back off at the end
+static int32_t dot_s8(const int8_t* a, const int8_t* b, int k, int32_t b_sum) {
+	int32_t sum = 0;
+	int p = 0;
+#if defined(QUANT_VNNI)
+	__m512i acc = _mm512_setzero_si512();
+	const __m512i flip = _mm512_set1_epi8((char)0x80);
+	for (; p + 64 <= k; p += 64) {
+		__m512i va = _mm512_xor_si512(_mm512_loadu_si512(&a[p]), flip);		// a + 128, as unsigned bytes
+		acc = _mm512_dpbusd_epi32(acc, va, _mm512_loadu_si512(&b[p]));
+	}
+	sum = _mm512_reduce_add_epi32(acc);
+	for (; p < k; p++) { sum += (a[p] + 128) * b[p]; }
+	return sum - 128 * b_sum;
+#else
+	(void)b_sum;
+#if defined(QUANT_AVX2)
+	__m256i acc = _mm256_setzero_si256();
+	for (; p + 16 <= k; p += 16) {
+		__m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)&a[p]));
+		__m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)&b[p]));
+		acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+	}
+	__m128i half = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+	half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+	half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+	sum = _mm_cvtsi128_si32(half);
+#endif
+	for (; p < k; p++) { sum += a[p] * b[p]; }
+	return sum;
+#endif
+}
+
+// multiplies A (quantized per row) by B (quantized per column) with int8 dot products, and returns the dequantized float
+// product allocated on frame. Rows of A and columns of B are packed contiguous first, unless their layout already has them that
+// way (a non transposed A, and a transposed B, ex. a quantized weight matrix stored as W^t).
+// Columns of B are processed QUANT_BLOCK_COLS at a time, so a block stays in cache while every row of A is dotted against it
+//
+// fmatrix C = qmatrix_multiply(Aq, Bq, &frame);
+fmatrix qmatrix_multiply(qmatrix matA, qmatrix matB, pool* frame) {
+	if (matA.n != matB.m) {
+		printf("error while multiplying quantized matrices: \ndimension mismatch: ");
+		printf("matrix a: (%d x _%d_)  matrix b: (_%d_ x %d)\n", matA.m, matA.n, matB.m, matB.n);
+		return ERROR_FMATRIX;
+	}
+	if (matA.axis != QUANT_PER_ROW || matB.axis != QUANT_PER_COL) {
+		printf("quantized multiply requires A quantized per row and B quantized per column\n");
+		return ERROR_FMATRIX;
+	}
+	int m = matA.m, k = matA.n, n = matB.n;
+
+	void* start = frame->ptr;
+	fmatrix result = fmatrix_create_zero(m, n, frame);
+	void* workspace = frame->ptr;
+	const int8_t* rows = matA.matrix;		// row i of A at rows[i * k]
+	const int8_t* cols = matB.matrix;		// column j of B at cols[j * k]
+	int8_t* packed_rows = matA.transpose ? raw_pool_alloc(frame, m * k) : NULL;
+	int8_t* packed_cols = matB.transpose ? NULL : raw_pool_alloc(frame, n * k);
+	int32_t* row_sums = raw_pool_alloc(frame, m * sizeof(int32_t));
+	int32_t* col_sums = raw_pool_alloc(frame, n * sizeof(int32_t));
+	if (result.matrix == NULL || (matA.transpose && packed_rows == NULL) || (!matB.transpose && packed_cols == NULL) ||
+		row_sums == NULL || col_sums == NULL) {
+		printf("error while multiplying quantized matrices: pool allocation failure\n");
+		pool_free_from(frame, start);
+		return ERROR_FMATRIX;
+	}
+
+	if (packed_rows != NULL) {
+		for (int i = 0; i < m; i++) {
+			for (int p = 0; p < k; p++) { packed_rows[i * k + p] = MATRIX_AT(matA, i, p); }
+		}
+		rows = packed_rows;
+	}
+	if (packed_cols != NULL) {
+		for (int p = 0; p < k; p++) {
+			for (int j = 0; j < n; j++) { packed_cols[j * k + p] = MATRIX_AT(matB, p, j); }
+		}
+		cols = packed_cols;
+	}
+	for (int i = 0; i < m; i++) {
+		int32_t sum = 0;
+		for (int p = 0; p < k; p++) { sum += rows[i * k + p]; }
+		row_sums[i] = sum;
+	}
+	for (int j = 0; j < n; j++) {
+		int32_t sum = 0;
+		for (int p = 0; p < k; p++) { sum += cols[j * k + p]; }
+		col_sums[j] = sum;
+	}
+
+	for (int j0 = 0; j0 < n; j0 += QUANT_BLOCK_COLS) {
+		int j1 = (j0 + QUANT_BLOCK_COLS < n) ? j0 + QUANT_BLOCK_COLS : n;
+		for (int i = 0; i < m; i++) {
+			const int8_t* a = &rows[i * k];
+			int32_t za = matA.zero[i];
+			float sa = matA.scale[i];
+			float* c = &result.matrix[i * n];
+			for (int j = j0; j < j1; j++) {
+				int32_t zb = matB.zero[j];
+				// fused epilogue: undo both zero points, then both scales
+				int32_t dot = dot_s8(a, &cols[j * k], k, col_sums[j]);
+				int64_t exact = (int64_t)dot - (int64_t)zb * row_sums[i] - (int64_t)za * col_sums[j] + (int64_t)k * za * zb;
+				c[j] = sa * matB.scale[j] * (float)exact;
+			}
+		}
+	}
+
+	pool_free_from(frame, workspace);
+	return result;
+}
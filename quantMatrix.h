@@ -0,0 +1,60 @@
+#ifndef QUANTMATRIX_H
+#define QUANTMATRIX_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "memoryPool.h"
+#include "matrix.h"
+
+// int8 quantized matrices
+// Each row (or column) of a float matrix is mapped onto the 256 levels of an int8 with an affine map:
+//   x ~ scale * (q - zero)
+// where scale and zero are picked per row or per column so its range (stretched to include 0, so 0 stays exact) fills
+// -128 to 127. Layout and the transpose flag work like fmatrix, so MATRIX_AT gives the raw int8.
+//
+// qmatrix_multiply computes A B with integer dot products, and dequantizes straight into a float result. That only works when
+// A's scales go with its rows and B's with its columns, since then the scales factor out of every dot product:
+//   (AB)[i][j] = sA[i] sB[j] (sum qa qb - zB[j] sum qa - zA[i] sum qb + k zA[i] zB[j])
+// The int8 x int8 -> int32 dot products use AVX512-VNNI (vpdpbusd) or AVX2 (vpmaddwd on widened int16s) when the compiler
+// targets them, and plain C otherwise. All three give exactly the same integers, so the results don't depend on the CPU.
+// (pmaddubsw is skipped on purpose: its int16 pair sums saturate for full range int8 inputs)
+//
+// qmatrix Aq = fmatrix_quantize(A, QUANT_PER_ROW, &frame);
+// qmatrix Bq = fmatrix_quantize(B, QUANT_PER_COL, &frame);
+// fmatrix C = qmatrix_multiply(Aq, Bq, &frame);	// ~ AB
+
+// columns of B that qmatrix_multiply keeps hot while it walks the rows of A (64 columns of a 1024 deep B is 64KB)
+#define QUANT_BLOCK_COLS 64
+
+typedef enum {
+	QUANT_PER_ROW,
+	QUANT_PER_COL
+}quant_axis;
+
+// int8 matrix
+typedef struct{
+	// rows, columns
+	int m, n;
+	// pointer to item at [0,0]
+	int8_t* matrix;
+	// one scale and zero point per row (m of each), or per column (n of each), depending on axis. Indexed as the matrix is read
+	float* scale;
+	int32_t* zero;
+	// flag for transpose handling
+	uint8_t transpose;
+	// quant_axis
+	uint8_t axis;
+	uint8_t padding[2];
+}qmatrix;
+
+#define ERROR_QMATRIX (qmatrix){ 0, 0, NULL, NULL, NULL, 0, 0 }
+
+qmatrix fmatrix_quantize(fmatrix mat, quant_axis axis, pool* frame);
+fmatrix qmatrix_dequantize(qmatrix mat, pool* frame);
+void qmatrix_transpose_in(qmatrix* mat);
+
+fmatrix qmatrix_multiply(qmatrix matA, qmatrix matB, pool* frame);
+
+#endif
@@ -0,0 +1,524 @@
+#include "sparseLU.h"
+
+// Checklist:
+//		  1) the minimum degree ordering keeps an explicit elimination graph. Switching to a quotient graph
+//			 with approximate degrees (AMD) would bound its memory by nnz(A), but this is fine for now
+//		  2) supernodes, so the numeric factorization can use dense kernels on blocks of columns
+//
+
+// grows a column compressed factor holding used elements so it has room for at least needed elements
+// the old arrays stay on the pool (it's a bump allocator), so the caller can't free its workspace anymore
+// returns 0 on allocation failure
+static int grow_factor(fspmatrix* F, int* capacity, int used, int needed, pool* frame) {
+	int new_capacity = 2 * (*capacity) + F->n;
+	if (new_capacity < needed) { new_capacity = needed; }
+
+	void* start = frame->ptr;
+	int* index = raw_pool_alloc(frame, new_capacity * sizeof(int));
+	float* values = raw_pool_alloc(frame, new_capacity * sizeof(float));
+	if (index == NULL || values == NULL) {
+		printf("sparse LU error: pool allocation failure while growing a factor\n");
+		pool_free_from(frame, start);
+		return 0;
+	}
+
+	memcpy(index, F->index, used * sizeof(int));
+	memcpy(values, F->values, used * sizeof(float));
+	F->index = index;
+	F->values = values;
+	*capacity = new_capacity;
+	return 1;
+}
+
+
+// Ordering
+
+// minimum degree ordering on the graph of A + A^t (C is A compressed by column). Writes the elimination
+// order into perm.
+// Repeatedly eliminates the node with the fewest neighbors. Eliminating a node connects all of its
+// neighbors to each other (that's the fill it would cause), so each neighbor's list becomes the union of
+// its own list and the eliminated node's list. Nodes are kept in buckets by degree, so picking the next
+// node doesn't need a scan over every node.
+// Everything it allocates on frame is freed before returning. returns 0 on failure
+static int min_degree_order(fspmatrix C, int* perm, pool* frame) {
+	int n = C.n;
+	void* workspace = frame->ptr;
+
+	int* len = raw_pool_alloc(frame, n * sizeof(int));
+	int** lists = raw_pool_alloc(frame, n * sizeof(int*));
+	int* mark = raw_pool_alloc(frame, n * sizeof(int));
+	int* head = raw_pool_alloc(frame, n * sizeof(int));
+	int* next = raw_pool_alloc(frame, n * sizeof(int));
+	int* prev = raw_pool_alloc(frame, n * sizeof(int));
+	int* eliminated = raw_pool_alloc(frame, n * sizeof(int));
+	int* adjacency = raw_pool_alloc(frame, (2 * C.nnz + 1) * sizeof(int));
+	if (!len || !lists || !mark || !head || !next || !prev || !eliminated || !adjacency) {
+		printf("minimum degree error: pool allocation failure\n");
+		pool_free_from(frame, workspace);
+		return 0;
+	}
+
+	// symmetric pattern, without the diagonal. Count first, then fill, then drop duplicates
+	memset(len, 0, n * sizeof(int));
+	for (int j = 0; j < n; j++) {
+		for (int p = C.ptr[j]; p < C.ptr[j + 1]; p++) {
+			int i = C.index[p];
+			if (i == j) { continue; }
+			len[i]++;
+			len[j]++;
+		}
+	}
+	int offset = 0;
+	for (int v = 0; v < n; v++) {
+		lists[v] = &adjacency[offset];
+		offset += len[v];
+		len[v] = 0;
+	}
+	for (int j = 0; j < n; j++) {
+		for (int p = C.ptr[j]; p < C.ptr[j + 1]; p++) {
+			int i = C.index[p];
+			if (i == j) { continue; }
+			lists[i][len[i]++] = j;
+			lists[j][len[j]++] = i;
+		}
+	}
+
+	int stamp = 0;
+	for (int v = 0; v < n; v++) { mark[v] = -1; }
+	for (int v = 0; v < n; v++) {
+		int unique = 0;
+		stamp++;
+		for (int a = 0; a < len[v]; a++) {
+			int u = lists[v][a];
+			if (mark[u] == stamp) { continue; }
+			mark[u] = stamp;
+			lists[v][unique++] = u;
+		}
+		len[v] = unique;
+	}
+
+	// degree buckets. head[d] is the first node with degree d
+	for (int d = 0; d < n; d++) { head[d] = -1; }
+	for (int v = 0; v < n; v++) {
+		eliminated[v] = 0;
+		prev[v] = -1;
+		next[v] = head[len[v]];
+		if (head[len[v]] != -1) { prev[head[len[v]]] = v; }
+		head[len[v]] = v;
+	}
+
+	int min_degree = 0;
+	for (int k = 0; k < n; k++) {
+		while (head[min_degree] == -1) { min_degree++; }
+
+		// take the first node of the lowest bucket
+		int v = head[min_degree];
+		head[min_degree] = next[v];
+		if (next[v] != -1) { prev[next[v]] = -1; }
+		eliminated[v] = 1;
+		perm[k] = v;
+
+		// every remaining neighbor u of v gets connected to the rest of v's neighbors
+		for (int a = 0; a < len[v]; a++) {
+			int u = lists[v][a];
+			if (eliminated[u]) { continue; }
+
+			int* merged = raw_pool_alloc(frame, (len[u] + len[v]) * sizeof(int));
+			if (merged == NULL) {
+				printf("minimum degree error: pool allocation failure\n");
+				pool_free_from(frame, workspace);
+				return 0;
+			}
+			int count = 0;
+			stamp++;
+			mark[u] = stamp;
+			for (int b = 0; b < len[u]; b++) {
+				int w = lists[u][b];
+				if (eliminated[w] || mark[w] == stamp) { continue; }
+				mark[w] = stamp;
+				merged[count++] = w;
+			}
+			for (int b = 0; b < len[v]; b++) {
+				int w = lists[v][b];
+				if (eliminated[w] || mark[w] == stamp) { continue; }
+				mark[w] = stamp;
+				merged[count++] = w;
+			}
+
+			// move u to the bucket for its new degree
+			if (prev[u] != -1) { next[prev[u]] = next[u]; }
+			else { head[len[u]] = next[u]; }
+			if (next[u] != -1) { prev[next[u]] = prev[u]; }
+
+			lists[u] = merged;
+			len[u] = count;
+			prev[u] = -1;
+			next[u] = head[count];
+			if (head[count] != -1) { prev[head[count]] = u; }
+			head[count] = u;
+			if (count < min_degree) { min_degree = count; }
+		}
+	}
+
+	pool_free_from(frame, workspace);
+	return 1;
+}
+
+// symbolic analysis of a square sparse matrix. Only looks at A's nonzero pattern, so the result can be
+// reused by fsplu_factorize for any matrix with the same pattern.
+// the column order is allocated on frame. On failure, the returned analysis has q set to NULL
+//
+// fsplu_symbolic S = fsplu_analyze(A, SPLU_ORDER_MIN_DEGREE, &frame);
+fsplu_symbolic fsplu_analyze(fspmatrix A, splu_order order, pool* frame) {
+	fsplu_symbolic result = { 0, 0, NULL, 0, 0 };
+	if (A.m != A.n) {
+		printf("sparse LU error: matrix must be square (%d x %d)\n", A.m, A.n);
+		return result;
+	}
+
+	int n = A.n;
+	int* q = raw_pool_alloc(frame, n * sizeof(int));
+	if (q == NULL) {
+		printf("sparse LU error: pool allocation failure\n");
+		return result;
+	}
+
+	if (order == SPLU_ORDER_MIN_DEGREE) {
+		void* workspace = frame->ptr;
+		fspmatrix C = fspmatrix_compress_cols(A, frame);
+		if (C.ptr == NULL || !min_degree_order(C, q, frame)) {
+			pool_free_from(frame, q);
+			return result;
+		}
+		pool_free_from(frame, workspace);
+	}
+	else {
+		for (int k = 0; k < n; k++) { q[k] = k; }
+	}
+
+	result.n = n;
+	result.nnz = A.nnz;
+	result.q = q;
+	// starting guess for the factors, corrected by each numeric factorization
+	result.lnz = 4 * A.nnz + n;
+	result.unz = 4 * A.nnz + n;
+	return result;
+}
+
+
+// Numeric factorization
+
+// depth first search from node j through the graph of the columns of L built so far. Nodes that are
+// finished get pushed onto xi from the top down, so xi[top..n) ends up in topological order.
+// returns the new top
+static int reach_dfs(int j, fspmatrix L, const int* pinv, int top, int* xi, int* stack, int* pstack, int* mark, int stamp) {
+	int head = 0;
+	stack[0] = j;
+
+	while (head >= 0) {
+		j = stack[head];
+		int column = pinv[j];				// column of L that row j is the pivot of (-1 if not a pivot yet)
+		if (mark[j] != stamp) {
+			mark[j] = stamp;
+			pstack[head] = (column < 0) ? 0 : L.ptr[column] + 1;	// skip the unit diagonal
+		}
+
+		int done = 1;
+		int end = (column < 0) ? 0 : L.ptr[column + 1];
+		for (int p = pstack[head]; p < end; p++) {
+			int i = L.index[p];
+			if (mark[i] == stamp) { continue; }
+			pstack[head] = p + 1;			// resume here after i is finished
+			stack[++head] = i;
+			done = 0;
+			break;
+		}
+
+		if (done) {
+			head--;
+			xi[--top] = j;
+		}
+	}
+	return top;
+}
+
+// solves Lx = A(:, col) for the partially built L, where x is dense but only the entries reachable from
+// the nonzeros of A(:, col) can become nonzero. Those entries are listed in xi[top..n), so the work is
+// proportional to the flops instead of n.
+// returns top
+static int sparse_lower_solve(fspmatrix L, fspmatrix C, int col, const int* pinv, float* x, int* xi, int* stack, int* pstack, int* mark, int stamp) {
+	int n = C.n;
+	int top = n;
+	for (int p = C.ptr[col]; p < C.ptr[col + 1]; p++) {
+		if (mark[C.index[p]] != stamp) {
+			top = reach_dfs(C.index[p], L, pinv, top, xi, stack, pstack, mark, stamp);
+		}
+	}
+
+	for (int p = top; p < n; p++) { x[xi[p]] = 0.0f; }
+	for (int p = C.ptr[col]; p < C.ptr[col + 1]; p++) { x[C.index[p]] = C.values[p]; }
+
+	for (int px = top; px < n; px++) {
+		int j = xi[px];
+		int column = pinv[j];
+		if (column < 0) { continue; }		// row j isn't pivotal yet, so it isn't eliminated by L
+		float xj = x[j];
+		for (int p = L.ptr[column] + 1; p < L.ptr[column + 1]; p++) {
+			x[L.index[p]] -= L.values[p] * xj;
+		}
+	}
+	return top;
+}
+
+// numeric factorization PAQ = LU of A, using the column order from S (left looking, one column at a time)
+// For each column: solve with the L built so far, the entries in rows that are already pivots go into U,
+// then pick the pivot among the rest (threshold partial pivoting, see SPLU_DEFAULT_TOL), and scale them into L.
+// The factors are allocated on frame and stored in N. S is updated with the actual sizes of L and U.
+// returns 1 on success, 0 if A is singular (or on errors)
+//
+// fsplu_numeric N;
+// if (!fsplu_factorize(A, &S, SPLU_DEFAULT_TOL, &N, &frame)) { printf("A is singular\n"); }
+int fsplu_factorize(fspmatrix A, fsplu_symbolic* S, float tol, fsplu_numeric* N, pool* frame) {
+	if (A.m != A.n) {
+		printf("sparse LU error: matrix must be square (%d x %d)\n", A.m, A.n);
+		return 0;
+	}
+	if (S->q == NULL || S->n != A.n || S->nnz != A.nnz) {
+		printf("sparse LU error: symbolic analysis doesn't match the matrix\n");
+		return 0;
+	}
+
+	int n = A.n;
+	void* start = frame->ptr;
+
+	// outputs first, so the workspace after them can be freed
+	int lcap = S->lnz, ucap = S->unz;
+	int* pinv = raw_pool_alloc(frame, n * sizeof(int));
+	int* lptr = raw_pool_alloc(frame, (n + 1) * sizeof(int));
+	int* uptr = raw_pool_alloc(frame, (n + 1) * sizeof(int));
+	int* lindex = raw_pool_alloc(frame, lcap * sizeof(int));
+	float* lvalues = raw_pool_alloc(frame, lcap * sizeof(float));
+	int* uindex = raw_pool_alloc(frame, ucap * sizeof(int));
+	float* uvalues = raw_pool_alloc(frame, ucap * sizeof(float));
+	fspmatrix L = { n, n, 0, lptr, lindex, lvalues, 1 };
+	fspmatrix U = { n, n, 0, uptr, uindex, uvalues, 1 };
+
+	void* workspace = frame->ptr;
+	fspmatrix C = fspmatrix_compress_cols(A, frame);
+	float* x = raw_pool_alloc(frame, n * sizeof(float));
+	int* xi = raw_pool_alloc(frame, n * sizeof(int));
+	int* stack = raw_pool_alloc(frame, n * sizeof(int));
+	int* pstack = raw_pool_alloc(frame, n * sizeof(int));
+	int* mark = raw_pool_alloc(frame, n * sizeof(int));
+	if (!pinv || !lptr || !uptr || !lindex || !lvalues || !uindex || !uvalues || C.ptr == NULL || !x || !xi || !stack || !pstack || !mark) {
+		printf("sparse LU error: pool allocation failure\n");
+		pool_free_from(frame, start);
+		return 0;
+	}
+
+	int grown = 0;
+	for (int i = 0; i < n; i++) {
+		pinv[i] = -1;
+		mark[i] = -1;
+		x[i] = 0.0f;
+	}
+
+	int lnz = 0, unz = 0;
+	for (int k = 0; k < n; k++) {
+		L.ptr[k] = lnz;
+		U.ptr[k] = unz;
+		// a column adds at most n elements to each factor
+		if (lnz + n > lcap) {
+			if (!grow_factor(&L, &lcap, lnz, lnz + n, frame)) {
+				pool_free_from(frame, start);
+				return 0;
+			}
+			grown = 1;
+		}
+		if (unz + n > ucap) {
+			if (!grow_factor(&U, &ucap, unz, unz + n, frame)) {
+				pool_free_from(frame, start);
+				return 0;
+			}
+			grown = 1;
+		}
+
+		int col = S->q[k];
+		int top = sparse_lower_solve(L, C, col, pinv, x, xi, stack, pstack, mark, k);
+
+		// rows that are already pivots belong to U, the largest of the rest is the pivot candidate
+		int ipiv = -1;
+		float largest = -1.0f;
+		for (int p = top; p < n; p++) {
+			int i = xi[p];
+			if (pinv[i] < 0) {
+				if (fabsf(x[i]) > largest) {
+					largest = fabsf(x[i]);
+					ipiv = i;
+				}
+			}
+			else {
+				U.index[unz] = pinv[i];
+				U.values[unz++] = x[i];
+			}
+		}
+		if (ipiv == -1 || largest <= 0.0f) {
+			printf("sparse LU: matrix is singular (no pivot in column %d)\n", col);
+			pool_free_from(frame, start);
+			return 0;
+		}
+
+		// keep the diagonal if it's big enough, so the fill reducing order is respected
+		if (pinv[col] < 0 && mark[col] == k && fabsf(x[col]) >= largest * tol) { ipiv = col; }
+
+		float pivot = x[ipiv];
+		U.index[unz] = k;						// diagonal of U is the last element of its column
+		U.values[unz++] = pivot;
+		pinv[ipiv] = k;
+		L.index[lnz] = ipiv;					// diagonal of L is the first element of its column
+		L.values[lnz++] = 1.0f;
+
+		for (int p = top; p < n; p++) {
+			int i = xi[p];
+			if (pinv[i] < 0) {
+				L.index[lnz] = i;
+				L.values[lnz++] = x[i] / pivot;
+			}
+			x[i] = 0.0f;
+		}
+	}
+	L.ptr[n] = lnz;
+	U.ptr[n] = unz;
+	L.nnz = lnz;
+	U.nnz = unz;
+
+	// L's rows were recorded in original row numbers. Renumber them in pivot order
+	for (int p = 0; p < lnz; p++) { L.index[p] = pinv[L.index[p]]; }
+
+	if (!grown) { pool_free_from(frame, workspace); }
+
+	S->lnz = lnz;
+	S->unz = unz;
+
+	N->n = n;
+	N->L = L;
+	N->U = U;
+	N->pinv = pinv;
+	N->q = S->q;
+	return 1;
+}
+
+
+// Triangular solves
+
+// solves Lx = b in place (x holds b going in) for a lower triangular L compressed by column, with the
+// diagonal stored as the first element of each column.
+// returns 0 if L is in the wrong format or has a 0 on the diagonal
+int fspmatrix_lower_solve_in(fspmatrix L, float* x) {
+	if (!L.transpose || L.m != L.n) {
+		printf("sparse lower solve error: L must be square and compressed by column\n");
+		return 0;
+	}
+
+	for (int j = 0; j < L.n; j++) {
+		float diagonal = L.values[L.ptr[j]];
+		if (diagonal == 0.0f) { return 0; }
+		x[j] /= diagonal;
+		float xj = x[j];
+		for (int p = L.ptr[j] + 1; p < L.ptr[j + 1]; p++) {
+			x[L.index[p]] -= L.values[p] * xj;
+		}
+	}
+	return 1;
+}
+
+// solves Ux = b in place (x holds b going in) for an upper triangular U compressed by column, with the
+// diagonal stored as the last element of each column.
+// returns 0 if U is in the wrong format or has a 0 on the diagonal
+int fspmatrix_upper_solve_in(fspmatrix U, float* x) {
+	if (!U.transpose || U.m != U.n) {
+		printf("sparse upper solve error: U must be square and compressed by column\n");
+		return 0;
+	}
+
+	for (int j = U.n - 1; j >= 0; j--) {
+		float diagonal = U.values[U.ptr[j + 1] - 1];
+		if (diagonal == 0.0f) { return 0; }
+		x[j] /= diagonal;
+		float xj = x[j];
+		for (int p = U.ptr[j]; p < U.ptr[j + 1] - 1; p++) {
+			x[U.index[p]] -= U.values[p] * xj;
+		}
+	}
+	return 1;
+}
+
+// solves Ax = b with a factorization from fsplu_factorize. b has to be n x 1
+// PAQ = LU, so LU(Q^t x) = Pb: permute b, solve with L then U, then undo the column order
+// returns x as a new n x 1 fmatrix on frame
+//
+// fmatrix x = fsplu_solve(N, b, &frame);
+fmatrix fsplu_solve(fsplu_numeric N, fmatrix b, pool* frame) {
+	if (b.m != N.n || b.n != 1 || b.kind != FMATRIX_GENERAL) {
+		printf("Solving a system requires b to be a general m x 1 vector, where m is A.m\n");
+		return ERROR_FMATRIX;
+	}
+
+	// x first, so the permuted copy of b can be freed afterwards
+	fmatrix x = fmatrix_create_zero(N.n, 1, frame);
+	if (x.matrix == NULL) { return ERROR_FMATRIX; }
+	float* y = raw_pool_alloc(frame, N.n * sizeof(float));
+	if (y == NULL) {
+		printf("sparse LU solve error: pool allocation failure\n");
+		pool_free_from(frame, x.matrix);
+		return ERROR_FMATRIX;
+	}
+
+	for (int i = 0; i < N.n; i++) { y[N.pinv[i]] = b.matrix[i]; }
+	if (!fspmatrix_lower_solve_in(N.L, y) || !fspmatrix_upper_solve_in(N.U, y)) {
+		pool_free_from(frame, x.matrix);
+		return ERROR_FMATRIX;
+	}
+	for (int k = 0; k < N.n; k++) { x.matrix[N.q[k]] = y[k]; }
+
+	pool_free_from(frame, y);
+	return x;
+}
+
+// one shot sparse solve of Ax = b, the sparse counterpart of fmatrix_LU_solve
+// analyzes, factors and solves. Only x is left on frame afterwards
+// returns ERROR_FMATRIX if A is singular
+//
+// fmatrix x = fspmatrix_LU_solve(A, b, &frame);
+fmatrix fspmatrix_LU_solve(fspmatrix A, fmatrix b, pool* frame) {
+	if (A.m != A.n) {
+		printf("Solving a system requires a square matrix\n");
+		return ERROR_FMATRIX;
+	}
+	if (b.m != A.m || b.n != 1 || b.kind != FMATRIX_GENERAL) {
+		printf("Solving a system requires b to be a general m x 1 vector, where m is A.m\n");
+		return ERROR_FMATRIX;
+	}
+
+	// allocate x before the factorization, so everything after it can be freed in one go
+	fmatrix x = fmatrix_create_zero(A.m, 1, frame);
+	if (x.matrix == NULL) { return ERROR_FMATRIX; }
+	void* workspace = frame->ptr;
+
+	fsplu_symbolic S = fsplu_analyze(A, SPLU_ORDER_MIN_DEGREE, frame);
+	fsplu_numeric N;
+	if (S.q == NULL || !fsplu_factorize(A, &S, SPLU_DEFAULT_TOL, &N, frame)) {
+		pool_free_from(frame, x.matrix);
+		return ERROR_FMATRIX;
+	}
+
+	fmatrix solution = fsplu_solve(N, b, frame);
+	if (solution.matrix == NULL) {
+		pool_free_from(frame, x.matrix);
+		return ERROR_FMATRIX;
+	}
+	memcpy(x.matrix, solution.matrix, A.m * sizeof(float));
+
+	pool_free_from(frame, workspace);
+	return x;
+}
@@ -0,0 +1,57 @@
+#ifndef SPARSELU_H
+#define SPARSELU_H
+
+#include "memoryPool.h"
+#include "matrix.h"
+#include "sparseMatrix.h"
+
+// Sparse direct LU solver
+// Factors a square sparse A as PAQ = LU without ever densifying it:
+//   - Q is a fill reducing column order, picked once by fsplu_analyze from the nonzero pattern alone
+//   - P comes from threshold partial pivoting during fsplu_factorize
+//   - L (unit lower triangular) and U (upper triangular) are compressed by column
+//
+// The symbolic analysis only depends on where the nonzeros are, so it can be reused for every matrix
+// with the same pattern (ex. every step of a nonlinear or time dependent solve). Each factorization also
+// records how much room L and U took, so the next one with the same analysis allocates the right amount.
+//
+// fsplu_symbolic S = fsplu_analyze(A, SPLU_ORDER_MIN_DEGREE, &frame);
+// fsplu_numeric N;
+// if (fsplu_factorize(A, &S, SPLU_DEFAULT_TOL, &N, &frame)) {
+//     fmatrix x = fsplu_solve(N, b, &frame);
+// }
+
+// pivot threshold: the diagonal element is kept as the pivot if it is at least tol times the largest
+// candidate in its column. 1.0 is plain partial pivoting, smaller values trade some stability for keeping
+// the fill reducing order intact
+#define SPLU_DEFAULT_TOL 0.1f
+
+typedef enum {
+	SPLU_ORDER_NATURAL,			// eliminate columns in their original order
+	SPLU_ORDER_MIN_DEGREE		// minimum degree on the pattern of A + A^t
+}splu_order;
+
+typedef struct {
+	int n;
+	int nnz;					// nonzeros of the matrix the analysis was done for
+	int* q;						// q[k] is the column of A eliminated at step k
+	int lnz, unz;				// expected nonzeros of L and U
+}fsplu_symbolic;
+
+typedef struct {
+	int n;
+	fspmatrix L;				// unit lower triangular, compressed by column (diagonal stored first)
+	fspmatrix U;				// upper triangular, compressed by column (diagonal stored last)
+	int* pinv;					// pinv[i] is the step at which row i of A became a pivot row
+	int* q;						// column order, shared with the symbolic analysis
+}fsplu_numeric;
+
+fsplu_symbolic fsplu_analyze(fspmatrix A, splu_order order, pool* frame);
+int fsplu_factorize(fspmatrix A, fsplu_symbolic* S, float tol, fsplu_numeric* N, pool* frame);
+fmatrix fsplu_solve(fsplu_numeric N, fmatrix b, pool* frame);
+fmatrix fspmatrix_LU_solve(fspmatrix A, fmatrix b, pool* frame);
+
+int fspmatrix_lower_solve_in(fspmatrix L, float* x);
+int fspmatrix_upper_solve_in(fspmatrix U, float* x);
+
+#endif
@@ -0,0 +1,437 @@
+#include "sparseMatrix.h"
+#include "parallel.h"
+
+#if defined(__AVX2__)
+#define SPARSE_AVX2
+#include <immintrin.h>
+#endif
+
+// Checklist:
+//		  1) CSR SpMV is split across threads and vectorized (see fspmatrix_multiply_vector_in). CSC SpMV and
+//			 the sparse/dense multiplies are still single threaded, with inner loops over contiguous arrays
+//			 so the compiler can vectorize them
+//
+
+// allocates the three arrays of a sparse matrix with nnz stored elements on frame
+// ptr gets outer + 1 ints, where outer is the number of compressed rows (or columns)
+// returns ERROR_FSPMATRIX on failure
+static fspmatrix fspmatrix_alloc(int m, int n, int outer, int nnz, pool* frame) {
+	int* ptr = raw_pool_alloc(frame, (outer + 1) * sizeof(int));
+	int* index = raw_pool_alloc(frame, nnz * sizeof(int));
+	float* values = raw_pool_alloc(frame, nnz * sizeof(float));
+	if (ptr == NULL || index == NULL || values == NULL) {
+		printf("pool allocation for sparse matrix failed, returning error matrix\n");
+		return ERROR_FSPMATRIX;
+	}
+
+	return (fspmatrix) { m, n, nnz, ptr, index, values, 0 };
+}
+
+// copies already compressed CSR arrays onto frame, and returns an m x n sparse matrix using them
+// ptr needs m + 1 elements, index and values need nnz elements. Elements of a row should be sorted by column
+// returns ERROR_FSPMATRIX if the arrays are inconsistent
+//
+// int ptr[4] = {0, 1, 3, 4};
+// int index[4] = {0, 0, 2, 1};
+// float values[4] = {2.0f, -1.0f, 4.0f, 3.0f};
+// fspmatrix S = create_fspmatrix(3, 3, 4, ptr, index, values, &frame);
+fspmatrix create_fspmatrix(int m, int n, int nnz, int* ptr, int* index, float* values, pool* frame) {
+	if (m < 0 || n < 0 || nnz < 0) {
+		printf("fspmatrix must have positive row/columns\n");
+		return ERROR_FSPMATRIX;
+	}
+	if (!frame || !frame->start) {
+		printf("failed to create sparse matrix (faulty input frame). Returning empty matrix\n");
+		return ERROR_FSPMATRIX;
+	}
+	if (ptr[0] != 0 || ptr[m] != nnz) {
+		printf("failed to create sparse matrix: ptr must start at 0 and end at nnz (%d)\n", nnz);
+		return ERROR_FSPMATRIX;
+	}
+	for (int p = 0; p < nnz; p++) {
+		if (index[p] < 0 || index[p] >= n) {
+			printf("failed to create sparse matrix: column index %d out of bounds\n", index[p]);
+			return ERROR_FSPMATRIX;
+		}
+	}
+
+	fspmatrix result = fspmatrix_alloc(m, n, m, nnz, frame);
+	if (result.ptr == NULL) { return result; }
+
+	memcpy(result.ptr, ptr, (m + 1) * sizeof(int));
+	memcpy(result.index, index, nnz * sizeof(int));
+	memcpy(result.values, values, nnz * sizeof(float));
+
+	return result;
+}
+
+// compresses the nonzero elements of mat by row
+// mat can be a transpose, but not packed (unpack it first)
+//
+// fspmatrix S = fspmatrix_create_csr(A, &frame);
+fspmatrix fspmatrix_create_csr(fmatrix mat, pool* frame) {
+	if (mat.kind != FMATRIX_GENERAL) {
+		printf("error while compressing: \nrequires a general matrix, unpack it first (fmatrix_unpack)\n");
+		return ERROR_FSPMATRIX;
+	}
+	int nnz = 0;
+	for (int i = 0; i < mat.m; i++) {
+		for (int j = 0; j < mat.n; j++) {
+			if (MATRIX_AT(mat, i, j) != 0.0f) { nnz++; }
+		}
+	}
+
+	fspmatrix result = fspmatrix_alloc(mat.m, mat.n, mat.m, nnz, frame);
+	if (result.ptr == NULL) { return result; }
+
+	int p = 0;
+	for (int i = 0; i < mat.m; i++) {
+		result.ptr[i] = p;
+		for (int j = 0; j < mat.n; j++) {
+			float value = MATRIX_AT(mat, i, j);
+			if (value == 0.0f) { continue; }
+			result.index[p] = j;
+			result.values[p] = value;
+			p++;
+		}
+	}
+	result.ptr[mat.m] = p;
+
+	return result;
+}
+
+// compresses the nonzero elements of mat by column
+// the CSC arrays of mat are the CSR arrays of mat^t, so compress the transpose then flip it back
+//
+// fspmatrix S = fspmatrix_create_csc(A, &frame);
+fspmatrix fspmatrix_create_csc(fmatrix mat, pool* frame) {
+	fmatrix_transpose_in(&mat);
+	fspmatrix result = fspmatrix_create_csr(mat, frame);
+	if (result.ptr == NULL) { return result; }
+
+	fspmatrix_transpose_in(&result);
+	return result;
+}
+
+// expands sp into a dense (non transposed) fmatrix allocated on frame
+//
+// fmatrix A = fspmatrix_to_fmatrix(S, &frame);
+fmatrix fspmatrix_to_fmatrix(fspmatrix sp, pool* frame) {
+	fmatrix result = fmatrix_create_zero(sp.m, sp.n, frame);
+	if (result.matrix == NULL) { return result; }
+
+	int outer = SPARSE_OUTER(sp);
+	for (int o = 0; o < outer; o++) {
+		for (int p = sp.ptr[o]; p < sp.ptr[o + 1]; p++) {
+			if (!sp.transpose) { result.matrix[o * sp.n + sp.index[p]] = sp.values[p]; }
+			else { result.matrix[sp.index[p] * sp.n + o] = sp.values[p]; }
+		}
+	}
+
+	return result;
+}
+
+// returns a deep copy of sp allocated on frame, with the same transpose state
+fspmatrix fspmatrix_copy_alloc(fspmatrix sp, pool* frame) {
+	int outer = SPARSE_OUTER(sp);
+	fspmatrix result = fspmatrix_alloc(sp.m, sp.n, outer, sp.nnz, frame);
+	if (result.ptr == NULL) { return result; }
+
+	memcpy(result.ptr, sp.ptr, (outer + 1) * sizeof(int));
+	memcpy(result.index, sp.index, sp.nnz * sizeof(int));
+	memcpy(result.values, sp.values, sp.nnz * sizeof(float));
+	result.transpose = sp.transpose;
+
+	return result;
+}
+
+// returns a copy of the arrays of sp compressed the other way (rows <-> columns), allocated on frame.
+// The result reads as the same matrix, but with the transpose flag flipped
+// this is a counting sort over the inner indices, so the new inner indices come out sorted
+static fspmatrix fspmatrix_recompress(fspmatrix sp, pool* frame) {
+	int outer = SPARSE_OUTER(sp);
+	int inner = sp.transpose ? sp.m : sp.n;
+
+	fspmatrix result = fspmatrix_alloc(sp.m, sp.n, inner, sp.nnz, frame);
+	if (result.ptr == NULL) { return result; }
+	result.transpose = !sp.transpose;
+
+	// count the elements of each new outer index, then turn the counts into starting positions
+	memset(result.ptr, 0, (inner + 1) * sizeof(int));
+	for (int p = 0; p < sp.nnz; p++) { result.ptr[sp.index[p] + 1]++; }
+	for (int i = 0; i < inner; i++) { result.ptr[i + 1] += result.ptr[i]; }
+
+	// result.ptr[i] is used as the next free slot of i while scattering, then shifted back
+	for (int o = 0; o < outer; o++) {
+		for (int p = sp.ptr[o]; p < sp.ptr[o + 1]; p++) {
+			int dest = result.ptr[sp.index[p]]++;
+			result.index[dest] = o;
+			result.values[dest] = sp.values[p];
+		}
+	}
+	for (int i = inner; i > 0; i--) { result.ptr[i] = result.ptr[i - 1]; }
+	result.ptr[0] = 0;
+
+	return result;
+}
+
+// returns sp stored in CSR form. If sp is already compressed by row, it is returned as is (no copy),
+// otherwise a recompressed copy is allocated on frame
+//
+// fspmatrix R = fspmatrix_compress_rows(S, &frame);
+fspmatrix fspmatrix_compress_rows(fspmatrix sp, pool* frame) {
+	if (!sp.transpose) { return sp; }
+	return fspmatrix_recompress(sp, frame);
+}
+
+// returns sp stored in CSC form. If sp is already compressed by column, it is returned as is (no copy),
+// otherwise a recompressed copy is allocated on frame
+//
+// fspmatrix C = fspmatrix_compress_cols(S, &frame);
+fspmatrix fspmatrix_compress_cols(fspmatrix sp, pool* frame) {
+	if (sp.transpose) { return sp; }
+	return fspmatrix_recompress(sp, frame);
+}
+
+// prints sp as a dense matrix. Only meant for small matrices
+void print_fspmatrix(fspmatrix sp) {
+	for (int i = 0; i < sp.m; i++) {
+		for (int j = 0; j < sp.n; j++) {
+			printf("%4.3f ", fspmatrix_at(sp, i, j));
+		}
+		printf("\n");
+	}
+}
+
+// returns the element of sp at [i][j] (0 if it isn't stored)
+// binary searches the compressed row (or column), so indices have to be sorted
+float fspmatrix_at(fspmatrix sp, int i, int j) {
+	int outer = sp.transpose ? j : i;
+	int inner = sp.transpose ? i : j;
+
+	int lo = sp.ptr[outer], hi = sp.ptr[outer + 1] - 1;
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		if (sp.index[mid] == inner) { return sp.values[mid]; }
+		if (sp.index[mid] < inner) { lo = mid + 1; }
+		else { hi = mid - 1; }
+	}
+	return 0.0f;
+}
+
+// transposes sp in constant time, the same way fmatrix_transpose_in does. A CSR matrix becomes the CSC
+// matrix of its transpose without touching its arrays.
+//
+// fspmatrix_transpose_in(&S);
+void fspmatrix_transpose_in(fspmatrix* sp) {
+	intswap(&sp->m, &sp->n);
+	sp->transpose = !sp->transpose;
+}
+
+
+// Multiplication
+
+// sparse matrix vector product. Returns Ax as a new A.m x 1 fmatrix on frame
+// x has to be A.n x 1. (a column vector is laid out the same either way, so its transpose flag doesn't matter)
+// CSR does a dot product per row. CSC scatters x[j] times column j into the result.
+//
+// fmatrix y = fspmatrix_multiply_vector(S, x, &frame);
+fmatrix fspmatrix_multiply_vector(fspmatrix A, fmatrix x, pool* frame) {
+	if (A.n != x.m || x.n != 1) {
+		printf("error while multiplying sparse matrix and vector: \ndimension mismatch: ");
+		printf("matrix a: (%d x _%d_)  vector x: (_%d_ x %d)\n", A.m, A.n, x.m, x.n);
+		return ERROR_FMATRIX;
+	}
+	if (x.kind != FMATRIX_GENERAL) {
+		printf("error while multiplying sparse matrix and vector: \nx has to be a general matrix\n");
+		return ERROR_FMATRIX;
+	}
+
+	fmatrix result = fmatrix_create_zero(A.m, 1, frame);
+	if (result.matrix == NULL) { return result; }
+
+	fspmatrix_multiply_vector_in(A, x.matrix, result.matrix);
+	return result;
+}
+
+// y[i] = (row i of A) . x for rows begin to end - 1 of a CSR matrix
+// with AVX2 it takes 8 elements at a time, gathering x by index. Otherwise it keeps 4 sums going, so consecutive multiply adds
+// don't each wait for the one before
+static void csr_rows(fspmatrix A, const float* x, float* y, int begin, int end) {
+	const int* ptr = A.ptr;
+	const int* index = A.index;
+	const float* values = A.values;
+
+	for (int i = begin; i < end; i++) {
+		int p = ptr[i];
+		int stop = ptr[i + 1];
+#if defined(SPARSE_AVX2)
+		__m256 acc = _mm256_setzero_ps();
+		for (; p + 8 <= stop; p += 8) {
+			__m256 xs = _mm256_i32gather_ps(x, _mm256_loadu_si256((const __m256i*)&index[p]), 4);
+			acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(&values[p]), xs));
+		}
+		__m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+		half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+		half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+		float sum = _mm_cvtss_f32(half);
+#else
+		float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+		for (; p + 4 <= stop; p += 4) {
+			s0 += values[p] * x[index[p]];
+			s1 += values[p + 1] * x[index[p + 1]];
+			s2 += values[p + 2] * x[index[p + 2]];
+			s3 += values[p + 3] * x[index[p + 3]];
+		}
+		float sum = (s0 + s1) + (s2 + s3);
+#endif
+		for (; p < stop; p++) { sum += values[p] * x[index[p]]; }
+		y[i] = sum;
+	}
+}
+
+typedef struct {
+	fspmatrix A;
+	const float* x;
+	float* y;
+	int parts;
+}spmv_context;
+
+// first row of part k when the nonzeros of A are cut into parts equal parts (the first row starting at or after the cut)
+static int part_start(fspmatrix A, int k, int parts) {
+	if (k >= parts) { return A.m; }
+	int cut = (int)((long long)A.nnz * k / parts);
+	int lo = 0, hi = A.m;
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (A.ptr[mid] < cut) { lo = mid + 1; }
+		else { hi = mid; }
+	}
+	return lo;
+}
+
+static void spmv_parts(void* context, int begin, int end) {
+	spmv_context* c = context;
+	csr_rows(c->A, c->x, c->y, part_start(c->A, begin, c->parts), part_start(c->A, end, c->parts));
+}
+
+// y = Ax on raw arrays, with no checks or allocation. x has A.n elements and y has A.m
+// used by fspmatrix_multiply_vector, and by the iterative solvers, which call it every iteration
+// A CSR matrix is split across threads by nonzeros rather than by rows (so a few dense rows don't leave one thread with most of the
+// work), once there are SPMV_PARALLEL_NNZ nonzeros per thread. Each row is a sum of its own, so the result doesn't depend on the
+// number of threads. A CSC matrix (transpose set) scatters each column into y, which threads would race on, so it stays serial
+void fspmatrix_multiply_vector_in(fspmatrix A, const float* x, float* y) {
+	const int* ptr = A.ptr;
+	const int* index = A.index;
+	const float* values = A.values;
+
+	if (!A.transpose) {
+		int parts = A.nnz / SPMV_PARALLEL_NNZ;
+		if (parts > parallel_threads()) { parts = parallel_threads(); }
+		if (parts <= 1) {
+			csr_rows(A, x, y, 0, A.m);
+			return;
+		}
+		spmv_context context = { A, x, y, parts };
+		parallel_for(parts, 1, spmv_parts, &context);
+	}
+	else {
+		memset(y, 0, A.m * sizeof(float));
+		for (int j = 0; j < A.n; j++) {
+			float xj = x[j];
+			if (xj == 0.0f) { continue; }
+			for (int p = ptr[j]; p < ptr[j + 1]; p++) {
+				y[index[p]] += values[p] * xj;
+			}
+		}
+	}
+}
+
+// dest[0..B.n) += c * (row k of B)
+// used by the sparse times dense multiply. Row k is contiguous unless B is a transpose
+static void add_scaled_row(float* dest, float c, fmatrix B, int k) {
+	if (!B.transpose) {
+		const float* src = &B.matrix[k * B.n];
+		for (int j = 0; j < B.n; j++) { dest[j] += c * src[j]; }
+	}
+	else {
+		for (int j = 0; j < B.n; j++) { dest[j] += c * MATRIX_AT(B, k, j); }
+	}
+}
+
+// sparse times dense. Returns AB as a new A.m x B.n fmatrix on frame
+// every stored element A[i][k] adds A[i][k] times row k of B to row i of the result, so each output
+// row is built from contiguous reads of B, and the zeros of A are never touched
+//
+// fmatrix C = fspmatrix_multiply_dense(S, B, &frame);
+fmatrix fspmatrix_multiply_dense(fspmatrix A, fmatrix B, pool* frame) {
+	if (A.n != B.m) {
+		printf("error while multiplying sparse and dense matrices: \ndimension mismatch: ");
+		printf("matrix a: (%d x _%d_)  matrix b: (_%d_ x %d)\n", A.m, A.n, B.m, B.n);
+		return ERROR_FMATRIX;
+	}
+	if (B.kind != FMATRIX_GENERAL) {
+		printf("error while multiplying sparse and dense matrices: \nrequires a general B, unpack it first (fmatrix_unpack)\n");
+		return ERROR_FMATRIX;
+	}
+
+	fmatrix result = fmatrix_create_zero(A.m, B.n, frame);
+	if (result.matrix == NULL) { return result; }
+
+	int outer = SPARSE_OUTER(A);
+	for (int o = 0; o < outer; o++) {
+		for (int p = A.ptr[o]; p < A.ptr[o + 1]; p++) {
+			// CSR: element is at [o][index], CSC: element is at [index][o]
+			int i = A.transpose ? A.index[p] : o;
+			int k = A.transpose ? o : A.index[p];
+			add_scaled_row(&result.matrix[i * B.n], A.values[p], B, k);
+		}
+	}
+
+	return result;
+}
+
+// dense times sparse. Returns AB as a new A.m x B.n fmatrix on frame
+// CSR B: row i of the result gets A[i][k] times sparse row k of B, for every nonzero A[i][k]
+// CSC B: element [i][j] of the result is a sparse dot product between row i of A and column j of B
+//
+// fmatrix C = fmatrix_multiply_sparse(A, S, &frame);
+fmatrix fmatrix_multiply_sparse(fmatrix A, fspmatrix B, pool* frame) {
+	if (A.n != B.m) {
+		printf("error while multiplying dense and sparse matrices: \ndimension mismatch: ");
+		printf("matrix a: (%d x _%d_)  matrix b: (_%d_ x %d)\n", A.m, A.n, B.m, B.n);
+		return ERROR_FMATRIX;
+	}
+	if (A.kind != FMATRIX_GENERAL) {
+		printf("error while multiplying dense and sparse matrices: \nrequires a general A, unpack it first (fmatrix_unpack)\n");
+		return ERROR_FMATRIX;
+	}
+
+	fmatrix result = fmatrix_create_zero(A.m, B.n, frame);
+	if (result.matrix == NULL) { return result; }
+
+	for (int i = 0; i < A.m; i++) {
+		float* dest = &result.matrix[i * B.n];
+
+		if (!B.transpose) {
+			for (int k = 0; k < A.n; k++) {
+				float a = MATRIX_AT(A, i, k);
+				if (a == 0.0f) { continue; }
+				for (int p = B.ptr[k]; p < B.ptr[k + 1]; p++) {
+					dest[B.index[p]] += a * B.values[p];
+				}
+			}
+		}
+		else {
+			for (int j = 0; j < B.n; j++) {
+				float sum = 0.0f;
+				for (int p = B.ptr[j]; p < B.ptr[j + 1]; p++) {
+					sum += MATRIX_AT(A, i, B.index[p]) * B.values[p];
+				}
+				dest[j] = sum;
+			}
+		}
+	}
+
+	return result;
+}
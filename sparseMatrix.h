@@ -0,0 +1,69 @@
+#ifndef SPARSEMATRIX_H
+#define SPARSEMATRIX_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "memoryPool.h"
+#include "matrix.h"
+
+// Compressed sparse matrices
+// Only the nonzero elements are stored. The matrix is compressed by rows (CSR), which takes three arrays:
+//   - values: the nonzero elements in row major order
+//   - index:  the column of each element of values
+//   - ptr:    ptr[i] is where row i starts in values/index, and ptr[i + 1] is where it ends. (m + 1 ints)
+//
+// Transposing works the same way as it does for fmatrix. The CSR arrays of A are exactly the compressed
+// sparse column (CSC) arrays of A^t, so fspmatrix_transpose_in just swaps m and n and flips the transpose
+// flag. With the flag set, ptr walks columns instead of rows, and index holds row numbers.
+// So the transpose flag doubles as the format flag: 0 is CSR, 1 is CSC.
+//
+// Sparse matrix vector products on a CSR matrix run across threads (see parallel.h) once there are SPMV_PARALLEL_NNZ nonzeros
+// for each thread, and use AVX2 gathers when compiled for it. On a CSC matrix they are serial, since every column scatters
+// into the whole result.
+
+// float sparse matrix
+typedef struct{
+	// rows, columns (of the matrix as it's read, so after any transpose)
+	int m, n;
+	// number of stored elements
+	int nnz;
+	// compressed pointers, nnz indices and nnz values, all allocated on a pool
+	int* ptr;
+	int* index;
+	float* values;
+	// flag for transpose handling. If set, the arrays are compressed by column
+	uint8_t transpose;
+	// padding for muh cache
+	uint8_t padding[3];
+}fspmatrix;
+
+// error sparse matrix
+#define ERROR_FSPMATRIX (fspmatrix){ 0, 0, 0, NULL, NULL, NULL, 0 }
+
+// nonzeros each thread of a CSR matrix vector product gets at least. Below this, threads cost more than they save
+#define SPMV_PARALLEL_NNZ 65536
+
+// length of the ptr array of a sparse matrix (number of compressed rows, or columns if transposed)
+#define SPARSE_OUTER(sp) ((sp).transpose ? (sp).n : (sp).m)
+
+fspmatrix create_fspmatrix(int m, int n, int nnz, int* ptr, int* index, float* values, pool* frame);
+fspmatrix fspmatrix_create_csr(fmatrix mat, pool* frame);
+fspmatrix fspmatrix_create_csc(fmatrix mat, pool* frame);
+fmatrix fspmatrix_to_fmatrix(fspmatrix sp, pool* frame);
+fspmatrix fspmatrix_copy_alloc(fspmatrix sp, pool* frame);
+fspmatrix fspmatrix_compress_rows(fspmatrix sp, pool* frame);
+fspmatrix fspmatrix_compress_cols(fspmatrix sp, pool* frame);
+
+void print_fspmatrix(fspmatrix sp);
+float fspmatrix_at(fspmatrix sp, int i, int j);
+
+void fspmatrix_transpose_in(fspmatrix* sp);
+
+fmatrix fspmatrix_multiply_vector(fspmatrix A, fmatrix x, pool* frame);
+void fspmatrix_multiply_vector_in(fspmatrix A, const float* x, float* y);
+fmatrix fspmatrix_multiply_dense(fspmatrix A, fmatrix B, pool* frame);
+fmatrix fmatrix_multiply_sparse(fmatrix A, fspmatrix B, pool* frame);
+
+#endif
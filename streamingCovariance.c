@@ -0,0 +1,171 @@
+#include <string.h>
+
+#include "streamingCovariance.h"
+
+// Accumulator
+
+// empty accumulator for rows of n variables, with its totals and scratch allocated on frame
+// upon failure, the accumulator's mean is NULL
+//
+// fcov_accumulator acc = fcov_create(A.n, &frame);
+fcov_accumulator fcov_create(int n, pool* frame) {
+	fcov_accumulator acc = { n, 0, NULL, NULL, NULL };
+	if (n <= 0) {
+		printf("error while creating covariance accumulator: \n%d variables\n", n);
+		return acc;
+	}
+
+	double* block = raw_pool_alloc(frame, (n + n * n + (COV_BLOCK_ROWS + 1) * n) * sizeof(double));
+	if (block == NULL) {
+		printf("error while creating covariance accumulator: \npool allocation failure\n");
+		return acc;
+	}
+	acc.mean = block;
+	acc.scatter = block + n;
+	acc.scratch = block + n + n * n;
+	fcov_reset(&acc);
+	return acc;
+}
+
+// forgets every row, so the accumulator can be reused for a new stream
+void fcov_reset(fcov_accumulator* acc) {
+	acc->count = 0;
+	memset(acc->mean, 0, acc->n * sizeof(double));
+	memset(acc->scatter, 0, acc->n * acc->n * sizeof(double));
+}
+
+// folds count_b rows with mean mean_b into acc, whose scatter already includes their own scatter (Chan's update, see the header)
+static void merge_totals(fcov_accumulator* acc, const double* mean_b, long long count_b) {
+	int n = acc->n;
+	if (acc->count == 0) {
+		memcpy(acc->mean, mean_b, n * sizeof(double));
+		acc->count = count_b;
+		return;
+	}
+
+	double total = (double)(acc->count + count_b);
+	double weight = (double)acc->count * (double)count_b / total;
+	double* delta = acc->scratch;		// free again once the batch is in the scatter
+	for (int i = 0; i < n; i++) { delta[i] = mean_b[i] - acc->mean[i]; }
+	for (int i = 0; i < n; i++) {
+		double d = weight * delta[i];
+		if (d == 0.0) { continue; }
+		double* s_i = &acc->scatter[i * n];
+		for (int j = 0; j <= i; j++) { s_i[j] += d * delta[j]; }
+	}
+	for (int i = 0; i < n; i++) { acc->mean[i] += delta[i] * ((double)count_b / total); }
+	acc->count += count_b;
+}
+
+// adds every row of batch (batch.n has to match the accumulator, and batch can be transposed). returns 1 on success
+//
+// fcov_add_batch(&acc, batch);
+int fcov_add_batch(fcov_accumulator* acc, fmatrix batch) {
+	int n = acc->n;
+	if (batch.n != n || acc->mean == NULL) {
+		printf("error while accumulating covariance: \ndimension mismatch: accumulator has %d variables, batch is (%d x %d)\n",
+			n, batch.m, batch.n);
+		return 0;
+	}
+	if (batch.kind != FMATRIX_GENERAL) {
+		printf("error while accumulating covariance: \nthe batch has to be a general matrix, unpack it first (fmatrix_unpack)\n");
+		return 0;
+	}
+	if (batch.m == 0) { return 1; }
+
+	// the batch's own mean, so its scatter is taken about a point close to its rows
+	double* mean_b = acc->scratch + COV_BLOCK_ROWS * n;
+	memset(mean_b, 0, n * sizeof(double));
+	for (int r = 0; r < batch.m; r++) {
+		for (int j = 0; j < n; j++) { mean_b[j] += MATRIX_AT(batch, r, j); }
+	}
+	for (int j = 0; j < n; j++) { mean_b[j] /= batch.m; }
+
+	// S += centered rows^t centered rows, a block of centered rows at a time, one band of S at a time (like fmatrix_syrk_in)
+	double* centered = acc->scratch;
+	for (int r0 = 0; r0 < batch.m; r0 += COV_BLOCK_ROWS) {
+		int rows = (r0 + COV_BLOCK_ROWS < batch.m) ? COV_BLOCK_ROWS : batch.m - r0;
+		for (int r = 0; r < rows; r++) {
+			for (int j = 0; j < n; j++) { centered[r * n + j] = MATRIX_AT(batch, r0 + r, j) - mean_b[j]; }
+		}
+		for (int i0 = 0; i0 < n; i0 += COV_BLOCK_ROWS) {
+			int i1 = (i0 + COV_BLOCK_ROWS < n) ? i0 + COV_BLOCK_ROWS : n;
+			for (int r = 0; r < rows; r++) {
+				const double* row = &centered[r * n];
+				for (int i = i0; i < i1; i++) {
+					double a = row[i];
+					if (a == 0.0) { continue; }
+					double* s_i = &acc->scatter[i * n];
+					for (int j = 0; j <= i; j++) { s_i[j] += a * row[j]; }
+				}
+			}
+		}
+	}
+
+	merge_totals(acc, mean_b, batch.m);
+	return 1;
+}
+
+// adds count rows of acc->n floats each, stored row major in rows
+//
+// fcov_add_rows(&acc, buffer, rows_read);
+int fcov_add_rows(fcov_accumulator* acc, const float* rows, int count) {
+	fmatrix batch = (fmatrix){ count, acc->n, (float*)rows, 0 };
+	return fcov_add_batch(acc, batch);
+}
+
+// adds everything other has accumulated into acc (other isn't modified). returns 1 on success
+//
+// fcov_merge(&totals, &per_thread[t]);
+int fcov_merge(fcov_accumulator* acc, const fcov_accumulator* other) {
+	int n = acc->n;
+	if (other->n != n || acc->mean == NULL || other->mean == NULL) {
+		printf("error while merging covariance accumulators: \n%d and %d variables\n", n, other->n);
+		return 0;
+	}
+	if (other->count == 0) { return 1; }
+
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j <= i; j++) { acc->scatter[i * n + j] += other->scatter[i * n + j]; }
+	}
+	merge_totals(acc, other->mean, other->count);
+	return 1;
+}
+
+
+// Results
+
+// returns the mean of every row so far as an n x 1 vector, allocated on frame
+//
+// fmatrix mu = fcov_mean(acc, &frame);
+fmatrix fcov_mean(fcov_accumulator acc, pool* frame) {
+	fmatrix result = fmatrix_create_zero(acc.n, 1, frame);
+	if (result.matrix == NULL) { return result; }
+	for (int i = 0; i < acc.n; i++) { result.matrix[i] = (float)acc.mean[i]; }
+	return result;
+}
+
+// returns the n x n covariance of every row so far, S / (count - ddof), allocated on frame. ddof = 1 gives the sample covariance
+// and ddof = 0 the population one. returns ERROR_FMATRIX if there are no more than ddof rows
+//
+// fmatrix C = fcov_covariance(acc, 1, &frame);
+fmatrix fcov_covariance(fcov_accumulator acc, int ddof, pool* frame) {
+	if (acc.count <= ddof) {
+		printf("error while computing covariance: \n%lld rows, need more than %d\n", acc.count, ddof);
+		return ERROR_FMATRIX;
+	}
+
+	int n = acc.n;
+	fmatrix result = fmatrix_create_zero(n, n, frame);
+	if (result.matrix == NULL) { return result; }
+
+	double scale = 1.0 / (double)(acc.count - ddof);
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j <= i; j++) {
+			float value = (float)(acc.scatter[i * n + j] * scale);
+			result.matrix[i * n + j] = value;
+			result.matrix[j * n + i] = value;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,50 @@
+#ifndef STREAMINGCOVARIANCE_H
+#define STREAMINGCOVARIANCE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "memoryPool.h"
+#include "matrix.h"
+
+// Streaming covariance
+// An fcov_accumulator keeps the mean and the scatter matrix S = sum of (x - mean)(x - mean)^t of every row it has been given,
+// so the covariance S / (count - ddof) is available at any point without the rows being stored.
+// Each batch is reduced on its own first (its mean, then the scatter of its rows about that mean, both in double), and then
+// merged into the running totals with Chan's pairwise update:
+//   delta = mean_b - mean_a,  mean = mean_a + delta * n_b / n,  S = S_a + S_b + delta delta^t * n_a n_b / n
+// which never subtracts two large sums the way E[xx^t] - mean mean^t does, so a large offset in the data costs no precision.
+// fcov_merge is the same update between two accumulators, so threads can each fill their own and combine them at the end.
+// Only the lower triangle of S is stored and updated, COV_BLOCK_ROWS centered rows at a time.
+//
+// fcov_accumulator acc = fcov_create(A.n, &frame);
+// while (read_rows(batch)) { fcov_add_batch(&acc, batch); }
+// fmatrix C = fcov_covariance(acc, 1, &frame);			// sample covariance
+
+// rows centered at a time before they're added to the scatter matrix. A band of S is updated with all of them at once, instead of
+// all of S streaming through cache once per row
+#define COV_BLOCK_ROWS 32
+
+typedef struct {
+	// number of variables (columns of the rows)
+	int n;
+	// rows accumulated so far
+	long long count;
+	// n means, and the n x n scatter matrix (row major, lower triangle only), allocated on a pool
+	double* mean;
+	double* scatter;
+	// COV_BLOCK_ROWS + 1 rows of n doubles: the batch mean and the centered rows of a block
+	double* scratch;
+}fcov_accumulator;
+
+fcov_accumulator fcov_create(int n, pool* frame);
+void fcov_reset(fcov_accumulator* acc);
+int fcov_add_batch(fcov_accumulator* acc, fmatrix batch);
+int fcov_add_rows(fcov_accumulator* acc, const float* rows, int count);
+int fcov_merge(fcov_accumulator* acc, const fcov_accumulator* other);
+
+fmatrix fcov_mean(fcov_accumulator acc, pool* frame);
+fmatrix fcov_covariance(fcov_accumulator acc, int ddof, pool* frame);
+
+#endif
@@ -0,0 +1,631 @@
+#include <string.h>
+
+#include "structuredMatrix.h"
+
+// Indexing
+
+// index into mat.matrix of [i][j], or -1 if the structure makes it 0
+// a transposed matrix is stored as its transpose, so the index is found for [j][i] of the stored shape instead
+static int packed_index(fmatrix mat, int i, int j) {
+	fmatrix_kind kind = (fmatrix_kind)mat.kind;
+	int cols = mat.n, kl = mat.kl, ku = mat.ku;
+	if (mat.transpose) {
+		intswap(&i, &j);
+		intswap(&kl, &ku);
+		cols = mat.m;
+		if (kind == FMATRIX_UPPER) { kind = FMATRIX_LOWER; }
+		else if (kind == FMATRIX_LOWER) { kind = FMATRIX_UPPER; }
+	}
+
+	switch (kind) {
+	case FMATRIX_GENERAL:
+		return i * cols + j;
+	case FMATRIX_SYMMETRIC:
+		if (j < i) { intswap(&i, &j); }
+		// fall through, the upper triangle is what's stored
+	case FMATRIX_UPPER:
+		return (j >= i) ? i * cols - i * (i - 1) / 2 + (j - i) : -1;
+	case FMATRIX_LOWER:
+		return (j <= i) ? i * (i + 1) / 2 + j : -1;
+	case FMATRIX_DIAGONAL:
+		return (i == j) ? i : -1;
+	case FMATRIX_BANDED:
+		return (j - i >= -kl && j - i <= ku) ? i * (kl + ku + 1) + (j - i + kl) : -1;
+	}
+	return -1;
+}
+
+// columns first to last - 1 of row i hold every element the structure allows to be nonzero (first >= last if there are none)
+static void row_range(fmatrix mat, int i, int* first, int* last) {
+	*first = 0;
+	*last = mat.n;
+	switch (mat.kind) {
+	case FMATRIX_UPPER:
+		*first = i;
+		break;
+	case FMATRIX_LOWER:
+		*last = i + 1;
+		break;
+	case FMATRIX_DIAGONAL:
+		*first = i;
+		*last = i + 1;
+		break;
+	case FMATRIX_BANDED:
+		if (i - mat.kl > 0) { *first = i - mat.kl; }
+		if (i + mat.ku + 1 < mat.n) { *last = i + mat.ku + 1; }
+		break;
+	}
+}
+
+// pointer to [i][first], if row i is stored contiguously from there to the end of its row_range. That's every row of a
+// non transposed matrix, except for the mirrored (j < i) part of a symmetric one. returns NULL otherwise
+static float* stored_row(fmatrix mat, int i, int first) {
+	if (mat.transpose && mat.kind != FMATRIX_DIAGONAL) { return NULL; }
+	if (mat.kind == FMATRIX_SYMMETRIC && first < i) { return NULL; }
+	int index = packed_index(mat, i, first);
+	return (index < 0) ? NULL : &mat.matrix[index];
+}
+
+// number of floats mat.matrix holds
+int fmatrix_stored_count(fmatrix mat) {
+	switch (mat.kind) {
+	case FMATRIX_UPPER:
+	case FMATRIX_LOWER:
+	case FMATRIX_SYMMETRIC:
+		return mat.n * (mat.n + 1) / 2;
+	case FMATRIX_DIAGONAL:
+		return mat.n;
+	case FMATRIX_BANDED:
+		return (mat.transpose ? mat.n : mat.m) * (mat.kl + mat.ku + 1);
+	}
+	return mat.m * mat.n;
+}
+
+// element [i][j] of a matrix of any kind, 0 where the structure says so
+//
+// float u01 = fmatrix_at(U, 0, 1);
+float fmatrix_at(fmatrix mat, int i, int j) {
+	if (mat.kind == FMATRIX_GENERAL) { return MATRIX_AT(mat, i, j); }
+	int index = packed_index(mat, i, j);
+	return (index < 0) ? 0.0f : mat.matrix[index];
+}
+
+// pointer to the stored element [i][j] (shared by [i][j] and [j][i] if mat is symmetric), or NULL if the structure fixes it at 0
+//
+// *fmatrix_ref(U, 0, 1) = 2.0f;
+float* fmatrix_ref(fmatrix mat, int i, int j) {
+	int index = packed_index(mat, i, j);
+	return (index < 0) ? NULL : &mat.matrix[index];
+}
+
+
+// Creation and conversion
+
+static fmatrix create_structured(int m, int n, fmatrix_kind kind, int kl, int ku, pool* frame) {
+	fmatrix mat = { m, n, NULL, 0, (uint8_t)kind, {0}, kl, ku };
+	int size = fmatrix_stored_count(mat) * sizeof(float);
+	if ((mat.matrix = raw_pool_alloc(frame, size)) == NULL) {
+		printf("pool allocation for packed matrix failed, returning error matrix\n");
+		return ERROR_FMATRIX;
+	}
+	memset(mat.matrix, 0, size);
+	return mat;
+}
+
+// creates an n x n upper, lower, symmetric or diagonal matrix of zeros, allocated on frame
+//
+// fmatrix L = fmatrix_create_packed(n, FMATRIX_LOWER, &frame);
+fmatrix fmatrix_create_packed(int n, fmatrix_kind kind, pool* frame) {
+	if (n < 0 || kind == FMATRIX_BANDED) {
+		printf("packed matrices are n x n (n >= 0) and not banded, use fmatrix_create_banded for those\n");
+		return ERROR_FMATRIX;
+	}
+	return create_structured(n, n, kind, 0, 0, frame);
+}
+
+// creates an m x n banded matrix of zeros with kl diagonals below the main one and ku above it, allocated on frame
+//
+// fmatrix T = fmatrix_create_banded(n, n, 1, 1, &frame);	// tridiagonal
+fmatrix fmatrix_create_banded(int m, int n, int kl, int ku, pool* frame) {
+	if (m < 0 || n < 0 || kl < 0 || ku < 0) {
+		printf("banded matrix must have positive row/columns and bandwidths\n");
+		return ERROR_FMATRIX;
+	}
+	return create_structured(m, n, FMATRIX_BANDED, kl, ku, frame);
+}
+
+// creates value * I, n x n, storing only the n diagonal elements
+//
+// fmatrix I = fmatrix_create_diagonal(n, 1.0f, &frame);
+fmatrix fmatrix_create_diagonal(int n, float value, pool* frame) {
+	fmatrix mat = fmatrix_create_packed(n, FMATRIX_DIAGONAL, frame);
+	if (mat.matrix == NULL) { return mat; }
+	for (int i = 0; i < n; i++) { mat.matrix[i] = value; }
+	return mat;
+}
+
+// fills every stored element of dst (fresh from create_structured) from src, which can be any kind
+static void copy_elements(fmatrix dst, fmatrix src) {
+	int first, last;
+	for (int i = 0; i < dst.m; i++) {
+		row_range(dst, i, &first, &last);
+		if (dst.kind == FMATRIX_SYMMETRIC) { first = i; }
+		if (first >= last) { continue; }
+		float* row = stored_row(dst, i, first);
+		for (int j = first; j < last; j++) { row[j - first] = fmatrix_at(src, i, j); }
+	}
+}
+
+// returns the packed kind version of mat (of any kind), allocated on frame. Elements outside the structure are dropped, and a
+// symmetric result keeps the upper triangle
+//
+// fmatrix U = fmatrix_pack(A, FMATRIX_UPPER, &frame);
+fmatrix fmatrix_pack(fmatrix mat, fmatrix_kind kind, pool* frame) {
+	if (kind != FMATRIX_GENERAL && mat.m != mat.n) {
+		printf("packing requires a square matrix (%d x %d)\n", mat.m, mat.n);
+		return ERROR_FMATRIX;
+	}
+	if (kind == FMATRIX_GENERAL) { return fmatrix_unpack(mat, frame); }
+	fmatrix result = fmatrix_create_packed(mat.n, kind, frame);
+	if (result.matrix == NULL) { return result; }
+	copy_elements(result, mat);
+	return result;
+}
+
+// returns the band of mat (of any kind) with kl diagonals below the main one and ku above it, allocated on frame
+//
+// fmatrix T = fmatrix_pack_banded(A, 1, 1, &frame);
+fmatrix fmatrix_pack_banded(fmatrix mat, int kl, int ku, pool* frame) {
+	fmatrix result = fmatrix_create_banded(mat.m, mat.n, kl, ku, frame);
+	if (result.matrix == NULL) { return result; }
+	copy_elements(result, mat);
+	return result;
+}
+
+// returns mat (of any kind) as a general, row major matrix, allocated on frame
+//
+// fmatrix A = fmatrix_unpack(U, &frame);
+fmatrix fmatrix_unpack(fmatrix mat, pool* frame) {
+	fmatrix result = fmatrix_create_zero(mat.m, mat.n, frame);
+	if (result.matrix == NULL) { return result; }
+	int first, last;
+	for (int i = 0; i < mat.m; i++) {
+		row_range(mat, i, &first, &last);
+		for (int j = first; j < last; j++) { result.matrix[i * mat.n + j] = fmatrix_at(mat, i, j); }
+	}
+	return result;
+}
+
+// splits a compact LU factorization into a packed L (with its unit diagonal) and a packed U, allocated on frame.
+// Together they're the same n^2 floats as F.LU, where fmatrix_LU_factorize returns 2n^2 for L and U
+//
+// fmatrix L, U;
+// flu_triangles(fmatrix_LU_decompose(A, &frame), &L, &U, &frame);
+void flu_triangles(flu F, fmatrix* L, fmatrix* U, pool* frame) {
+	int n = F.LU.n;
+	*L = fmatrix_create_packed(n, FMATRIX_LOWER, frame);
+	*U = fmatrix_create_packed(n, FMATRIX_UPPER, frame);
+	if (F.LU.matrix == NULL || L->matrix == NULL || U->matrix == NULL) {
+		printf("error while splitting LU factors\n");
+		*L = ERROR_FMATRIX;
+		*U = ERROR_FMATRIX;
+		return;
+	}
+	for (int i = 0; i < n; i++) {
+		const float* row = &F.LU.matrix[i * n];
+		float* l = stored_row(*L, i, 0);
+		memcpy(l, row, i * sizeof(float));
+		l[i] = 1.0f;
+		memcpy(stored_row(*U, i, i), &row[i], (n - i) * sizeof(float));
+	}
+}
+
+
+// Operations
+// fmatrix_transpose_in, fmatrix_add, fmatrix_multiply, ... call these when either input isn't general, after checking dimensions
+
+// symmetric and diagonal matrices are their own transposes, everything else flips like a general matrix, and its kind and
+// bandwidths are mirrored
+void fmatrix_structured_transpose_in(fmatrix* mat) {
+	if (mat->kind == FMATRIX_SYMMETRIC || mat->kind == FMATRIX_DIAGONAL) { return; }
+	intswap(&mat->m, &mat->n);
+	mat->transpose = !mat->transpose;
+	if (mat->kind == FMATRIX_UPPER) { mat->kind = FMATRIX_LOWER; }
+	else if (mat->kind == FMATRIX_LOWER) { mat->kind = FMATRIX_UPPER; }
+	intswap(&mat->kl, &mat->ku);
+}
+
+// same kind, bandwidths and storage order, so the two buffers line up element for element
+static int same_layout(fmatrix a, fmatrix b) {
+	if (a.kind != b.kind || a.kl != b.kl || a.ku != b.ku) { return 0; }
+	return a.transpose == b.transpose || a.kind == FMATRIX_SYMMETRIC || a.kind == FMATRIX_DIAGONAL;
+}
+
+// whether every element that can be nonzero in inner has a place in outer's storage
+static int contains(fmatrix outer, fmatrix inner) {
+	if (outer.kind == FMATRIX_GENERAL || inner.kind == FMATRIX_DIAGONAL) { return 1; }
+	if (inner.kind == FMATRIX_BANDED) {
+		if (outer.kind == FMATRIX_BANDED) { return inner.kl <= outer.kl && inner.ku <= outer.ku; }
+		return (outer.kind == FMATRIX_UPPER && inner.kl == 0) || (outer.kind == FMATRIX_LOWER && inner.ku == 0);
+	}
+	return inner.kind == outer.kind;
+}
+
+// matA += sign * matB, for matB's structure fitting in matA's (any B into a general A, a diagonal into anything, an upper
+// triangle into an upper triangle, ...). Matching layouts are added as flat buffers
+//
+// fmatrix_structured_add_in(A, fmatrix_create_diagonal(n, 1.0f, &frame), 1.0f);	// A += I
+void fmatrix_structured_add_in(fmatrix matA, fmatrix matB, float sign) {
+	if (same_layout(matA, matB)) {
+		int count = fmatrix_stored_count(matA);
+		for (int k = 0; k < count; k++) { matA.matrix[k] += sign * matB.matrix[k]; }
+		return;
+	}
+	if (!contains(matA, matB)) {
+		printf("error while adding: matrix b doesn't fit in the structure of matrix a, unpack a first\n");
+		return;
+	}
+	int first, last;
+	for (int i = 0; i < matB.m; i++) {
+		row_range(matB, i, &first, &last);
+		if (matA.kind == FMATRIX_SYMMETRIC && first < i) { first = i; }		// the mirrored half shares storage
+		for (int j = first; j < last; j++) { *fmatrix_ref(matA, i, j) += sign * fmatrix_at(matB, i, j); }
+	}
+}
+
+// returns matA + sign * matB allocated on frame, in the smallest structure that holds both (general if neither holds the other)
+//
+// fmatrix S = fmatrix_structured_add(U, D, 1.0f, &frame);	// still upper triangular
+fmatrix fmatrix_structured_add(fmatrix matA, fmatrix matB, float sign, pool* frame) {
+	fmatrix result;
+	if (contains(matA, matB)) {
+		if ((result = fmatrix_copy_alloc(matA, frame)).matrix == NULL) { return result; }
+		fmatrix_structured_add_in(result, matB, sign);
+	}
+	else if (contains(matB, matA)) {
+		if ((result = fmatrix_copy_alloc(matB, frame)).matrix == NULL) { return result; }
+		fmatrix_scale_in(result, sign);
+		fmatrix_structured_add_in(result, matA, 1.0f);
+	}
+	else {
+		if ((result = fmatrix_unpack(matA, frame)).matrix == NULL) { return result; }
+		fmatrix_structured_add_in(result, matB, sign);
+	}
+	return result;
+}
+
+// returns matA matB allocated on frame. Only the k where A[i][k] can be nonzero, and the j where B[k][j] can be, are visited, so
+// a triangular factor halves the work and a diagonal one makes it a scaling. Two upper (lower, diagonal) matrices give a packed
+// upper (lower, diagonal) product, anything else a general one
+//
+// fmatrix UB = fmatrix_structured_multiply(U, B, &frame);
+fmatrix fmatrix_structured_multiply(fmatrix matA, fmatrix matB, pool* frame) {
+	fmatrix_kind kind = FMATRIX_GENERAL;
+	if (matA.kind == matB.kind && (matA.kind == FMATRIX_UPPER || matA.kind == FMATRIX_LOWER || matA.kind == FMATRIX_DIAGONAL)) {
+		kind = (fmatrix_kind)matA.kind;
+	}
+	fmatrix result = (kind == FMATRIX_GENERAL) ? fmatrix_create_zero(matA.m, matB.n, frame) : fmatrix_create_packed(matA.m, kind, frame);
+	if (result.matrix == NULL) {
+		printf("error while multiplying: \npool allocation failure\n");
+		return ERROR_FMATRIX;
+	}
+
+	int k0, k1, j0, j1, c0, c1;
+	for (int i = 0; i < matA.m; i++) {
+		row_range(result, i, &c0, &c1);
+		if (c0 >= c1) { continue; }
+		float* c = stored_row(result, i, c0);		// the product row can only be nonzero where the rows of B it sums are
+
+		row_range(matA, i, &k0, &k1);
+		for (int k = k0; k < k1; k++) {
+			float a = fmatrix_at(matA, i, k);
+			if (a == 0.0f) { continue; }
+			row_range(matB, k, &j0, &j1);
+			// a symmetric row is contiguous from its diagonal on, and the part before it is gathered from its column
+			int split = (matB.kind == FMATRIX_SYMMETRIC) ? k : j0;
+			const float* b = (split < j1) ? stored_row(matB, k, split) : NULL;
+			int j = j0;
+			for (; j < (b ? split : j1); j++) { c[j - c0] += a * fmatrix_at(matB, k, j); }
+			if (b) {
+				for (; j < j1; j++) { c[j - c0] += a * b[j - split]; }
+			}
+		}
+	}
+	return result;
+}
+
+// solves AX = B for a structured A, and returns X (n x k, general) allocated on frame. Triangular and diagonal systems are
+// solved by substitution straight from the packed storage, and banded ones by fmatrix_banded_solve. Symmetric ones are copied
+// into a packed lower triangle and cholesky factored (half of LU's work, and no pivoting), and if A turns out not to be
+// positive definite, they are unpacked and LU factored instead. Either way only X is left on frame.
+// returns ERROR_FMATRIX if A is singular
+//
+// fmatrix X = fmatrix_structured_solve(L, B, &frame);
+fmatrix fmatrix_structured_solve(fmatrix A, fmatrix B, pool* frame) {
+	if (A.m != A.n || B.m != A.m) {
+		printf("Solving a system requires a square A and B with as many rows (A is %d x %d, B is %d x %d)\n", A.m, A.n, B.m, B.n);
+		return ERROR_FMATRIX;
+	}
+	int n = A.n, k = B.n;
+
+	if (A.kind == FMATRIX_BANDED) { return fmatrix_banded_solve(A, B, frame); }
+	if (A.kind == FMATRIX_SYMMETRIC) {
+		void* start = frame->ptr;
+		fmatrix L = fmatrix_create_packed(n, FMATRIX_LOWER, frame);
+		if (L.matrix == NULL) { return ERROR_FMATRIX; }
+		// the stored upper triangle of A, read by rows of the lower one
+		for (int i = 0; i < n; i++) {
+			for (int j = 0; j <= i; j++) { *fmatrix_ref(L, i, j) = fmatrix_at(A, i, j); }
+		}
+		if (fmatrix_cholesky_factorize_in(L)) {
+			fmatrix X = fmatrix_cholesky_solve(L, B, frame);
+			if (X.matrix == NULL) {
+				pool_free_from(frame, start);
+				return ERROR_FMATRIX;
+			}
+			X.matrix = pool_compact(frame, start, X.matrix, n * k * sizeof(float));
+			return X;
+		}
+		// not positive definite, so LU below
+		pool_free_from(frame, start);
+	}
+	if (A.kind != FMATRIX_UPPER && A.kind != FMATRIX_LOWER && A.kind != FMATRIX_DIAGONAL) {
+		void* start = frame->ptr;
+		fmatrix dense = fmatrix_unpack(A, frame);
+		if (dense.matrix == NULL) { return ERROR_FMATRIX; }
+		fmatrix X = flu_solve(fmatrix_LU_decompose(dense, frame), B, frame);
+		if (X.matrix == NULL) {
+			pool_free_from(frame, start);
+			return ERROR_FMATRIX;
+		}
+		// move X down over the factorization
+		X.matrix = pool_compact(frame, start, X.matrix, n * k * sizeof(float));
+		return X;
+	}
+
+	fmatrix X = fmatrix_create_zero(n, k, frame);
+	if (X.matrix == NULL) { return X; }
+
+	// whole rows of X at a time: x_i = (b_i - sum of a_ij x_j) / a_ii, top down for lower, bottom up for upper
+	int upper = (A.kind == FMATRIX_UPPER);
+	int first, last;
+	for (int step = 0; step < n; step++) {
+		int i = upper ? n - 1 - step : step;
+		float* x_i = &X.matrix[i * k];
+		for (int c = 0; c < k; c++) { x_i[c] = fmatrix_at(B, i, c); }
+
+		row_range(A, i, &first, &last);
+		for (int j = first; j < last; j++) {
+			float a = (j == i) ? 0.0f : fmatrix_at(A, i, j);
+			if (a == 0.0f) { continue; }
+			const float* x_j = &X.matrix[j * k];
+			for (int c = 0; c < k; c++) { x_i[c] -= a * x_j[c]; }
+		}
+
+		float diagonal = fmatrix_at(A, i, i);
+		if (diagonal == 0.0f) {
+			printf("structured solve failed: matrix is singular\n");
+			pool_free_from(frame, X.matrix);
+			return ERROR_FMATRIX;
+		}
+		float inverse = 1.0f / diagonal;
+		for (int c = 0; c < k; c++) { x_i[c] *= inverse; }
+	}
+	return X;
+}
+
+
+// Banded solvers
+// Both are O(n) for a fixed bandwidth, where a dense LU is O(n^3):
+//   - tridiagonal_solve_in is the Thomas algorithm: elimination without pivoting on three diagonals. It's stable when the matrix
+//     is diagonally dominant (or SPD), which spline and implicit PDE systems are, and tridiagonal_solve_batch runs it on many
+//     independent systems at once
+//   - fmatrix_banded_solve is LU with partial pivoting on band storage, like LAPACK's gbtrf/gbtrs. Row swaps let U grow kl
+//     diagonals past ku, so the factorization works on a copy with kl + (ku + kl) + 1 slots per row
+
+// [i][j] of a row major band with kl diagonals below the main one and width slots per row
+#define BAND_AT(a, width, kl, i, j) ((a)[(i) * (width) + (j) - (i) + (kl)])
+
+// solves a tridiagonal system in place with the Thomas algorithm. sub[i] is [i][i - 1] (sub[0] is unused), diag[i] is [i][i],
+// and super[i] is [i][i + 1] (super[n - 1] is unused). x holds the right hand side, and gets the solution. scratch holds n floats.
+// There's no pivoting, see above. returns 0 if a pivot came out 0 (x is garbage then), 1 otherwise
+//
+// tridiagonal_solve_in(n, sub, diag, super, x, scratch);
+int tridiagonal_solve_in(int n, const float* sub, const float* diag, const float* super, float* x, float* scratch) {
+	if (n <= 0) { return 1; }
+	float beta = diag[0];
+	if (beta == 0.0f) { return 0; }
+	x[0] /= beta;
+	// forward: scratch[i] is the multiplier of x[i] left in row i - 1 once its subdiagonal is eliminated
+	for (int i = 1; i < n; i++) {
+		scratch[i] = super[i - 1] / beta;
+		beta = diag[i] - sub[i] * scratch[i];
+		if (beta == 0.0f) { return 0; }
+		x[i] = (x[i] - sub[i] * x[i - 1]) / beta;
+	}
+	for (int i = n - 2; i >= 0; i--) { x[i] -= scratch[i + 1] * x[i + 1]; }
+	return 1;
+}
+
+// runs tridiagonal_solve_in on count independent n x n systems. Every array is interleaved: element i of system s is at
+// [i * count + s], so each step of the recurrence is one contiguous loop over the systems, which the compiler vectorizes (a
+// system per SIMD lane). scratch holds (n + 2) * count floats. Systems that hit a 0 pivot come out inf/NaN instead of stopping the
+// rest, and the number of them is returned
+//
+// int failed = tridiagonal_solve_batch(n, count, sub, diag, super, x, scratch);
+int tridiagonal_solve_batch(int n, int count, const float* sub, const float* diag, const float* super, float* x, float* scratch) {
+	if (n <= 0) { return 0; }
+	float* beta = scratch;
+	float* smallest = &scratch[count];
+	float* multiplier = &scratch[2 * count];		// multiplier[i * count + s], like scratch in tridiagonal_solve_in
+
+	for (int s = 0; s < count; s++) {
+		beta[s] = diag[s];
+		smallest[s] = fabsf(beta[s]);
+		x[s] /= beta[s];
+	}
+	for (int i = 1; i < n; i++) {
+		const float* l = &sub[i * count];
+		const float* d = &diag[i * count];
+		const float* u = &super[(i - 1) * count];
+		float* c = &multiplier[i * count];
+		float* x_i = &x[i * count];
+		const float* x_prev = &x[(i - 1) * count];
+		for (int s = 0; s < count; s++) {
+			c[s] = u[s] / beta[s];
+			beta[s] = d[s] - l[s] * c[s];
+			smallest[s] = fminf(smallest[s], fabsf(beta[s]));
+			x_i[s] = (x_i[s] - l[s] * x_prev[s]) / beta[s];
+		}
+	}
+	for (int i = n - 2; i >= 0; i--) {
+		const float* c = &multiplier[(i + 1) * count];
+		const float* x_next = &x[(i + 1) * count];
+		float* x_i = &x[i * count];
+		for (int s = 0; s < count; s++) { x_i[s] -= c[s] * x_next[s]; }
+	}
+
+	int failed = 0;
+	for (int s = 0; s < count; s++) { failed += (smallest[s] == 0.0f); }
+	return failed;
+}
+
+// whether every row of a tridiagonal A has |[i][i]| >= |[i][i - 1]| + |[i][i + 1]|, which makes the Thomas algorithm safe
+static int diagonally_dominant(fmatrix A) {
+	for (int i = 0; i < A.n; i++) {
+		float off = 0.0f;
+		if (i > 0) { off += fabsf(fmatrix_at(A, i, i - 1)); }
+		if (i + 1 < A.n) { off += fabsf(fmatrix_at(A, i, i + 1)); }
+		if (fabsf(fmatrix_at(A, i, i)) < off) { return 0; }
+	}
+	return 1;
+}
+
+// solves AX = B for a banded n x n A (fmatrix_create_banded/fmatrix_pack_banded, transposed or not), and returns X (n x k)
+// allocated on frame. Diagonally dominant tridiagonal matrices go through the Thomas algorithm, and everything else through a
+// partial pivoting band LU in O(n kl (kl + ku)). B can be packed too. Only X is left on frame.
+// returns ERROR_FMATRIX if A is singular
+//
+// fmatrix T = fmatrix_pack_banded(A, 1, 1, &frame);
+// fmatrix x = fmatrix_banded_solve(T, b, &frame);
+fmatrix fmatrix_banded_solve(fmatrix A, fmatrix B, pool* frame) {
+	if (A.kind != FMATRIX_BANDED || A.m != A.n || B.m != A.n) {
+		printf("banded solve requires a square banded A and B with as many rows (A is %d x %d, B is %d x %d)\n", A.m, A.n, B.m, B.n);
+		return ERROR_FMATRIX;
+	}
+	int n = A.n, k = B.n, kl = A.kl, ku = A.ku;
+
+	fmatrix X = fmatrix_create_zero(n, k, frame);
+	if (X.matrix == NULL) { return X; }
+	for (int i = 0; i < n; i++) {
+		for (int c = 0; c < k; c++) { X.matrix[i * k + c] = fmatrix_at(B, i, c); }
+	}
+	void* workspace = frame->ptr;
+
+	if (kl == 1 && ku == 1 && diagonally_dominant(A)) {
+		float* diagonals = raw_pool_alloc(frame, 5 * n * sizeof(float));
+		if (diagonals == NULL) {
+			printf("error in banded solve: pool allocation failure\n");
+			pool_free_from(frame, X.matrix);
+			return ERROR_FMATRIX;
+		}
+		float* sub = diagonals;
+		float* diag = &diagonals[n];
+		float* super = &diagonals[2 * n];
+		float* column = &diagonals[3 * n];
+		float* scratch = &diagonals[4 * n];
+		for (int i = 0; i < n; i++) {
+			sub[i] = (i > 0) ? fmatrix_at(A, i, i - 1) : 0.0f;
+			diag[i] = fmatrix_at(A, i, i);
+			super[i] = (i + 1 < n) ? fmatrix_at(A, i, i + 1) : 0.0f;
+		}
+		for (int c = 0; c < k; c++) {
+			for (int i = 0; i < n; i++) { column[i] = X.matrix[i * k + c]; }
+			if (!tridiagonal_solve_in(n, sub, diag, super, column, scratch)) {
+				printf("banded solve failed: matrix is singular\n");
+				pool_free_from(frame, X.matrix);
+				return ERROR_FMATRIX;
+			}
+			for (int i = 0; i < n; i++) { X.matrix[i * k + c] = column[i]; }
+		}
+		pool_free_from(frame, workspace);
+		return X;
+	}
+
+	// kl rows below a pivot can be swapped up, which pushes U kl diagonals further right
+	int width = 2 * kl + ku + 1;
+	float* band = raw_pool_alloc(frame, n * width * sizeof(float));
+	int* ipiv = raw_pool_alloc(frame, n * sizeof(int));
+	if (band == NULL || ipiv == NULL) {
+		printf("error in banded solve: pool allocation failure\n");
+		pool_free_from(frame, X.matrix);
+		return ERROR_FMATRIX;
+	}
+	memset(band, 0, n * width * sizeof(float));
+	int first, last;
+	for (int i = 0; i < n; i++) {
+		row_range(A, i, &first, &last);
+		for (int j = first; j < last; j++) { BAND_AT(band, width, kl, i, j) = fmatrix_at(A, i, j); }
+	}
+
+	// factor. The multipliers are kept where they eliminated, and aren't swapped by later pivots (LAPACK's band convention), so the
+	// solve below replays each swap right before the elimination step it belongs to
+	for (int p = 0; p < n; p++) {
+		int rows_end = (p + kl + 1 < n) ? p + kl + 1 : n;
+		int cols_end = (p + ku + kl + 1 < n) ? p + ku + kl + 1 : n;
+		int pivot = p;
+		for (int i = p + 1; i < rows_end; i++) {
+			if (fabsf(BAND_AT(band, width, kl, i, p)) > fabsf(BAND_AT(band, width, kl, pivot, p))) { pivot = i; }
+		}
+		ipiv[p] = pivot;
+		if (BAND_AT(band, width, kl, pivot, p) == 0.0f) {
+			printf("banded solve failed: matrix is singular\n");
+			pool_free_from(frame, X.matrix);
+			return ERROR_FMATRIX;
+		}
+		if (pivot != p) {
+			for (int j = p; j < cols_end; j++) { fswap(&BAND_AT(band, width, kl, p, j), &BAND_AT(band, width, kl, pivot, j)); }
+		}
+
+		float inverse = 1.0f / BAND_AT(band, width, kl, p, p);
+		const float* u_p = &BAND_AT(band, width, kl, p, p);
+		for (int i = p + 1; i < rows_end; i++) {
+			float* a_i = &BAND_AT(band, width, kl, i, p);
+			float l = (a_i[0] *= inverse);
+			if (l == 0.0f) { continue; }
+			for (int j = 1; j < cols_end - p; j++) { a_i[j] -= l * u_p[j]; }
+		}
+	}
+
+	// LY = PB, swapping and eliminating whole rows of X like the factorization did
+	for (int p = 0; p < n; p++) {
+		float* x_p = &X.matrix[p * k];
+		if (ipiv[p] != p) {
+			float* x_pivot = &X.matrix[ipiv[p] * k];
+			for (int c = 0; c < k; c++) { fswap(&x_p[c], &x_pivot[c]); }
+		}
+		int rows_end = (p + kl + 1 < n) ? p + kl + 1 : n;
+		for (int i = p + 1; i < rows_end; i++) {
+			float l = BAND_AT(band, width, kl, i, p);
+			if (l == 0.0f) { continue; }
+			float* x_i = &X.matrix[i * k];
+			for (int c = 0; c < k; c++) { x_i[c] -= l * x_p[c]; }
+		}
+	}
+	// UX = Y, bottom up
+	for (int i = n - 1; i >= 0; i--) {
+		float* x_i = &X.matrix[i * k];
+		int cols_end = (i + ku + kl + 1 < n) ? i + ku + kl + 1 : n;
+		for (int j = i + 1; j < cols_end; j++) {
+			float u = BAND_AT(band, width, kl, i, j);
+			if (u == 0.0f) { continue; }
+			const float* x_j = &X.matrix[j * k];
+			for (int c = 0; c < k; c++) { x_i[c] -= u * x_j[c]; }
+		}
+		float inverse = 1.0f / BAND_AT(band, width, kl, i, i);
+		for (int c = 0; c < k; c++) { x_i[c] *= inverse; }
+	}
+
+	pool_free_from(frame, workspace);
+	return X;
+}
@@ -0,0 +1,57 @@
+#ifndef STRUCTUREDMATRIX_H
+#define STRUCTUREDMATRIX_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "memoryPool.h"
+#include "matrix.h"
+
+// Structured (packed) matrices
+// An fmatrix whose kind isn't FMATRIX_GENERAL only stores the elements its structure allows to be nonzero, row by row:
+//   - FMATRIX_UPPER:     row i holds columns i to n - 1, so it starts at i*n - i(i - 1)/2
+//   - FMATRIX_LOWER:     row i holds columns 0 to i, so it starts at i(i + 1)/2
+//   - FMATRIX_SYMMETRIC: stored like FMATRIX_UPPER, and [j][i] is read from [i][j]
+//   - FMATRIX_DIAGONAL:  element i is [i][i]
+//   - FMATRIX_BANDED:    row i holds columns i - kl to i + ku in kl + ku + 1 slots (LAPACK's band layout, by rows), so [i][j]
+//                        is at i*(kl + ku + 1) + j - i + kl. Slots that fall outside the matrix are kept but never read
+// kind, kl, ku, m and n always describe the matrix as it's read, and the transpose flag works like it does for a general one:
+// the packed rows of an upper triangle are the packed columns of its transpose, so fmatrix_transpose_in stays constant time and
+// just turns FMATRIX_UPPER into FMATRIX_LOWER (and swaps kl and ku).
+//
+// fmatrix_multiply, fmatrix_add, fmatrix_subtract (and their _in versions), fmatrix_scale, fmatrix_transpose, fmatrix_copy_alloc,
+// fmatrix_LU_solve and print_fmatrix check the kind and send structured matrices here, where only the stored elements are
+// visited. A triangle times a dense matrix is half the flops of the dense product, and a diagonal one is a row scaling.
+// Other functions expect general matrices, so fmatrix_unpack anything structured before handing it to them.
+//
+// fmatrix U = fmatrix_pack(A, FMATRIX_UPPER, &frame);		// n(n + 1)/2 floats instead of n^2
+// fmatrix UB = fmatrix_multiply(U, B, &frame);				// skips the zero triangle
+// fmatrix x = fmatrix_LU_solve(U, b, &frame);				// back substitution, no factorization
+//
+// Banded systems (tridiagonal ones included) are solved in O(n) by fmatrix_banded_solve, and tridiagonal_solve_in and
+// tridiagonal_solve_batch run the Thomas algorithm on raw diagonals, for code that solves lots of small systems
+
+fmatrix fmatrix_create_packed(int n, fmatrix_kind kind, pool* frame);
+fmatrix fmatrix_create_banded(int m, int n, int kl, int ku, pool* frame);
+fmatrix fmatrix_create_diagonal(int n, float value, pool* frame);
+fmatrix fmatrix_pack(fmatrix mat, fmatrix_kind kind, pool* frame);
+fmatrix fmatrix_pack_banded(fmatrix mat, int kl, int ku, pool* frame);
+fmatrix fmatrix_unpack(fmatrix mat, pool* frame);
+void flu_triangles(flu F, fmatrix* L, fmatrix* U, pool* frame);
+
+int fmatrix_stored_count(fmatrix mat);
+float fmatrix_at(fmatrix mat, int i, int j);
+float* fmatrix_ref(fmatrix mat, int i, int j);
+
+void fmatrix_structured_transpose_in(fmatrix* mat);
+void fmatrix_structured_add_in(fmatrix matA, fmatrix matB, float sign);
+fmatrix fmatrix_structured_add(fmatrix matA, fmatrix matB, float sign, pool* frame);
+fmatrix fmatrix_structured_multiply(fmatrix matA, fmatrix matB, pool* frame);
+fmatrix fmatrix_structured_solve(fmatrix A, fmatrix B, pool* frame);
+
+int tridiagonal_solve_in(int n, const float* sub, const float* diag, const float* super, float* x, float* scratch);
+int tridiagonal_solve_batch(int n, int count, const float* sub, const float* diag, const float* super, float* x, float* scratch);
+fmatrix fmatrix_banded_solve(fmatrix A, fmatrix B, pool* frame);
+
+#endif
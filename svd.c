@@ -0,0 +1,448 @@
+#include <float.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "svd.h"
+#include "qrFactorization.h"
+#include "structuredMatrix.h"
+#include "parallel.h"
+
+#if defined(__AVX__)
+#define SVD_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SVD_SSE2
+#include <emmintrin.h>
+#endif
+
+// |x|^2, |y|^2 and x^t y for two columns of count floats, accumulated in double
+// 4 (AVX) or 2 (SSE2) lanes of each sum, then the leftovers one by one
+static void column_dots(const float* x, const float* y, int count, double* alpha, double* beta, double* gamma) {
+	int i = 0;
+	double xx = 0.0, yy = 0.0, xy = 0.0;
+#if defined(SVD_AVX)
+	__m256d sxx = _mm256_setzero_pd(), syy = _mm256_setzero_pd(), sxy = _mm256_setzero_pd();
+	for (; i + 4 <= count; i += 4) {
+		__m256d a = _mm256_cvtps_pd(_mm_loadu_ps(&x[i]));
+		__m256d b = _mm256_cvtps_pd(_mm_loadu_ps(&y[i]));
+		sxx = _mm256_add_pd(sxx, _mm256_mul_pd(a, a));
+		syy = _mm256_add_pd(syy, _mm256_mul_pd(b, b));
+		sxy = _mm256_add_pd(sxy, _mm256_mul_pd(a, b));
+	}
+	double lanes[3][4];
+	_mm256_storeu_pd(lanes[0], sxx);
+	_mm256_storeu_pd(lanes[1], syy);
+	_mm256_storeu_pd(lanes[2], sxy);
+	xx = (lanes[0][0] + lanes[0][1]) + (lanes[0][2] + lanes[0][3]);
+	yy = (lanes[1][0] + lanes[1][1]) + (lanes[1][2] + lanes[1][3]);
+	xy = (lanes[2][0] + lanes[2][1]) + (lanes[2][2] + lanes[2][3]);
+#elif defined(SVD_SSE2)
+	__m128d sxx = _mm_setzero_pd(), syy = _mm_setzero_pd(), sxy = _mm_setzero_pd();
+	for (; i + 4 <= count; i += 4) {
+		__m128 xs = _mm_loadu_ps(&x[i]), ys = _mm_loadu_ps(&y[i]);
+		for (int half = 0; half < 2; half++) {
+			__m128d a = _mm_cvtps_pd(xs);
+			__m128d b = _mm_cvtps_pd(ys);
+			sxx = _mm_add_pd(sxx, _mm_mul_pd(a, a));
+			syy = _mm_add_pd(syy, _mm_mul_pd(b, b));
+			sxy = _mm_add_pd(sxy, _mm_mul_pd(a, b));
+			xs = _mm_movehl_ps(xs, xs);
+			ys = _mm_movehl_ps(ys, ys);
+		}
+	}
+	double lanes[3][2];
+	_mm_storeu_pd(lanes[0], sxx);
+	_mm_storeu_pd(lanes[1], syy);
+	_mm_storeu_pd(lanes[2], sxy);
+	xx = lanes[0][0] + lanes[0][1];
+	yy = lanes[1][0] + lanes[1][1];
+	xy = lanes[2][0] + lanes[2][1];
+#endif
+	for (; i < count; i++) {
+		xx += (double)x[i] * x[i];
+		yy += (double)y[i] * y[i];
+		xy += (double)x[i] * y[i];
+	}
+	*alpha = xx;
+	*beta = yy;
+	*gamma = xy;
+}
+
+// rotates columns x and y (count floats each) by the jacobi rotation (c, s)
+// x = c x - s y, y = s x + c y, 8 (AVX) or 4 (SSE2) elements at a time
+static void rotate_columns(float* x, float* y, int count, float c, float s) {
+	int i = 0;
+#if defined(SVD_AVX)
+	__m256 vc = _mm256_set1_ps(c), vs = _mm256_set1_ps(s);
+	for (; i + 8 <= count; i += 8) {
+		__m256 a = _mm256_loadu_ps(&x[i]), b = _mm256_loadu_ps(&y[i]);
+		_mm256_storeu_ps(&x[i], _mm256_sub_ps(_mm256_mul_ps(vc, a), _mm256_mul_ps(vs, b)));
+		_mm256_storeu_ps(&y[i], _mm256_add_ps(_mm256_mul_ps(vs, a), _mm256_mul_ps(vc, b)));
+	}
+#elif defined(SVD_SSE2)
+	__m128 vc = _mm_set1_ps(c), vs = _mm_set1_ps(s);
+	for (; i + 4 <= count; i += 4) {
+		__m128 a = _mm_loadu_ps(&x[i]), b = _mm_loadu_ps(&y[i]);
+		_mm_storeu_ps(&x[i], _mm_sub_ps(_mm_mul_ps(vc, a), _mm_mul_ps(vs, b)));
+		_mm_storeu_ps(&y[i], _mm_add_ps(_mm_mul_ps(vs, a), _mm_mul_ps(vc, b)));
+	}
+#endif
+	for (; i < count; i++) {
+		float a = x[i], b = y[i];
+		x[i] = c * a - s * b;
+		y[i] = s * a + c * b;
+	}
+}
+
+// one round of the round robin schedule. Its pairs share no columns, so they're split across threads
+typedef struct {
+	float* G;					// M x N, column major
+	float* W;					// N x N, column major. NULL without vectors
+	int M, N;
+	const int* round;
+	int slots;
+	float tol;
+	double negligible;
+	int* rotated;				// per pair: 1 if it was rotated
+}jacobi_round;
+
+// pairs begin to end - 1 of the round: seat i with seat slots - 1 - i
+static void jacobi_pairs(void* context, int begin, int end) {
+	jacobi_round* job = context;
+	int M = job->M, N = job->N;
+	for (int i = begin; i < end; i++) {
+		job->rotated[i] = 0;
+		int p = job->round[i], q = job->round[job->slots - 1 - i];
+		if (p >= N || q >= N) { continue; }			// sitting out this round
+		float* x = &job->G[p * M];
+		float* y = &job->G[q * M];
+
+		double alpha, beta, gamma;
+		column_dots(x, y, M, &alpha, &beta, &gamma);
+		if (gamma == 0.0 || fabs(gamma) <= job->tol * sqrt(alpha * beta) || alpha <= job->negligible || beta <= job->negligible) { continue; }
+
+		// rotation that zeroes the (p, q) element of B^t B
+		double zeta = (beta - alpha) / (2.0 * gamma);
+		double t = ((zeta >= 0.0) ? 1.0 : -1.0) / (fabs(zeta) + sqrt(1.0 + zeta * zeta));
+		float c = (float)(1.0 / sqrt(1.0 + t * t));
+		float s = c * (float)t;
+		rotate_columns(x, y, M, c, s);
+		if (job->W != NULL) { rotate_columns(&job->W[p * N], &job->W[q * N], N, c, s); }
+		job->rotated[i] = 1;
+	}
+}
+
+// fills columns have to total - 1 of the column major M x total array Q with unit vectors orthogonal to each other and to
+// columns 0 to have - 1 (which must already be orthonormal). Candidates are the standard basis vectors, orthogonalized twice
+// with modified gram schmidt, and kept if enough of them is left
+static void complete_orthonormal(float* Q, int M, int have, int total) {
+	int candidate = 0;
+	for (int j = have; j < total; j++) {
+		float* q = &Q[j * M];
+		while (candidate < M) {
+			memset(q, 0, M * sizeof(float));
+			q[candidate++] = 1.0f;
+			for (int pass = 0; pass < 2; pass++) {
+				for (int p = 0; p < j; p++) {
+					const float* other = &Q[p * M];
+					double dot = 0.0;
+					for (int i = 0; i < M; i++) { dot += (double)other[i] * q[i]; }
+					for (int i = 0; i < M; i++) { q[i] -= (float)dot * other[i]; }
+				}
+			}
+			double sum = 0.0;
+			for (int i = 0; i < M; i++) { sum += (double)q[i] * q[i]; }
+			if (sum > 0.01) {
+				float inverse = (float)(1.0 / sqrt(sum));
+				for (int i = 0; i < M; i++) { q[i] *= inverse; }
+				break;
+			}
+		}
+	}
+}
+
+// finds the singular values of A, and its singular vectors if want_vectors is set. thin picks U and V with min(m, n) columns,
+// otherwise they're square. tol is the convergence threshold: a pair of columns counts as orthogonal once the cosine of the
+// angle between them is below it (tol <= 0 uses sqrt(max(m, n)) * FLT_EPSILON).
+// U, V and values are allocated on frame. Columns of U for 0 singular values are filled in with an orthonormal completion.
+// upon failure, returns a result with NULL values
+//
+// fsvd S = fmatrix_svd(A, 1, 1, 0.0f, &frame);
+fsvd fmatrix_svd(fmatrix A, int want_vectors, int thin, float tol, pool* frame) {
+	fsvd result = { A.m, A.n, 0, NULL, ERROR_FMATRIX, ERROR_FMATRIX, 0 };
+	if (A.m < 1 || A.n < 1) {
+		printf("SVD requires a non empty matrix (%d x %d)\n", A.m, A.n);
+		return result;
+	}
+
+	// work on B = A, or B = A^t if A is wide, so B is M x N with M >= N
+	int swap = A.m < A.n;
+	int M = swap ? A.n : A.m;
+	int N = swap ? A.m : A.n;
+	if (tol <= 0.0f) { tol = sqrtf((float)M) * FLT_EPSILON; }
+
+	// results first. B = Ub S Vb^t, so U and V are Ub and Vb, or the other way around if A was swapped
+	int u_cols = thin ? N : A.m;
+	int v_cols = thin ? N : A.n;
+	void* start = frame->ptr;
+	float* values = raw_pool_alloc(frame, N * sizeof(float));
+	fmatrix U = want_vectors ? fmatrix_create_zero(A.m, u_cols, frame) : ERROR_FMATRIX;
+	fmatrix V = want_vectors ? fmatrix_create_zero(A.n, v_cols, frame) : ERROR_FMATRIX;
+
+	// workspace, all column major: column j of B is G[j * M] to G[j * M + M - 1]
+	void* workspace = frame->ptr;
+	int complete = thin ? N : M;			// columns of Ub that get returned
+	float* G = raw_pool_alloc(frame, M * N * sizeof(float));
+	float* W = want_vectors ? raw_pool_alloc(frame, N * N * sizeof(float)) : NULL;
+	float* Ub = want_vectors ? raw_pool_alloc(frame, M * complete * sizeof(float)) : NULL;
+	float* norms = raw_pool_alloc(frame, N * sizeof(float));
+	int* order = raw_pool_alloc(frame, (N + 1) * sizeof(int));
+	int* round = raw_pool_alloc(frame, (N + 1) * sizeof(int));
+	int* turned = raw_pool_alloc(frame, (N / 2 + 1) * sizeof(int));
+	if (values == NULL || (want_vectors && (U.matrix == NULL || V.matrix == NULL || W == NULL || Ub == NULL)) || G == NULL || norms == NULL ||
+		order == NULL || round == NULL || turned == NULL) {
+		printf("SVD error: pool allocation failure\n");
+		pool_free_from(frame, start);
+		return result;
+	}
+
+	// column j of B is row j of A if swapped, or column j of A otherwise. When that's contiguous in A's storage, it's copied
+	// straight across. Otherwise each stored row holds one element of every column of B, so scatter the rows instead.
+	// A packed A has neither layout, so it's read element by element
+	if (A.kind != FMATRIX_GENERAL) {
+		for (int j = 0; j < N; j++) {
+			for (int i = 0; i < M; i++) { G[j * M + i] = swap ? fmatrix_at(A, j, i) : fmatrix_at(A, i, j); }
+		}
+	}
+	else if (swap != A.transpose) {
+		memcpy(G, A.matrix, M * N * sizeof(float));
+	}
+	else {
+		for (int i = 0; i < M; i++) {
+			const float* row = &A.matrix[i * N];
+			for (int j = 0; j < N; j++) { G[j * M + i] = row[j]; }
+		}
+	}
+	if (want_vectors) {
+		memset(W, 0, N * N * sizeof(float));
+		for (int j = 0; j < N; j++) { W[j * N + j] = 1.0f; }
+	}
+
+	// round robin schedule: seat the columns around a table (plus an empty seat if N is odd), pair seat i with seat
+	// slots - 1 - i, then rotate everyone but seat 0
+	int slots = N + (N & 1);
+	for (int i = 0; i < slots; i++) { round[i] = i; }
+
+	// columns squeezed down to rounding noise are left alone, their angle with anything else is just noise too
+	double negligible = 0.0;
+	for (int i = 0; i < M * N; i++) { negligible += (double)G[i] * G[i]; }
+	negligible *= (double)FLT_EPSILON * FLT_EPSILON;
+
+	// about 5 M multiply adds per pair for the dots and the rotation, plus 4 N for V
+	jacobi_round job = { G, W, M, N, round, slots, tol, negligible, turned };
+	int min_pairs = PARALLEL_MIN_WORK / (5 * M + (want_vectors ? 4 * N : 0)) + 1;
+
+	int sweep, rotated = 1;
+	for (sweep = 0; sweep < SVD_MAX_SWEEPS && rotated; sweep++) {
+		rotated = 0;
+		for (int r = 0; r < slots - 1; r++) {
+			parallel_for(slots / 2, min_pairs, jacobi_pairs, &job);
+			for (int i = 0; i < slots / 2; i++) { rotated |= turned[i]; }
+
+			int last = round[slots - 1];
+			for (int i = slots - 1; i > 1; i--) { round[i] = round[i - 1]; }
+			round[1] = last;
+		}
+	}
+	if (rotated) { printf("SVD warning: not converged after %d sweeps\n", SVD_MAX_SWEEPS); }
+
+	// singular values are the column norms, sorted descending
+	for (int j = 0; j < N; j++) {
+		double sum = 0.0;
+		const float* g = &G[j * M];
+		for (int i = 0; i < M; i++) { sum += (double)g[i] * g[i]; }
+		norms[j] = (float)sqrt(sum);
+		order[j] = j;
+	}
+	for (int i = 1; i < N; i++) {
+		int key = order[i];
+		int j = i - 1;
+		while (j >= 0 && norms[order[j]] < norms[key]) {
+			order[j + 1] = order[j];
+			j--;
+		}
+		order[j + 1] = key;
+	}
+	for (int j = 0; j < N; j++) { values[j] = norms[order[j]]; }
+
+	if (want_vectors) {
+		// Ub: the normalized columns in sorted order, completed with an orthonormal basis past the numerical rank
+		int rank = 0;
+		for (int j = 0; j < N; j++) {
+			if (values[j] > values[0] * M * FLT_EPSILON) { rank = j + 1; }
+		}
+		for (int j = 0; j < rank; j++) {
+			const float* g = &G[order[j] * M];
+			float* u = &Ub[j * M];
+			float inverse = 1.0f / values[j];
+			for (int i = 0; i < M; i++) { u[i] = g[i] * inverse; }
+		}
+		complete_orthonormal(Ub, M, rank, complete);
+
+		// back to the caller's row major layout. Vb is column order[j] of W
+		fmatrix big = swap ? V : U;			// M x complete
+		fmatrix small = swap ? U : V;		// N x N
+		for (int i = 0; i < M; i++) {
+			for (int j = 0; j < complete; j++) { big.matrix[i * complete + j] = Ub[j * M + i]; }
+		}
+		for (int i = 0; i < N; i++) {
+			for (int j = 0; j < N; j++) { small.matrix[i * N + j] = W[order[j] * N + i]; }
+		}
+	}
+
+	result.k = N;
+	result.values = values;
+	result.U = U;
+	result.V = V;
+	result.sweeps = sweep;
+	pool_free_from(frame, workspace);
+	return result;
+}
+
+svd_operator svd_operator_from_fmatrix(fmatrix A) {
+	svd_operator op = { OPERATOR_DENSE, A.m, A.n, A, NULL, NULL, NULL };
+	return op;
+}
+
+svd_operator svd_operator_from_callback(int m, int n, operator_apply apply, operator_apply apply_transpose, void* context) {
+	svd_operator op = { OPERATOR_CALLBACK, m, n, ERROR_FMATRIX, apply, apply_transpose, context };
+	return op;
+}
+
+// splitmix64, so the sketch only depends on the seed
+static uint64_t next_random(uint64_t* state) {
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+// fills values with count standard normal samples (box muller)
+static void fill_gaussian(float* values, int count, uint64_t* state) {
+	const double two_pi = 6.283185307179586;
+	for (int i = 0; i < count; i += 2) {
+		double u1 = ((double)(next_random(state) >> 11) + 1.0) * (1.0 / 9007199254740992.0);	// (0, 1]
+		double u2 = (double)(next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+		double radius = sqrt(-2.0 * log(u1));
+		values[i] = (float)(radius * cos(two_pi * u2));
+		if (i + 1 < count) { values[i + 1] = (float)(radius * sin(two_pi * u2)); }
+	}
+}
+
+// A X, or A^t X if transpose is set. Dense operators go through fmatrix_multiply, callbacks are applied column by column
+static fmatrix operator_times(svd_operator A, fmatrix X, int transpose, pool* frame) {
+	if (A.kind == OPERATOR_DENSE) {
+		fmatrix view = A.dense;
+		if (transpose) { fmatrix_transpose_in(&view); }
+		return fmatrix_multiply(view, X, frame);
+	}
+
+	int rows = transpose ? A.n : A.m;
+	int cols = transpose ? A.m : A.n;
+	operator_apply apply = transpose ? A.apply_transpose : A.apply;
+	void* start = frame->ptr;
+	fmatrix Y = fmatrix_create_zero(rows, X.n, frame);
+	void* workspace = frame->ptr;
+	float* x = raw_pool_alloc(frame, cols * sizeof(float));
+	float* y = raw_pool_alloc(frame, rows * sizeof(float));
+	if (Y.matrix == NULL || x == NULL || y == NULL) {
+		printf("randomized SVD error: pool allocation failure\n");
+		pool_free_from(frame, start);
+		return ERROR_FMATRIX;
+	}
+	for (int j = 0; j < X.n; j++) {
+		for (int i = 0; i < cols; i++) { x[i] = MATRIX_AT(X, i, j); }
+		apply(A.context, x, y);
+		for (int i = 0; i < rows; i++) { Y.matrix[i * X.n + j] = y[i]; }
+	}
+	pool_free_from(frame, workspace);
+	return Y;
+}
+
+// replaces Y with an orthonormal basis of its columns, moved down to start so every pass reuses the same space
+static fmatrix orthonormal_basis(fmatrix Y, void* start, pool* frame) {
+	if (Y.matrix == NULL) { return ERROR_FMATRIX; }
+	fqr F = fmatrix_QR_factorize(Y, frame);
+	fmatrix Q = (F.QR.matrix != NULL) ? fqr_Q(F, frame) : ERROR_FMATRIX;
+	if (Q.matrix == NULL) { return ERROR_FMATRIX; }
+
+	int size = Q.m * Q.n * sizeof(float);
+	Q.matrix = pool_compact(frame, start, Q.matrix, size);
+	return Q;
+}
+
+// finds the k largest singular values of A, with their singular vectors (U is m x k, V is n x k). power_iterations of 1 or 2
+// is usually plenty. Only the results stay on the pool. upon failure, returns a result with NULL values
+//
+// fsvd top = fmatrix_randomized_svd(svd_operator_from_fmatrix(A), 10, 2, 1, &frame);
+fsvd fmatrix_randomized_svd(svd_operator A, int k, int power_iterations, unsigned int seed, pool* frame) {
+	fsvd result = { A.m, A.n, 0, NULL, ERROR_FMATRIX, ERROR_FMATRIX, 0 };
+	int smaller = (A.m < A.n) ? A.m : A.n;
+	if (k < 1 || k > smaller) {
+		printf("randomized SVD requires 1 <= k <= min(m, n) (k = %d, A is %d x %d)\n", k, A.m, A.n);
+		return result;
+	}
+	if (A.kind == OPERATOR_CALLBACK && (A.apply == NULL || A.apply_transpose == NULL)) {
+		printf("randomized SVD requires both A x and A^t x callbacks\n");
+		return result;
+	}
+	int width = (k + RSVD_OVERSAMPLE < smaller) ? k + RSVD_OVERSAMPLE : smaller;
+
+	void* start = frame->ptr;
+	float* values = raw_pool_alloc(frame, k * sizeof(float));
+	fmatrix U = fmatrix_create_zero(A.m, k, frame);
+	fmatrix V = fmatrix_create_zero(A.n, k, frame);
+	void* workspace = frame->ptr;
+	fmatrix Omega = fmatrix_create_zero(A.n, width, frame);
+	if (values == NULL || U.matrix == NULL || V.matrix == NULL || Omega.matrix == NULL) {
+		printf("randomized SVD error: pool allocation failure\n");
+		pool_free_from(frame, start);
+		return result;
+	}
+
+	uint64_t state = seed ? seed : (uint64_t)time(NULL) ^ ((uint64_t)clock() << 32);
+	fill_gaussian(Omega.matrix, A.n * width, &state);
+
+	// range finder. Q is always the only thing left in the workspace between steps
+	fmatrix Q = orthonormal_basis(operator_times(A, Omega, 0, frame), workspace, frame);
+	for (int iteration = 0; iteration < power_iterations && Q.matrix != NULL; iteration++) {
+		fmatrix Z = orthonormal_basis(operator_times(A, Q, 1, frame), workspace, frame);
+		Q = (Z.matrix != NULL) ? orthonormal_basis(operator_times(A, Z, 0, frame), workspace, frame) : ERROR_FMATRIX;
+	}
+
+	// B^t = A^t Q is n x width, so it's tall and its SVD is B^t = W S X^t. Then A ~ Q B = (Q X) S W^t
+	fmatrix Bt = (Q.matrix != NULL) ? operator_times(A, Q, 1, frame) : ERROR_FMATRIX;
+	fsvd small = (Bt.matrix != NULL) ? fmatrix_svd(Bt, 1, 1, 0.0f, frame) : result;
+	fmatrix QX = (small.values != NULL) ? fmatrix_multiply(Q, small.V, frame) : ERROR_FMATRIX;
+	if (QX.matrix == NULL) {
+		printf("randomized SVD error: failed to build the small SVD\n");
+		pool_free_from(frame, start);
+		return result;
+	}
+
+	memcpy(values, small.values, k * sizeof(float));
+	for (int i = 0; i < A.m; i++) {
+		for (int j = 0; j < k; j++) { U.matrix[i * k + j] = MATRIX_AT(QX, i, j); }
+	}
+	for (int i = 0; i < A.n; i++) {
+		for (int j = 0; j < k; j++) { V.matrix[i * k + j] = MATRIX_AT(small.U, i, j); }
+	}
+
+	result.k = k;
+	result.values = values;
+	result.U = U;
+	result.V = V;
+	result.sweeps = small.sweeps;
+	pool_free_from(frame, workspace);
+	return result;
+}
@@ -0,0 +1,64 @@
+#ifndef SVD_H
+#define SVD_H
+
+#include "memoryPool.h"
+#include "matrix.h"
+#include "iterativeSolvers.h"
+
+// Singular value decomposition, A = U diag(values) V^t, by one sided Jacobi
+// Columns of a working copy of A are rotated in pairs until they're all orthogonal to each other. Then their norms are the
+// singular values, the normalized columns are U, and the product of the rotations is V. It's slower than bidiagonalization
+// methods but simple, and it finds small singular values to high relative accuracy.
+//
+// Each sweep visits every pair of columns in round robin order: n - 1 rounds of n / 2 pairs, where no column shows up twice in a
+// round, so the rotations within a round are independent of each other and each round is split across threads (see
+// parallel.h). Columns are kept contiguous, so each rotation is a pair of streaming loops, vectorized with AVX or SSE2 when the
+// compiler targets them. Results are the same for any number of threads.
+// If A is wide (m < n), A^t is decomposed instead and U and V trade places. Either way, the working copy is read straight from
+// A's storage, so transposed inputs don't need to be materialized first (packed ones are read through fmatrix_at).
+//
+// fsvd S = fmatrix_svd(A, 1, 1, 0.0f, &frame);	// thin U and V, default tolerance
+// float condition = S.values[0] / S.values[S.k - 1];
+
+// Randomized truncated SVD (Halko, Martinsson, Tropp), for when only the k largest singular triplets are needed
+//   1) sketch: Y = A Omega, where Omega is n x (k + RSVD_OVERSAMPLE) and gaussian. Y's columns span most of A's dominant range
+//   2) power iterations: Y = A (A^t Q), re-orthonormalized with QR every time. Each one sharpens the decay of the spectrum, which
+//      helps when the singular values fall off slowly
+//   3) Q = orthonormal basis of Y, then a small dense SVD of B = Q^t A. U = Q U_B
+// A only ever shows up in products A X and A^t X, so it can be a dense fmatrix (which goes through fmatrix_multiply), or a
+// pair of callbacks that never store A at all. seed fixes the gaussian sketch so results are reproducible (0 picks one from
+// the clock).
+//
+// svd_operator op = svd_operator_from_fmatrix(A);
+// fsvd top = fmatrix_randomized_svd(op, 50, 2, 1234, &frame);	// top 50 triplets, 2 power iterations
+
+#define SVD_MAX_SWEEPS 30
+#define RSVD_OVERSAMPLE 10
+
+typedef struct {
+	int m, n;
+	int k;						// number of singular values, min(m, n)
+	float* values;				// descending
+	fmatrix U;					// m x k if thin, m x m if not. ERROR_FMATRIX if vectors weren't asked for
+	fmatrix V;					// n x k if thin, n x n if not. ERROR_FMATRIX if vectors weren't asked for
+	int sweeps;					// sweeps it took to converge
+}fsvd;
+
+// A for the randomized SVD. Callbacks are operator_apply: apply computes y = Ax (x has n elements, y has m), and
+// apply_transpose computes y = A^t x (x has m elements, y has n)
+typedef struct {
+	operator_kind kind;			// OPERATOR_DENSE or OPERATOR_CALLBACK
+	int m, n;
+	fmatrix dense;
+	operator_apply apply;
+	operator_apply apply_transpose;
+	void* context;
+}svd_operator;
+
+fsvd fmatrix_svd(fmatrix A, int want_vectors, int thin, float tol, pool* frame);
+
+svd_operator svd_operator_from_fmatrix(fmatrix A);
+svd_operator svd_operator_from_callback(int m, int n, operator_apply apply, operator_apply apply_transpose, void* context);
+fsvd fmatrix_randomized_svd(svd_operator A, int k, int power_iterations, unsigned int seed, pool* frame);
+
+#endif
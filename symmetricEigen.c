@@ -0,0 +1,673 @@
+#include <float.h>
+
+#include "symmetricEigen.h"
+#include "structuredMatrix.h"
+#include "parallel.h"
+
+// Tridiagonal reduction
+
+// one step of the reduction, shared by the row bodies below
+typedef struct {
+	float* a22;					// trailing block, row stride n
+	int n;
+	int len;					// size of the trailing block
+	float t;					// tau of the reflector
+	const float* v;
+	float* p;
+}tridiagonal_step;
+
+// p = tau A22 v, rows begin to end - 1
+static void tridiagonal_product(void* context, int begin, int end) {
+	tridiagonal_step* step = context;
+	for (int r = begin; r < end; r++) {
+		const float* row = &step->a22[r * step->n];
+		float dot = 0.0f;
+		for (int c = 0; c < step->len; c++) { dot += row[c] * step->v[c]; }
+		step->p[r] = step->t * dot;
+	}
+}
+
+// A22 -= v w^t + w v^t, rows begin to end - 1 (w is in p)
+static void tridiagonal_rank2(void* context, int begin, int end) {
+	tridiagonal_step* step = context;
+	const float* v = step->v;
+	const float* w = step->p;
+	for (int r = begin; r < end; r++) {
+		float* row = &step->a22[r * step->n];
+		float v_r = v[r], w_r = w[r];
+		for (int c = 0; c < step->len; c++) { row[c] -= v_r * w[c] + w_r * v[c]; }
+	}
+}
+
+// reduces the symmetric n x n row major array a to tridiagonal form (diagonal d, off diagonal e) with householder reflectors
+// H_j, one per column. The vector of H_j is kept below the subdiagonal of column j (its leading 1 is implied), and its scale
+// in tau[j]. Both triangles of a must be filled in. v needs n floats, p needs n
+static void tridiagonalize(float* a, int n, float* d, float* e, float* tau, float* v, float* p) {
+	for (int j = 0; j < n - 2; j++) {
+		int len = n - j - 1;
+		float* column = &a[(j + 1) * n + j];
+
+		// reflector that zeroes column j below the subdiagonal
+		float alpha = column[0];
+		float scale = 0.0f;
+		for (int i = 1; i < len; i++) { scale = fmaxf(scale, fabsf(column[i * n])); }
+		d[j] = a[j * n + j];
+		if (scale == 0.0f) {
+			e[j] = alpha;
+			tau[j] = 0.0f;
+			continue;
+		}
+		scale = fmaxf(scale, fabsf(alpha));
+		float sum = 0.0f;
+		for (int i = 0; i < len; i++) {
+			float x = column[i * n] / scale;
+			sum += x * x;
+		}
+		float beta = (alpha >= 0.0f) ? -scale * sqrtf(sum) : scale * sqrtf(sum);
+		float t = (beta - alpha) / beta;
+		float inverse = 1.0f / (alpha - beta);
+		v[0] = 1.0f;
+		for (int i = 1; i < len; i++) {
+			column[i * n] *= inverse;
+			v[i] = column[i * n];
+		}
+		e[j] = beta;
+		tau[j] = t;
+
+		// A22 = H A22 H. With p = tau A22 v and w = p - (tau / 2)(p^t v) v, that's A22 -= v w^t + w v^t
+		// both are split by rows across threads once the block is big enough
+		tridiagonal_step step = { &a[(j + 1) * n + j + 1], n, len, t, v, p };
+		int min_rows = PARALLEL_MIN_WORK / (2 * len) + 1;
+		parallel_for(len, min_rows, tridiagonal_product, &step);
+		float pv = 0.0f;
+		for (int r = 0; r < len; r++) { pv += p[r] * v[r]; }
+		float k = 0.5f * t * pv;
+		for (int r = 0; r < len; r++) { p[r] -= k * v[r]; }
+		parallel_for(len, min_rows, tridiagonal_rank2, &step);
+	}
+	if (n >= 2) {
+		d[n - 2] = a[(n - 2) * n + n - 2];
+		e[n - 2] = a[(n - 1) * n + n - 2];
+	}
+	d[n - 1] = a[(n - 1) * n + n - 1];
+}
+
+typedef struct {
+	const float* a;
+	int n;
+	const float* tau;
+	float* Z;
+	int count;
+	float* w;
+}reflector_columns;
+
+// applies every reflector to columns begin to end - 1 of Z. The columns don't mix, so each chunk runs the whole sequence on
+// its own slice of Z and of w
+static void apply_reflector_columns(void* context, int begin, int end) {
+	reflector_columns* work = context;
+	const float* a = work->a;
+	int n = work->n, count = work->count;
+	float* w = work->w;
+	for (int j = n - 3; j >= 0; j--) {
+		if (work->tau[j] == 0.0f) { continue; }
+		// rows j + 1 and down, with v[0] = 1
+		float* top = &work->Z[(j + 1) * count];
+		for (int c = begin; c < end; c++) { w[c] = top[c]; }
+		for (int i = j + 2; i < n; i++) {
+			float v = a[i * n + j];
+			if (v == 0.0f) { continue; }
+			const float* row = &work->Z[i * count];
+			for (int c = begin; c < end; c++) { w[c] += v * row[c]; }
+		}
+		for (int c = begin; c < end; c++) { top[c] -= work->tau[j] * w[c]; }
+		for (int i = j + 2; i < n; i++) {
+			float v = work->tau[j] * a[i * n + j];
+			if (v == 0.0f) { continue; }
+			float* row = &work->Z[i * count];
+			for (int c = begin; c < end; c++) { row[c] -= v * w[c]; }
+		}
+	}
+}
+
+// Z = H_0 H_1 ... H_(n-3) Z, for the n x count row major Z, split by columns across threads. w needs count floats
+static void apply_tridiagonal_reflectors(const float* a, int n, const float* tau, float* Z, int count, float* w) {
+	reflector_columns work = { a, n, tau, Z, count, w };
+	// about n^2 multiply adds per column, and a chunk of at least a cache line of columns so threads don't share one
+	int min_columns = PARALLEL_MIN_WORK / (n * n + 1) + 1;
+	if (min_columns < 16) { min_columns = 16; }
+	parallel_for(count, min_columns, apply_reflector_columns, &work);
+}
+
+
+// Divide and conquer
+
+// workspace for the merge step, sized for the whole problem once
+typedef struct {
+	int n;						// row length of Q
+	float* Qs;					// len x len: columns of the block, sorted by eigenvalue, then rotated by deflation
+	float* Qn;					// len x len: new eigenvectors
+	float* U;					// k x k: eigenvectors of the rank one update
+	float* ds;					// sorted eigenvalues
+	float* zs;					// sorted update vector
+	float* values;				// new eigenvalues (unsorted)
+	int* index;					// sort orders
+	int* kept;					// non deflated positions
+	int* deflated;
+	int* origin;				// secular roots: the pole each root is measured from
+	double* offset;				// secular roots: distance from that pole
+	double* zhat;
+	float* e;					// scratch copy of the off diagonal for a small block
+}dc_work;
+
+// implicit QL on the len x len block of T starting at s, with eigenvectors accumulated into the same block of Q (which starts as
+// identity). d and e are the whole diagonal/off diagonal. returns 0 if it fails to converge
+static int tridiagonal_ql(float* d, const float* e_full, float* Q, int n, int s, int len, float* e) {
+	float* dd = &d[s];
+	float* q = &Q[s * n + s];
+	for (int i = 0; i < len - 1; i++) { e[i] = e_full[s + i]; }
+	e[len - 1] = 0.0f;
+
+	for (int l = 0; l < len; l++) {
+		int iterations = 0;
+		while (1) {
+			int m;
+			for (m = l; m < len - 1; m++) {
+				float scale = fabsf(dd[m]) + fabsf(dd[m + 1]);
+				if (fabsf(e[m]) <= FLT_EPSILON * scale) { break; }
+			}
+			if (m == l) { break; }
+			if (iterations++ == 60) { return 0; }
+
+			// wilkinson shift, then chase the bulge from m back to l
+			float g = (dd[l + 1] - dd[l]) / (2.0f * e[l]);
+			float r = hypotf(g, 1.0f);
+			g = dd[m] - dd[l] + e[l] / (g + copysignf(r, g));
+			float s_ = 1.0f, c = 1.0f, p = 0.0f;
+			int i;
+			for (i = m - 1; i >= l; i--) {
+				float f = s_ * e[i];
+				float b = c * e[i];
+				e[i + 1] = (r = hypotf(f, g));
+				if (r == 0.0f) {
+					dd[i + 1] -= p;
+					e[m] = 0.0f;
+					break;
+				}
+				s_ = f / r;
+				c = g / r;
+				g = dd[i + 1] - p;
+				r = (dd[i] - g) * s_ + 2.0f * c * b;
+				p = s_ * r;
+				dd[i + 1] = g + p;
+				g = c * r - b;
+				for (int k = 0; k < len; k++) {
+					float* row = &q[k * n];
+					f = row[i + 1];
+					row[i + 1] = s_ * row[i] + c * f;
+					row[i] = c * row[i] - s_ * f;
+				}
+			}
+			if (r == 0.0f && i >= l) { continue; }
+			dd[l] -= p;
+			e[l] = g;
+			e[m] = 0.0f;
+		}
+	}
+
+	// ascending order
+	for (int i = 0; i < len - 1; i++) {
+		int smallest = i;
+		for (int j = i + 1; j < len; j++) {
+			if (dd[j] < dd[smallest]) { smallest = j; }
+		}
+		if (smallest == i) { continue; }
+		fswap(&dd[i], &dd[smallest]);
+		for (int k = 0; k < len; k++) { fswap(&q[k * n + i], &q[k * n + smallest]); }
+	}
+	return 1;
+}
+
+// secular function f(x) = 1 + rho sum z_i^2 / (d_i - x), with x = d[origin] + offset. Differences to the poles are taken
+// relative to the origin, so roots right next to a pole keep their accuracy. Also returns f'(x)
+static double secular(const float* d, const float* z, int k, float rho, int origin, double offset, double* derivative) {
+	double f = 1.0, df = 0.0;
+	for (int i = 0; i < k; i++) {
+		double delta = ((double)d[i] - d[origin]) - offset;
+		double t = (double)z[i] / delta;
+		f += rho * z[i] * t;
+		df += rho * t * t;
+	}
+	*derivative = df;
+	return f;
+}
+
+// finds the root of the secular equation between d[j] and d[j + 1] (or past d[k - 1], for the last one). Bisection safeguarded
+// newton, in double. The result is stored as the nearest pole and the distance from it
+static void secular_root(const float* d, const float* z, int k, float rho, int j, int* origin, double* offset) {
+	double width;
+	if (j < k - 1) { width = (double)d[j + 1] - d[j]; }
+	else {
+		double zz = 0.0;
+		for (int i = 0; i < k; i++) { zz += (double)z[i] * z[i]; }
+		width = rho * zz;
+	}
+
+	// measure from whichever pole the root is closer to. f increases from -inf to +inf between the poles, so the sign of f at
+	// the midpoint says which half the root is in. The last root is always measured from d[k - 1]
+	double derivative;
+	int o = j;
+	double lo = 0.0, hi = width;
+	if (j < k - 1) {
+		hi = width / 2.0;
+		if (secular(d, z, k, rho, j, hi, &derivative) < 0.0) {
+			o = j + 1;
+			lo = -width / 2.0;
+			hi = 0.0;
+		}
+	}
+	double x = 0.5 * (lo + hi);
+
+	for (int iteration = 0; iteration < 200; iteration++) {
+		double f = secular(d, z, k, rho, o, x, &derivative);
+		if (f == 0.0) { break; }
+		if (f < 0.0) { lo = x; }
+		else { hi = x; }
+		if (hi - lo <= 4.0 * DBL_EPSILON * fmax(fabs(lo), fabs(hi)) + DBL_MIN) { break; }
+
+		double next = x - f / derivative;
+		x = (next > lo && next < hi) ? next : 0.5 * (lo + hi);
+	}
+	*origin = o;
+	*offset = x;
+}
+
+// merges the solved halves [s, s + n1) and [s + n1, s + len) of T, torn apart at e[s + n1 - 1].
+// Each half's eigenvalues are in d (ascending), and its eigenvectors in its diagonal block of Q
+typedef struct {
+	const dc_work* W;
+	int len;
+	int k;						// updated eigenvalues
+	int deflated;
+}dc_product;
+
+// rows begin to end - 1 of the new eigenvectors
+static void dc_product_rows(void* context, int begin, int end) {
+	dc_product* product = context;
+	const dc_work* W = product->W;
+	int len = product->len, k = product->k;
+	for (int r = begin; r < end; r++) {
+		const float* qs_row = &W->Qs[r * len];
+		float* qn_row = &W->Qn[r * len];
+		for (int j = 0; j < k; j++) { qn_row[j] = 0.0f; }
+		for (int i = 0; i < k; i++) {
+			float x = qs_row[W->kept[i]];
+			if (x == 0.0f) { continue; }
+			const float* u_row = &W->U[i * k];
+			for (int j = 0; j < k; j++) { qn_row[j] += x * u_row[j]; }
+		}
+		for (int i = 0; i < product->deflated; i++) { qn_row[k + i] = qs_row[W->deflated[i]]; }
+	}
+}
+
+static void dc_merge(float* d, float e_split, float* Q, int s, int n1, int len, dc_work* W) {
+	int n = W->n;
+	float* q = &Q[s * n + s];
+	float sign = (e_split < 0.0f) ? -1.0f : 1.0f;
+	float rho = fabsf(e_split);
+
+	// T = diag(Q1, Q2) (diag(D1, D2) + rho z z^t) diag(Q1, Q2)^t, with z = (last row of Q1, sign * first row of Q2)
+	// sort the poles, bringing z and the columns of Q along
+	int* index = W->index;
+	int a = 0, b = n1;
+	for (int i = 0; i < len; i++) {
+		if (b >= len || (a < n1 && d[s + a] <= d[s + b])) { index[i] = a++; }
+		else { index[i] = b++; }
+	}
+	float norm = 0.0f;
+	for (int i = 0; i < len; i++) {
+		int c = index[i];
+		W->ds[i] = d[s + c];
+		W->zs[i] = (c < n1) ? q[(n1 - 1) * n + c] : sign * q[n1 * n + c];
+		norm += W->zs[i] * W->zs[i];
+		for (int r = 0; r < len; r++) { W->Qs[r * len + i] = q[r * n + c]; }
+	}
+	norm = sqrtf(norm);
+	rho *= norm * norm;
+	for (int i = 0; i < len; i++) { W->zs[i] /= norm; }
+
+	// deflation: tiny weights leave their eigenpair unchanged, and a close pair of poles can be rotated so one of them
+	// has a zero weight
+	float largest = 0.0f;
+	for (int i = 0; i < len; i++) { largest = fmaxf(largest, fabsf(W->ds[i])); }
+	float tol = 8.0f * FLT_EPSILON * fmaxf(largest, rho);
+	int k = 0, deflated = 0;
+	int last = -1;				// last non deflated pole, still waiting to see if the next one deflates it
+	for (int i = 0; i < len; i++) {
+		if (rho * fabsf(W->zs[i]) <= tol) {
+			W->deflated[deflated++] = i;
+			continue;
+		}
+		if (last != -1) {
+			float r = hypotf(W->zs[last], W->zs[i]);
+			float c = W->zs[i] / r;
+			float s_ = -W->zs[last] / r;
+			if (fabsf(c * s_ * (W->ds[i] - W->ds[last])) <= tol) {
+				W->zs[i] = r;
+				W->zs[last] = 0.0f;
+				for (int row = 0; row < len; row++) {
+					float x = W->Qs[row * len + last], y = W->Qs[row * len + i];
+					W->Qs[row * len + last] = c * x + s_ * y;
+					W->Qs[row * len + i] = c * y - s_ * x;
+				}
+				float d_last = W->ds[last] * c * c + W->ds[i] * s_ * s_;
+				W->ds[i] = W->ds[last] * s_ * s_ + W->ds[i] * c * c;
+				W->ds[last] = d_last;
+				W->deflated[deflated++] = last;
+				last = i;
+				continue;
+			}
+			W->kept[k++] = last;
+		}
+		last = i;
+	}
+	if (last != -1) { W->kept[k++] = last; }
+
+	// poles and weights of the reduced problem, which need to be strictly ascending
+	float* dk = W->values + len;			// second half of values is free until the end
+	for (int i = 1; i < k; i++) {
+		int key = W->kept[i];
+		int j = i - 1;
+		while (j >= 0 && W->ds[W->kept[j]] > W->ds[key]) {
+			W->kept[j + 1] = W->kept[j];
+			j--;
+		}
+		W->kept[j + 1] = key;
+	}
+	float* zk = W->zs + len;				// zs has room for 2 * len
+	for (int i = 0; i < k; i++) {
+		dk[i] = W->ds[W->kept[i]];
+		zk[i] = W->zs[W->kept[i]];
+	}
+
+	// secular roots, then the weights that make them exact eigenvalues (Gu and Eisenstat), so the eigenvectors come out
+	// orthogonal no matter how close the roots are
+	for (int j = 0; j < k; j++) { secular_root(dk, zk, k, rho, j, &W->origin[j], &W->offset[j]); }
+	for (int i = 0; i < k; i++) {
+		// (lambda_j - d_i) for the root j, measured from its pole
+		#define ROOT_MINUS_POLE(j, i) (((double)dk[W->origin[j]] - dk[i]) + W->offset[j])
+		double product = ROOT_MINUS_POLE(k - 1, i) / rho;
+		for (int j = 0; j < i; j++) { product *= ROOT_MINUS_POLE(j, i) / ((double)dk[j] - dk[i]); }
+		for (int j = i; j < k - 1; j++) { product *= ROOT_MINUS_POLE(j, i) / ((double)dk[j + 1] - dk[i]); }
+		W->zhat[i] = copysign(sqrt(fabs(product)), (double)zk[i]);
+	}
+	for (int j = 0; j < k; j++) {
+		double sum = 0.0;
+		for (int i = 0; i < k; i++) {
+			double u = W->zhat[i] / -ROOT_MINUS_POLE(j, i);
+			W->U[i * k + j] = (float)u;
+			sum += u * u;
+		}
+		float inverse = (float)(1.0 / sqrt(sum));
+		for (int i = 0; i < k; i++) { W->U[i * k + j] *= inverse; }
+		W->values[j] = (float)((double)dk[W->origin[j]] + W->offset[j]);
+		#undef ROOT_MINUS_POLE
+	}
+
+	// new eigenvectors: Qs[:, kept] U for the updated ones, columns of Qs for the deflated ones. Split by rows across threads
+	dc_product product = { W, len, k, deflated };
+	parallel_for(len, PARALLEL_MIN_WORK / (k * k + 1) + 1, dc_product_rows, &product);
+	for (int i = 0; i < deflated; i++) { W->values[k + i] = W->ds[W->deflated[i]]; }
+
+	// back into d and the block of Q, in ascending order
+	for (int i = 0; i < len; i++) { index[i] = i; }
+	for (int i = 1; i < len; i++) {
+		int key = index[i];
+		int j = i - 1;
+		while (j >= 0 && W->values[index[j]] > W->values[key]) {
+			index[j + 1] = index[j];
+			j--;
+		}
+		index[j + 1] = key;
+	}
+	for (int i = 0; i < len; i++) { d[s + i] = W->values[index[i]]; }
+	for (int r = 0; r < len; r++) {
+		float* q_row = &q[r * n];
+		const float* qn_row = &W->Qn[r * len];
+		for (int i = 0; i < len; i++) { q_row[i] = qn_row[index[i]]; }
+	}
+}
+
+// solves the len x len block of T at s. Q must be identity on that block. returns 0 on failure
+static int dc_solve(float* d, const float* e, float* Q, int s, int len, dc_work* W) {
+	if (len <= EIGEN_DC_MIN_SIZE) { return tridiagonal_ql(d, e, Q, W->n, s, len, W->e); }
+
+	// tear T into two halves with a rank one update: T = diag(T1, T2) + |e| v v^t
+	int n1 = len / 2;
+	float split = e[s + n1 - 1];
+	d[s + n1 - 1] -= fabsf(split);
+	d[s + n1] -= fabsf(split);
+	if (!dc_solve(d, e, Q, s, n1, W)) { return 0; }
+	if (!dc_solve(d, e, Q, s + n1, len - n1, W)) { return 0; }
+	dc_merge(d, split, Q, s, n1, len, W);
+	return 1;
+}
+
+
+// Bisection and inverse iteration
+
+// number of eigenvalues of T less than x (sturm count)
+static int sturm_count(const float* d, const float* e, int n, double x) {
+	int count = 0;
+	double q = 1.0;
+	for (int i = 0; i < n; i++) {
+		double off = (i > 0) ? (double)e[i - 1] * e[i - 1] : 0.0;
+		q = ((double)d[i] - x) - ((i > 0) ? off / q : 0.0);
+		if (q == 0.0) { q = -DBL_EPSILON * (fabs(d[i]) + fabs(x) + DBL_MIN); }
+		if (q < 0.0) { count++; }
+	}
+	return count;
+}
+
+// the i-th smallest eigenvalue of T, by bisection inside the gershgorin bounds
+static float bisect_eigenvalue(const float* d, const float* e, int n, int i, double lower, double upper) {
+	while (upper - lower > 2.0 * DBL_EPSILON * fmax(fabs(lower), fabs(upper)) + DBL_MIN) {
+		double middle = 0.5 * (lower + upper);
+		if (middle == lower || middle == upper) { break; }
+		if (sturm_count(d, e, n, middle) > i) { upper = middle; }
+		else { lower = middle; }
+	}
+	return (float)(0.5 * (lower + upper));
+}
+
+// eigenvector of T for the eigenvalue lambda by inverse iteration. LU with partial pivoting of T - lambda I
+// (it's tridiagonal, so U has two superdiagonals), then a few solves. Vectors for nearby eigenvalues (earlier columns of
+// Z from first to column - 1) are projected out each time, so a cluster comes out orthogonal.
+// scratch needs 7n floats and n ints
+static void inverse_iteration(const float* d, const float* e, int n, float lambda, float norm,
+	float* Z, int count, int column, int first, float* scratch, int* pivot) {
+	float* dl = scratch;
+	float* dd = dl + n;
+	float* du = dd + n;
+	float* du2 = du + n;
+	float* x = du2 + n;
+
+	for (int i = 0; i < n; i++) {
+		dd[i] = d[i] - lambda;
+		if (i < n - 1) { dl[i] = du[i] = e[i]; }
+		du2[i] = 0.0f;
+	}
+	float tiny = FLT_EPSILON * norm;
+	if (tiny == 0.0f) { tiny = FLT_MIN; }
+	for (int i = 0; i < n - 1; i++) {
+		if (fabsf(dd[i]) >= fabsf(dl[i])) {
+			pivot[i] = i;
+			if (dd[i] == 0.0f) { dd[i] = tiny; }
+			float factor = dl[i] / dd[i];
+			dl[i] = factor;
+			dd[i + 1] -= factor * du[i];
+		}
+		else {
+			pivot[i] = i + 1;
+			float factor = dd[i] / dl[i];
+			dd[i] = dl[i];
+			dl[i] = factor;
+			float temp = du[i];
+			du[i] = dd[i + 1];
+			dd[i + 1] = temp - factor * dd[i + 1];
+			if (i < n - 2) {
+				du2[i] = du[i + 1];
+				du[i + 1] = -factor * du[i + 1];
+			}
+		}
+	}
+	if (dd[n - 1] == 0.0f) { dd[n - 1] = tiny; }
+
+	// a start vector with no special structure
+	for (int i = 0; i < n; i++) { x[i] = 1.0f + 0.1f * (float)((i * 7919 + column * 104729) % 17) / 17.0f; }
+
+	for (int iteration = 0; iteration < 4; iteration++) {
+		for (int i = 0; i < n - 1; i++) {
+			if (pivot[i] == i) { x[i + 1] -= dl[i] * x[i]; }
+			else {
+				float temp = x[i];
+				x[i] = x[i + 1];
+				x[i + 1] = temp - dl[i] * x[i];
+			}
+		}
+		x[n - 1] /= dd[n - 1];
+		if (n > 1) { x[n - 2] = (x[n - 2] - du[n - 2] * x[n - 1]) / dd[n - 2]; }
+		for (int i = n - 3; i >= 0; i--) { x[i] = (x[i] - du[i] * x[i + 1] - du2[i] * x[i + 2]) / dd[i]; }
+
+		for (int c = first; c < column; c++) {
+			double dot = 0.0;
+			for (int i = 0; i < n; i++) { dot += (double)x[i] * Z[i * count + c]; }
+			for (int i = 0; i < n; i++) { x[i] -= (float)dot * Z[i * count + c]; }
+		}
+		double sum = 0.0;
+		for (int i = 0; i < n; i++) { sum += (double)x[i] * x[i]; }
+		float inverse = (sum > 0.0) ? (float)(1.0 / sqrt(sum)) : 1.0f;
+		for (int i = 0; i < n; i++) { x[i] *= inverse; }
+	}
+	for (int i = 0; i < n; i++) { Z[i * count + column] = x[i]; }
+}
+
+
+// Eigensolver
+
+// finds eigenvalues first to last (0 indexed, ascending; last = -1 means n - 1) of the symmetric matrix A, and their
+// eigenvectors if want_vectors is set. Only the lower triangle of A is read.
+// upon failure, returns a result with count 0 and NULL values
+//
+// fsymeig E = fmatrix_symmetric_eigen(A, 1, 0, -1, &frame);
+// for (int i = 0; i < E.count; i++) { printf("%f\n", E.values[i]); }
+fsymeig fmatrix_symmetric_eigen(fmatrix A, int want_vectors, int first, int last, pool* frame) {
+	fsymeig result = { A.m, 0, NULL, ERROR_FMATRIX };
+	int n = A.m;
+	if (A.m != A.n || n < 1) {
+		printf("symmetric eigensolver requires a square matrix (%d x %d)\n", A.m, A.n);
+		return result;
+	}
+	if (last < 0) { last = n - 1; }
+	if (first < 0 || first > last || last >= n) {
+		printf("symmetric eigensolver error: index range %d to %d is outside 0 to %d\n", first, last, n - 1);
+		return result;
+	}
+	int count = last - first + 1;
+	int full = want_vectors && count == n;
+
+	void* start = frame->ptr;
+	float* values = raw_pool_alloc(frame, count * sizeof(float));
+	fmatrix vectors = want_vectors ? fmatrix_create_zero(n, count, frame) : ERROR_FMATRIX;
+	void* workspace = frame->ptr;
+
+	// row major copy with both triangles filled in from the lower one
+	float* a = raw_pool_alloc(frame, n * n * sizeof(float));
+	float* d = raw_pool_alloc(frame, n * sizeof(float));
+	float* e = raw_pool_alloc(frame, n * sizeof(float));
+	float* tau = raw_pool_alloc(frame, n * sizeof(float));
+	float* scratch = raw_pool_alloc(frame, 7 * n * sizeof(float));
+	int* pivot = raw_pool_alloc(frame, n * sizeof(int));
+	if (values == NULL || (want_vectors && vectors.matrix == NULL) || a == NULL || d == NULL || e == NULL || tau == NULL ||
+		scratch == NULL || pivot == NULL) {
+		printf("symmetric eigensolver error: pool allocation failure\n");
+		pool_free_from(frame, start);
+		return result;
+	}
+	for (int i = 0; i < n; i++) {
+		for (int j = 0; j <= i; j++) { a[i * n + j] = a[j * n + i] = fmatrix_at(A, i, j); }
+	}
+	e[n - 1] = 0.0f;
+
+	tridiagonalize(a, n, d, e, tau, scratch, scratch + n);
+
+	if (full) {
+		// divide and conquer needs Q (n x n, starting as identity) plus its merge workspace
+		dc_work W;
+		W.n = n;
+		W.Qs = raw_pool_alloc(frame, n * n * sizeof(float));
+		W.Qn = raw_pool_alloc(frame, n * n * sizeof(float));
+		W.U = raw_pool_alloc(frame, n * n * sizeof(float));
+		W.ds = raw_pool_alloc(frame, n * sizeof(float));
+		W.zs = raw_pool_alloc(frame, 2 * n * sizeof(float));
+		W.values = raw_pool_alloc(frame, 2 * n * sizeof(float));
+		W.index = raw_pool_alloc(frame, n * sizeof(int));
+		W.kept = raw_pool_alloc(frame, n * sizeof(int));
+		W.deflated = raw_pool_alloc(frame, n * sizeof(int));
+		W.origin = raw_pool_alloc(frame, n * sizeof(int));
+		W.offset = raw_pool_alloc(frame, n * sizeof(double));
+		W.zhat = raw_pool_alloc(frame, n * sizeof(double));
+		W.e = raw_pool_alloc(frame, n * sizeof(float));
+		if (W.Qs == NULL || W.Qn == NULL || W.U == NULL || W.ds == NULL || W.zs == NULL || W.values == NULL || W.index == NULL ||
+			W.kept == NULL || W.deflated == NULL || W.origin == NULL || W.offset == NULL || W.zhat == NULL || W.e == NULL) {
+			printf("symmetric eigensolver error: pool allocation failure\n");
+			pool_free_from(frame, values);
+			return result;
+		}
+
+		float* Q = vectors.matrix;
+		for (int i = 0; i < n; i++) { Q[i * n + i] = 1.0f; }
+		if (!dc_solve(d, e, Q, 0, n, &W)) {
+			printf("symmetric eigensolver error: QL iteration did not converge\n");
+			pool_free_from(frame, values);
+			return result;
+		}
+		memcpy(values, d, n * sizeof(float));
+	}
+	else {
+		// gershgorin bounds for bisection, widened a little so the ends are strictly outside the spectrum
+		double lower = d[0], upper = d[0];
+		float norm = 0.0f;
+		for (int i = 0; i < n; i++) {
+			double radius = ((i > 0) ? fabs(e[i - 1]) : 0.0) + ((i < n - 1) ? fabs(e[i]) : 0.0);
+			lower = fmin(lower, d[i] - radius);
+			upper = fmax(upper, d[i] + radius);
+			norm = fmaxf(norm, fabsf(d[i]) + (float)radius);
+		}
+		double margin = 2.0 * DBL_EPSILON * fmax(fabs(lower), fabs(upper)) * n + DBL_MIN;
+		lower -= margin;
+		upper += margin;
+
+		for (int i = 0; i < count; i++) { values[i] = bisect_eigenvalue(d, e, n, first + i, lower, upper); }
+
+		if (want_vectors) {
+			// eigenvalues closer than this are treated as a cluster, and their vectors are orthogonalized against each other
+			float gap = 1e-3f * norm;
+			float separation = 10.0f * FLT_EPSILON * norm;
+			float previous = 0.0f;
+			int cluster = 0;
+			for (int i = 0; i < count; i++) {
+				float lambda = values[i];
+				if (i > 0 && values[i] - values[i - 1] > gap) { cluster = i; }
+				// nudge repeated eigenvalues apart, or every vector in the cluster would come from the same solve
+				if (i > cluster && lambda - previous < separation) { lambda = previous + separation; }
+				previous = lambda;
+				inverse_iteration(d, e, n, lambda, norm, vectors.matrix, count, i, cluster, scratch, pivot);
+			}
+		}
+	}
+
+	if (want_vectors) { apply_tridiagonal_reflectors(a, n, tau, vectors.matrix, count, scratch); }
+
+	pool_free_from(frame, workspace);
+	return (fsymeig) { n, count, values, vectors };
+}
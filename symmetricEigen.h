@@ -0,0 +1,37 @@
+#ifndef SYMMETRICEIGEN_H
+#define SYMMETRICEIGEN_H
+
+#include "memoryPool.h"
+#include "matrix.h"
+
+// Symmetric eigensolver, A = V diag(values) V^t
+// Only the lower triangle of A is read, through fmatrix_at, so a packed FMATRIX_SYMMETRIC A works as is. It works in two stages:
+//   1) householder reduction of A to a tridiagonal T = H^t A H
+//   2) eigenvalues (and vectors) of T, picked by what was asked for:
+//        - all eigenvectors: divide and conquer. T is split in half by a rank one tear, both halves are solved recursively, and
+//          they're glued back together by solving the secular equation of the rank one update. Eigenvalues that barely move
+//          (small weights, or close pairs) are deflated, so they skip the secular solve and the vector update entirely.
+//          Blocks of at most EIGEN_DC_MIN_SIZE are solved directly with implicit QL.
+//        - only eigenvalues, or only an index range: bisection with sturm counts finds just the requested eigenvalues, and
+//          inverse iteration finds their eigenvectors, if wanted
+//   3) the eigenvectors of T are turned into eigenvectors of A by applying H
+// Workspace comes from the pool once, and is freed before returning. Only the values and vectors stay on it.
+// The reduction in 1), the eigenvector products of the merges in 2) and the back transformation in 3) are split across threads
+// (see parallel.h), with the same results for any number of threads.
+//
+// fsymeig E = fmatrix_symmetric_eigen(A, 1, 0, -1, &frame);	// everything
+// fsymeig top = fmatrix_symmetric_eigen(A, 1, n - 3, n - 1, &frame);	// the 3 largest eigenpairs
+// fsymeig values = fmatrix_symmetric_eigen(A, 0, 0, -1, &frame);	// eigenvalues only
+
+#define EIGEN_DC_MIN_SIZE 25
+
+typedef struct {
+	int n;						// size of A
+	int count;					// number of eigenpairs found
+	float* values;				// ascending
+	fmatrix vectors;			// n x count, column i goes with values[i]. ERROR_FMATRIX if vectors weren't asked for
+}fsymeig;
+
+fsymeig fmatrix_symmetric_eigen(fmatrix A, int want_vectors, int first, int last, pool* frame);
+
+#endif
@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#define TRACE_CAS_PTR(dest, expected, desired) \
+	(_InterlockedCompareExchangePointer((void* volatile*)(dest), (desired), (expected)) == (expected))
+#define TRACE_NEXT_THREAD_ID() _InterlockedIncrement(&next_thread_id)
+#else
+#define TRACE_THREAD_LOCAL _Thread_local
+#define TRACE_CAS_PTR(dest, expected, desired) __sync_bool_compare_and_swap((dest), (expected), (desired))
+#define TRACE_NEXT_THREAD_ID() __sync_add_and_fetch(&next_thread_id, 1)
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TRACE_HAS_TSC 1
+#elif defined(_M_X64) || defined(_M_IX86)
+#define TRACE_HAS_TSC 1
+#else
+#define TRACE_HAS_TSC 0
+#endif
+
+// one ring buffer per thread. Buffers are pushed onto a global list the first time their thread
+// records an event, and stay on it until trace_shutdown.
+typedef struct trace_buffer {
+	trace_event events[TRACE_RING_SIZE];
+	volatile uint64_t head;				// total events ever written. events[head % TRACE_RING_SIZE] is next
+	long thread_id;
+	struct trace_buffer* next;
+}trace_buffer;
+
+int trace_enabled = 0;
+
+static trace_buffer* volatile buffers = NULL;
+static volatile long next_thread_id = 0;
+
+static TRACE_THREAD_LOCAL trace_buffer* thread_buffer = NULL;
+static TRACE_THREAD_LOCAL int64_t thread_bytes = 0;		// pool bytes allocated by this thread while tracing
+static TRACE_THREAD_LOCAL int thread_depth = 0;
+
+// timestamps are taken when tracing is turned on and when the trace is exported, so ticks can be
+// converted to microseconds without assuming a tsc frequency
+static uint64_t base_ticks = 0;
+static uint64_t base_ns = 0;
+
+static uint64_t wall_ns(void) {
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t read_ticks(void) {
+#if TRACE_HAS_TSC
+	return __rdtsc();
+#else
+	return wall_ns();
+#endif
+}
+
+// returns the calling thread's buffer, creating and registering it on first use. Returns NULL if
+// the buffer couldn't be allocated, in which case the event is dropped.
+static trace_buffer* get_thread_buffer(void) {
+	if (thread_buffer != NULL) { return thread_buffer; }
+
+	trace_buffer* buffer = malloc(sizeof(trace_buffer));
+	if (buffer == NULL) {
+		printf("failed to allocate a trace buffer, dropping events for this thread\n");
+		return NULL;
+	}
+	buffer->head = 0;
+	buffer->thread_id = TRACE_NEXT_THREAD_ID();
+
+	// lock free push onto the buffer list
+	trace_buffer* old_head;
+	do {
+		old_head = buffers;
+		buffer->next = old_head;
+	} while (!TRACE_CAS_PTR(&buffers, old_head, buffer));
+
+	thread_buffer = buffer;
+	return buffer;
+}
+
+// turns tracing on or off for every thread.
+void trace_set_enabled(int enabled) {
+	if (enabled && !trace_enabled) {
+		base_ticks = read_ticks();
+		base_ns = wall_ns();
+	}
+	trace_enabled = enabled;
+}
+
+// forgets every recorded event. Only call this while no thread is tracing
+void trace_reset(void) {
+	for (trace_buffer* b = buffers; b != NULL; b = b->next) {
+		b->head = 0;
+	}
+}
+
+// frees every buffer. Only call this once no other thread will record again, since their
+// thread local buffer pointers would dangle. The calling thread's pointer is cleared.
+void trace_shutdown(void) {
+	trace_enabled = 0;
+	trace_buffer* b = buffers;
+	buffers = NULL;
+	while (b != NULL) {
+		trace_buffer* next = b->next;
+		free(b);
+		b = next;
+	}
+	thread_buffer = NULL;
+}
+
+// called by TRACE_BEGIN once it has checked trace_enabled
+void trace_scope_start(trace_scope* scope, matrix_op op, int m, int n, int k, int transpose, int64_t bytes) {
+	scope->event.op = (uint16_t)op;
+	scope->event.m = m;
+	scope->event.n = n;
+	scope->event.k = k;
+	scope->event.transpose = (uint8_t)transpose;
+	scope->event.depth = (uint8_t)(thread_depth < 255 ? thread_depth : 255);
+	thread_depth++;
+
+	// allocations count toward every op that is running on this thread, frees are only recorded
+	scope->event.bytes = bytes;
+	if (bytes > 0) { thread_bytes += bytes; }
+	scope->bytes_start = thread_bytes;
+
+	scope->event.start = read_ticks();
+}
+
+// called by TRACE_END. Writes the finished event into the thread's ring buffer
+void trace_scope_stop(trace_scope* scope) {
+	scope->event.end = read_ticks();
+	thread_depth--;
+
+	if (scope->event.bytes == 0) { scope->event.bytes = thread_bytes - scope->bytes_start; }
+
+	trace_buffer* buffer = get_thread_buffer();
+	if (buffer == NULL) { return; }
+
+	uint64_t head = buffer->head;
+	buffer->events[head & (TRACE_RING_SIZE - 1)] = scope->event;
+	buffer->head = head + 1;
+}
+
+// returns the number of events currently held in all buffers
+int trace_event_count(void) {
+	int count = 0;
+	for (trace_buffer* b = buffers; b != NULL; b = b->next) {
+		count += (int)(b->head < TRACE_RING_SIZE ? b->head : TRACE_RING_SIZE);
+	}
+	return count;
+}
+
+// writes every recorded event to path in the chrome trace event format. Each traced call becomes a
+// complete ("X") event on its thread's track, with the dimensions, transpose flags and bytes as args.
+// Only call this while no thread is tracing.
+// returns 0 on success, -1 if the file couldn't be written
+int trace_export_chrome(const char* path) {
+	FILE* out = fopen(path, "w");
+	if (out == NULL) {
+		printf("trace export failed: couldn't open %s\n", path);
+		return -1;
+	}
+
+	// microseconds per tick, measured over the time since tracing was turned on
+	double us_per_tick = 0.001;
+	uint64_t ticks = read_ticks() - base_ticks;
+	if (TRACE_HAS_TSC && ticks != 0) { us_per_tick = (double)(wall_ns() - base_ns) / 1000.0 / (double)ticks; }
+
+	fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	int first = 1;
+	for (trace_buffer* b = buffers; b != NULL; b = b->next) {
+		fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%ld,\"args\":{\"name\":\"thread %ld\"}}",
+			first ? "" : ",\n", b->thread_id, b->thread_id);
+		first = 0;
+
+		uint64_t count = b->head < TRACE_RING_SIZE ? b->head : TRACE_RING_SIZE;
+		for (uint64_t i = b->head - count; i < b->head; i++) {
+			trace_event e = b->events[i & (TRACE_RING_SIZE - 1)];
+			matrix_op op = (matrix_op)e.op;
+
+			fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%ld,\"ts\":%.3f,\"dur\":%.3f,"
+				"\"args\":{\"m\":%d,\"n\":%d,\"k\":%d,\"transpose\":%d,\"bytes\":%lld,\"depth\":%d}}",
+				matrix_op_name(op), op >= MATRIX_OP_CREATE_POOL ? "pool" : "matrix", b->thread_id,
+				(double)(int64_t)(e.start - base_ticks) * us_per_tick, (double)(e.end - e.start) * us_per_tick,
+				e.m, e.n, e.k, e.transpose, (long long)e.bytes, e.depth);
+		}
+	}
+	fprintf(out, "\n]}\n");
+
+	fclose(out);
+	return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Operation tracing
+// Every public entry point in matrix.c and memoryPool.c records an event (op, dimensions, transpose
+// flags, bytes allocated, start/end timestamps) into a ring buffer owned by the calling thread. Each
+// thread writes only to its own buffer, so recording needs no locks. trace_export_chrome writes every
+// buffer out as a Chrome trace (load it in chrome://tracing or ui.perfetto.dev).
+//
+// Tracing starts off. While it is off, each hook costs one well predicted branch on trace_enabled.
+// Define MATRIX_NO_TRACE to compile the hooks out completely.
+//
+// trace_set_enabled(1);
+// ... fmatrix work ...
+// trace_set_enabled(0);
+// trace_export_chrome("trace.json");
+
+#include <stdint.h>
+
+#include "matrixOps.h"
+
+// events per thread. Must be a power of 2. Once a buffer is full, the oldest events get overwritten
+#define TRACE_RING_SIZE 8192
+
+typedef struct {
+	uint64_t start, end;		// timestamps in ticks (rdtsc where available)
+	int64_t bytes;				// pool bytes allocated during the op (negative for frees)
+	int m, n, k;				// matA is m x n, matB has k columns (0 for unary ops)
+	uint16_t op;				// matrix_op
+	uint8_t transpose;			// bit 0: matA is a transpose, bit 1: matB is a transpose
+	uint8_t depth;				// nesting depth, 0 for calls made directly by the user
+}trace_event;
+
+// state for one traced call, lives on the caller's stack between begin and end
+typedef struct {
+	int active;
+	trace_event event;
+	int64_t bytes_start;
+}trace_scope;
+
+extern int trace_enabled;
+
+void trace_set_enabled(int enabled);
+void trace_reset(void);
+void trace_shutdown(void);
+
+void trace_scope_start(trace_scope* scope, matrix_op op, int m, int n, int k, int transpose, int64_t bytes);
+void trace_scope_stop(trace_scope* scope);
+
+int trace_event_count(void);
+int trace_export_chrome(const char* path);
+
+#ifndef MATRIX_NO_TRACE
+// bytes is the size of the allocation for pool allocation ops, and 0 for everything else (those record
+// how much was allocated from pools while they ran)
+#define TRACE_BEGIN(op, m, n, k, transpose, bytes) \
+	trace_scope trace_scope_local = { trace_enabled }; \
+	if (trace_scope_local.active) { trace_scope_start(&trace_scope_local, (op), (m), (n), (k), (transpose), (bytes)); }
+#define TRACE_END() if (trace_scope_local.active) { trace_scope_stop(&trace_scope_local); }
+#else
+#define TRACE_BEGIN(op, m, n, k, transpose, bytes)
+#define TRACE_END()
+#endif
+
+#endif